@@ -0,0 +1,239 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPBandwidthLimiter.h"
+#include "HTTPRequestScheduler.h"
+#include "HAL/PlatformProcess.h"
+
+static_assert((int32)EHttpRequestPriority::Max == 3, "NumPriorities must match EHttpRequestPriority");
+
+void FHttpTransferCounter::SetPace(double PaceSeconds, float MaxWaitSeconds)
+{
+	const bool bPaced = PaceSeconds > 0 && MaxWaitSeconds > 0;
+	PaceUntilCycles.Set(bPaced ? (int64)FPlatformTime::Cycles64() + (int64)(PaceSeconds / FPlatformTime::GetSecondsPerCycle64()) : 0);
+	MaxWaitMicroseconds.Set(bPaced ? (int64)(MaxWaitSeconds * 1000000.0) : 0);
+}
+
+void FHttpTransferCounter::Pace() const
+{
+	const int64 PaceUntil = PaceUntilCycles.GetValue();
+	if (PaceUntil <= 0)
+	{
+		return;
+	}
+	const double WaitSeconds = FMath::Min((PaceUntil - (int64)FPlatformTime::Cycles64()) * FPlatformTime::GetSecondsPerCycle64(), MaxWaitMicroseconds.GetValue() / 1000000.0);
+	if (WaitSeconds > 0)
+	{
+		FPlatformProcess::Sleep((float)WaitSeconds);
+	}
+}
+
+void FHttpBandwidthLimiter::FTokenBucket::Refill(int64 BytesPerSecond, float BurstSeconds, double DeltaSeconds)
+{
+	if (BytesPerSecond <= 0)
+	{
+		//不限制时清除透支，之后重新开启限制从满的桶开始
+		*this = FTokenBucket();
+		return;
+	}
+	const double Capacity = (double)BytesPerSecond * FMath::Max(0.01f, BurstSeconds);
+	if (!bInitialized)
+	{
+		bInitialized = true;
+		Tokens = Capacity;
+		return;
+	}
+	double Added = DeltaSeconds * BytesPerSecond;
+	//先还优先级高的透支
+	for (double& PriorityDebt : Debt)
+	{
+		const double Repaid = FMath::Min(PriorityDebt, Added);
+		PriorityDebt -= Repaid;
+		Added -= Repaid;
+	}
+	Tokens = FMath::Min(Capacity, Tokens + Added);
+}
+
+void FHttpBandwidthLimiter::FTokenBucket::Consume(int64 Bytes, EHttpRequestPriority Priority)
+{
+	const double Taken = FMath::Min((double)Bytes, FMath::Max(0.0, Tokens));
+	Tokens -= Taken;
+	Debt[FMath::Clamp((int32)Priority, 0, NumPriorities - 1)] += Bytes - Taken;
+}
+
+double FHttpBandwidthLimiter::FTokenBucket::GetDebt(EHttpRequestPriority Priority) const
+{
+	double Total = 0;
+	for (int32 Index = 0; Index <= FMath::Clamp((int32)Priority, 0, NumPriorities - 1); Index++)
+	{
+		Total += Debt[Index];
+	}
+	return Total;
+}
+
+void FHttpBandwidthLimiter::FBucketPair::Refill(const FHttpBandwidthLimit& Limit, double DeltaSeconds)
+{
+	Upload.Refill(Limit.UploadBytesPerSecond, Limit.BurstSeconds, DeltaSeconds);
+	Download.Refill(Limit.DownloadBytesPerSecond, Limit.BurstSeconds, DeltaSeconds);
+}
+
+bool FHttpBandwidthLimiter::FBucketPair::CanDispatch(const FHttpBandwidthLimit& Limit, EHttpRequestPriority Priority, bool bHasContent) const
+{
+	if (Limit.DownloadBytesPerSecond > 0 && Download.GetDebt(Priority) > 0)
+	{
+		return false;
+	}
+	return !bHasContent || Limit.UploadBytesPerSecond <= 0 || Upload.GetDebt(Priority) <= 0;
+}
+
+void FHttpBandwidthLimiter::FBucketPair::Consume(const FHttpBandwidthLimit& Limit, EHttpRequestPriority Priority, int64 BytesSent, int64 BytesReceived)
+{
+	if (Limit.UploadBytesPerSecond > 0)
+	{
+		Upload.Consume(BytesSent, Priority);
+	}
+	if (Limit.DownloadBytesPerSecond > 0)
+	{
+		Download.Consume(BytesReceived, Priority);
+	}
+}
+
+double FHttpBandwidthLimiter::FBucketPair::GetPaceSeconds(const FHttpBandwidthLimit& Limit, EHttpRequestPriority Priority, bool bUpload) const
+{
+	const int64 BytesPerSecond = bUpload ? Limit.UploadBytesPerSecond : Limit.DownloadBytesPerSecond;
+	if (BytesPerSecond <= 0)
+	{
+		return 0;
+	}
+	//补充的令牌先还更高优先级的透支，所以要等这些透支一起还清
+	return (bUpload ? Upload : Download).GetDebt(Priority) / BytesPerSecond;
+}
+
+const FHttpBandwidthLimit* FHttpBandwidthLimiter::GetClassLimit(const FHttpBandwidthSettings& Settings, EHttpRequestPriority Priority)
+{
+	switch (Priority)
+	{
+	case EHttpRequestPriority::Normal:
+		return &Settings.Normal;
+	case EHttpRequestPriority::Background:
+		return &Settings.Background;
+	default:
+		return nullptr;
+	}
+}
+
+FHttpBandwidthLimiter::FBucketPair* FHttpBandwidthLimiter::GetClassBuckets(EHttpRequestPriority Priority)
+{
+	switch (Priority)
+	{
+	case EHttpRequestPriority::Normal:
+		return &NormalBuckets;
+	case EHttpRequestPriority::Background:
+		return &BackgroundBuckets;
+	default:
+		return nullptr;
+	}
+}
+
+void FHttpBandwidthLimiter::Refill(const FHttpBandwidthSettings& Settings, double Now)
+{
+	const double DeltaSeconds = LastRefillTime > 0 ? FMath::Max(0.0, Now - LastRefillTime) : 0.0;
+	LastRefillTime = Now;
+	GlobalBuckets.Refill(Settings.Global, DeltaSeconds);
+	NormalBuckets.Refill(Settings.Normal, DeltaSeconds);
+	BackgroundBuckets.Refill(Settings.Background, DeltaSeconds);
+	for (auto It = HostBuckets.CreateIterator(); It; ++It)
+	{
+		const FHttpBandwidthLimit* Limit = Settings.HostLimits.Find(It.Key());
+		if (!Limit)
+		{
+			//限制被移除
+			It.RemoveCurrent();
+			continue;
+		}
+		It.Value().Refill(*Limit, DeltaSeconds);
+	}
+	for (const TPair<FString, FHttpBandwidthLimit>& Pair : Settings.HostLimits)
+	{
+		if (!HostBuckets.Contains(Pair.Key))
+		{
+			HostBuckets.Add(Pair.Key).Refill(Pair.Value, 0.0);
+		}
+	}
+}
+
+bool FHttpBandwidthLimiter::CanDispatch(const FHttpBandwidthSettings& Settings, const FString& Host, EHttpRequestPriority Priority, bool bHasContent) const
+{
+	if (!Settings.bEnabled || (Priority == EHttpRequestPriority::Critical && !Settings.bLimitCritical))
+	{
+		return true;
+	}
+	if (!GlobalBuckets.CanDispatch(Settings.Global, Priority, bHasContent))
+	{
+		return false;
+	}
+	if (const FHttpBandwidthLimit* ClassLimit = GetClassLimit(Settings, Priority))
+	{
+		const FBucketPair& ClassBuckets = Priority == EHttpRequestPriority::Normal ? NormalBuckets : BackgroundBuckets;
+		if (!ClassBuckets.CanDispatch(*ClassLimit, Priority, bHasContent))
+		{
+			return false;
+		}
+	}
+	const FHttpBandwidthLimit* HostLimit = Settings.HostLimits.Find(Host);
+	const FBucketPair* Buckets = HostLimit ? HostBuckets.Find(Host) : nullptr;
+	return !Buckets || Buckets->CanDispatch(*HostLimit, Priority, bHasContent);
+}
+
+void FHttpBandwidthLimiter::Consume(const FHttpBandwidthSettings& Settings, const FString& Host, EHttpRequestPriority Priority, int64 BytesSent, int64 BytesReceived)
+{
+	if (!Settings.bEnabled || (BytesSent <= 0 && BytesReceived <= 0))
+	{
+		return;
+	}
+	BytesSent = FMath::Max<int64>(0, BytesSent);
+	BytesReceived = FMath::Max<int64>(0, BytesReceived);
+	GlobalBuckets.Consume(Settings.Global, Priority, BytesSent, BytesReceived);
+	const FHttpBandwidthLimit* ClassLimit = GetClassLimit(Settings, Priority);
+	FBucketPair* ClassBuckets = GetClassBuckets(Priority);
+	if (ClassLimit && ClassBuckets)
+	{
+		ClassBuckets->Consume(*ClassLimit, Priority, BytesSent, BytesReceived);
+	}
+	if (const FHttpBandwidthLimit* HostLimit = Settings.HostLimits.Find(Host))
+	{
+		if (FBucketPair* Buckets = HostBuckets.Find(Host))
+		{
+			Buckets->Consume(*HostLimit, Priority, BytesSent, BytesReceived);
+		}
+	}
+}
+
+double FHttpBandwidthLimiter::GetPaceSeconds(const FHttpBandwidthSettings& Settings, const FString& Host, EHttpRequestPriority Priority, bool bUpload) const
+{
+	if (!Settings.bEnabled || (Priority == EHttpRequestPriority::Critical && !Settings.bLimitCritical))
+	{
+		return 0;
+	}
+	double PaceSeconds = GlobalBuckets.GetPaceSeconds(Settings.Global, Priority, bUpload);
+	if (const FHttpBandwidthLimit* ClassLimit = GetClassLimit(Settings, Priority))
+	{
+		const FBucketPair& ClassBuckets = Priority == EHttpRequestPriority::Normal ? NormalBuckets : BackgroundBuckets;
+		PaceSeconds = FMath::Max(PaceSeconds, ClassBuckets.GetPaceSeconds(*ClassLimit, Priority, bUpload));
+	}
+	const FHttpBandwidthLimit* HostLimit = Settings.HostLimits.Find(Host);
+	if (const FBucketPair* Buckets = HostLimit ? HostBuckets.Find(Host) : nullptr)
+	{
+		PaceSeconds = FMath::Max(PaceSeconds, Buckets->GetPaceSeconds(*HostLimit, Priority, bUpload));
+	}
+	return PaceSeconds;
+}
+
+void FHttpBandwidthLimiter::Reset()
+{
+	GlobalBuckets = FBucketPair();
+	NormalBuckets = FBucketPair();
+	BackgroundBuckets = FBucketPair();
+	HostBuckets.Empty();
+	LastRefillTime = 0;
+}
@@ -0,0 +1,238 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPBenchmark.h"
+#include "HTTPHelperSubsystem.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static FAutoConsoleCommandWithWorldAndArgs GSimpleHttpBenchmarkCommand(
+	TEXT("SimpleHTTP.Benchmark"),
+	TEXT("SimpleHTTP.Benchmark <URL> [Mode=String|Binary|Files|SaveAsFile] [Requests=200] [Concurrency=16] [PayloadBytes=4096]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+		{
+			UGameInstance* GameInstance = World ? World->GetGameInstance() : nullptr;
+			UHTTPHelperSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UHTTPHelperSubsystem>() : nullptr;
+			if (!Subsystem || Args.Num() == 0)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Usage: SimpleHTTP.Benchmark <URL> [Mode=String|Binary|Files|SaveAsFile] [Requests=200] [Concurrency=16] [PayloadBytes=4096]"));
+				return;
+			}
+			FHttpBenchmarkSettings Settings;
+			Settings.URL = Args[0];
+			for (int32 Index = 1; Index < Args.Num(); Index++)
+			{
+				FString Key, Value;
+				if (!Args[Index].Split(TEXT("="), &Key, &Value))
+				{
+					continue;
+				}
+				if (Key == TEXT("Mode"))
+				{
+					const int64 ModeValue = StaticEnum<EHttpBenchmarkMode>()->GetValueByNameString(Value);
+					Settings.Mode = ModeValue == INDEX_NONE ? Settings.Mode : (EHttpBenchmarkMode)ModeValue;
+				}
+				else if (Key == TEXT("Requests"))
+				{
+					Settings.Requests = FCString::Atoi(*Value);
+				}
+				else if (Key == TEXT("Concurrency"))
+				{
+					Settings.Concurrency = FCString::Atoi(*Value);
+				}
+				else if (Key == TEXT("PayloadBytes"))
+				{
+					Settings.PayloadBytes = FCString::Atoi(*Value);
+				}
+			}
+			Subsystem->RunBenchmark(Settings);
+		}));
+
+void UHTTPBenchmark::BindBenchmarkComplete(FSimpleHttpBenchmarkCompleteDelegate InDelegate)
+{
+	OnBenchmarkComplete = InDelegate;
+}
+
+FString UHTTPBenchmark::ResultToString(const FHttpBenchmarkResult& InResult)
+{
+	return FString::Printf(TEXT("SimpleHTTP benchmark %s x%d (concurrency %d, payload %d bytes): %d completed, %d failed, %.2fs, %.1f req/s, latency p50 %.1fms p95 %.1fms p99 %.1fms max %.1fms, peak memory +%.1fMB, game thread %.3fms per completion"),
+		*StaticEnum<EHttpBenchmarkMode>()->GetNameStringByValue((int64)InResult.Settings.Mode),
+		InResult.Settings.Requests, InResult.Settings.Concurrency, InResult.Settings.PayloadBytes,
+		InResult.CompletedRequests, InResult.FailedRequests, InResult.WallSeconds, InResult.RequestsPerSecond,
+		InResult.LatencyP50Ms, InResult.LatencyP95Ms, InResult.LatencyP99Ms, InResult.LatencyMaxMs,
+		InResult.PeakMemoryGrowthMB, InResult.GameThreadMsPerCompletion);
+}
+
+void UHTTPBenchmark::Start(UHTTPHelperSubsystem* InSubsystem, const FHttpBenchmarkSettings& InSettings)
+{
+	HTTPHelperSubsystem = InSubsystem;
+	Settings = InSettings;
+	Settings.Requests = FMath::Max(1, Settings.Requests);
+	Settings.Concurrency = FMath::Max(1, Settings.Concurrency);
+	Settings.PayloadBytes = FMath::Max(0, Settings.PayloadBytes);
+	Result.Settings = Settings;
+
+	//内容在开始前准备好，不计入测试时间
+	WorkingDirectory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SimpleHTTP"), TEXT("Benchmark"), FGuid::NewGuid().ToString());
+	switch (Settings.Mode)
+	{
+	case EHttpBenchmarkMode::String:
+		StringPayload = FString::ChrN(Settings.PayloadBytes, TEXT('a'));
+		break;
+	case EHttpBenchmarkMode::Binary:
+	case EHttpBenchmarkMode::Files:
+	{
+		FRandomStream Random(Settings.PayloadBytes);
+		BinaryPayload.SetNumUninitialized(Settings.PayloadBytes);
+		for (uint8& Byte : BinaryPayload)
+		{
+			Byte = (uint8)Random.RandHelper(256);
+		}
+		if (Settings.Mode == EHttpBenchmarkMode::Files)
+		{
+			FFileHelper::SaveArrayToFile(BinaryPayload, *FPaths::Combine(WorkingDirectory, TEXT("payload.bin")));
+			BinaryPayload.Empty();
+		}
+		break;
+	}
+	default:
+		break;
+	}
+
+	const FPlatformMemoryStats MemoryStats = FPlatformMemory::GetStats();
+	StartUsedPhysical = PeakUsedPhysical = MemoryStats.UsedPhysical;
+	StartCompletionSeconds = HTTPHelperSubsystem->GetRequestMetricsCollector().GetCompletionSeconds();
+	StartRecordedRequests = HTTPHelperSubsystem->GetRequestMetricsCollector().GetRecordedRequests();
+	StartTime = FPlatformTime::Seconds();
+	LaunchRequests();
+}
+
+void UHTTPBenchmark::LaunchRequests()
+{
+	while (!bFinished && InFlight < Settings.Concurrency && Launched < Settings.Requests)
+	{
+		const int32 Index = Launched++;
+		UHTTPRequest* Request = SendRequest(Index);
+		if (!Request)
+		{
+			Result.CompletedRequests++;
+			Result.FailedRequests++;
+			continue;
+		}
+		InFlight++;
+		Request->OnRequestCompleteAsView.BindUObject(this, &UHTTPBenchmark::OnRequestComplete, Request);
+		if (Settings.Mode == EHttpBenchmarkMode::String)
+		{
+			FSimpleHttpRequestCompleteAsStringDelegate StringDelegate;
+			StringDelegate.BindUFunction(this, GET_FUNCTION_NAME_CHECKED(UHTTPBenchmark, OnStringComplete));
+			Request->BindRequestCompleteAsString(StringDelegate);
+		}
+		else if (Settings.Mode == EHttpBenchmarkMode::Binary)
+		{
+			FSimpleHttpRequestCompleteAsBinaryDelegate BinaryDelegate;
+			BinaryDelegate.BindUFunction(this, GET_FUNCTION_NAME_CHECKED(UHTTPBenchmark, OnBinaryComplete));
+			Request->BindRequestCompleteAsBinary(BinaryDelegate);
+		}
+	}
+	if (!bFinished && InFlight == 0 && Launched >= Settings.Requests)
+	{
+		Finish();
+	}
+}
+
+UHTTPRequest* UHTTPBenchmark::SendRequest(int32 Index)
+{
+	//每个请求使用不同的参数，避免GET请求被合并或者命中缓存
+	TMap<FString, FString> Params;
+	Params.Add(TEXT("bench"), FString::FromInt(Index));
+	const TMap<FString, FString> Headers;
+	switch (Settings.Mode)
+	{
+	case EHttpBenchmarkMode::String:
+		return HTTPHelperSubsystem->CallHTTP(Settings.URL, EMethodByte::POST, Headers, Params, StringPayload);
+	case EHttpBenchmarkMode::Binary:
+		return HTTPHelperSubsystem->CallHTTPAsBinary(Settings.URL, EMethodByte::POST, Headers, Params, BinaryPayload);
+	case EHttpBenchmarkMode::Files:
+	{
+		TArray<FHttpRequestFileCreator> Files;
+		FHttpRequestFileCreator& File = Files.AddDefaulted_GetRef();
+		File.bIsFile = true;
+		File.KeyName = TEXT("file");
+		File.ContentInfo = FPaths::Combine(WorkingDirectory, TEXT("payload.bin"));
+		return HTTPHelperSubsystem->CallHTTPAsFiles(Settings.URL, Headers, Params, Files);
+	}
+	case EHttpBenchmarkMode::SaveAsFile:
+		return HTTPHelperSubsystem->CallHTTP(Settings.URL, EMethodByte::GET, Headers, Params, FString());
+	default:
+		return nullptr;
+	}
+}
+
+void UHTTPBenchmark::OnRequestComplete(bool bSuccess, TArrayView<const uint8> Content, UHTTPRequest* Request)
+{
+	if (bFinished)
+	{
+		return;
+	}
+	InFlight--;
+	Result.CompletedRequests++;
+	if (bSuccess && Settings.Mode == EHttpBenchmarkMode::SaveAsFile)
+	{
+		//同时保存的文件数量不超过并发数量，循环使用文件名
+		bSuccess = Request->SaveAsFile(WorkingDirectory, FString::Printf(TEXT("response_%d.bin"), Result.CompletedRequests % Settings.Concurrency), false);
+	}
+	if (!bSuccess)
+	{
+		Result.FailedRequests++;
+	}
+	const FHttpRequestTiming Timing = Request->GetTiming();
+	Latency.Add(Timing.TotalSeconds);
+	SampleMemory();
+	LaunchRequests();
+}
+
+void UHTTPBenchmark::OnStringComplete(bool bSuccess, FString Content)
+{
+}
+
+void UHTTPBenchmark::OnBinaryComplete(bool bSuccess, const TArray<uint8>& Content)
+{
+}
+
+void UHTTPBenchmark::SampleMemory()
+{
+	PeakUsedPhysical = FMath::Max<uint64>(PeakUsedPhysical, FPlatformMemory::GetStats().UsedPhysical);
+}
+
+void UHTTPBenchmark::Finish()
+{
+	bFinished = true;
+	SampleMemory();
+	Result.WallSeconds = (float)(FPlatformTime::Seconds() - StartTime);
+	Result.RequestsPerSecond = Result.WallSeconds > 0 ? Result.CompletedRequests / Result.WallSeconds : 0.f;
+	Result.LatencyP50Ms = Latency.GetPercentileMs(0.5f);
+	Result.LatencyP95Ms = Latency.GetPercentileMs(0.95f);
+	Result.LatencyP99Ms = Latency.GetPercentileMs(0.99f);
+	Result.LatencyMaxMs = Latency.GetMaxMs();
+	Result.PeakMemoryGrowthMB = (float)((double)(PeakUsedPhysical - StartUsedPhysical) / (1024.0 * 1024.0));
+	if (HTTPHelperSubsystem)
+	{
+		const FHttpRequestMetrics& Metrics = HTTPHelperSubsystem->GetRequestMetricsCollector();
+		const int64 Recorded = Metrics.GetRecordedRequests() - StartRecordedRequests;
+		Result.GameThreadMsPerCompletion = Recorded > 0 ? (float)((Metrics.GetCompletionSeconds() - StartCompletionSeconds) * 1000.0 / Recorded) : 0.f;
+	}
+	IFileManager::Get().DeleteDirectory(*WorkingDirectory, false, true);
+
+	UE_LOG(LogTemp, Display, TEXT("%s"), *ResultToString(Result));
+	if (HTTPHelperSubsystem)
+	{
+		HTTPHelperSubsystem->OnBenchmarkFinished(this);
+	}
+	OnBenchmarkComplete.ExecuteIfBound(Result);
+}
@@ -0,0 +1,45 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPBodyCompression.h"
+#include "Misc/Compression.h"
+
+const TCHAR* FHttpBodyCompression::GetEncodingName(EHttpContentEncoding Encoding)
+{
+	return Encoding == EHttpContentEncoding::Deflate ? TEXT("deflate") : TEXT("gzip");
+}
+
+bool FHttpBodyCompression::ShouldCompress(const FHttpCompressionSettings& Settings, const FString& ContentType, int64 ContentSize)
+{
+	if (!Settings.bEnabled || ContentSize < FMath::Max(1, Settings.MinSizeBytes))
+	{
+		return false;
+	}
+	for (const FString& Skipped : Settings.SkippedContentTypes)
+	{
+		if (!Skipped.IsEmpty() && ContentType.StartsWith(Skipped, ESearchCase::IgnoreCase))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FHttpBodyCompression::Compress(EHttpContentEncoding Encoding, float MaxCompressedRatio, TArrayView<const uint8> Content, TArray<uint8>& OutCompressed)
+{
+	const FName FormatName = Encoding == EHttpContentEncoding::Deflate ? NAME_Zlib : NAME_Gzip;
+	int32 CompressedSize = FCompression::CompressMemoryBound(FormatName, Content.Num());
+	OutCompressed.SetNumUninitialized(CompressedSize);
+	if (!FCompression::CompressMemory(FormatName, OutCompressed.GetData(), CompressedSize, Content.GetData(), Content.Num()))
+	{
+		OutCompressed.Reset();
+		return false;
+	}
+	if (CompressedSize > Content.Num() * FMath::Clamp(MaxCompressedRatio, 0.f, 1.f))
+	{
+		OutCompressed.Reset();
+		return false;
+	}
+	OutCompressed.SetNum(CompressedSize);
+	return true;
+}
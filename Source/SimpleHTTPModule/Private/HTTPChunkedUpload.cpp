@@ -0,0 +1,655 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPChunkedUpload.h"
+#include "Interfaces/IHttpResponse.h"
+#include "HTTPHelperSubsystem.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/Base64.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+
+static const TCHAR* TusVersion = TEXT("1.0.0");
+
+void UHTTPChunkedUpload::BindUploadComplete(FSimpleHttpChunkedUploadCompleteDelegate InDelegate)
+{
+	OnUploadComplete = InDelegate;
+}
+
+void UHTTPChunkedUpload::BindUploadProgress(FSimpleHttpChunkedUploadProgressDelegate InDelegate)
+{
+	OnUploadProgress = InDelegate;
+}
+
+int64 UHTTPChunkedUpload::GetBytesSent() const
+{
+	int64 BytesSent = CompletedBytes;
+	for (const FPart& Part : Parts)
+	{
+		BytesSent += Part.bCompleted ? 0 : Part.ConfirmedBytes + Part.SentBytes;
+	}
+	return BytesSent;
+}
+
+void UHTTPChunkedUpload::Start(UHTTPHelperSubsystem* InSubsystem, const FString& InEndpoint, const TMap<FString, FString>& InHeaders, const FString& InFilePath, const FHttpChunkedUploadSettings& InSettings)
+{
+	HTTPHelperSubsystem = InSubsystem;
+	Endpoint = InEndpoint;
+	Headers = InHeaders;
+	FilePath = FPaths::ConvertRelativePathToFull(InFilePath);
+	Settings = InSettings;
+
+	StartTickHandle = FSimpleHttpTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UHTTPChunkedUpload::OnStartTick));
+	TotalBytes = IFileManager::Get().FileSize(*FilePath);
+	if (TotalBytes < 0)
+	{
+		return;
+	}
+	FileTimeStamp = IFileManager::Get().GetTimeStamp(*FilePath);
+}
+
+bool UHTTPChunkedUpload::OnStartTick(float DeltaTime)
+{
+	StartTickHandle.Reset();
+	if (bFinished)
+	{
+		return false;
+	}
+	if (TotalBytes < 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Chunked upload file not found: %s"), *FilePath);
+		Finish(false);
+		return false;
+	}
+	//只有一个分块或者不并行时不需要合并，也就不需要查询服务器的扩展
+	if (Settings.MaxParallelParts > 1 && TotalBytes > FMath::Max<int64>(Settings.PartSizeBytes, 256 * 1024))
+	{
+		SendOptions();
+	}
+	else
+	{
+		StartParts(false);
+	}
+	return false;
+}
+
+void UHTTPChunkedUpload::SendOptions()
+{
+	OptionsRequest = CreateRequest(Endpoint, EMethodByte::OPTIONS);
+	OptionsRequest->OnProcessRequestComplete().BindUObject(this, &UHTTPChunkedUpload::OnOptionsComplete);
+	TWeakObjectPtr<UHTTPChunkedUpload> WeakThis(this);
+	HTTPHelperSubsystem->EnqueueRequest(OptionsRequest.ToSharedRef(), Settings.Priority, [WeakThis]()
+		{
+			AsyncTask(ENamedThreads::GameThread, [WeakThis]()
+				{
+					UHTTPChunkedUpload* This = WeakThis.Get();
+					if (This && This->OptionsRequest.IsValid())
+					{
+						This->OnOptionsComplete(This->OptionsRequest, nullptr, false);
+					}
+				});
+		});
+}
+
+void UHTTPChunkedUpload::OnOptionsComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+{
+	HTTPHelperSubsystem->NotifyRequestFinished(Request);
+	if (bFinished || OptionsRequest != Request)
+	{
+		return;
+	}
+	OptionsRequest.Reset();
+	bool bConcatenate = false;
+	if (bWasSuccessful && Response.IsValid() && EHttpResponseCodes::IsOk(Response->GetResponseCode()))
+	{
+		TArray<FString> Extensions;
+		Response->GetHeader(TEXT("Tus-Extension")).ParseIntoArray(Extensions, TEXT(","));
+		for (FString& Extension : Extensions)
+		{
+			bConcatenate |= Extension.TrimStartAndEnd().Equals(TEXT("concatenation"), ESearchCase::IgnoreCase);
+		}
+	}
+	if (!bConcatenate)
+	{
+		UE_LOG(LogTemp, Log, TEXT("%s does not support tus concatenation, upload %s sequentially"), *Endpoint, *FilePath);
+	}
+	StartParts(bConcatenate);
+}
+
+void UHTTPChunkedUpload::StartParts(bool bConcatenate)
+{
+	//不合并时整个文件是一个分块，每个PATCH的大小由PatchSizeBytes限制
+	const int64 PartSize = bConcatenate ? FMath::Max<int64>(Settings.PartSizeBytes, 256 * 1024) : FMath::Max<int64>(TotalBytes, 1);
+	int64 Offset = 0;
+	do
+	{
+		FPart& Part = Parts.AddDefaulted_GetRef();
+		Part.Offset = Offset;
+		Part.Size = FMath::Min(PartSize, TotalBytes - Offset);
+		Offset += PartSize;
+	} while (Offset < TotalBytes);
+
+	//分块方式不同时journal中的PartSize不一致，不会使用另一种方式留下的上传地址
+	if (LoadJournal())
+	{
+		ResumedBytes = CompletedBytes;
+		UE_LOG(LogTemp, Log, TEXT("Resume chunked upload %s, %lld bytes already confirmed"), *FilePath, ResumedBytes);
+	}
+	if (CompletedBytes >= TotalBytes && !Parts.ContainsByPredicate([](const FPart& Item) { return !Item.bCompleted; }))
+	{
+		OnAllPartsCompleted();
+		return;
+	}
+	LaunchParts();
+}
+
+TSharedRef<IHttpRequest, ESPMode::ThreadSafe> UHTTPChunkedUpload::CreateRequest(const FString& InURL, EMethodByte Verb) const
+{
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = HTTPHelperSubsystem->CreateHTTP_Native(InURL, Verb, Headers, TMap<FString, FString>(), Settings.TimeoutSecs, Settings.bAddDefaultHeaders);
+	Request->SetHeader(TEXT("Tus-Resumable"), TusVersion);
+	return Request;
+}
+
+void UHTTPChunkedUpload::SendRequest(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& Request, int32 PartIndex)
+{
+	Parts[PartIndex].Request = Request;
+	TWeakObjectPtr<UHTTPChunkedUpload> WeakThis(this);
+	HTTPHelperSubsystem->EnqueueRequest(Request, Settings.Priority, [WeakThis, PartIndex]()
+		{
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, PartIndex]()
+				{
+					UHTTPChunkedUpload* This = WeakThis.Get();
+					if (This && !This->bFinished && This->Parts.IsValidIndex(PartIndex) && This->Parts[PartIndex].Request.IsValid())
+					{
+						This->Parts[PartIndex].Request.Reset();
+						This->FailPart(PartIndex);
+					}
+				});
+		});
+}
+
+void UHTTPChunkedUpload::LaunchParts()
+{
+	for (int32 Index = 0; Index < Parts.Num() && InFlightCount < FMath::Max(1, Settings.MaxParallelParts); Index++)
+	{
+		const FPart& Part = Parts[Index];
+		if (Part.bCompleted || Part.bReading || Part.Request.IsValid())
+		{
+			continue;
+		}
+		InFlightCount++;
+		AdvancePart(Index);
+		if (bFinished)
+		{
+			return;
+		}
+	}
+}
+
+void UHTTPChunkedUpload::AdvancePart(int32 PartIndex)
+{
+	const FPart& Part = Parts[PartIndex];
+	if (Part.URL.IsEmpty())
+	{
+		SendCreate(PartIndex);
+	}
+	else if (!Part.bOffsetKnown)
+	{
+		SendQuery(PartIndex);
+	}
+	else if (Part.ConfirmedBytes >= Part.Size)
+	{
+		CompletePart(PartIndex);
+	}
+	else
+	{
+		SendPatch(PartIndex);
+	}
+}
+
+void UHTTPChunkedUpload::SendCreate(int32 PartIndex)
+{
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = CreateRequest(Endpoint, EMethodByte::POST);
+	Request->SetHeader(TEXT("Upload-Length"), FString::Printf(TEXT("%lld"), Parts[PartIndex].Size));
+	if (IsMultiPart())
+	{
+		Request->SetHeader(TEXT("Upload-Concat"), TEXT("partial"));
+	}
+	else
+	{
+		Request->SetHeader(TEXT("Upload-Metadata"), GetUploadMetadata());
+	}
+	Request->OnProcessRequestComplete().BindUObject(this, &UHTTPChunkedUpload::OnCreateComplete, PartIndex);
+	SendRequest(Request, PartIndex);
+}
+
+void UHTTPChunkedUpload::SendQuery(int32 PartIndex)
+{
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = CreateRequest(Parts[PartIndex].URL, EMethodByte::HEAD);
+	Request->OnProcessRequestComplete().BindUObject(this, &UHTTPChunkedUpload::OnQueryComplete, PartIndex);
+	SendRequest(Request, PartIndex);
+}
+
+void UHTTPChunkedUpload::SendPatch(int32 PartIndex)
+{
+	FPart& Part = Parts[PartIndex];
+	Part.bReading = true;
+	//在后台线程读取这次PATCH发送的内容，读取完成后回到游戏线程发送。分块剩余的内容由之后的PATCH发送
+	const int64 PatchSize = FMath::Clamp<int64>(Settings.PatchSizeBytes, 64 * 1024, 256 * 1024 * 1024);
+	TWeakObjectPtr<UHTTPChunkedUpload> WeakThis(this);
+	Async(EAsyncExecution::ThreadPool, [WeakThis, PartIndex, Path = FilePath, Offset = Part.Offset + Part.ConfirmedBytes, Size = FMath::Min(Part.Size - Part.ConfirmedBytes, PatchSize)]()
+		{
+			TArray<uint8> Content;
+			bool bRead = false;
+			TUniquePtr<IFileHandle> Handle(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*Path));
+			if (Handle.IsValid() && Handle->Seek(Offset))
+			{
+				Content.SetNumUninitialized((int32)Size);
+				bRead = Handle->Read(Content.GetData(), Size);
+			}
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, PartIndex, bRead, Content = MoveTemp(Content)]() mutable
+				{
+					UHTTPChunkedUpload* This = WeakThis.Get();
+					if (!This || This->bFinished)
+					{
+						return;
+					}
+					FPart& Part = This->Parts[PartIndex];
+					Part.bReading = false;
+					if (!bRead)
+					{
+						UE_LOG(LogTemp, Error, TEXT("Read part %d of %s failed"), PartIndex, *This->FilePath);
+						This->FailPart(PartIndex);
+						return;
+					}
+					const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = This->CreateRequest(Part.URL, EMethodByte::PATCH);
+					Request->SetHeader(TEXT("Upload-Offset"), FString::Printf(TEXT("%lld"), Part.ConfirmedBytes));
+					Request->SetHeader(TEXT("Content-Type"), TEXT("application/offset+octet-stream"));
+					Request->SetContent(MoveTemp(Content));
+					Request->OnProcessRequestComplete().BindUObject(This, &UHTTPChunkedUpload::OnPatchComplete, PartIndex);
+					SimpleHttpOnRequestProgress(*Request).BindUObject(This, &UHTTPChunkedUpload::OnPatchProgress, PartIndex);
+					Part.SentBytes = 0;
+					This->SendRequest(Request, PartIndex);
+				});
+		});
+}
+
+bool UHTTPChunkedUpload::ClaimResponse(const FHttpRequestPtr& Request, int32 PartIndex)
+{
+	HTTPHelperSubsystem->NotifyRequestFinished(Request);
+	if (bFinished || !Parts.IsValidIndex(PartIndex) || Parts[PartIndex].Request != Request)
+	{
+		return false;
+	}
+	Parts[PartIndex].Request.Reset();
+	return true;
+}
+
+void UHTTPChunkedUpload::OnCreateComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 PartIndex)
+{
+	if (!ClaimResponse(Request, PartIndex))
+	{
+		return;
+	}
+	const FString Location = bWasSuccessful && Response.IsValid() && Response->GetResponseCode() == EHttpResponseCodes::Created ? Response->GetHeader(TEXT("Location")) : FString();
+	if (Location.IsEmpty())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Create upload for part %d of %s failed: %d"), PartIndex, *FilePath, Response.IsValid() ? Response->GetResponseCode() : 0);
+		FailPart(PartIndex);
+		return;
+	}
+	FPart& Part = Parts[PartIndex];
+	Part.URL = ResolveLocation(Location);
+	Part.ConfirmedBytes = 0;
+	Part.bOffsetKnown = true;
+	SaveJournal();
+	AdvancePart(PartIndex);
+}
+
+void UHTTPChunkedUpload::OnQueryComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 PartIndex)
+{
+	if (!ClaimResponse(Request, PartIndex))
+	{
+		return;
+	}
+	FPart& Part = Parts[PartIndex];
+	const int32 ResponseCode = bWasSuccessful && Response.IsValid() ? Response->GetResponseCode() : 0;
+	if (ResponseCode == EHttpResponseCodes::NotFound || ResponseCode == EHttpResponseCodes::Gone)
+	{
+		//服务器上的上传已经过期，重新创建
+		Part.URL.Empty();
+		Part.ConfirmedBytes = 0;
+		SaveJournal();
+		FailPart(PartIndex);
+		return;
+	}
+	const FString UploadOffset = EHttpResponseCodes::IsOk(ResponseCode) ? Response->GetHeader(TEXT("Upload-Offset")) : FString();
+	if (UploadOffset.IsEmpty())
+	{
+		FailPart(PartIndex);
+		return;
+	}
+	const int64 Confirmed = FMath::Clamp<int64>(FCString::Atoi64(*UploadOffset), 0, Part.Size);
+	if (Part.Attempts == 0)
+	{
+		ResumedBytes += Confirmed;
+	}
+	Part.ConfirmedBytes = Confirmed;
+	Part.bOffsetKnown = true;
+	BroadcastProgress();
+	AdvancePart(PartIndex);
+}
+
+void UHTTPChunkedUpload::OnPatchProgress(FHttpRequestPtr Request, FSimpleHttpProgressBytes BytesSent, FSimpleHttpProgressBytes BytesReceived, int32 PartIndex)
+{
+	if (Parts.IsValidIndex(PartIndex) && Parts[PartIndex].Request == Request)
+	{
+		Parts[PartIndex].SentBytes = (int64)BytesSent;
+		HTTPHelperSubsystem->ReportTransferredBytes(Request, (int64)BytesSent, (int64)BytesReceived);
+		BroadcastProgress();
+	}
+}
+
+void UHTTPChunkedUpload::OnPatchComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 PartIndex)
+{
+	if (!ClaimResponse(Request, PartIndex))
+	{
+		return;
+	}
+	FPart& Part = Parts[PartIndex];
+	Part.SentBytes = 0;
+	const int32 ResponseCode = bWasSuccessful && Response.IsValid() ? Response->GetResponseCode() : 0;
+	if (ResponseCode == EHttpResponseCodes::NotFound || ResponseCode == EHttpResponseCodes::Gone)
+	{
+		Part.URL.Empty();
+		Part.ConfirmedBytes = 0;
+		SaveJournal();
+		FailPart(PartIndex);
+		return;
+	}
+	const FString UploadOffset = EHttpResponseCodes::IsOk(ResponseCode) ? Response->GetHeader(TEXT("Upload-Offset")) : FString();
+	if (UploadOffset.IsEmpty())
+	{
+		//409表示Upload-Offset和服务器不一致，失败后都用HEAD重新查询位置
+		FailPart(PartIndex);
+		return;
+	}
+	const int64 Confirmed = FMath::Clamp<int64>(FCString::Atoi64(*UploadOffset), 0, Part.Size);
+	if (Confirmed > Part.ConfirmedBytes)
+	{
+		//重试次数按连续失败计算，一个分块有多个PATCH时不会累计
+		Part.Attempts = 0;
+	}
+	Part.ConfirmedBytes = Confirmed;
+	Part.bOffsetKnown = true;
+	AdvancePart(PartIndex);
+}
+
+void UHTTPChunkedUpload::FailPart(int32 PartIndex)
+{
+	InFlightCount--;
+	FPart& Part = Parts[PartIndex];
+	Part.SentBytes = 0;
+	Part.bOffsetKnown = false;
+	if (++Part.Attempts > Settings.MaxPartRetries)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Part %d of %s failed after %d attempts"), PartIndex, *FilePath, Part.Attempts);
+		Finish(false);
+		return;
+	}
+	LaunchParts();
+}
+
+void UHTTPChunkedUpload::CompletePart(int32 PartIndex)
+{
+	InFlightCount--;
+	FPart& Part = Parts[PartIndex];
+	Part.bCompleted = true;
+	CompletedBytes += Part.Size;
+	SaveJournal();
+	BroadcastProgress();
+	if (CompletedBytes >= TotalBytes && !Parts.ContainsByPredicate([](const FPart& Item) { return !Item.bCompleted; }))
+	{
+		OnAllPartsCompleted();
+		return;
+	}
+	LaunchParts();
+}
+
+void UHTTPChunkedUpload::OnAllPartsCompleted()
+{
+	if (IsMultiPart())
+	{
+		SendConcatenate();
+		return;
+	}
+	UploadURL = Parts[0].URL;
+	Finish(true);
+}
+
+void UHTTPChunkedUpload::SendConcatenate()
+{
+	FString Concat = TEXT("final;");
+	for (int32 Index = 0; Index < Parts.Num(); Index++)
+	{
+		if (Index > 0)
+		{
+			Concat += TEXT(" ");
+		}
+		Concat += Parts[Index].URL;
+	}
+	ConcatenateRequest = CreateRequest(Endpoint, EMethodByte::POST);
+	ConcatenateRequest->SetHeader(TEXT("Upload-Concat"), Concat);
+	ConcatenateRequest->SetHeader(TEXT("Upload-Metadata"), GetUploadMetadata());
+	ConcatenateRequest->OnProcessRequestComplete().BindUObject(this, &UHTTPChunkedUpload::OnConcatenateComplete);
+	TWeakObjectPtr<UHTTPChunkedUpload> WeakThis(this);
+	HTTPHelperSubsystem->EnqueueRequest(ConcatenateRequest.ToSharedRef(), Settings.Priority, [WeakThis]()
+		{
+			AsyncTask(ENamedThreads::GameThread, [WeakThis]()
+				{
+					UHTTPChunkedUpload* This = WeakThis.Get();
+					if (This && This->ConcatenateRequest.IsValid())
+					{
+						This->OnConcatenateComplete(This->ConcatenateRequest, nullptr, false);
+					}
+				});
+		});
+}
+
+void UHTTPChunkedUpload::OnConcatenateComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+{
+	HTTPHelperSubsystem->NotifyRequestFinished(Request);
+	if (bFinished || ConcatenateRequest != Request)
+	{
+		return;
+	}
+	ConcatenateRequest.Reset();
+	const FString Location = bWasSuccessful && Response.IsValid() && Response->GetResponseCode() == EHttpResponseCodes::Created ? Response->GetHeader(TEXT("Location")) : FString();
+	if (!Location.IsEmpty())
+	{
+		UploadURL = ResolveLocation(Location);
+		Finish(true);
+	}
+	else if (++ConcatenateAttempts > Settings.MaxPartRetries)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Concatenate upload of %s failed: %d"), *FilePath, Response.IsValid() ? Response->GetResponseCode() : 0);
+		Finish(false);
+	}
+	else
+	{
+		SendConcatenate();
+	}
+}
+
+void UHTTPChunkedUpload::Cancel()
+{
+	Finish(false);
+}
+
+void UHTTPChunkedUpload::Finish(bool bSuccess)
+{
+	if (bFinished)
+	{
+		return;
+	}
+	bFinished = true;
+	if (StartTickHandle.IsValid())
+	{
+		//还没有开始就被取消
+		FSimpleHttpTicker::GetCoreTicker().RemoveTicker(StartTickHandle);
+		StartTickHandle.Reset();
+	}
+	auto CancelRequest = [this](const TSharedPtr<IHttpRequest, ESPMode::ThreadSafe>& Request)
+	{
+		Request->OnProcessRequestComplete().Unbind();
+		SimpleHttpOnRequestProgress(*Request).Unbind();
+		if (!HTTPHelperSubsystem->RemoveQueuedRequest(Request))
+		{
+			Request->CancelRequest();
+			HTTPHelperSubsystem->NotifyRequestFinished(Request);
+		}
+	};
+	if (OptionsRequest.IsValid())
+	{
+		CancelRequest(OptionsRequest);
+		OptionsRequest.Reset();
+	}
+	for (FPart& Part : Parts)
+	{
+		if (Part.Request.IsValid())
+		{
+			CancelRequest(Part.Request);
+			Part.Request.Reset();
+		}
+		Part.SentBytes = 0;
+	}
+	if (ConcatenateRequest.IsValid())
+	{
+		CancelRequest(ConcatenateRequest);
+		ConcatenateRequest.Reset();
+	}
+	InFlightCount = 0;
+	if (bSuccess)
+	{
+		IFileManager::Get().Delete(*GetJournalPath());
+	}
+	HTTPHelperSubsystem->OnChunkedUploadFinished(this);
+	OnUploadComplete.ExecuteIfBound(bSuccess, UploadURL);
+}
+
+void UHTTPChunkedUpload::BroadcastProgress()
+{
+	OnUploadProgress.ExecuteIfBound(GetBytesSent(), TotalBytes);
+}
+
+FString UHTTPChunkedUpload::ResolveLocation(const FString& Location) const
+{
+	if (Location.Contains(TEXT("://")))
+	{
+		return Location;
+	}
+	if (Location.StartsWith(TEXT("/")))
+	{
+		//只替换路径部分，保留Endpoint的协议、域名和端口
+		const int32 SchemeEnd = Endpoint.Find(TEXT("://"));
+		const int32 PathStart = SchemeEnd == INDEX_NONE ? INDEX_NONE : Endpoint.Find(TEXT("/"), ESearchCase::CaseSensitive, ESearchDir::FromStart, SchemeEnd + 3);
+		return (PathStart == INDEX_NONE ? Endpoint : Endpoint.Left(PathStart)) + Location;
+	}
+	FString Base = Endpoint;
+	Base.RemoveFromEnd(TEXT("/"));
+	return Base + TEXT("/") + Location;
+}
+
+FString UHTTPChunkedUpload::GetUploadMetadata() const
+{
+	//tus的metadata为逗号分隔的key和base64编码的value
+	const FTCHARToUTF8 FileName(*FPaths::GetCleanFilename(FilePath));
+	return TEXT("filename ") + FBase64::Encode((const uint8*)FileName.Get(), FileName.Length());
+}
+
+FString UHTTPChunkedUpload::GetJournalPath() const
+{
+	//源文件所在的目录不一定可以写入，journal放在Saved目录下
+	const FString Key = Endpoint + TEXT("|") + FilePath;
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SimpleHTTP"), TEXT("Uploads"), FMD5::HashAnsiString(*Key) + TEXT(".journal"));
+}
+
+bool UHTTPChunkedUpload::LoadJournal()
+{
+	FString JournalString;
+	if (!FFileHelper::LoadFileToString(JournalString, *GetJournalPath()))
+	{
+		return false;
+	}
+	TSharedPtr<FJsonObject> Journal;
+	if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(JournalString), Journal) || !Journal.IsValid())
+	{
+		return false;
+	}
+	//文件内容或者分块方式改变时不能继续
+	const TArray<TSharedPtr<FJsonValue>>* PartURLs = nullptr;
+	if (Journal->GetStringField(TEXT("Endpoint")) != Endpoint
+		|| Journal->GetStringField(TEXT("FilePath")) != FilePath
+		|| (int64)Journal->GetNumberField(TEXT("TotalBytes")) != TotalBytes
+		|| (int64)Journal->GetNumberField(TEXT("PartSize")) != Parts[0].Size
+		|| Journal->GetStringField(TEXT("TimeStamp")) != FileTimeStamp.ToIso8601()
+		|| !Journal->TryGetArrayField(TEXT("Parts"), PartURLs)
+		|| PartURLs->Num() != Parts.Num())
+	{
+		return false;
+	}
+	for (int32 Index = 0; Index < Parts.Num(); Index++)
+	{
+		Parts[Index].URL = (*PartURLs)[Index]->AsString();
+	}
+	const TArray<TSharedPtr<FJsonValue>>* Completed = nullptr;
+	if (Journal->TryGetArrayField(TEXT("Completed"), Completed))
+	{
+		for (const TSharedPtr<FJsonValue>& Value : *Completed)
+		{
+			const int32 Index = (int32)Value->AsNumber();
+			if (Parts.IsValidIndex(Index) && !Parts[Index].bCompleted && !Parts[Index].URL.IsEmpty())
+			{
+				Parts[Index].bCompleted = true;
+				CompletedBytes += Parts[Index].Size;
+			}
+		}
+	}
+	return true;
+}
+
+void UHTTPChunkedUpload::SaveJournal() const
+{
+	const TSharedRef<FJsonObject> Journal = MakeShared<FJsonObject>();
+	Journal->SetStringField(TEXT("Endpoint"), Endpoint);
+	Journal->SetStringField(TEXT("FilePath"), FilePath);
+	Journal->SetNumberField(TEXT("TotalBytes"), (double)TotalBytes);
+	Journal->SetNumberField(TEXT("PartSize"), (double)Parts[0].Size);
+	Journal->SetStringField(TEXT("TimeStamp"), FileTimeStamp.ToIso8601());
+	TArray<TSharedPtr<FJsonValue>> PartURLs;
+	TArray<TSharedPtr<FJsonValue>> Completed;
+	for (int32 Index = 0; Index < Parts.Num(); Index++)
+	{
+		PartURLs.Add(MakeShared<FJsonValueString>(Parts[Index].URL));
+		if (Parts[Index].bCompleted)
+		{
+			Completed.Add(MakeShared<FJsonValueNumber>(Index));
+		}
+	}
+	Journal->SetArrayField(TEXT("Parts"), PartURLs);
+	Journal->SetArrayField(TEXT("Completed"), Completed);
+
+	FString JournalString;
+	FJsonSerializer::Serialize(Journal, TJsonWriterFactory<>::Create(&JournalString));
+	const FString TempPath = GetJournalPath() + TEXT(".tmp");
+	if (FFileHelper::SaveStringToFile(JournalString, *TempPath))
+	{
+		IFileManager::Get().Move(*GetJournalPath(), *TempPath);
+	}
+}
@@ -0,0 +1,37 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPCompletionBudget.h"
+#include "CoreGlobals.h"
+
+bool FHttpCompletionBudget::IsEnabled(const FHttpCompletionBudgetSettings& Settings)
+{
+	return Settings.MaxCompletionsPerFrame > 0 || Settings.MaxMillisecondsPerFrame > 0;
+}
+
+bool FHttpCompletionBudget::HasBudget(const FHttpCompletionBudgetSettings& Settings)
+{
+	Refresh();
+	if (Settings.MaxCompletionsPerFrame > 0 && Completions >= Settings.MaxCompletionsPerFrame)
+	{
+		return false;
+	}
+	return Settings.MaxMillisecondsPerFrame <= 0 || Seconds * 1000.0 < Settings.MaxMillisecondsPerFrame;
+}
+
+void FHttpCompletionBudget::Consume(uint32 Cycles)
+{
+	Refresh();
+	++Completions;
+	Seconds += FPlatformTime::ToSeconds(Cycles);
+}
+
+void FHttpCompletionBudget::Refresh()
+{
+	if (Frame != GFrameCounter)
+	{
+		Frame = GFrameCounter;
+		Completions = 0;
+		Seconds = 0;
+	}
+}
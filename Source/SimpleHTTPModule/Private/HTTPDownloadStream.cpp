@@ -0,0 +1,271 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPDownloadStream.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/ScopeLock.h"
+
+FHttpFileDownloadStream::FHttpFileDownloadStream(const FString& InTempFilePath, int64 InMaxPendingBytes)
+	: TempFilePath(InTempFilePath)
+	, MaxPendingBytes(FMath::Max<int64>(InMaxPendingBytes, 64 * 1024))
+{
+	SetIsSaving(true);
+	SetIsPersistent(false);
+	WriterIdleEvent = FPlatformProcess::GetSynchEventFromPool(true);
+	WriterIdleEvent->Trigger();
+}
+
+FHttpFileDownloadStream::~FHttpFileDownloadStream()
+{
+	//写入任务持有流的引用，这时已经结束
+	{
+		FScopeLock ScopeLock(&Lock);
+		bClosed = true;
+		//请求被取消或者请求对象被回收，没有调用Finalize
+		bDeleteOnClose |= !bFinalized;
+		CloseFile();
+	}
+	FPlatformProcess::ReturnSynchEventToPool(WriterIdleEvent);
+}
+
+bool FHttpFileDownloadStream::Open()
+{
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(TempFilePath), true);
+	FScopeLock ScopeLock(&Lock);
+	File.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*TempFilePath));
+	return File.IsValid();
+}
+
+void FHttpFileDownloadStream::Serialize(void* Data, int64 Length)
+{
+	if (Length <= 0)
+	{
+		return;
+	}
+	//请求的桶透支时短暂等待，不等待磁盘
+	ReceiveCounter->Pace();
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (bWriteFailed || bClosed || !File.IsValid())
+		{
+			SetError();
+			return;
+		}
+		//不在HTTP线程上等待磁盘，其他请求共用这个线程。队列为空时总是允许放入，保证单个超大的数据块也能写入
+		if (PendingBytes > 0 && PendingBytes + Length > MaxPendingBytes)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Download writer is %lld bytes behind, abort download: %s"), PendingBytes, *TempFilePath);
+			bWriteFailed = true;
+			SetError();
+			return;
+		}
+		TArray<uint8> Chunk;
+		if (FreeChunks.Num() > 0)
+		{
+			Chunk = MoveTemp(FreeChunks.Last());
+			FreeChunks.RemoveAt(FreeChunks.Num() - 1);
+		}
+		Chunk.Reset();
+		Chunk.Append(static_cast<const uint8*>(Data), Length);
+		PendingChunks.Add(MoveTemp(Chunk));
+		PendingBytes += Length;
+		BytesReceived += Length;
+		ReceiveCounter->Add(Length);
+		if (bWriterActive)
+		{
+			return;
+		}
+		bWriterActive = true;
+		WriterIdleEvent->Reset();
+	}
+	Async(EAsyncExecution::ThreadPool, [This = AsShared()]()
+		{
+			This->WriterLoop();
+		});
+}
+
+void FHttpFileDownloadStream::WriterLoop()
+{
+	while (true)
+	{
+		TArray<uint8> Chunk;
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (PendingChunks.Num() == 0 || bWriteFailed)
+			{
+				PendingChunks.Empty();
+				PendingBytes = 0;
+				bWriterActive = false;
+				//Close等待超时后由写入任务关闭文件
+				if (bClosed)
+				{
+					CloseFile();
+				}
+				WriterIdleEvent->Trigger();
+				return;
+			}
+			Chunk = MoveTemp(PendingChunks[0]);
+			PendingChunks.RemoveAt(0);
+		}
+		const bool bWritten = File->Write(Chunk.GetData(), Chunk.Num());
+		FScopeLock ScopeLock(&Lock);
+		if (!bWritten)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Write download file failed: %s"), *TempFilePath);
+			bWriteFailed = true;
+		}
+		PendingBytes -= Chunk.Num();
+		if (FreeChunks.Num() < 4)
+		{
+			FreeChunks.Add(MoveTemp(Chunk));
+		}
+	}
+}
+
+void FHttpFileDownloadStream::CloseFile()
+{
+	if (File.IsValid())
+	{
+		File->Flush();
+		File.Reset();
+	}
+	FreeChunks.Empty();
+	if (bDeleteOnClose)
+	{
+		bDeleteOnClose = false;
+		IFileManager::Get().Delete(*TempFilePath, false, true, true);
+	}
+}
+
+bool FHttpFileDownloadStream::Close()
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		bClosed = true;
+	}
+	if (!WriterIdleEvent->Wait(FTimespan::FromSeconds(CloseTimeoutSeconds)))
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (bWriterActive)
+		{
+			//丢弃还没有写入的数据，写入任务完成当前的数据块后关闭文件
+			UE_LOG(LogTemp, Error, TEXT("Timed out waiting for download writer: %s"), *TempFilePath);
+			bWriteFailed = true;
+			return false;
+		}
+	}
+	FScopeLock ScopeLock(&Lock);
+	CloseFile();
+	return !bWriteFailed && !IsError();
+}
+
+bool FHttpFileDownloadStream::Finalize(const FString& TargetFilePath)
+{
+	if (!Close())
+	{
+		Discard();
+		return false;
+	}
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(TargetFilePath), true);
+	//临时文件与目标文件在同一目录，Move是一次重命名
+	if (!IFileManager::Get().Move(*TargetFilePath, *TempFilePath, true))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Move download file %s to %s failed"), *TempFilePath, *TargetFilePath);
+		Discard();
+		return false;
+	}
+	FScopeLock ScopeLock(&Lock);
+	bFinalized = true;
+	return true;
+}
+
+void FHttpFileDownloadStream::Discard()
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		bDeleteOnClose = true;
+	}
+	//超时时文件由写入任务关闭并删除
+	Close();
+}
+
+FHttpSharedWriteFile::~FHttpSharedWriteFile()
+{
+	Close();
+}
+
+bool FHttpSharedWriteFile::Open(const FString& InFilePath, int64 TotalSize, bool& bOutKeptExisting)
+{
+	FScopeLock ScopeLock(&Lock);
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	bOutKeptExisting = PlatformFile.FileSize(*InFilePath) == TotalSize;
+	//保留已有内容时以追加方式打开，避免文件被清空
+	File.Reset(PlatformFile.OpenWrite(*InFilePath, bOutKeptExisting, true));
+	if (!File.IsValid())
+	{
+		return false;
+	}
+	if (!bOutKeptExisting && TotalSize > 0)
+	{
+		//写入最后一个字节预分配文件
+		const uint8 Zero = 0;
+		if (!File->Seek(TotalSize - 1) || !File->Write(&Zero, 1))
+		{
+			File.Reset();
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FHttpSharedWriteFile::WriteAt(int64 Offset, const uint8* Data, int64 Length)
+{
+	FScopeLock ScopeLock(&Lock);
+	return File.IsValid() && File->Seek(Offset) && File->Write(Data, Length);
+}
+
+bool FHttpSharedWriteFile::Flush()
+{
+	FScopeLock ScopeLock(&Lock);
+	//Close时已经刷新过
+	return !File.IsValid() || File->Flush();
+}
+
+void FHttpSharedWriteFile::Close()
+{
+	FScopeLock ScopeLock(&Lock);
+	if (File.IsValid())
+	{
+		File->Flush();
+		File.Reset();
+	}
+}
+
+FHttpRangeWriteStream::FHttpRangeWriteStream(const TSharedRef<FHttpSharedWriteFile, ESPMode::ThreadSafe>& InFile, int64 InOffset, int64 InSize)
+	: File(InFile)
+	, Offset(InOffset)
+	, Size(InSize)
+{
+	SetIsSaving(true);
+	SetIsPersistent(false);
+}
+
+void FHttpRangeWriteStream::Serialize(void* Data, int64 Length)
+{
+	if (IsError())
+	{
+		return;
+	}
+	ReceiveCounter->Pace();
+	const int64 Written = GetBytesWritten();
+	//服务器忽略Range返回了完整内容时会超过范围
+	if (Written + Length > Size || !File->WriteAt(Offset + Written, static_cast<const uint8*>(Data), Length))
+	{
+		SetError();
+		return;
+	}
+	FPlatformAtomics::InterlockedExchange(&BytesWritten, Written + Length);
+	ReceiveCounter->Add(Length);
+}
@@ -3,7 +3,15 @@
 
 #include "HTTPHelperSubsystem.h"
 #include "HttpModule.h"
+#include "PlatformHttp.h"
 #include "GenericPlatform/GenericPlatformHttp.h"
+#include "SimpleHTTPCompat.h"
+#include "HTTPDownloadStream.h"
+#include "Async/Async.h"
+#include "JsonObjectConverter.h"
+#include "UObject/StructOnScope.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
 
 
 FHttpRequestFileWapper::FHttpRequestFileWapper(const FString& InKeyName, const FString& InFilePah)
@@ -31,153 +39,1445 @@ FHttpRequestFileWapper::FHttpRequestFileWapper(const FString& InKeyName, const F
 	FileName = InFileName;
 	bIsFile = true;
 	FilePath = InFileName;
-	if (InFileContent.Num() > 0)
+	FileContent = MoveTemp(InFileContent);
+}
+
+bool FHttpRequestFileWapper::CheckValid() const
+{
+	if(FilePath.IsEmpty() && bIsFile)
+	{
+		return false;
+	}
+	if(GetContentView().Num() == 0)
+	{
+		return false;
+	}
+	return true;
+}
+
+bool FHttpRequestFileWapper::LoadFile()
+{
+	if (FilePath.Len()>2)
+	{
+		if (FFileHelper::LoadFileToArray(FileContent, *FilePath))
+		{
+			bIsFile = true;
+			FileName = FPaths::GetCleanFilename(FilePath);
+			return true;
+		}
+	}
+	bIsFile = false;
+	
+	return false;
+}
+
+FHttpRequestMappedFileWapper::FHttpRequestMappedFileWapper(const FString& InKeyName, const FString& InFilePath)
+{
+	KeyName = InKeyName;
+	FilePath = InFilePath;
+	MapFile();
+}
+
+bool FHttpRequestMappedFileWapper::MapFile()
+{
+	MappedFile = FHttpMappedFile::Open(FilePath);
+	if (MappedFile.IsValid())
+	{
+		bIsFile = true;
+		FileName = FPaths::GetCleanFilename(FilePath);
+		FileContent.Empty();
+		return true;
+	}
+	//平台不支持映射时加载文件内容
+	return LoadFile();
+}
+
+TArrayView64<const uint8> FHttpRequestMappedFileWapper::GetContentView() const
+{
+	return MappedFile.IsValid() ? MappedFile->GetView() : FHttpRequestFileWapper::GetContentView();
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::CallHTTP(FString URL, EMethodByte Verb, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, FString Content, float InTimeoutSecs, bool bAddDefaultHeaders, EHttpRequestPriority Priority)
+{
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL,Verb,Headers,Params,InTimeoutSecs,bAddDefaultHeaders);
+	HttpRequest->SetContentAsString(Content);
+	return CreateHttpRequestObject(HttpRequest, 0, Priority);
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAndUploadFile(FString URL, EMethodByte Verb, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, FString FilePath, float InTimeoutSecs,bool bAddDefaultHeaders, EHttpRequestPriority Priority)
+{
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL, Verb, Headers, Params, InTimeoutSecs, bAddDefaultHeaders);
+	HttpRequest->SetContentAsStreamedFile(FilePath);
+	UHTTPRequest* HttpRequestObject = PrepareHttpRequestObject(HttpRequest);
+	HttpRequestObject->bStreamedContent = true;
+	SubmitHttpRequestObject(HttpRequestObject, Priority);
+	return HttpRequestObject;
+}
+
+UHTTPChunkedUpload* UHTTPHelperSubsystem::CallHTTPAndUploadFileChunked(FString URL, const TMap<FString, FString>& Headers, FString FilePath, FHttpChunkedUploadSettings Settings)
+{
+	if (URL.IsEmpty() || !FPaths::FileExists(FilePath))
+	{
+		return nullptr;
+	}
+	UHTTPChunkedUpload* Upload = NewObject<UHTTPChunkedUpload>(this);
+	ActiveChunkedUploads.Add(Upload);
+	Upload->Start(this, URL, Headers, FilePath, Settings);
+	return Upload;
+}
+
+void UHTTPHelperSubsystem::OnChunkedUploadFinished(UHTTPChunkedUpload* Upload)
+{
+	ActiveChunkedUploads.Remove(Upload);
+}
+
+UHTTPBenchmark* UHTTPHelperSubsystem::RunBenchmark(FHttpBenchmarkSettings Settings)
+{
+	if (Settings.URL.IsEmpty())
+	{
+		return nullptr;
+	}
+	UHTTPBenchmark* Benchmark = NewObject<UHTTPBenchmark>(this);
+	ActiveBenchmarks.Add(Benchmark);
+	Benchmark->Start(this, Settings);
+	return Benchmark;
+}
+
+void UHTTPHelperSubsystem::OnBenchmarkFinished(UHTTPBenchmark* Benchmark)
+{
+	ActiveBenchmarks.Remove(Benchmark);
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAndDownloadFile(FString URL, EMethodByte Verb, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, FString SavePath, FString FileName, bool UsingReceivedFileName, float InTimeoutSecs, bool bAddDefaultHeaders, EHttpRequestPriority Priority)
+{
+	if (SavePath.IsEmpty())
+	{
+		return nullptr;
+	}
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL, Verb, Headers, Params, InTimeoutSecs, bAddDefaultHeaders);
+	TSharedPtr<FHttpFileDownloadStream, ESPMode::ThreadSafe> DownloadStream;
+#if SIMPLEHTTP_WITH_RESPONSE_STREAM
+	DownloadStream = MakeShared<FHttpFileDownloadStream, ESPMode::ThreadSafe>(FPaths::Combine(SavePath, FGuid::NewGuid().ToString() + TEXT(".download")));
+	if (!DownloadStream->Open())
+	{
+		return nullptr;
+	}
+	HttpRequest->SetResponseBodyReceiveStream(DownloadStream.ToSharedRef());
+#endif
+	UHTTPRequest* HttpRequestObject = PrepareHttpRequestObject(HttpRequest, 0);
+	HttpRequestObject->SetupDownloadToFile(DownloadStream, SavePath, FileName, UsingReceivedFileName);
+	SubmitHttpRequestObject(HttpRequestObject, Priority);
+	return HttpRequestObject;
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAsBinary(FString URL, EMethodByte Verb, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, const TArray<uint8>& Content, int32 ContentLength, float InTimeoutSecs,bool bAddDefaultHeaders, EHttpRequestPriority Priority)
+{
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL, Verb, Headers, Params, InTimeoutSecs, bAddDefaultHeaders);
+	HttpRequest->SetContent(Content);
+	return CreateHttpRequestObject(HttpRequest, ContentLength, Priority);
+}
+
+//创建还没有加载文件内容的Wapper，文件在后台线程加载
+//名称为空、文本为空或者文件路径为空的Part不会被发送，内存和流式的multipart使用相同的规则
+static bool IsFormDataPartValid(const FHttpRequestFileCreator& File)
+{
+	return File.KeyName.Len() > 0 && File.ContentInfo.Len() > 0;
+}
+
+static TSharedPtr<FHttpRequestFileWapperBase> MakeDeferredFileWapper(const FHttpRequestFileCreator& File)
+{
+	if (!IsFormDataPartValid(File))
+	{
+		return nullptr;
+	}
+	if (!File.bIsFile)
+	{
+		return MakeShareable(new FHttpRequestFileWapperBase(File.KeyName, File.ContentInfo));
+	}
+	if (File.UploadContent.Num() > 0)
+	{
+		return MakeShareable(new FHttpRequestFileWapper(File.KeyName, File.ContentInfo, TArray64<uint8>(File.UploadContent)));
+	}
+	FHttpRequestMappedFileWapper* FileWapper = new FHttpRequestMappedFileWapper();
+	FileWapper->KeyName = File.KeyName;
+	FileWapper->FilePath = File.ContentInfo;
+	FileWapper->bIsFile = true;
+	return MakeShareable(FileWapper);
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAsFiles(FString URL, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, TArray<FHttpRequestFileCreator>& Files, EMethodByte Verb,float InTimeoutSecs, bool bAddDefaultHeaders, EHttpRequestPriority Priority)
+{
+	if (Files.Num() == 0)
+	{
+		return nullptr;
+	}
+	//Wapper只由后台任务持有，避免在线程间共享非线程安全的引用计数
+	TArray<TSharedPtr<FHttpRequestFileWapperBase>> FileWappers;
+	for (int32 Index = 0; Index < Files.Num(); Index++)
+	{
+		TSharedPtr<FHttpRequestFileWapperBase> FileWapper = MakeDeferredFileWapper(Files[Index]);
+		if (!FileWapper.IsValid())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Multipart part %d is invalid and will be skipped, KeyName: \"%s\", ContentInfo: \"%s\""), Index, *Files[Index].KeyName, *Files[Index].ContentInfo);
+			continue;
+		}
+		FileWappers.Add(MoveTemp(FileWapper));
+	}
+	if (FileWappers.Num() == 0)
+	{
+		return nullptr;
+	}
+	TMap<FString, FString> LocalHeader = Headers;
+	//真正的Content-Type在内容生成后设置，这里避免添加默认的Content-Type
+	LocalHeader.FindOrAdd(TEXT("Content-Type"), TEXT("multipart/form-data"));
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL, Verb, LocalHeader, Params, InTimeoutSecs, bAddDefaultHeaders);
+	UHTTPRequest* HttpRequestObject = PrepareHttpRequestObject(HttpRequest);
+
+	TWeakObjectPtr<UHTTPHelperSubsystem> WeakThis(this);
+	TWeakObjectPtr<UHTTPRequest> WeakRequestObject(HttpRequestObject);
+	Async(EAsyncExecution::ThreadPool, [WeakThis, WeakRequestObject, Priority, FileWappers = MoveTemp(FileWappers)]() mutable
+		{
+			//并行加载所有文件
+			const double StartTime = FPlatformTime::Seconds();
+			TArray<bool> Loaded;
+			Loaded.Init(true, FileWappers.Num());
+			ParallelFor(FileWappers.Num(), [&FileWappers, &Loaded](int32 Index)
+				{
+					if (FileWappers[Index]->bIsFile && FileWappers[Index]->GetContentView().Num() == 0)
+					{
+						//文件内容只映射不复制，生成Content时直接从映射的内存读取
+						Loaded[Index] = static_cast<FHttpRequestMappedFileWapper*>(FileWappers[Index].Get())->MapFile();
+					}
+				});
+			const double LoadSeconds = FPlatformTime::Seconds() - StartTime;
+
+			int64 LoadedBytes = 0;
+			TArray<FHttpRequestFileWapperBase*> ValidWappers;
+			for (int32 Index = 0; Index < FileWappers.Num(); Index++)
+			{
+				if (Loaded[Index] && FileWappers[Index]->CheckValid())
+				{
+					LoadedBytes += FileWappers[Index]->GetContentView().Num();
+					ValidWappers.Add(FileWappers[Index].Get());
+				}
+				else
+				{
+					UE_LOG(LogTemp, Warning, TEXT("Multipart part \"%s\" failed to load or is empty and will be skipped"), *FileWappers[Index]->KeyName);
+				}
+			}
+			TMap<FString, FString> FormDataHeaders;
+#if SIMPLEHTTP_WITH_REQUEST_STREAM
+			//边界和Part头部与映射的文件组成流，HTTP线程发送时直接从映射的内存读取
+			TSharedPtr<FHttpMultipartFormDataStream, ESPMode::ThreadSafe> Content;
+			Content = CreateFileStreamAndHeadersForFromData(ValidWappers, FormDataHeaders);
+			const bool bBuilt = Content.IsValid();
+#else
+			TArray<uint8> Content;
+			int32 ContentLength = 0;
+			const bool bBuilt = CreateFileContentAndHeadersForFromData(ValidWappers, FormDataHeaders, Content, ContentLength);
+#endif
+			//Content已经生成，提前释放文件内容，流持有自己需要的映射
+			FileWappers.Empty();
+
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, WeakRequestObject, Priority, bBuilt, LoadSeconds, LoadedBytes, FileCount = ValidWappers.Num(), FormDataHeaders = MoveTemp(FormDataHeaders), Content = MoveTemp(Content)]() mutable
+				{
+					UHTTPHelperSubsystem* This = WeakThis.Get();
+					if (!This)
+					{
+						return;
+					}
+					FHttpFileLoadStats& Stats = This->FileLoadStats;
+					Stats.TotalLoads++;
+					Stats.FailedLoads += bBuilt ? 0 : 1;
+					Stats.TotalFiles += FileCount;
+					Stats.TotalBytes += LoadedBytes;
+					Stats.LastLoadSeconds = (float)LoadSeconds;
+					Stats.MaxLoadSeconds = FMath::Max(Stats.MaxLoadSeconds, (float)LoadSeconds);
+					Stats.TotalLoadSeconds += (float)LoadSeconds;
+
+					UHTTPRequest* RequestObject = WeakRequestObject.Get();
+					if (!RequestObject || !RequestObject->HttpRequest.IsValid())
+					{
+						return;
+					}
+					if (!bBuilt)
+					{
+						RequestObject->OnDispatchFailed();
+						return;
+					}
+					for (const auto& it : FormDataHeaders)
+					{
+						RequestObject->HttpRequest->SetHeader(it.Key, it.Value);
+					}
+#if SIMPLEHTTP_WITH_REQUEST_STREAM
+					RequestObject->HttpRequest->SetContentFromStream(Content.ToSharedRef());
+					RequestObject->bStreamedContent = true;
+					RequestObject->SendCounter = Content->GetSendCounter();
+#else
+					RequestObject->HttpRequest->SetContent(MoveTemp(Content));
+#endif
+					This->SubmitHttpRequestObject(RequestObject, Priority);
+				});
+		});
+	return HttpRequestObject;
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAsFilesStreamed(FString URL, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, const TArray<FHttpRequestFileCreator>& Files, EMethodByte Verb, float InTimeoutSecs, bool bAddDefaultHeaders, EHttpRequestPriority Priority)
+{
+#if SIMPLEHTTP_WITH_REQUEST_STREAM
+	TMap<FString, FString> LocalHeader;
+	const TSharedPtr<FHttpMultipartFormDataStream, ESPMode::ThreadSafe> Stream = CreateFileStreamAndHeadersForFromData(Files, LocalHeader);
+	if (!Stream.IsValid())
+	{
+		return nullptr;
+	}
+	for (const auto& it : Headers)
+	{
+		if (!LocalHeader.Contains(it.Key))
+		{
+			LocalHeader.Add(it.Key, it.Value);
+		}
+	}
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL, Verb, LocalHeader, Params, InTimeoutSecs, bAddDefaultHeaders);
+	HttpRequest->SetContentFromStream(Stream.ToSharedRef());
+	UHTTPRequest* HttpRequestObject = PrepareHttpRequestObject(HttpRequest);
+	HttpRequestObject->bStreamedContent = true;
+	HttpRequestObject->SendCounter = Stream->GetSendCounter();
+	SubmitHttpRequestObject(HttpRequestObject, Priority);
+	return HttpRequestObject;
+#else
+	TArray<FHttpRequestFileCreator> LocalFiles = Files;
+	return CallHTTPAsFiles(URL, Headers, Params, LocalFiles, Verb, InTimeoutSecs, bAddDefaultHeaders, Priority);
+#endif
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAsStruct(FString URL, EMethodByte Verb, TMap<FString, FString> Headers, TMap<FString, FString> Params, const int32& Body, float InTimeoutSecs, bool bAddDefaultHeaders, EHttpRequestPriority Priority)
+{
+	//由execCallHTTPAsStruct实现
+	check(0);
+	return nullptr;
+}
+
+DEFINE_FUNCTION(UHTTPHelperSubsystem::execCallHTTPAsStruct)
+{
+	P_GET_PROPERTY(FStrProperty, URL);
+	P_GET_ENUM(EMethodByte, Verb);
+	P_GET_TMAP(FString, FString, Headers);
+	P_GET_TMAP(FString, FString, Params);
+	Stack.MostRecentPropertyAddress = nullptr;
+	Stack.MostRecentProperty = nullptr;
+	Stack.StepCompiledIn<FStructProperty>(nullptr);
+	const void* BodyPtr = Stack.MostRecentPropertyAddress;
+	const FStructProperty* BodyProperty = CastField<FStructProperty>(Stack.MostRecentProperty);
+	P_GET_PROPERTY(FFloatProperty, InTimeoutSecs);
+	P_GET_UBOOL(bAddDefaultHeaders);
+	P_GET_ENUM(EHttpRequestPriority, Priority);
+	P_FINISH;
+	UHTTPRequest* Result = nullptr;
+	P_NATIVE_BEGIN;
+	if (BodyProperty && BodyPtr)
+	{
+		Result = P_THIS->CallHTTPAsStruct_Native(URL, Verb, Headers, Params, BodyProperty->Struct, BodyPtr, InTimeoutSecs, bAddDefaultHeaders, Priority);
+	}
+	P_NATIVE_END;
+	*(UHTTPRequest**)RESULT_PARAM = Result;
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAsStruct_Native(FString URL, EMethodByte Verb, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, const UScriptStruct* StructType, const void* StructData, float InTimeoutSecs, bool bAddDefaultHeaders, EHttpRequestPriority Priority)
+{
+	if (!StructType || !StructData)
+	{
+		return nullptr;
+	}
+	TMap<FString, FString> LocalHeaders = Headers;
+	if (!LocalHeaders.Contains(TEXT("Content-Type")))
+	{
+		LocalHeaders.Add(TEXT("Content-Type"), TEXT("application/json"));
+	}
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL, Verb, LocalHeaders, Params, InTimeoutSecs, bAddDefaultHeaders);
+	UHTTPRequest* HttpRequestObject = PrepareHttpRequestObject(HttpRequest);
+
+	//复制一份结构体，调用者的结构体在返回后可能已经失效
+	const TSharedRef<FStructOnScope, ESPMode::ThreadSafe> Body = MakeShared<FStructOnScope, ESPMode::ThreadSafe>(StructType);
+	StructType->CopyScriptStruct(Body->GetStructMemory(), StructData);
+	TWeakObjectPtr<UHTTPHelperSubsystem> WeakThis(this);
+	TWeakObjectPtr<UHTTPRequest> WeakRequestObject(HttpRequestObject);
+	Async(EAsyncExecution::ThreadPool, [Body, WeakThis, WeakRequestObject, Priority]()
+		{
+			FString JsonString;
+			const bool bSerialized = FJsonObjectConverter::UStructToJsonObjectString(Body->GetStruct(), Body->GetStructMemory(), JsonString, 0, 0);
+			TArray<uint8> Content;
+			if (bSerialized)
+			{
+				const FTCHARToUTF8 JsonChar(*JsonString);
+				Content.Append((const uint8*)JsonChar.Get(), JsonChar.Length());
+			}
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, WeakRequestObject, Priority, bSerialized, Content = MoveTemp(Content)]() mutable
+				{
+					UHTTPHelperSubsystem* This = WeakThis.Get();
+					UHTTPRequest* RequestObject = WeakRequestObject.Get();
+					if (!This || !RequestObject || !RequestObject->HttpRequest.IsValid())
+					{
+						return;
+					}
+					if (!bSerialized)
+					{
+						RequestObject->OnDispatchFailed();
+						return;
+					}
+					RequestObject->HttpRequest->SetHeader(TEXT("Content-Length"), FString::FromInt(Content.Num()));
+					RequestObject->HttpRequest->SetContent(MoveTemp(Content));
+					This->SubmitHttpRequestObject(RequestObject, Priority);
+				});
+		});
+	return HttpRequestObject;
+}
+
+UHTTPRequestBatch* UHTTPHelperSubsystem::CallHTTPBatch(const TArray<FHttpBatchRequestItem>& Items, FHttpBatchSettings Settings)
+{
+	if (Items.Num() == 0)
+	{
+		return nullptr;
+	}
+	UHTTPRequestBatch* Batch = NewObject<UHTTPRequestBatch>(this);
+	ActiveBatches.Add(Batch);
+	Batch->Start(this, Items, Settings);
+	return Batch;
+}
+
+void UHTTPHelperSubsystem::OnBatchFinished(UHTTPRequestBatch* Batch)
+{
+	ActiveBatches.Remove(Batch);
+}
+
+UHTTPSegmentedDownload* UHTTPHelperSubsystem::CallHTTPSegmentedDownload(FString URL, const TMap<FString, FString>& Headers, FString SavePath, FString FileName, FHttpSegmentedDownloadSettings Settings)
+{
+	if (FileName.IsEmpty())
+	{
+		FString Path = URL;
+		int32 Index;
+		if (Path.FindChar(TEXT('?'), Index))
+		{
+			Path.LeftInline(Index);
+		}
+		FileName = FPaths::GetCleanFilename(Path);
+	}
+	if (URL.IsEmpty() || FileName.IsEmpty())
+	{
+		return nullptr;
+	}
+	UHTTPSegmentedDownload* Download = NewObject<UHTTPSegmentedDownload>(this);
+	ActiveSegmentedDownloads.Add(Download);
+	Download->Start(this, URL, Headers, FPaths::Combine(SavePath, FileName), Settings);
+	return Download;
+}
+
+void UHTTPHelperSubsystem::OnSegmentedDownloadFinished(UHTTPSegmentedDownload* Download)
+{
+	ActiveSegmentedDownloads.Remove(Download);
+}
+
+UHTTPStreamRequest* UHTTPHelperSubsystem::CallHTTPStream(FString URL, EMethodByte Verb, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, FString Content, FHttpStreamSettings Settings)
+{
+	if (URL.IsEmpty())
+	{
+		return nullptr;
+	}
+#if !SIMPLEHTTP_WITH_RESPONSE_STREAM
+	if (!Settings.bAllowBufferedFallback)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Streaming responses need engine 5.3 or later, set bAllowBufferedFallback to parse the whole response after completion: %s"), *URL);
+		return nullptr;
+	}
+#endif
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL, Verb, Headers, Params, Settings.TimeoutSecs, Settings.bAddDefaultHeaders);
+	if (!Content.IsEmpty())
+	{
+		HttpRequest->SetContentAsString(Content);
+	}
+	if (!Headers.Contains(TEXT("Accept")))
+	{
+		switch (Settings.Format)
+		{
+		case EHttpStreamFormat::ServerSentEvents:
+			HttpRequest->SetHeader(TEXT("Accept"), TEXT("text/event-stream"));
+			break;
+		case EHttpStreamFormat::NewlineDelimited:
+			HttpRequest->SetHeader(TEXT("Accept"), TEXT("application/x-ndjson, application/jsonl, text/plain"));
+			break;
+		default:
+			break;
+		}
+	}
+	if (Settings.Format == EHttpStreamFormat::ServerSentEvents && !Headers.Contains(TEXT("Accept-Encoding")))
+	{
+		HttpRequest->SetHeader(TEXT("Accept-Encoding"), TEXT("identity"));
+	}
+	UHTTPStreamRequest* StreamRequest = NewObject<UHTTPStreamRequest>(this);
+	ActiveStreamRequests.Add(StreamRequest);
+	StreamRequest->Start(this, HttpRequest, Settings);
+	return StreamRequest;
+}
+
+void UHTTPHelperSubsystem::OnStreamRequestFinished(UHTTPStreamRequest* StreamRequest)
+{
+	ActiveStreamRequests.Remove(StreamRequest);
+}
+
+UHTTPRequestTemplate* UHTTPHelperSubsystem::CreateRequestTemplate(FString URL, EMethodByte Verb, const TMap<FString, FString>& Headers, float InTimeoutSecs, bool bAddDefaultHeaders, EHttpRequestPriority Priority)
+{
+	if (URL.IsEmpty())
+	{
+		return nullptr;
+	}
+	UHTTPRequestTemplate* Template = NewObject<UHTTPRequestTemplate>(this);
+	Template->Initialize(this, URL, Verb, Headers, InTimeoutSecs, bAddDefaultHeaders, Priority);
+	return Template;
+}
+
+TSharedRef<IHttpRequest, ESPMode::ThreadSafe> UHTTPHelperSubsystem::CreateHTTP_Native(FString URL, const EMethodByte& Verb, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, float InTimeoutSecs, bool bAddDefaultHeaders)
+{
+	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = FHttpModule::Get().CreateRequest();
+	HttpRequest->SetURL(Params.Num() > 0 ? BuildRequestURL(URL, Params, bEncodeQueryParams) : URL);
+	HttpRequest->SetVerb(MethodByteToString(Verb));
+	ForEachRequestHeader(Verb, Headers, bAddDefaultHeaders, [&HttpRequest](const FString& Key, const FString& Value)
+		{
+			HttpRequest->AppendToHeader(Key, Value);
+		});
+	HttpRequest->SetTimeout(InTimeoutSecs);
+	return HttpRequest;
+}
+
+void UHTTPHelperSubsystem::ForEachRequestHeader(EMethodByte Verb, const TMap<FString, FString>& Headers, bool bAddDefaultHeaders, TFunctionRef<void(const FString&, const FString&)> Visitor) const
+{
+	for (const TPair<FString, FString>& Header : Headers)
+	{
+		Visitor(Header.Key, Header.Value);
+	}
+	if (!bAddDefaultHeaders)
+	{
+		return;
+	}
+	//启用缓存时GET请求不使用默认的Cache-Control: no-cache，由缓存层决定是否需要验证
+	const bool bSkipCacheControl = bEnableResponseCache && Verb == EMethodByte::GET;
+	for (const TPair<FString, FString>& Header : DefaultHeaders)
+	{
+		if (bSkipCacheControl && Header.Key.Equals(TEXT("Cache-Control"), ESearchCase::IgnoreCase))
+		{
+			continue;
+		}
+		if (!Headers.Contains(Header.Key))
+		{
+			Visitor(Header.Key, Header.Value);
+		}
+	}
+}
+
+//RFC 3986中不需要编码的字符
+static bool IsUnreservedUrlChar(uint8 Char)
+{
+	return (Char >= 'A' && Char <= 'Z') || (Char >= 'a' && Char <= 'z') || (Char >= '0' && Char <= '9')
+		|| Char == '-' || Char == '_' || Char == '.' || Char == '~';
+}
+
+static void AppendUrlEncoded(FString& Out, const FString& Value)
+{
+	bool bNeedsEncode = false;
+	for (const TCHAR Char : Value)
+	{
+		if (Char > 0x7F || !IsUnreservedUrlChar((uint8)Char))
+		{
+			bNeedsEncode = true;
+			break;
+		}
+	}
+	if (!bNeedsEncode)
+	{
+		Out.Append(Value);
+		return;
+	}
+	static const TCHAR HexDigits[] = TEXT("0123456789ABCDEF");
+	const FTCHARToUTF8 Utf8(*Value, Value.Len());
+	const uint8* Bytes = (const uint8*)Utf8.Get();
+	for (int32 Index = 0; Index < Utf8.Length(); Index++)
+	{
+		const uint8 Byte = Bytes[Index];
+		if (IsUnreservedUrlChar(Byte))
+		{
+			Out.AppendChar((TCHAR)Byte);
+		}
+		else
+		{
+			Out.AppendChar(TEXT('%'));
+			Out.AppendChar(HexDigits[Byte >> 4]);
+			Out.AppendChar(HexDigits[Byte & 0x0F]);
+		}
+	}
+}
+
+FString UHTTPHelperSubsystem::BuildRequestURL(const FString& URL, const TMap<FString, FString>& Params, bool bEncode)
+{
+	//一次预留所有内容的长度，需要编码的字符较多时才会再次扩容
+	int32 EstimatedLength = URL.Len();
+	for (const TPair<FString, FString>& Param : Params)
+	{
+		EstimatedLength += Param.Key.Len() + Param.Value.Len() + 2;
+	}
+	FString Result;
+	Result.Reserve(EstimatedLength);
+	Result.Append(URL);
+	int32 QueryIndex;
+	bool bHasQuery = URL.FindChar(TEXT('?'), QueryIndex);
+	bool bNeedsSeparator = !bHasQuery || !(URL.EndsWith(TEXT("?")) || URL.EndsWith(TEXT("&")));
+	for (const TPair<FString, FString>& Param : Params)
+	{
+		if (bNeedsSeparator)
+		{
+			Result.AppendChar(bHasQuery ? TEXT('&') : TEXT('?'));
+		}
+		bHasQuery = true;
+		bNeedsSeparator = true;
+		if (bEncode)
+		{
+			AppendUrlEncoded(Result, Param.Key);
+			Result.AppendChar(TEXT('='));
+			AppendUrlEncoded(Result, Param.Value);
+		}
+		else
+		{
+			Result.Append(Param.Key);
+			Result.AppendChar(TEXT('='));
+			Result.Append(Param.Value);
+		}
+	}
+	return Result;
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::CreateHttpRequestObject(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest, uint32 ContentLength, EHttpRequestPriority Priority)
+{
+	UHTTPRequest* HttpRequestObject = PrepareHttpRequestObject(HttpRequest, ContentLength);
+	SubmitHttpRequestObject(HttpRequestObject, Priority);
+	return HttpRequestObject;
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::PrepareHttpRequestObject(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest, uint32 ContentLength)
+{
+	if (ContentLength == 0)
+	{
+		FString Content = FString::FromInt(HttpRequest->GetContent().Num());
+		// cull , char in Content
+		Content.ReplaceInline(TEXT(","), TEXT(""), ESearchCase::CaseSensitive);
+		HttpRequest->SetHeader("Content-Length", Content);
+	}
+	return PrepareHttpRequestObject(HttpRequest);
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::PrepareHttpRequestObject(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest)
+{
+	checkf(IsInGameThread(), TEXT("UHTTPHelperSubsystem can only create request objects on the game thread, use GetNativeRequestQueue() from other threads"));
+	UHTTPRequest* HttpRequestObject = AcquireRequestObject();
+	HttpRequestObject->BindAllDelegate(HttpRequest);
+	HistoryHttpRequests.Add(HttpRequestObject);
+	HttpRequestObject->HTTPHelperSubsystem = this;
+	return HttpRequestObject;
+}
+
+void UHTTPHelperSubsystem::SubmitHttpRequestObject(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority)
+{
+	HttpRequestObject->Timestamps.Submitted = FPlatformTime::Seconds();
+	if (!CompressRequestBody(HttpRequestObject, Priority))
+	{
+		SubmitEncodedRequestObject(HttpRequestObject, Priority);
+	}
+}
+
+bool UHTTPHelperSubsystem::CompressRequestBody(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority)
+{
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = HttpRequestObject->HttpRequest.ToSharedRef();
+	TWeakObjectPtr<UHTTPHelperSubsystem> WeakThis(this);
+	TWeakObjectPtr<UHTTPRequest> WeakRequestObject(HttpRequestObject);
+	return CompressNativeRequestBody(HttpRequest, [WeakThis, WeakRequestObject, HttpRequest, Priority]()
+		{
+			UHTTPHelperSubsystem* This = WeakThis.Get();
+			UHTTPRequest* RequestObject = WeakRequestObject.Get();
+			//压缩期间请求对象可能已经被释放后重新使用
+			if (!This || !RequestObject || RequestObject->HttpRequest != HttpRequest)
+			{
+				return;
+			}
+			This->SubmitEncodedRequestObject(RequestObject, Priority);
+		});
+}
+
+bool UHTTPHelperSubsystem::CompressNativeRequestBody(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest, TFunction<void()>&& OnEncoded)
+{
+	if (!HttpRequest->GetHeader(TEXT("Content-Encoding")).IsEmpty()
+		|| !FHttpBodyCompression::ShouldCompress(CompressionSettings, HttpRequest->GetHeader(TEXT("Content-Type")), HttpRequest->GetContent().Num()))
+	{
+		return false;
+	}
+	TWeakObjectPtr<UHTTPHelperSubsystem> WeakThis(this);
+	//请求还没有发送，后台线程读取内容时不会被修改
+	Async(EAsyncExecution::ThreadPool, [WeakThis, HttpRequest, OnEncoded = MoveTemp(OnEncoded), Encoding = CompressionSettings.Encoding, MaxCompressedRatio = CompressionSettings.MaxCompressedRatio]() mutable
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			const TArray<uint8>& Content = HttpRequest->GetContent();
+			const int64 UncompressedSize = Content.Num();
+			TArray<uint8> Compressed;
+			const bool bCompressed = FHttpBodyCompression::Compress(Encoding, MaxCompressedRatio, Content, Compressed);
+			const double CompressSeconds = FPlatformTime::Seconds() - StartTime;
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, HttpRequest, OnEncoded = MoveTemp(OnEncoded), Encoding, bCompressed, UncompressedSize, CompressSeconds, Compressed = MoveTemp(Compressed)]() mutable
+				{
+					UHTTPHelperSubsystem* This = WeakThis.Get();
+					if (!This)
+					{
+						return;
+					}
+					FHttpCompressionStats& Stats = This->CompressionStats;
+					Stats.TotalCompressSeconds += (float)CompressSeconds;
+					if (bCompressed)
+					{
+						Stats.CompressedRequests++;
+						Stats.UncompressedBytes += UncompressedSize;
+						Stats.CompressedBytes += Compressed.Num();
+						HttpRequest->SetHeader(TEXT("Content-Encoding"), FHttpBodyCompression::GetEncodingName(Encoding));
+						HttpRequest->SetHeader(TEXT("Content-Length"), FString::FromInt(Compressed.Num()));
+						HttpRequest->SetContent(MoveTemp(Compressed));
+					}
+					else
+					{
+						Stats.IneffectiveRequests++;
+					}
+					OnEncoded();
+				});
+		});
+	return true;
+}
+
+void UHTTPHelperSubsystem::SubmitEncodedRequestObject(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority)
+{
+	HttpRequestObject->RequestPriority = Priority;
+	RetryBudget.OnRequestSubmitted();
+	if (bEnableResponseCache && !HttpRequestObject->bDownloadToFile && HttpRequestObject->HttpRequest->GetVerb() == TEXT("GET"))
+	{
+		const FString CacheKey = FHttpResponseCache::MakeKey(*HttpRequestObject->HttpRequest);
+		HttpRequestObject->CacheKey = CacheKey;
+		TWeakObjectPtr<UHTTPHelperSubsystem> WeakThis(this);
+		TWeakObjectPtr<UHTTPRequest> WeakRequestObject(HttpRequestObject);
+		GetResponseCache().Find(CacheKey, [WeakThis, WeakRequestObject, Priority](FHttpCacheEntryPtr Entry)
+			{
+				UHTTPHelperSubsystem* This = WeakThis.Get();
+				UHTTPRequest* RequestObject = WeakRequestObject.Get();
+				if (!This || !RequestObject || !RequestObject->HttpRequest.IsValid())
+				{
+					return;
+				}
+				if (Entry.IsValid() && Entry->IsFresh())
+				{
+					This->GetResponseCache().RecordHit(*Entry);
+					//下一帧再完成，保证调用者有机会绑定委托
+					AsyncTask(ENamedThreads::GameThread, [WeakRequestObject, Entry]()
+						{
+							if (UHTTPRequest* CachedRequestObject = WeakRequestObject.Get())
+							{
+								CachedRequestObject->CompleteFromCache(Entry);
+							}
+						});
+					return;
+				}
+				This->GetResponseCache().RecordMiss();
+				if (Entry.IsValid() && Entry->HasValidator())
+				{
+					FHttpResponseCache::AddConditionalHeaders(*RequestObject->HttpRequest, *Entry);
+					RequestObject->CachedEntry = Entry;
+				}
+				This->EnqueueHttpRequestObject(RequestObject, Priority);
+			});
+		return;
+	}
+	EnqueueHttpRequestObject(HttpRequestObject, Priority);
+}
+
+void UHTTPHelperSubsystem::EnqueueHttpRequestObject(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority)
+{
+	const FString Verb = HttpRequestObject->HttpRequest->GetVerb();
+	if (bCoalesceIdenticalRequests && !HttpRequestObject->bDownloadToFile && (Verb == TEXT("GET") || Verb == TEXT("HEAD")) && HttpRequestObject->HttpRequest->GetContent().Num() == 0)
+	{
+		const FString CoalesceKey = MakeCoalesceKey(*HttpRequestObject->HttpRequest);
+		UHTTPRequest* Leader = CoalesceKey.IsEmpty() ? nullptr : CoalescedRequests.FindRef(CoalesceKey).Get();
+		if (Leader && Leader != HttpRequestObject && Leader->HttpRequest.IsValid())
+		{
+			Leader->AddCoalescedFollower(HttpRequestObject);
+			TotalCoalescedRequests++;
+			//按合并的请求中最高的优先级发送，还在排队时移到对应的队列
+			if ((int32)Priority < (int32)Leader->RequestPriority)
+			{
+				Leader->RequestPriority = Priority;
+				Scheduler.RaisePriority(Leader->HttpRequest, Priority);
+				Scheduler.Pump(SchedulerSettings);
+			}
+			return;
+		}
+		if (!CoalesceKey.IsEmpty())
+		{
+			CoalescedRequests.Add(CoalesceKey, HttpRequestObject);
+			HttpRequestObject->CoalesceKey = CoalesceKey;
+		}
+	}
+	DispatchHttpRequestObject(HttpRequestObject, Priority);
+}
+
+void UHTTPHelperSubsystem::DispatchHttpRequestObject(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority)
+{
+	TWeakObjectPtr<UHTTPRequest> WeakRequestObject(HttpRequestObject);
+	HttpRequestObject->Timestamps.MarkQueued();
+	EnqueueRequest(HttpRequestObject->HttpRequest.ToSharedRef(), Priority, [WeakRequestObject]()
+		{
+			//下一帧再通知失败，保证调用者有机会绑定委托
+			AsyncTask(ENamedThreads::GameThread, [WeakRequestObject]()
+				{
+					if (UHTTPRequest* RequestObject = WeakRequestObject.Get())
+					{
+						RequestObject->OnDispatchFailed();
+					}
+				});
+		},
+		[WeakRequestObject]()
+		{
+			if (UHTTPRequest* RequestObject = WeakRequestObject.Get())
+			{
+				RequestObject->Timestamps.Dispatched = FPlatformTime::Seconds();
+				if ((RequestObject->SendCounter.IsValid() || RequestObject->DownloadStream.IsValid()) && RequestObject->HTTPHelperSubsystem)
+				{
+					//流式的请求体和下载到文件的响应体按经过流的字节计入带宽
+					TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe> ReceiveCounter;
+					if (RequestObject->DownloadStream.IsValid())
+					{
+						ReceiveCounter = RequestObject->DownloadStream->GetReceiveCounter();
+					}
+					RequestObject->HTTPHelperSubsystem->SetTransferCounters(RequestObject->HttpRequest, RequestObject->SendCounter, ReceiveCounter);
+				}
+			}
+		});
+}
+
+const FHttpRetryPolicy& UHTTPHelperSubsystem::GetRetryPolicy(const UHTTPRequest* RequestObject) const
+{
+	if (RequestObject->RetryPolicyOverride.IsSet())
+	{
+		return RequestObject->RetryPolicyOverride.GetValue();
+	}
+	if (HostRetryPolicies.Num() > 0 && RequestObject->HttpRequest.IsValid())
+	{
+		if (const FHttpRetryPolicy* HostPolicy = HostRetryPolicies.Find(FPlatformHttp::GetUrlDomain(RequestObject->HttpRequest->GetURL())))
+		{
+			return *HostPolicy;
+		}
+	}
+	return DefaultRetryPolicy;
+}
+
+float UHTTPHelperSubsystem::EvaluateRetry(const FHttpRetryPolicy& Policy, const IHttpRequest& Request, const FHttpResponsePtr& Response, bool bWasSuccessful, int32 Attempt)
+{
+	const FString Host = FPlatformHttp::GetUrlDomain(Request.GetURL());
+	//没有响应或者服务器错误计入断路器
+	const bool bServerFailed = !bWasSuccessful || !Response.IsValid() || Response->GetResponseCode() >= 500;
+	RetryBudget.OnRequestResult(Host, bServerFailed);
+
+	float Delay = -1.f;
+	if (Policy.ShouldRetry(Request, Response, bWasSuccessful, Attempt))
+	{
+		Delay = Policy.GetRetryDelay(Response, Attempt);
+		if (Delay >= 0.f && !RetryBudget.TryConsumeRetry(Host))
+		{
+			Delay = -1.f;
+		}
+	}
+	return Delay;
+}
+
+bool UHTTPHelperSubsystem::TryScheduleRetry(UHTTPRequest* RequestObject, const FHttpResponsePtr& Response, bool bWasSuccessful)
+{
+	if (!RequestObject->HttpRequest.IsValid())
+	{
+		return false;
+	}
+	const int32 Attempt = RequestObject->RetryCount;
+	const float Delay = EvaluateRetry(GetRetryPolicy(RequestObject), *RequestObject->HttpRequest, Response, bWasSuccessful, Attempt);
+	if (Delay < 0.f)
+	{
+		if (Attempt > 0)
+		{
+			const bool bRecovered = bWasSuccessful && Response.IsValid() && EHttpResponseCodes::IsOk(Response->GetResponseCode());
+			if (bRecovered)
+			{
+				RetryBudget.RecordRecovered();
+			}
+			else
+			{
+				RetryBudget.RecordExhausted();
+			}
+		}
+		return false;
+	}
+	RequestObject->RetryCount++;
+	PendingRetries.Add(FPendingRetry{ RequestObject, FPlatformTime::Seconds() + Delay });
+	RequestObject->OnRequestWillRetry.ExecuteIfBound(Delay);
+	for (UHTTPRequest* Follower : RequestObject->GetCoalescedFollowers())
+	{
+		Follower->OnRequestWillRetry.ExecuteIfBound(Delay);
+	}
+	return true;
+}
+
+void UHTTPHelperSubsystem::ProcessPendingRetries()
+{
+	if (PendingRetries.Num() == 0)
+	{
+		return;
+	}
+	const double Now = FPlatformTime::Seconds();
+	for (int32 Index = 0; Index < PendingRetries.Num();)
+	{
+		if (PendingRetries[Index].RetryTime > Now)
+		{
+			Index++;
+			continue;
+		}
+		UHTTPRequest* RequestObject = PendingRetries[Index].RequestObject.Get();
+		PendingRetries.RemoveAtSwap(Index);
+		if (RequestObject && RequestObject->HttpRequest.IsValid())
+		{
+			//重新发送同一个IHttpRequest，委托仍然绑定在请求对象上
+			DispatchHttpRequestObject(RequestObject, RequestObject->RequestPriority);
+		}
+	}
+}
+
+FHttpRetryStats UHTTPHelperSubsystem::GetRetryStats() const
+{
+	return RetryBudget.GetStats();
+}
+
+bool UHTTPHelperSubsystem::IsHostCircuitOpen(const FString& Host) const
+{
+	return RetryBudget.IsCircuitOpen(Host);
+}
+
+FHttpResponseCache& UHTTPHelperSubsystem::GetResponseCache()
+{
+	if (!ResponseCache.IsValid())
+	{
+		ResponseCache = MakeShared<FHttpResponseCache, ESPMode::ThreadSafe>();
+		ResponseCache->SetSettings(CacheSettings);
+	}
+	return *ResponseCache;
+}
+
+FHttpCacheStats UHTTPHelperSubsystem::GetCacheStats() const
+{
+	return ResponseCache.IsValid() ? ResponseCache->GetStats() : FHttpCacheStats();
+}
+
+void UHTTPHelperSubsystem::ClearResponseCache()
+{
+	GetResponseCache().Clear();
+}
+
+void UHTTPHelperSubsystem::EnqueueRequest(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest, EHttpRequestPriority Priority, TFunction<void()>&& OnDispatchFailed, TFunction<void()>&& OnDispatched)
+{
+	Scheduler.Enqueue(HttpRequest, Priority, MoveTemp(OnDispatchFailed), MoveTemp(OnDispatched));
+	Scheduler.Pump(SchedulerSettings);
+}
+
+void UHTTPHelperSubsystem::NotifyRequestFinished(const FHttpRequestPtr& HttpRequest)
+{
+	Scheduler.NotifyFinished(HttpRequest, SchedulerSettings);
+	Scheduler.Pump(SchedulerSettings);
+}
+
+bool UHTTPHelperSubsystem::ShouldDeferCompletion(const UHTTPRequest* RequestObject)
+{
+	if ((RequestObject && RequestObject->RequestPriority == EHttpRequestPriority::Critical) || !FHttpCompletionBudget::IsEnabled(CompletionBudgetSettings))
 	{
-		FileContent = InFileContent;
+		return false;
 	}
+	//已经有推迟的完成时排在后面，保持完成的顺序
+	return DeferredCompletions.Num() > 0 || !CompletionBudget.HasBudget(CompletionBudgetSettings);
 }
 
-bool FHttpRequestFileWapper::CheckValid() const
+bool UHTTPHelperSubsystem::DeferCompletion(UHTTPRequest* RequestObject, TFunction<void(UHTTPRequest*)>& Continuation)
 {
-	if(FilePath.IsEmpty() && bIsFile)
+	if (!ShouldDeferCompletion(RequestObject))
 	{
 		return false;
 	}
-	if(FileContent.Num() == 0)
+	FDeferredCompletion& Completion = DeferredCompletions.AddDefaulted_GetRef();
+	Completion.RequestObject = RequestObject;
+	Completion.Continuation = MoveTemp(Continuation);
+	++TotalDeferredCompletions;
+	return true;
+}
+
+bool UHTTPHelperSubsystem::DeferCompletion(UHTTPRequest* RequestObject, const FHttpRequestPtr& Request, const FHttpResponsePtr& Response, bool bWasSuccessful)
+{
+	if (!ShouldDeferCompletion(RequestObject))
 	{
 		return false;
 	}
+	FDeferredCompletion& Completion = DeferredCompletions.AddDefaulted_GetRef();
+	Completion.RequestObject = RequestObject;
+	Completion.Request = Request;
+	Completion.Response = Response;
+	Completion.bWasSuccessful = bWasSuccessful;
+	++TotalDeferredCompletions;
 	return true;
 }
 
-bool FHttpRequestFileWapper::LoadFile()
+void UHTTPHelperSubsystem::ProcessDeferredCompletions()
 {
-	if (FilePath.Len()>2)
+	const bool bBudgetEnabled = FHttpCompletionBudget::IsEnabled(CompletionBudgetSettings);
+	bool bFirst = true;
+	while (DeferredCompletions.Num() > 0)
 	{
-		if (FFileHelper::LoadFileToArray(FileContent, *FilePath))
+		if (!bFirst && bBudgetEnabled && !CompletionBudget.HasBudget(CompletionBudgetSettings))
 		{
-			bIsFile = true;
-			FileName = FPaths::GetCleanFilename(FilePath);
-			return true;
+			break;
+		}
+		bFirst = false;
+		//完成委托中可能释放其他请求，先从队列中取出
+		FDeferredCompletion Completion = MoveTemp(DeferredCompletions[0]);
+		DeferredCompletions.RemoveAt(0);
+		if (Completion.Continuation)
+		{
+			//请求对象已经释放时仍然要分发给合并的请求
+			Completion.Continuation(Completion.RequestObject.Get());
+		}
+		else if (UHTTPRequest* RequestObject = Completion.RequestObject.Get())
+		{
+			RequestObject->ProcessCompletion(Completion.Request, Completion.Response, Completion.bWasSuccessful);
 		}
 	}
-	bIsFile = false;
-	
-	return false;
 }
 
-UHTTPRequest* UHTTPHelperSubsystem::CallHTTP(FString URL, EMethodByte Verb, TMap<FString, FString> Headers, TMap<FString, FString> Params, FString Content, float InTimeoutSecs, bool bAddDefaultHeaders)
+void UHTTPHelperSubsystem::ProcessNativeRequests()
 {
-	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL,Verb,Headers,Params,InTimeoutSecs,bAddDefaultHeaders);
-	HttpRequest->SetContentAsString(Content);
-	return CreateHttpRequestObject(HttpRequest);
+	if (!NativeRequestQueue.IsValid())
+	{
+		return;
+	}
+	FHttpNativeRequestQueue::FSubmission Submission;
+	while (NativeRequestQueue->Dequeue(Submission))
+	{
+		SendNativeRequest(MoveTemp(Submission.Request), MoveTemp(Submission.OnComplete));
+	}
 }
 
-UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAndUploadFile(FString URL, EMethodByte Verb, TMap<FString, FString> Headers, TMap<FString, FString> Params, FString FilePath, float InTimeoutSecs,bool bAddDefaultHeaders)
+void UHTTPHelperSubsystem::SendNativeRequest(FHttpNativeRequest&& Request, FHttpNativeRequestCallback&& OnComplete)
 {
-	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL, Verb, Headers, Params, InTimeoutSecs, bAddDefaultHeaders);
-	HttpRequest->SetContentAsStreamedFile(FilePath);
-	return CreateHttpRequestObject(HttpRequest,-1);
+	const EHttpCompletionThread CompletionThread = Request.CompletionThread;
+	if (Request.URL.IsEmpty())
+	{
+		FHttpNativeRequestQueue::Deliver(CompletionThread, OnComplete, FHttpNativeResponse());
+		return;
+	}
+	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = FHttpModule::Get().CreateRequest();
+	HttpRequest->SetURL(Request.Params.Num() > 0 ? BuildRequestURL(Request.URL, Request.Params, bEncodeQueryParams) : Request.URL);
+	HttpRequest->SetVerb(Request.Verb);
+	//Verb只用于决定GET请求是否跳过默认的Cache-Control
+	const EMethodByte HeaderVerb = Request.Verb.Equals(TEXT("GET"), ESearchCase::IgnoreCase) ? EMethodByte::GET : EMethodByte::POST;
+	ForEachRequestHeader(HeaderVerb, Request.Headers, Request.bAddDefaultHeaders, [&HttpRequest](const FString& Key, const FString& Value)
+		{
+			HttpRequest->AppendToHeader(Key, Value);
+		});
+	HttpRequest->SetTimeout(Request.TimeoutSecs);
+	if (Request.Content.Num() > 0)
+	{
+		HttpRequest->SetHeader(TEXT("Content-Length"), FString::FromInt(Request.Content.Num()));
+		HttpRequest->SetContent(MoveTemp(Request.Content));
+	}
+
+	if (CompletionThread != EHttpCompletionThread::GameThread)
+	{
+		//不需要回到游戏线程时，复制响应内容也在HTTP线程进行
+		SimpleHttpCompleteOnHttpThread(*HttpRequest);
+	}
+	TWeakObjectPtr<UHTTPHelperSubsystem> WeakThis(this);
+	HttpRequest->OnProcessRequestComplete().BindLambda([WeakThis, CompletionThread, OnComplete](FHttpRequestPtr InRequest, FHttpResponsePtr InResponse, bool bWasSuccessful)
+		{
+			auto ReleaseRequest = [WeakThis, InRequest]()
+			{
+				if (UHTTPHelperSubsystem* This = WeakThis.Get())
+				{
+					This->ActiveNativeRequests.Remove(InRequest);
+					This->NotifyRequestFinished(InRequest);
+				}
+			};
+			if (IsInGameThread())
+			{
+				ReleaseRequest();
+			}
+			else
+			{
+				AsyncTask(ENamedThreads::GameThread, MoveTemp(ReleaseRequest));
+			}
+			FHttpNativeResponse Response;
+			if (bWasSuccessful && InResponse.IsValid())
+			{
+				Response.ResponseCode = InResponse->GetResponseCode();
+				Response.bSuccess = EHttpResponseCodes::IsOk(Response.ResponseCode);
+				Response.Content = InResponse->GetContent();
+				Response.Headers = InResponse->GetAllHeaders();
+				Response.ContentType = InResponse->GetContentType();
+			}
+			FHttpNativeRequestQueue::Deliver(CompletionThread, OnComplete, MoveTemp(Response));
+		});
+	ActiveNativeRequests.Add(HttpRequest);
+	TWeakPtr<IHttpRequest, ESPMode::ThreadSafe> WeakRequest(HttpRequest);
+	EnqueueRequest(HttpRequest, Request.Priority, [WeakRequest]()
+		{
+			if (const TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> FailedRequest = WeakRequest.Pin())
+			{
+				//避免之后再次收到完成事件
+				const FHttpRequestCompleteDelegate OnRequestComplete = FailedRequest->OnProcessRequestComplete();
+				FailedRequest->OnProcessRequestComplete().Unbind();
+				OnRequestComplete.ExecuteIfBound(FailedRequest, nullptr, false);
+			}
+		});
 }
 
-UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAsBinary(FString URL, EMethodByte Verb, TMap<FString, FString> Headers, TMap<FString, FString> Params, TArray<uint8> Content, int32 ContentLength, float InTimeoutSecs,bool bAddDefaultHeaders)
+void UHTTPHelperSubsystem::SetTransferCounters(const FHttpRequestPtr& HttpRequest, const TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe>& SendCounter, const TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe>& ReceiveCounter)
 {
-	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateHTTP_Native(URL, Verb, Headers, Params, InTimeoutSecs, bAddDefaultHeaders);
-	HttpRequest->SetContent(Content);
-	return CreateHttpRequestObject(HttpRequest,ContentLength);
+	Scheduler.SetTransferCounters(HttpRequest, SendCounter, ReceiveCounter);
 }
 
-UHTTPRequest* UHTTPHelperSubsystem::CallHTTPAsFiles(FString URL, TMap<FString, FString> Headers, TMap<FString, FString> Params, TArray<FHttpRequestFileCreator>& Files, EMethodByte Verb,float InTimeoutSecs, bool bAddDefaultHeaders)
+void UHTTPHelperSubsystem::ReportTransferredBytes(const FHttpRequestPtr& HttpRequest, int64 BytesSent, int64 BytesReceived)
 {
-	if (Files.Num() == 0)
-	{
-		return nullptr;
-	}
-	TArray< FHttpRequestFileWapperBase*> FileWapper;
-	for (int i=0;i<Files.Num();i++)
+	Scheduler.AddTransferredBytes(HttpRequest, BytesSent, BytesReceived, SchedulerSettings);
+}
+
+bool UHTTPHelperSubsystem::RemoveQueuedRequest(const FHttpRequestPtr& HttpRequest)
+{
+	return Scheduler.Remove(HttpRequest);
+}
+
+FString UHTTPHelperSubsystem::MakeCoalesceKey(const IHttpRequest& Request)
+{
+	//条件请求和部分内容的响应取决于调用者自己的状态，不能共享
+	static const TCHAR* ExcludedHeaders[] = {
+		TEXT("Range"),
+		TEXT("If-Range"),
+		TEXT("If-Match"),
+		TEXT("If-None-Match"),
+		TEXT("If-Modified-Since"),
+		TEXT("If-Unmodified-Since"),
+	};
+	for (const TCHAR* HeaderName : ExcludedHeaders)
 	{
-		if (Files[i].GenerateFileWapper().IsValid())
+		if (!Request.GetHeader(HeaderName).IsEmpty())
 		{
-			FileWapper.Add(Files[i].GetCreateWapper().Get());
+			return FString();
 		}
 	}
-	TMap<FString, FString> LocalHeader;
-	TArray<uint8> Content;
-	int32 ContentLength = 0;
-	if (CreateFileContentAndHeadersForFromData(FileWapper, LocalHeader, Content, ContentLength))
+	//任何请求头不同时服务器都可能返回不同的内容，排序后与添加的顺序无关
+	TArray<FString> AllHeaders = Request.GetAllHeaders();
+	AllHeaders.Sort();
+	FString Key = Request.GetVerb() + TEXT(" ") + Request.GetURL();
+	for (const FString& Header : AllHeaders)
+	{
+		Key += TEXT("\n");
+		Key += Header;
+	}
+	return Key;
+}
+
+void UHTTPHelperSubsystem::RemoveCoalescedRequest(UHTTPRequest* Leader)
+{
+	const TWeakObjectPtr<UHTTPRequest>* Found = CoalescedRequests.Find(Leader->CoalesceKey);
+	if (Found && (!Found->IsValid() || Found->Get() == Leader))
+	{
+		CoalescedRequests.Remove(Leader->CoalesceKey);
+	}
+	Leader->CoalesceKey.Empty();
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::HandOverCoalescedRequest(UHTTPRequest* Leader)
+{
+	UHTTPRequest* NewLeader = nullptr;
+	TArray<UHTTPRequest*> Followers = MoveTemp(Leader->CoalescedFollowers);
+	Leader->CoalescedFollowers.Reset();
+	for (UHTTPRequest* Follower : Followers)
 	{
-		for (auto it : Headers)
+		if (!IsValid(Follower))
+		{
+			continue;
+		}
+		if (!NewLeader)
 		{
-			if (FString* FindedValue = LocalHeader.Find(it.Key))
+			NewLeader = Follower;
+			NewLeader->CoalesceLeader.Reset();
+			//重新绑定IHttpRequest的委托到新的主请求
+			NewLeader->BindAllDelegate(Leader->HttpRequest.ToSharedRef());
+			NewLeader->CoalesceKey = Leader->CoalesceKey;
+			if (!NewLeader->CoalesceKey.IsEmpty())
 			{
-				continue;
+				CoalescedRequests.Add(NewLeader->CoalesceKey, NewLeader);
 			}
-			else
+		}
+		else
+		{
+			Follower->CoalesceLeader = NewLeader;
+			NewLeader->CoalescedFollowers.Add(Follower);
+		}
+	}
+	if (!NewLeader && !Leader->CoalesceKey.IsEmpty())
+	{
+		RemoveCoalescedRequest(Leader);
+	}
+	Leader->CoalesceKey.Empty();
+	return NewLeader;
+}
+
+UHTTPRequest* UHTTPHelperSubsystem::AcquireRequestObject()
+{
+	if (RequestObjectPool.Num() > 0)
+	{
+		UHTTPRequest* RequestObject = RequestObjectPool.Pop();
+		if (IsValid(RequestObject))
+		{
+			return RequestObject;
+		}
+	}
+	return NewObject<UHTTPRequest>(this);
+}
+
+void UHTTPHelperSubsystem::OnRequestObjectCompleted(UHTTPRequest* RequestObject)
+{
+	//完成委托仍在IHttpRequest的回调中执行，推迟到Tick中再释放
+	CompletedRequestObjects.AddUnique(RequestObject);
+}
+
+void UHTTPHelperSubsystem::TouchRequestObject(UHTTPRequest* RequestObject)
+{
+	if (RetainedRequestObjects.Remove(RequestObject) > 0)
+	{
+		RetainedRequestObjects.Add(RequestObject);
+	}
+}
+
+void UHTTPHelperSubsystem::ForgetRequestObject(UHTTPRequest* RequestObject)
+{
+	HistoryHttpRequests.Remove(RequestObject);
+	CompletedRequestObjects.Remove(RequestObject);
+	RetainedRequestObjects.Remove(RequestObject);
+	PendingRetries.RemoveAll([RequestObject](const FPendingRetry& PendingRetry) { return PendingRetry.RequestObject == RequestObject; });
+	//对象可能被对象池复用，不能留下推迟的完成
+	FDeferredCompletion* Deferred = DeferredCompletions.FindByPredicate([RequestObject](const FDeferredCompletion& Completion) { return Completion.RequestObject == RequestObject; });
+	if (Deferred && Deferred->Continuation)
+	{
+		//合并的请求已经交给了后台转换的结果，只是不再分发给这个对象
+		Deferred->RequestObject.Reset();
+		Deferred = nullptr;
+	}
+	if (UHTTPRequest* Leader = RequestObject->CoalesceLeader.Get())
+	{
+		//合并的请求共享主请求的IHttpRequest，不能取消
+		Leader->CoalescedFollowers.Remove(RequestObject);
+		RequestObject->CoalesceLeader.Reset();
+		return;
+	}
+	if (RequestObject->CoalescedFollowers.Num() > 0)
+	{
+		if (UHTTPRequest* NewLeader = HandOverCoalescedRequest(RequestObject))
+		{
+			if (Deferred)
 			{
-				LocalHeader.Add(it.Key, it.Value);
+				//响应已经到达，由新的主请求分发给剩下的请求
+				Deferred->RequestObject = NewLeader;
 			}
+			return;
 		}
-		return CallHTTPAsBinary(URL, Verb, LocalHeader, Params, Content, ContentLength, InTimeoutSecs, bAddDefaultHeaders);
 	}
-	return nullptr;
+	else if (!RequestObject->CoalesceKey.IsEmpty())
+	{
+		RemoveCoalescedRequest(RequestObject);
+	}
+	if (Deferred)
+	{
+		DeferredCompletions.RemoveAt(Deferred - DeferredCompletions.GetData());
+	}
+	if (RequestObject->HttpRequest.IsValid())
+	{
+		RemoveQueuedRequest(RequestObject->HttpRequest);
+	}
 }
 
-TSharedRef<IHttpRequest, ESPMode::ThreadSafe> UHTTPHelperSubsystem::CreateHTTP_Native(FString URL, const EMethodByte& Verb, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, float InTimeoutSecs, bool bAddDefaultHeaders)
+void UHTTPHelperSubsystem::ProcessCompletedRequestObjects()
 {
-	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = FHttpModule::Get().CreateRequest();
-	int ParamsCount = 0;
-	for (auto Param : Params)
+	if (CompletedRequestObjects.Num() == 0)
+	{
+		return;
+	}
+	TArray<UHTTPRequest*> Completed = MoveTemp(CompletedRequestObjects);
+	CompletedRequestObjects.Reset();
+	for (UHTTPRequest* RequestObject : Completed)
 	{
-		if (ParamsCount == 0)
+		//在委托中调用了FreeRequest
+		if (!IsValid(RequestObject) || !HistoryHttpRequests.Contains(RequestObject))
+		{
+			continue;
+		}
+		if (RequestObject->IsPinned() || !bAutoReleaseCompletedRequests)
 		{
-			URL = URL + "?";
+			RetainedRequestObjects.Remove(RequestObject);
+			RetainedRequestObjects.Add(RequestObject);
 		}
 		else
 		{
-			URL = URL + "&";
+			ReleaseRequestObject(RequestObject, true);
 		}
-		URL = URL + Param.Key + "=" + Param.Value;
-		ParamsCount++;
 	}
-	HttpRequest->SetURL(URL);
-	HttpRequest->SetVerb(MethodByteToString(Verb));
-	for (auto Header : Headers)
+	if (MaxRetainedRequests > 0)
+	{
+		while (RetainedRequestObjects.Num() > MaxRetainedRequests)
+		{
+			//被淘汰的请求可能仍被调用者持有，不放回对象池
+			ReleaseRequestObject(RetainedRequestObjects[0], false);
+		}
+	}
+}
+
+void UHTTPHelperSubsystem::ReleaseRequestObject(UHTTPRequest* RequestObject, bool bReturnToPool)
+{
+	HistoryHttpRequests.Remove(RequestObject);
+	RetainedRequestObjects.Remove(RequestObject);
+	if (!IsValid(RequestObject))
+	{
+		return;
+	}
+	RequestObject->ResetForReuse();
+	if (bReturnToPool && RequestObjectPool.Num() < MaxPooledRequestObjects)
+	{
+		RequestObjectPool.Add(RequestObject);
+	}
+}
+
+FHttpSchedulerStats UHTTPHelperSubsystem::GetSchedulerStats() const
+{
+	return Scheduler.GetStats();
+}
+
+FHttpFileLoadStats UHTTPHelperSubsystem::GetFileLoadStats() const
+{
+	return FileLoadStats;
+}
+
+FHttpCompressionStats UHTTPHelperSubsystem::GetCompressionStats() const
+{
+	return CompressionStats;
+}
+
+TArray<FHttpHostMetrics> UHTTPHelperSubsystem::GetRequestMetrics() const
+{
+	return RequestMetrics.GetSnapshot();
+}
+
+void UHTTPHelperSubsystem::ResetRequestMetrics()
+{
+	RequestMetrics.Reset();
+}
+
+void UHTTPHelperSubsystem::RecordRequestTiming(const FHttpRequestTiming& Timing)
+{
+	if (bCollectRequestMetrics)
+	{
+		RequestMetrics.SetMaxHosts(MaxMetricsHosts);
+		RequestMetrics.Record(Timing);
+	}
+}
+
+void UHTTPHelperSubsystem::RecordCompletionCycles(uint32 Cycles)
+{
+	CompletionBudget.Consume(Cycles);
+	if (bCollectRequestMetrics)
+	{
+		RequestMetrics.AddCompletionCycles(Cycles);
+	}
+}
+
+void UHTTPHelperSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	NativeRequestQueue = MakeShared<FHttpNativeRequestQueue, ESPMode::ThreadSafe>();
+	TickHandle = FSimpleHttpTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UHTTPHelperSubsystem::Tick));
+}
+
+void UHTTPHelperSubsystem::Deinitialize()
+{
+	FSimpleHttpTicker::GetCoreTicker().RemoveTicker(TickHandle);
+	for (UHTTPRequestBatch* Batch : TArray<UHTTPRequestBatch*>(ActiveBatches))
+	{
+		Batch->Cancel();
+	}
+	ActiveBatches.Empty();
+	for (UHTTPSegmentedDownload* Download : TArray<UHTTPSegmentedDownload*>(ActiveSegmentedDownloads))
+	{
+		Download->Cancel();
+	}
+	ActiveSegmentedDownloads.Empty();
+	for (UHTTPStreamRequest* StreamRequest : TArray<UHTTPStreamRequest*>(ActiveStreamRequests))
 	{
-		HttpRequest->AppendToHeader(Header.Key, Header.Value);
+		StreamRequest->Cancel();
 	}
-	if (bAddDefaultHeaders)
+	ActiveStreamRequests.Empty();
+	for (UHTTPChunkedUpload* Upload : TArray<UHTTPChunkedUpload*>(ActiveChunkedUploads))
 	{
-		for(auto Header : DefaultHeaders)
+		Upload->Cancel();
+	}
+	ActiveChunkedUploads.Empty();
+	ActiveBenchmarks.Empty();
+	if (NativeRequestQueue.IsValid())
+	{
+		NativeRequestQueue->Close();
+		NativeRequestQueue.Reset();
+	}
+	//还在排队的请求不会再发送，直接以失败完成
+	for (const FHttpRequestPtr& Request : TSet<FHttpRequestPtr>(ActiveNativeRequests))
+	{
+		if (Scheduler.Remove(Request))
 		{
-			if (!Headers.Contains(Header.Key))
-			{
-				HttpRequest->AppendToHeader(Header.Key, Header.Value);
-			}
+			Request->OnProcessRequestComplete().ExecuteIfBound(Request, nullptr, false);
 		}
-
 	}
-	HttpRequest->SetTimeout(InTimeoutSecs);
-	return HttpRequest;
+	ActiveNativeRequests.Empty();
+	Scheduler.Reset();
+	PendingRetries.Empty();
+	DeferredCompletions.Empty();
+	CoalescedRequests.Empty();
+	CompletedRequestObjects.Empty();
+	RetainedRequestObjects.Empty();
+	RequestObjectPool.Empty();
+	ResponseCache.Reset();
+	Super::Deinitialize();
 }
 
-UHTTPRequest* UHTTPHelperSubsystem::CreateHttpRequestObject(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest, uint32 ContentLength)
+bool UHTTPHelperSubsystem::Tick(float DeltaTime)
 {
-	if (ContentLength == 0)
+	if (ResponseCache.IsValid())
 	{
-		FString Content = FString::FromInt(HttpRequest->GetContent().Num());
-		// cull , char in Content
-		Content.ReplaceInline(TEXT(","), TEXT(""), ESearchCase::CaseSensitive);
-		HttpRequest->SetHeader("Content-Length", Content);
+		ResponseCache->SetSettings(CacheSettings);
 	}
-	if (HttpRequest->ProcessRequest())
+	RetryBudget.SetSettings(RetryBudgetSettings);
+	ProcessDeferredCompletions();
+	ProcessCompletedRequestObjects();
+	ProcessNativeRequests();
+	ProcessPendingRetries();
+	Scheduler.Tick(SchedulerSettings);
+	if (bCollectRequestMetrics)
 	{
-		UHTTPRequest* HttpRequestObject = NewObject<UHTTPRequest>();
-		HttpRequestObject->BindAllDelegate(HttpRequest);
-		HistoryHttpRequests.Add(HttpRequestObject);
-		HttpRequestObject->HTTPHelperSubsystem = this;
-		return HttpRequestObject;
+		RequestMetrics.UpdateSchedulerStats(Scheduler.GetStats());
 	}
-	return nullptr;
+	return true;
 }
 
 bool UHTTPHelperSubsystem::CreateFileContentAndHeadersForFromData(const TArray<FHttpRequestFileWapperBase*>& FileWappers,
@@ -188,29 +1488,39 @@ bool UHTTPHelperSubsystem::CreateFileContentAndHeadersForFromData(const TArray<F
 	{
 		return false; 
 	}
-	FString Boundary = "----" + FString(TEXT("WebKitFormBoundary"))+ FString::FromInt(FMath::Abs( FDateTime::Now().GetMillisecond()))+ FGuid::NewGuid().ToString();
+	FString Boundary = MakeFormDataBoundary();
 	Headers.Add("Content-Type", TEXT("multipart/form-data; boundary=" + Boundary));
 	FString BoundaryLine = "\r\n--" + Boundary + "\r\n";
+	int64 ReserveSize = 0;
+	for (const auto& FileWapper : FileWappers)
+	{
+		//头部按1KB估算
+		ReserveSize += FileWapper->GetContentView().Num() + BoundaryLine.Len() + 1024;
+	}
+	if (ReserveSize >= MAX_int32)
+	{
+		return false;
+	}
+	Content.Reserve(Content.Num() + (int32)ReserveSize);
 	for (const auto& FileWapper : FileWappers)
 	{
 		if (!FileWapper->CheckValid())
 		{
 			return false;
 		}
+		const TArrayView64<const uint8> FileContent = FileWapper->GetContentView();
 		Content.Append((uint8*)TCHAR_TO_ANSI(*BoundaryLine), BoundaryLine.Len());
-		ContentLength += FileWapper->FileContent.Num();
-		FString FileHeader = "Content-Disposition: form-data;name=\"" + FileWapper->KeyName + "\"";
+		ContentLength += FileContent.Num();
+		FString FilePath;
 		//check if it is a file not string 
 		if(FileWapper->bIsFile)
 		{
-			const FHttpRequestFileWapper* LocalFileWapper = (FHttpRequestFileWapper *)(FileWapper);
-			FileHeader.Append(";");
-			FileHeader.Append("filename=\"" + FPaths::GetCleanFilename(LocalFileWapper->FilePath) + "\"\r\n");
-			FileHeader.Append("Content-Type: "+ GetFileContentType(LocalFileWapper->FilePath) + "\r\n\r\n");
+			FilePath = ((FHttpRequestFileWapper *)(FileWapper))->FilePath;
 		}
+		const FString FileHeader = MakeFormDataPartHeader(FileWapper->KeyName, FilePath, FileWapper->bIsFile);
 		const FTCHARToUTF8  FileHeaderChar = FTCHARToUTF8(*FileHeader);
 		Content.Append((uint8*)FileHeaderChar.Get(), FileHeaderChar.Length());
-		Content.Append(FileWapper->FileContent);
+		Content.Append(FileContent.GetData(), (int32)FileContent.Num());
 		FString FileEndLine = TEXT("\r\n");
 		Content.Append((uint8*)TCHAR_TO_ANSI(*FileEndLine), FileEndLine.Len());
 	}
@@ -226,6 +1536,112 @@ bool UHTTPHelperSubsystem::CreateFileContentAndHeadersForFromData(const TArray<F
 	return true;
 }
 
+TSharedPtr<FHttpMultipartFormDataStream, ESPMode::ThreadSafe> UHTTPHelperSubsystem::CreateFileStreamAndHeadersForFromData(const TArray<FHttpRequestFileCreator>& Files, TMap<FString, FString>& Headers)
+{
+	if (Files.Num() == 0)
+	{
+		return nullptr;
+	}
+	const FString Boundary = MakeFormDataBoundary();
+	const FString BoundaryLine = "\r\n--" + Boundary + "\r\n";
+	TSharedPtr<FHttpMultipartFormDataStream, ESPMode::ThreadSafe> Stream = MakeShared<FHttpMultipartFormDataStream, ESPMode::ThreadSafe>();
+	int32 PartCount = 0;
+	for (int32 Index = 0; Index < Files.Num(); Index++)
+	{
+		const FHttpRequestFileCreator& File = Files[Index];
+		if (!IsFormDataPartValid(File))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Multipart part %d is invalid and will be skipped, KeyName: \"%s\", ContentInfo: \"%s\""), Index, *File.KeyName, *File.ContentInfo);
+			continue;
+		}
+		//先确定文件存在且不为空，和CallHTTPAsFiles一样跳过无法读取的文件
+		TSharedPtr<FHttpMappedFile, ESPMode::ThreadSafe> MappedFile;
+		if (File.bIsFile && File.UploadContent.Num() == 0)
+		{
+			MappedFile = FHttpMappedFile::Open(File.ContentInfo);
+			if (!MappedFile.IsValid() && IFileManager::Get().FileSize(*File.ContentInfo) <= 0)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Multipart file not found or empty and will be skipped: %s"), *File.ContentInfo);
+				continue;
+			}
+		}
+		Stream->AddString(BoundaryLine);
+		Stream->AddString(MakeFormDataPartHeader(File.KeyName, File.ContentInfo, File.bIsFile));
+		if (!File.bIsFile)
+		{
+			Stream->AddString(File.ContentInfo);
+		}
+		else if (File.UploadContent.Num() > 0)
+		{
+			Stream->AddBytes(TArray<uint8>(File.UploadContent));
+		}
+		else if (MappedFile.IsValid())
+		{
+			Stream->AddMappedFile(MappedFile.ToSharedRef());
+		}
+		else
+		{
+			Stream->AddFile(File.ContentInfo);
+		}
+		Stream->AddString(TEXT("\r\n"));
+		PartCount++;
+	}
+	if (PartCount == 0)
+	{
+		return nullptr;
+	}
+	Stream->AddString("\r\n--" + Boundary + FString("--") + "\r\n");
+
+	Headers.Add("Content-Type", TEXT("multipart/form-data; boundary=" + Boundary));
+	Headers.Add("Content-Length", FString::Printf(TEXT("%lld"), Stream->TotalSize()));
+	return Stream;
+}
+
+TSharedPtr<FHttpMultipartFormDataStream, ESPMode::ThreadSafe> UHTTPHelperSubsystem::CreateFileStreamAndHeadersForFromData(const TArray<FHttpRequestFileWapperBase*>& FileWappers, TMap<FString, FString>& Headers)
+{
+	if (FileWappers.Num() == 0)
+	{
+		return nullptr;
+	}
+	const FString Boundary = MakeFormDataBoundary();
+	const FString BoundaryLine = "\r\n--" + Boundary + "\r\n";
+	TSharedPtr<FHttpMultipartFormDataStream, ESPMode::ThreadSafe> Stream = MakeShared<FHttpMultipartFormDataStream, ESPMode::ThreadSafe>();
+	for (const FHttpRequestFileWapperBase* FileWapper : FileWappers)
+	{
+		if (!FileWapper->CheckValid())
+		{
+			return nullptr;
+		}
+		FString FilePath;
+		if (FileWapper->bIsFile)
+		{
+			FilePath = static_cast<const FHttpRequestFileWapper*>(FileWapper)->FilePath;
+		}
+		Stream->AddString(BoundaryLine);
+		Stream->AddString(MakeFormDataPartHeader(FileWapper->KeyName, FilePath, FileWapper->bIsFile));
+		//文本、UploadContent和映射失败时加载的内容本来就在内存中，只有映射的文件由流共享
+		if (const TSharedPtr<FHttpMappedFile, ESPMode::ThreadSafe> MappedFile = FileWapper->GetMappedFile())
+		{
+			Stream->AddMappedFile(MappedFile.ToSharedRef());
+		}
+		else
+		{
+			const TArrayView64<const uint8> FileContent = FileWapper->GetContentView();
+			if (FileContent.Num() >= MAX_int32)
+			{
+				return nullptr;
+			}
+			Stream->AddBytes(TArray<uint8>(FileContent.GetData(), (int32)FileContent.Num()));
+		}
+		Stream->AddString(TEXT("\r\n"));
+	}
+	Stream->AddString("\r\n--" + Boundary + FString("--") + "\r\n");
+
+	Headers.Add("Content-Type", TEXT("multipart/form-data; boundary=" + Boundary));
+	Headers.Add("Content-Length", FString::Printf(TEXT("%lld"), Stream->TotalSize()));
+	return Stream;
+}
+
 FString UHTTPHelperSubsystem::MethodByteToString(EMethodByte MethodByte)
 {
 	switch (MethodByte)
@@ -344,6 +1760,28 @@ FString UHTTPHelperSubsystem::GetFileContentType(const FString& FilePath)
 	return FGenericPlatformHttp::GetMimeType(FilePath);
 }
 
+FString UHTTPHelperSubsystem::MakeFormDataBoundary()
+{
+	return "----" + FString(TEXT("WebKitFormBoundary"))+ FString::FromInt(FMath::Abs( FDateTime::Now().GetMillisecond()))+ FGuid::NewGuid().ToString();
+}
+
+FString UHTTPHelperSubsystem::MakeFormDataPartHeader(const FString& KeyName, const FString& FilePath, bool bIsFile)
+{
+	FString FileHeader = "Content-Disposition: form-data;name=\"" + KeyName + "\"";
+	if (bIsFile)
+	{
+		FileHeader.Append(";");
+		FileHeader.Append("filename=\"" + FPaths::GetCleanFilename(FilePath) + "\"\r\n");
+		FileHeader.Append("Content-Type: " + GetFileContentType(FilePath) + "\r\n\r\n");
+	}
+	else
+	{
+		//文本Part同样需要空行分隔头部和内容
+		FileHeader.Append("\r\n\r\n");
+	}
+	return FileHeader;
+}
+
 FHttpRequestFileWapperBase::FHttpRequestFileWapperBase(const FString& InKeyName, const FString& TextContent)
 {
 	KeyName = InKeyName;
@@ -354,7 +1792,7 @@ FHttpRequestFileWapperBase::FHttpRequestFileWapperBase(const FString& InKeyName,
 
 bool FHttpRequestFileWapperBase::CheckValid() const
 {
-	if (FileContent.Num() == 0 || KeyName.IsEmpty())
+	if (GetContentView().Num() == 0 || KeyName.IsEmpty())
 	{
 		return false;
 	}
@@ -388,7 +1826,7 @@ TSharedPtr<FHttpRequestFileWapperBase> FHttpRequestFileCreator::GenerateFileWapp
 		else
 		{
 			
-			CreateWapper = MakeShareable(new FHttpRequestFileWapper(KeyName, ContentInfo));
+			CreateWapper = MakeShareable(new FHttpRequestMappedFileWapper(KeyName, ContentInfo));
 			if (!CreateWapper->CheckValid())
 			{
 				CreateWapper.Reset();
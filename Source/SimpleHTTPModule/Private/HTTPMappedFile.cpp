@@ -0,0 +1,41 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPMappedFile.h"
+#include "HAL/PlatformFileManager.h"
+#include "Async/MappedFileHandle.h"
+
+TSharedPtr<FHttpMappedFile, ESPMode::ThreadSafe> FHttpMappedFile::Open(const FString& InFilePath)
+{
+	TUniquePtr<IMappedFileHandle> Handle(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*InFilePath));
+	if (!Handle.IsValid() || Handle->GetFileSize() <= 0)
+	{
+		return nullptr;
+	}
+	TUniquePtr<IMappedFileRegion> Region(Handle->MapRegion(0, Handle->GetFileSize()));
+	if (!Region.IsValid())
+	{
+		return nullptr;
+	}
+	TSharedPtr<FHttpMappedFile, ESPMode::ThreadSafe> MappedFile = MakeShareable(new FHttpMappedFile());
+	MappedFile->FilePath = InFilePath;
+	MappedFile->Handle = MoveTemp(Handle);
+	MappedFile->Region = MoveTemp(Region);
+	return MappedFile;
+}
+
+FHttpMappedFile::~FHttpMappedFile()
+{
+	//映射的区域必须在文件句柄之前释放
+	Region.Reset();
+	Handle.Reset();
+}
+
+TArrayView64<const uint8> FHttpMappedFile::GetView() const
+{
+	if (!Region.IsValid())
+	{
+		return TArrayView64<const uint8>();
+	}
+	return TArrayView64<const uint8>(Region->GetMappedPtr(), Region->GetMappedSize());
+}
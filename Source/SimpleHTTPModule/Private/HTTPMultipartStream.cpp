@@ -0,0 +1,139 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPMultipartStream.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/FileManager.h"
+
+FHttpMultipartFormDataStream::FHttpMultipartFormDataStream()
+{
+	SetIsLoading(true);
+	SetIsPersistent(false);
+}
+
+FHttpMultipartFormDataStream::~FHttpMultipartFormDataStream()
+{
+	Close();
+}
+
+void FHttpMultipartFormDataStream::AddBytes(TArray<uint8>&& InBytes)
+{
+	if (InBytes.Num() == 0)
+	{
+		return;
+	}
+	FSegment& Segment = Segments.AddDefaulted_GetRef();
+	Segment.Offset = Size;
+	Segment.Size = InBytes.Num();
+	Segment.Bytes = MoveTemp(InBytes);
+	Size += Segment.Size;
+}
+
+void FHttpMultipartFormDataStream::AddString(const FString& InString)
+{
+	const FTCHARToUTF8 StringChar = FTCHARToUTF8(*InString);
+	TArray<uint8> Bytes;
+	Bytes.Append((uint8*)StringChar.Get(), StringChar.Length());
+	AddBytes(MoveTemp(Bytes));
+}
+
+bool FHttpMultipartFormDataStream::AddFile(const FString& InFilePath)
+{
+	const int64 FileSize = IFileManager::Get().FileSize(*InFilePath);
+	if (FileSize <= 0)
+	{
+		return false;
+	}
+	FSegment& Segment = Segments.AddDefaulted_GetRef();
+	Segment.Offset = Size;
+	Segment.Size = FileSize;
+	Segment.FilePath = InFilePath;
+	Size += FileSize;
+	return true;
+}
+
+void FHttpMultipartFormDataStream::AddMappedFile(const TSharedRef<FHttpMappedFile, ESPMode::ThreadSafe>& InMappedFile)
+{
+	FSegment& Segment = Segments.AddDefaulted_GetRef();
+	Segment.Offset = Size;
+	Segment.Size = InMappedFile->GetView().Num();
+	Segment.MappedFile = InMappedFile;
+	Size += Segment.Size;
+}
+
+const FHttpMultipartFormDataStream::FSegment& FHttpMultipartFormDataStream::FindSegment(int64 InPos)
+{
+	//读取基本是顺序的，从上次的位置开始找
+	while (CurrentSegment > 0 && Segments[CurrentSegment].Offset > InPos)
+	{
+		CurrentSegment--;
+	}
+	while (CurrentSegment < Segments.Num() - 1 && Segments[CurrentSegment].Offset + Segments[CurrentSegment].Size <= InPos)
+	{
+		CurrentSegment++;
+	}
+	return Segments[CurrentSegment];
+}
+
+void FHttpMultipartFormDataStream::Serialize(void* Data, int64 Length)
+{
+	if (Length > 0)
+	{
+		//请求的桶透支时在HTTP线程短暂等待，读出的字节由调度器计入带宽
+		SendCounter->Pace();
+		SendCounter->Add(Length);
+	}
+	uint8* Dest = static_cast<uint8*>(Data);
+	while (Length > 0)
+	{
+		if (Pos + Length > Size || IsError())
+		{
+			FMemory::Memzero(Dest, Length);
+			SetError();
+			return;
+		}
+		const FSegment& Segment = FindSegment(Pos);
+		const int64 SegmentPos = Pos - Segment.Offset;
+		const int64 CopySize = FMath::Min(Length, Segment.Size - SegmentPos);
+		if (Segment.MappedFile.IsValid())
+		{
+			FMemory::Memcpy(Dest, Segment.MappedFile->GetView().GetData() + SegmentPos, CopySize);
+		}
+		else if (Segment.FilePath.IsEmpty())
+		{
+			FMemory::Memcpy(Dest, Segment.Bytes.GetData() + SegmentPos, CopySize);
+		}
+		else
+		{
+			if (CurrentFileSegment != CurrentSegment)
+			{
+				CurrentFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*Segment.FilePath));
+				CurrentFileSegment = CurrentSegment;
+			}
+			if (!CurrentFile.IsValid()
+				|| (CurrentFile->Tell() != SegmentPos && !CurrentFile->Seek(SegmentPos))
+				|| !CurrentFile->Read(Dest, CopySize))
+			{
+				UE_LOG(LogTemp, Error, TEXT("Read multipart file failed: %s"), *Segment.FilePath);
+				FMemory::Memzero(Dest, Length);
+				SetError();
+				return;
+			}
+		}
+		Dest += CopySize;
+		Pos += CopySize;
+		Length -= CopySize;
+	}
+}
+
+void FHttpMultipartFormDataStream::Seek(int64 InPos)
+{
+	Pos = FMath::Clamp<int64>(InPos, 0, Size);
+}
+
+bool FHttpMultipartFormDataStream::Close()
+{
+	CurrentFile.Reset();
+	CurrentFileSegment = INDEX_NONE;
+	return !IsError();
+}
@@ -0,0 +1,95 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPNativeRequestQueue.h"
+#include "Async/Async.h"
+#include "Misc/ScopeLock.h"
+
+FString FHttpNativeResponse::GetContentAsString() const
+{
+	const FUTF8ToTCHAR Converter((const ANSICHAR*)Content.GetData(), Content.Num());
+	return FString(Converter.Length(), Converter.Get());
+}
+
+FHttpNativeRequestQueue::~FHttpNativeRequestQueue()
+{
+	FailPending();
+}
+
+TFuture<FHttpNativeResponse> FHttpNativeRequestQueue::Submit(FHttpNativeRequest&& Request)
+{
+	const TSharedRef<TPromise<FHttpNativeResponse>, ESPMode::ThreadSafe> Promise = MakeShared<TPromise<FHttpNativeResponse>, ESPMode::ThreadSafe>();
+	TFuture<FHttpNativeResponse> Future = Promise->GetFuture();
+	Submit(MoveTemp(Request), [Promise](const FHttpNativeResponse& Response)
+		{
+			Promise->SetValue(Response);
+		});
+	return Future;
+}
+
+void FHttpNativeRequestQueue::Submit(FHttpNativeRequest&& Request, FHttpNativeRequestCallback&& OnComplete)
+{
+	if (bClosed)
+	{
+		Deliver(Request.CompletionThread, OnComplete, FHttpNativeResponse());
+		return;
+	}
+	Pending.Enqueue(FSubmission{ MoveTemp(Request), MoveTemp(OnComplete) });
+	//入队的同时Subsystem可能已经关闭并清空了队列
+	if (bClosed)
+	{
+		FailPending();
+	}
+}
+
+void FHttpNativeRequestQueue::Deliver(EHttpCompletionThread Thread, const FHttpNativeRequestCallback& OnComplete, FHttpNativeResponse&& Response)
+{
+	if (!OnComplete)
+	{
+		return;
+	}
+	if (Thread == EHttpCompletionThread::GameThread)
+	{
+		if (IsInGameThread())
+		{
+			OnComplete(Response);
+			return;
+		}
+		AsyncTask(ENamedThreads::GameThread, [OnComplete, Response = MoveTemp(Response)]()
+			{
+				OnComplete(Response);
+			});
+		return;
+	}
+	if (Thread == EHttpCompletionThread::HttpThread && !IsInGameThread())
+	{
+		OnComplete(Response);
+		return;
+	}
+	Async(EAsyncExecution::ThreadPool, [OnComplete, Response = MoveTemp(Response)]()
+		{
+			OnComplete(Response);
+		});
+}
+
+bool FHttpNativeRequestQueue::Dequeue(FSubmission& OutSubmission)
+{
+	FScopeLock Lock(&DequeueLock);
+	return Pending.Dequeue(OutSubmission);
+}
+
+void FHttpNativeRequestQueue::Close()
+{
+	bClosed = true;
+	FailPending();
+}
+
+void FHttpNativeRequestQueue::FailPending()
+{
+	FScopeLock Lock(&DequeueLock);
+	FSubmission Submission;
+	while (Pending.Dequeue(Submission))
+	{
+		Deliver(Submission.Request.CompletionThread, Submission.OnComplete, FHttpNativeResponse());
+	}
+}
@@ -3,7 +3,17 @@
 
 #include "HTTPRequest.h"
 #include "Interfaces/IHttpResponse.h"
+#include "PlatformHttp.h"
 #include "HTTPHelperSubsystem.h"
+#include "HTTPDownloadStream.h"
+#include "SimpleHTTPCompat.h"
+#include "Async/Async.h"
+#include "Misc/ScopeExit.h"
+#include "Stats/Stats.h"
+#include "HAL/FileManager.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "JsonObjectConverter.h"
 
 
 void UHTTPRequest::BindRequestCompleteAsString(FSimpleHttpRequestCompleteAsStringDelegate InDelegate)
@@ -26,51 +36,152 @@ void UHTTPRequest::BindRequestProgress(FSimpleHttpRequestProgressDelegate InDele
 	OnRequestProgress = InDelegate;
 }
 
+void UHTTPRequest::BindRequestDetailedProgress(FSimpleHttpRequestDetailedProgressDelegate InDelegate)
+{
+	OnRequestDetailedProgress = InDelegate;
+}
+
+void UHTTPRequest::SetProgressSettings(const FHttpProgressSettings& InProgressSettings)
+{
+	ProgressSettingsOverride = InProgressSettings;
+}
+
 void UHTTPRequest::BindRequestWillRetry(FSimpleHttpRequestWillRetryDelegate InDelegate)
 {
 	OnRequestWillRetry = InDelegate;
 }
 
+void UHTTPRequest::BindRequestCompleteNative(EHttpCompletionThread Thread, FHttpNativeRequestCallback&& InCallback)
+{
+	NativeCompletionThread = Thread;
+	OnRequestCompleteNative = MoveTemp(InCallback);
+}
+
+void UHTTPRequest::BindRequestCompleteAsStruct(UScriptStruct* StructType, FSimpleHttpRequestCompleteAsStructDelegate InDelegate)
+{
+	ParseStructType = StructType;
+	OnRequestCompleteAsStruct = InDelegate;
+}
+
+void UHTTPRequest::BindRequestCompleteAsStruct(UScriptStruct* StructType, FSimpleHttpRequestCompleteAsStructCallback&& InCallback)
+{
+	ParseStructType = StructType;
+	OnRequestCompleteAsStructNative = MoveTemp(InCallback);
+}
+
+bool UHTTPRequest::CopyParsedStruct(const UScriptStruct* StructType, void* OutStruct) const
+{
+	if (!ParsedStruct.IsValid() || StructType != ParseStructType)
+	{
+		return false;
+	}
+	StructType->CopyScriptStruct(OutStruct, ParsedStruct->GetStructMemory());
+	return true;
+}
+
+bool UHTTPRequest::GetParsedStruct(int32& OutStruct)
+{
+	//由execGetParsedStruct实现
+	check(0);
+	return false;
+}
+
+DEFINE_FUNCTION(UHTTPRequest::execGetParsedStruct)
+{
+	Stack.MostRecentPropertyAddress = nullptr;
+	Stack.MostRecentProperty = nullptr;
+	Stack.StepCompiledIn<FStructProperty>(nullptr);
+	void* OutStructPtr = Stack.MostRecentPropertyAddress;
+	FStructProperty* StructProperty = CastField<FStructProperty>(Stack.MostRecentProperty);
+	P_FINISH;
+	bool bResult = false;
+	P_NATIVE_BEGIN;
+	if (StructProperty && OutStructPtr)
+	{
+		bResult = P_THIS->CopyParsedStruct(StructProperty->Struct, OutStructPtr);
+	}
+	P_NATIVE_END;
+	*(bool*)RESULT_PARAM = bResult;
+}
+
 bool UHTTPRequest::SaveAsFile(FString SavePath, FString FileName, bool UsingReceivedFileName)
 {
-	auto SaveFile = [&]()
-		{
-			;
-			SavePath = FPaths::Combine(SavePath, FileName);
-			return FFileHelper::SaveArrayToFile(HttpRequest->GetResponse()->GetContent(), *SavePath);
-		};
-	if (HttpRequest.IsValid() && HttpRequest->GetResponse().IsValid() && EHttpResponseCodes::IsOk(HttpRequest->GetResponse()->GetResponseCode()))
+	const TArray<uint8>* Content = nullptr;
+	if (CachedEntry.IsValid() && CachedEntry->Content.IsValid())
+	{
+		//由缓存提供的响应
+		Content = CachedEntry->Content.Get();
+	}
+	else if (HttpRequest.IsValid() && HttpRequest->GetResponse().IsValid() && EHttpResponseCodes::IsOk(HttpRequest->GetResponse()->GetResponseCode()))
+	{
+		Content = &HttpRequest->GetResponse()->GetContent();
+	}
+	if (Content)
 	{
 		//save uint8 array to file
+		if (HTTPHelperSubsystem)
+		{
+			HTTPHelperSubsystem->TouchRequestObject(this);
+		}
 		if (UsingReceivedFileName)
 		{
-			TArray<FString> AllHeaders = HttpRequest->GetResponse()->GetAllHeaders();
-			bool bFindedFileName = false;
-			for (auto Header : AllHeaders)
-			{
-				if (Header.StartsWith("Content-Disposition"))
-				{
-					int32 FileNameStartIndex = Header.Find("filename=\"");
-					if (FileNameStartIndex != INDEX_NONE)
-					{
-						FileName = Header.Mid(FileNameStartIndex + 10).Replace(TEXT("\""), TEXT(""));
-						UE_LOG(LogTemp, Log, TEXT("File name: %s will be saved"), *FileName);
-						return SaveFile();
-					}
-					break;
-				}
-			}
-			TArray<FString> UrlParseFileNameArray;
-			HttpRequest->GetURL().ParseIntoArray(UrlParseFileNameArray, TEXT("/"));
-			if (UrlParseFileNameArray.Num() > 0)
+			ResolveReceivedFileName(FileName);
+		}
+		SavePath = FPaths::Combine(SavePath, FileName);
+		if (!DownloadedFilePath.IsEmpty())
+		{
+			//响应体已经写入了磁盘，复制已下载的文件
+			return FPaths::IsSamePath(DownloadedFilePath, SavePath) || IFileManager::Get().Copy(*SavePath, *DownloadedFilePath) == COPY_OK;
+		}
+		return FFileHelper::SaveArrayToFile(*Content, *SavePath);
+	}
+	return false;
+}
+
+TArrayView<const uint8> UHTTPRequest::GetResponseContentView() const
+{
+	if (CachedEntry.IsValid() && CachedEntry->Content.IsValid())
+	{
+		return *CachedEntry->Content;
+	}
+	if (HttpRequest.IsValid() && HttpRequest->GetResponse().IsValid())
+	{
+		return HttpRequest->GetResponse()->GetContent();
+	}
+	return TArrayView<const uint8>();
+}
+
+bool UHTTPRequest::ResolveReceivedFileName(FString& OutFileName) const
+{
+	if (!HttpRequest.IsValid())
+	{
+		return false;
+	}
+	TArray<FString> AllHeaders;
+	if (HttpRequest->GetResponse().IsValid())
+	{
+		AllHeaders = HttpRequest->GetResponse()->GetAllHeaders();
+	}
+	for (const FString& Header : AllHeaders)
+	{
+		if (Header.StartsWith("Content-Disposition"))
+		{
+			int32 FileNameStartIndex = Header.Find("filename=\"");
+			if (FileNameStartIndex != INDEX_NONE)
 			{
-				FileName = FPaths::GetCleanFilename(UrlParseFileNameArray.Last());
-				return SaveFile();
+				OutFileName = Header.Mid(FileNameStartIndex + 10).Replace(TEXT("\""), TEXT(""));
+				UE_LOG(LogTemp, Log, TEXT("File name: %s will be saved"), *OutFileName);
+				return true;
 			}
-			
+			break;
 		}
-		return SaveFile();
-		
+	}
+	TArray<FString> UrlParseFileNameArray;
+	HttpRequest->GetURL().ParseIntoArray(UrlParseFileNameArray, TEXT("/"));
+	if (UrlParseFileNameArray.Num() > 0)
+	{
+		OutFileName = FPaths::GetCleanFilename(UrlParseFileNameArray.Last());
+		return true;
 	}
 	return false;
 }
@@ -79,7 +190,7 @@ void UHTTPRequest::FreeRequest()
 {
 	if (HTTPHelperSubsystem)
 	{
-		HTTPHelperSubsystem->HistoryHttpRequests.Remove(this);
+		HTTPHelperSubsystem->ForgetRequestObject(this);
 	}
 #if ENGINE_MAJOR_VERSION>4
 	this->MarkAsGarbage();
@@ -88,6 +199,118 @@ void UHTTPRequest::FreeRequest()
 #endif
 }
 
+void UHTTPRequest::SetPinned(bool bInPinned)
+{
+	bPinned = bInPinned;
+}
+
+FHttpRequestTiming UHTTPRequest::GetTiming() const
+{
+	FHttpRequestTiming Timing;
+	if (HttpRequest.IsValid())
+	{
+		Timing.Host = FPlatformHttp::GetUrlDomain(HttpRequest->GetURL());
+		Timing.Verb = HttpRequest->GetVerb();
+	}
+	Timing.ResponseCode = FinalResponseCode;
+	Timing.bSucceeded = bFinalSucceeded;
+	Timing.RetryCount = RetryCount;
+	Timestamps.FillTiming(Timing);
+	return Timing;
+}
+
+void UHTTPRequest::RecordCompleted(const FHttpResponsePtr& Response, bool bWasSuccessful)
+{
+	Timestamps.Completed = FPlatformTime::Seconds();
+	FinalResponseCode = bWasSuccessful && Response.IsValid() ? Response->GetResponseCode() : 0;
+	bFinalSucceeded = FinalResponseCode > 0 && FinalResponseCode < 400;
+	if (HttpRequest.IsValid())
+	{
+		Timestamps.BytesSent = FMath::Max<int64>(Timestamps.BytesSent, HttpRequest->GetContentLength());
+	}
+	if (Response.IsValid())
+	{
+		Timestamps.BytesReceived = FMath::Max<int64>(Timestamps.BytesReceived, Response->GetContent().Num());
+	}
+	if (HTTPHelperSubsystem)
+	{
+		HTTPHelperSubsystem->RecordRequestTiming(GetTiming());
+	}
+}
+
+void UHTTPRequest::SetRetryPolicy(const FHttpRetryPolicy& InRetryPolicy)
+{
+	RetryPolicyOverride = InRetryPolicy;
+}
+
+void UHTTPRequest::NotifyCompleted()
+{
+	if (HTTPHelperSubsystem)
+	{
+		HTTPHelperSubsystem->OnRequestObjectCompleted(this);
+	}
+}
+
+void UHTTPRequest::ResetForReuse()
+{
+	if (HttpRequest.IsValid())
+	{
+		//合并的请求共享主请求的IHttpRequest，只解绑自己绑定的委托
+		if (HttpRequest->OnProcessRequestComplete().IsBoundToObject(this))
+		{
+			HttpRequest->OnProcessRequestComplete().Unbind();
+			HttpRequest->OnHeaderReceived().Unbind();
+			SimpleHttpOnRequestProgress(*HttpRequest).Unbind();
+			HttpRequest->OnRequestWillRetry().Unbind();
+			//下载中的请求被回收时取消，流随请求释放并删除临时文件
+			if (DownloadStream.IsValid() && !EHttpRequestStatus::IsFinished(HttpRequest->GetStatus()))
+			{
+				HttpRequest->CancelRequest();
+			}
+		}
+		HttpRequest.Reset();
+	}
+	OnRequestCompleteAsString.Unbind();
+	OnRequestCompleteAsBinary.Unbind();
+	OnRequestCompleteAsView.Unbind();
+	OnRequestCompleteAsStruct.Unbind();
+	OnRequestCompleteAsStructNative = nullptr;
+	OnRequestCompleteNative = nullptr;
+	NativeCompletionThread = EHttpCompletionThread::ThreadPool;
+	ParseStructType = nullptr;
+	ParsedStruct.Reset();
+	OnRequestHeaderReceived.Unbind();
+	OnRequestProgress.Unbind();
+	OnRequestDetailedProgress.Unbind();
+	OnRequestProgressNative.Unbind();
+	OnRequestWillRetry.Unbind();
+	bPinned = false;
+	RequestPriority = EHttpRequestPriority::Normal;
+	RetryPolicyOverride.Reset();
+	RetryCount = 0;
+	Timestamps = FHttpRequestTimestamps();
+	FinalResponseCode = 0;
+	bFinalSucceeded = false;
+	ProgressSettingsOverride.Reset();
+	ProgressThrottle.Reset();
+	ProgressContentLength = -1;
+	bStreamedContent = false;
+	SendCounter.Reset();
+	bDecodingCompletion = false;
+	PendingCompletionCycles = 0;
+	bDownloadToFile = false;
+	DownloadStream.Reset();
+	DownloadSavePath.Empty();
+	DownloadFileName.Empty();
+	bDownloadUsingReceivedFileName = true;
+	DownloadedFilePath.Empty();
+	CacheKey.Empty();
+	CachedEntry.Reset();
+	CoalesceKey.Empty();
+	CoalescedFollowers.Empty();
+	CoalesceLeader.Reset();
+}
+
 void UHTTPRequest::BindAllDelegate(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> InHttpRequest)
 {
 	//BinaryContent.Empty();
@@ -96,29 +319,492 @@ void UHTTPRequest::BindAllDelegate(const TSharedRef<IHttpRequest, ESPMode::Threa
 
 	HttpRequest->OnHeaderReceived().BindUObject(this, &UHTTPRequest::OnHeaderReceivedEvent);
 
-	HttpRequest->OnRequestProgress().BindUObject(this, &UHTTPRequest::OnRequestProgressEvent);
+	SimpleHttpOnRequestProgress(*HttpRequest).BindUObject(this, &UHTTPRequest::OnRequestProgressEvent);
 
 	HttpRequest->OnRequestWillRetry().BindUObject(this, &UHTTPRequest::OnRequestWillRetryEvent);
 }
 
+void UHTTPRequest::SetupDownloadToFile(const TSharedPtr<FHttpFileDownloadStream, ESPMode::ThreadSafe>& InDownloadStream, const FString& InSavePath, const FString& InFileName, bool bInUsingReceivedFileName)
+{
+	bDownloadToFile = true;
+	DownloadStream = InDownloadStream;
+	DownloadSavePath = InSavePath;
+	DownloadFileName = InFileName;
+	bDownloadUsingReceivedFileName = bInUsingReceivedFileName;
+}
+
+void UHTTPRequest::FinishDownloadToFile(FHttpResponsePtr Response, bool bWasSuccessful)
+{
+	const bool bResponseOk = bWasSuccessful && Response.IsValid() && EHttpResponseCodes::IsOk(Response->GetResponseCode());
+	FString TargetFilePath;
+	if (bResponseOk)
+	{
+		FString FileName = DownloadFileName;
+		if (bDownloadUsingReceivedFileName)
+		{
+			ResolveReceivedFileName(FileName);
+		}
+		TargetFilePath = FPaths::Combine(DownloadSavePath, FileName);
+	}
+	//剩余数据的写入和重命名放到后台线程，完成后回到游戏线程触发委托
+	TWeakObjectPtr<UHTTPRequest> WeakThis(this);
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Stream = DownloadStream, Response, TargetFilePath, bResponseOk]()
+		{
+			bool bSaved = false;
+#if SIMPLEHTTP_WITH_RESPONSE_STREAM
+			if (bResponseOk)
+			{
+				bSaved = Stream->Finalize(TargetFilePath);
+			}
+			else
+			{
+				Stream->Discard();
+			}
+#else
+			if (bResponseOk)
+			{
+				bSaved = FFileHelper::SaveArrayToFile(Response->GetContent(), *TargetFilePath);
+			}
+#endif
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, TargetFilePath, bSaved]()
+				{
+					if (UHTTPRequest* This = WeakThis.Get())
+					{
+						This->DownloadStream.Reset();
+						This->DownloadedFilePath = bSaved ? TargetFilePath : FString();
+						This->DeliverNativeComplete(bSaved, TArrayView<const uint8>());
+						This->OnRequestCompleteAsView.ExecuteIfBound(bSaved, TArrayView<const uint8>());
+						This->OnRequestCompleteAsString.ExecuteIfBound(bSaved, This->DownloadedFilePath);
+						This->OnRequestCompleteAsBinary.ExecuteIfBound(bSaved, TArray<uint8>());
+						This->NotifyCompleted();
+					}
+				});
+		});
+}
+
+FString UHTTPRequest::DecodeContentString(const TArray<uint8>& Content)
+{
+	const FUTF8ToTCHAR ContentChar((const ANSICHAR*)Content.GetData(), Content.Num());
+	return FString(ContentChar.Length(), ContentChar.Get());
+}
+
+void UHTTPRequest::DecodeContent(const TArray<uint8>& Content, const TArray<const UScriptStruct*>& StructTypes, FDecodedContent& OutDecoded)
+{
+	OutDecoded.String = DecodeContentString(Content);
+	OutDecoded.bHasString = true;
+	for (const UScriptStruct* StructType : StructTypes)
+	{
+		FDecodedStruct& Decoded = OutDecoded.Structs.AddDefaulted_GetRef();
+		Decoded.StructType = StructType;
+		TSharedPtr<FJsonObject> JsonObject;
+		const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(OutDecoded.String);
+		if (!FJsonSerializer::Deserialize(JsonReader, JsonObject) || !JsonObject.IsValid())
+		{
+			Decoded.ErrorMessage = FString::Printf(TEXT("Invalid json: %s"), *JsonReader->GetErrorMessage());
+			continue;
+		}
+		TSharedPtr<FStructOnScope, ESPMode::ThreadSafe> Struct = MakeShared<FStructOnScope, ESPMode::ThreadSafe>(StructType);
+		if (!FJsonObjectConverter::JsonObjectToUStruct(JsonObject.ToSharedRef(), StructType, Struct->GetStructMemory(), 0, 0))
+		{
+			Decoded.ErrorMessage = FString::Printf(TEXT("Failed to convert json to %s"), *StructType->GetName());
+			continue;
+		}
+		Decoded.Struct = Struct;
+	}
+}
+
+bool UHTTPRequest::HasOkResponse() const
+{
+	return CachedEntry.IsValid() || (FinalResponseCode >= 200 && FinalResponseCode < 300);
+}
+
+void UHTTPRequest::DeliverNativeComplete(bool bSuccess, TArrayView<const uint8> Content)
+{
+	if (!OnRequestCompleteNative)
+	{
+		return;
+	}
+	FHttpNativeResponse Response;
+	Response.bSuccess = bSuccess && HasOkResponse();
+	//内容来自缓存时代表缓存的200响应
+	Response.ResponseCode = CachedEntry.IsValid() ? EHttpResponseCodes::Ok : FinalResponseCode;
+	Response.Content = TArray<uint8>(Content.GetData(), Content.Num());
+	const FHttpResponsePtr HttpResponse = HttpRequest.IsValid() ? HttpRequest->GetResponse() : nullptr;
+	if (HttpResponse.IsValid())
+	{
+		Response.Headers = HttpResponse->GetAllHeaders();
+		Response.ContentType = HttpResponse->GetContentType();
+	}
+	FHttpNativeRequestQueue::Deliver(NativeCompletionThread, OnRequestCompleteNative, MoveTemp(Response));
+}
+
+void UHTTPRequest::ExecuteCompleteDelegates(bool bSuccess, const TArray<uint8>& Content, const FDecodedContent* Decoded)
+{
+	//先交给后台线程，和游戏线程的委托并行执行
+	DeliverNativeComplete(bSuccess, Content);
+	OnRequestCompleteAsView.ExecuteIfBound(bSuccess, Content);
+	if (OnRequestCompleteAsString.IsBound())
+	{
+		OnRequestCompleteAsString.Execute(bSuccess, Decoded && Decoded->bHasString ? Decoded->String : DecodeContentString(Content));
+	}
+	OnRequestCompleteAsBinary.ExecuteIfBound(bSuccess, Content);
+	if (ParseStructType)
+	{
+		//4xx/5xx的响应内容是服务器的错误信息，不按结构体解析，报告响应码
+		FString ErrorMessage;
+		if (!bSuccess)
+		{
+			ErrorMessage = TEXT("Request failed");
+		}
+		else if (!HasOkResponse())
+		{
+			ErrorMessage = FString::Printf(TEXT("HTTP %d"), FinalResponseCode);
+		}
+		const FDecodedStruct* DecodedStruct = nullptr;
+		if (ErrorMessage.IsEmpty() && Decoded)
+		{
+			DecodedStruct = Decoded->Structs.FindByPredicate([this](const FDecodedStruct& Item) { return Item.StructType == ParseStructType; });
+		}
+		if (DecodedStruct && DecodedStruct->Struct.IsValid())
+		{
+			//每个请求对象持有自己的副本，合并的请求之间互不影响
+			ParsedStruct = MakeShared<FStructOnScope, ESPMode::ThreadSafe>(ParseStructType);
+			ParseStructType->CopyScriptStruct(ParsedStruct->GetStructMemory(), DecodedStruct->Struct->GetStructMemory());
+		}
+		else if (DecodedStruct)
+		{
+			ErrorMessage = DecodedStruct->ErrorMessage;
+		}
+		else if (ErrorMessage.IsEmpty())
+		{
+			ErrorMessage = TEXT("Response was not parsed");
+		}
+		const bool bParsed = ParsedStruct.IsValid();
+		if (OnRequestCompleteAsStructNative)
+		{
+			OnRequestCompleteAsStructNative(bParsed, ParsedStruct.Get(), ErrorMessage);
+		}
+		OnRequestCompleteAsStruct.ExecuteIfBound(bParsed, ErrorMessage);
+	}
+}
+
+void UHTTPRequest::DeliverComplete(UHTTPRequest* Leader, const TArray<UHTTPRequest*>& Followers, bool bSuccess, const TArray<uint8>& Content, const FDecodedContent* Decoded, const FHttpCacheEntryPtr& ContentEntry)
+{
+	if (IsValid(Leader))
+	{
+		Leader->ExecuteCompleteDelegates(bSuccess, Content, Decoded);
+	}
+	for (UHTTPRequest* Follower : Followers)
+	{
+		if (IsValid(Follower))
+		{
+			Follower->CoalesceLeader.Reset();
+			Follower->CachedEntry = ContentEntry;
+			if (IsValid(Leader))
+			{
+				//跟随的请求没有自己的发送过程，使用主请求的时间点
+				const double Submitted = Follower->Timestamps.Submitted;
+				Follower->Timestamps = Leader->Timestamps;
+				Follower->Timestamps.Submitted = Submitted;
+				Follower->FinalResponseCode = Leader->FinalResponseCode;
+				Follower->bFinalSucceeded = Leader->bFinalSucceeded;
+			}
+			Follower->ExecuteCompleteDelegates(bSuccess, Content, Decoded);
+			Follower->NotifyCompleted();
+		}
+	}
+	if (IsValid(Leader))
+	{
+		Leader->NotifyCompleted();
+	}
+}
+
+void UHTTPRequest::BroadcastComplete(bool bSuccess, const TArray<uint8>& Content, const FHttpResponsePtr& ContentResponse, const FHttpCacheEntryPtr& ContentEntry)
+{
+	if (HTTPHelperSubsystem && !CoalesceKey.IsEmpty())
+	{
+		//完成后再发起的相同请求不能再合并到这个请求
+		HTTPHelperSubsystem->RemoveCoalescedRequest(this);
+	}
+	TArray<UHTTPRequest*> Followers = MoveTemp(CoalescedFollowers);
+	CoalescedFollowers.Reset();
+
+	//只有绑定了字符委托或者需要解析结构体时才需要转换，合并的请求共用一次转换的结果
+	bool bNeedString = false;
+	TArray<const UScriptStruct*> StructTypes;
+	auto CollectDecodeRequirements = [&bNeedString, &StructTypes](const UHTTPRequest* RequestObject)
+	{
+		if (IsValid(RequestObject))
+		{
+			bNeedString |= RequestObject->OnRequestCompleteAsString.IsBound();
+			if (RequestObject->ParseStructType)
+			{
+				StructTypes.AddUnique(RequestObject->ParseStructType);
+			}
+		}
+	};
+	CollectDecodeRequirements(this);
+	for (UHTTPRequest* Follower : Followers)
+	{
+		CollectDecodeRequirements(Follower);
+	}
+	//合并的请求使用相同的响应，主请求的响应码对所有请求有效
+	if (StructTypes.Num() == 0 || !bSuccess || !HasOkResponse())
+	{
+		StructTypes.Reset();
+		if (!bNeedString)
+		{
+			DeliverComplete(this, Followers, bSuccess, Content, nullptr, ContentEntry);
+			return;
+		}
+		const int32 AsyncThreshold = HTTPHelperSubsystem ? HTTPHelperSubsystem->AsyncDecodeThresholdBytes : 0;
+		if (AsyncThreshold <= 0 || Content.Num() < AsyncThreshold || !(ContentResponse.IsValid() || ContentEntry.IsValid()))
+		{
+			FDecodedContent Decoded;
+			DecodeContent(Content, StructTypes, Decoded);
+			DeliverComplete(this, Followers, bSuccess, Content, &Decoded, ContentEntry);
+			return;
+		}
+	}
+	//JSON解析和较大文本的转换在后台线程进行，Content由ContentResponse或者ContentEntry持有
+	TWeakObjectPtr<UHTTPRequest> WeakThis(this);
+	TWeakObjectPtr<UHTTPHelperSubsystem> WeakSubsystem(HTTPHelperSubsystem);
+	TArray<TWeakObjectPtr<UHTTPRequest>> WeakFollowers;
+	for (UHTTPRequest* Follower : Followers)
+	{
+		WeakFollowers.Add(Follower);
+	}
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> ContentCopy;
+	if (!ContentResponse.IsValid() && !ContentEntry.IsValid())
+	{
+		ContentCopy = MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(Content);
+	}
+	const TArray<uint8>* ContentPtr = ContentCopy.IsValid() ? ContentCopy.Get() : &Content;
+	bDecodingCompletion = true;
+	Async(EAsyncExecution::ThreadPool, [WeakThis, WeakSubsystem, WeakFollowers = MoveTemp(WeakFollowers), ContentPtr, ContentCopy, ContentResponse, ContentEntry, StructTypes = MoveTemp(StructTypes), bSuccess]() mutable
+		{
+			TSharedRef<FDecodedContent, ESPMode::ThreadSafe> Decoded = MakeShared<FDecodedContent, ESPMode::ThreadSafe>();
+			DecodeContent(*ContentPtr, StructTypes, *Decoded);
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, WeakSubsystem, WeakFollowers = MoveTemp(WeakFollowers), ContentPtr, ContentCopy, ContentResponse, ContentEntry, Decoded, bSuccess]() mutable
+				{
+					//执行委托的部分和其他完成一样受完成预算限制
+					TFunction<void(UHTTPRequest*)> Continuation = [WeakSubsystem, WeakFollowers = MoveTemp(WeakFollowers), ContentPtr, ContentCopy, ContentResponse, ContentEntry, Decoded, bSuccess](UHTTPRequest* Leader)
+					{
+						if (Leader && !Leader->bDecodingCompletion)
+						{
+							//对象已经被回收复用
+							Leader = nullptr;
+						}
+						const uint32 StartCycles = FPlatformTime::Cycles();
+						uint32 PendingCycles = 0;
+						if (Leader)
+						{
+							PendingCycles = Leader->PendingCompletionCycles;
+							Leader->PendingCompletionCycles = 0;
+							Leader->bDecodingCompletion = false;
+						}
+						ON_SCOPE_EXIT
+						{
+							if (UHTTPHelperSubsystem* Subsystem = WeakSubsystem.Get())
+							{
+								Subsystem->RecordCompletionCycles(FPlatformTime::Cycles() - StartCycles + PendingCycles);
+							}
+						};
+						TArray<UHTTPRequest*> AliveFollowers;
+						for (const TWeakObjectPtr<UHTTPRequest>& WeakFollower : WeakFollowers)
+						{
+							if (UHTTPRequest* Follower = WeakFollower.Get())
+							{
+								AliveFollowers.Add(Follower);
+							}
+						}
+						DeliverComplete(Leader, AliveFollowers, bSuccess, *ContentPtr, &Decoded.Get(), ContentEntry);
+					};
+					UHTTPRequest* Leader = WeakThis.Get();
+					UHTTPHelperSubsystem* Subsystem = WeakSubsystem.Get();
+					if (Subsystem && Subsystem->DeferCompletion(Leader, Continuation))
+					{
+						return;
+					}
+					Continuation(Leader);
+				});
+		});
+}
+
+TArray<UHTTPRequest*> UHTTPRequest::GetCoalescedFollowers() const
+{
+	TArray<UHTTPRequest*> Followers;
+	for (UHTTPRequest* Follower : CoalescedFollowers)
+	{
+		if (IsValid(Follower) && Follower->CoalesceLeader.Get() == this)
+		{
+			Followers.Add(Follower);
+		}
+	}
+	return Followers;
+}
+
+void UHTTPRequest::AddCoalescedFollower(UHTTPRequest* Follower)
+{
+	//跟随的请求自己的IHttpRequest不会被发送，改为共享主请求的，以便SaveAsFile等函数读取响应
+	Follower->HttpRequest = HttpRequest;
+	Follower->CoalesceLeader = this;
+	CoalescedFollowers.Add(Follower);
+}
+
+void UHTTPRequest::OnDispatchFailed()
+{
+	CachedEntry.Reset();
+	RecordCompleted(nullptr, false);
+	if (bDownloadToFile)
+	{
+		FinishDownloadToFile(nullptr, false);
+		return;
+	}
+	BroadcastComplete(false, TArray<uint8>(), nullptr, nullptr);
+}
+
+void UHTTPRequest::CompleteFromCache(const FHttpCacheEntryPtr& Entry)
+{
+	CachedEntry = Entry;
+	BroadcastComplete(true, *Entry->Content, nullptr, Entry);
+}
+
 void UHTTPRequest::OnProcessRequestCompleteEvent(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
 {
+	if (HTTPHelperSubsystem)
+	{
+		//先释放调度器的并发名额，推迟的只是完成回调
+		HTTPHelperSubsystem->NotifyRequestFinished(Request);
+		if (HTTPHelperSubsystem->DeferCompletion(this, Request, Response, bWasSuccessful))
+		{
+			return;
+		}
+	}
+	ProcessCompletion(Request, Response, bWasSuccessful);
+}
+
+void UHTTPRequest::ProcessCompletion(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SimpleHTTP_RequestComplete);
+	const uint32 StartCycles = FPlatformTime::Cycles();
+	UHTTPHelperSubsystem* Subsystem = HTTPHelperSubsystem;
+	ON_SCOPE_EXIT
+	{
+		if (bDecodingCompletion)
+		{
+			//委托在后台转换后执行，到时一起记录
+			PendingCompletionCycles += FPlatformTime::Cycles() - StartCycles;
+		}
+		else if (Subsystem)
+		{
+			Subsystem->RecordCompletionCycles(FPlatformTime::Cycles() - StartCycles);
+		}
+	};
+	//下载到文件时流中已经写入了部分内容，请求内容来自流时流已经被读取，都不能直接重试
+	if (HTTPHelperSubsystem && !bDownloadToFile && !bStreamedContent && HTTPHelperSubsystem->TryScheduleRetry(this, Response, bWasSuccessful))
+	{
+		return;
+	}
+	//最后一次进度可能被合并掉了，完成前补发
+	UpdateProgress(Request, Timestamps.BytesSent, Timestamps.BytesReceived, true);
+	for (UHTTPRequest* Follower : GetCoalescedFollowers())
+	{
+		Follower->UpdateProgress(Request, Timestamps.BytesSent, Timestamps.BytesReceived, true);
+	}
+	RecordCompleted(Response, bWasSuccessful);
+	if (HTTPHelperSubsystem && CachedEntry.IsValid() && bWasSuccessful && Response.IsValid() && Response->GetResponseCode() == EHttpResponseCodes::NotModified)
+	{
+		//服务器确认缓存仍然有效
+		CompleteFromCache(HTTPHelperSubsystem->GetResponseCache().Revalidate(CachedEntry, Response));
+		return;
+	}
+	//验证失败或者返回了新内容，缓存的内容不再代表这个请求的结果
+	CachedEntry.Reset();
+	if (bDownloadToFile)
+	{
+		FinishDownloadToFile(Response, bWasSuccessful);
+		return;
+	}
+	if (HTTPHelperSubsystem && !CacheKey.IsEmpty() && bWasSuccessful && Response.IsValid())
+	{
+		HTTPHelperSubsystem->GetResponseCache().Store(CacheKey, Response);
+	}
 	//BinaryContent = Response->GetContent();
-	OnRequestCompleteAsString.ExecuteIfBound(bWasSuccessful, Response->GetContentAsString());
-	OnRequestCompleteAsBinary.ExecuteIfBound(bWasSuccessful, Response->GetContent());
+	static const TArray<uint8> EmptyContent;
+	BroadcastComplete(bWasSuccessful, Response.IsValid() ? Response->GetContent() : EmptyContent, Response, nullptr);
 }
 
 void UHTTPRequest::OnHeaderReceivedEvent(FHttpRequestPtr Request, const FString& HeaderName, const FString& NewHeaderValue)
 {
+	if (Timestamps.HeadersReceived == 0)
+	{
+		Timestamps.HeadersReceived = FPlatformTime::Seconds();
+	}
 	OnRequestHeaderReceived.ExecuteIfBound(HeaderName, NewHeaderValue);
+	for (UHTTPRequest* Follower : GetCoalescedFollowers())
+	{
+		if (Follower->Timestamps.HeadersReceived == 0)
+		{
+			Follower->Timestamps.HeadersReceived = Timestamps.HeadersReceived;
+		}
+		Follower->OnRequestHeaderReceived.ExecuteIfBound(HeaderName, NewHeaderValue);
+	}
+}
+
+void UHTTPRequest::OnRequestProgressEvent(FHttpRequestPtr Request, FSimpleHttpProgressBytes BytesSent, FSimpleHttpProgressBytes BytesReceived)
+{
+	if (HTTPHelperSubsystem)
+	{
+		HTTPHelperSubsystem->ReportTransferredBytes(Request, (int64)BytesSent, (int64)BytesReceived);
+	}
+	UpdateProgress(Request, (int64)BytesSent, (int64)BytesReceived, false);
+	for (UHTTPRequest* Follower : GetCoalescedFollowers())
+	{
+		Follower->UpdateProgress(Request, (int64)BytesSent, (int64)BytesReceived, false);
+	}
 }
 
-void UHTTPRequest::OnRequestProgressEvent(FHttpRequestPtr Request, int32 BytesSent, int32 BytesReceived)
+void UHTTPRequest::UpdateProgress(const FHttpRequestPtr& Request, int64 BytesSent, int64 BytesReceived, bool bFinal)
 {
-	OnRequestProgress.ExecuteIfBound(BytesReceived, Request->GetResponse()->GetContentLength());
+	Timestamps.MarkProgress(BytesSent, BytesReceived);
+	//没有绑定进度委托时只记录字节数
+	if (!OnRequestProgress.IsBound() && !OnRequestDetailedProgress.IsBound() && !OnRequestProgressNative.IsBound())
+	{
+		return;
+	}
+	if (ProgressThrottle.IsRestarted(BytesSent, BytesReceived))
+	{
+		ProgressThrottle.Reset();
+		ProgressContentLength = -1;
+	}
+	//Content-Length在收到响应头后只读取一次
+	if (ProgressContentLength < 0 && Request.IsValid() && (Timestamps.HeadersReceived > 0 || BytesReceived > 0))
+	{
+		const FHttpResponsePtr Response = Request->GetResponse();
+		if (Response.IsValid() && Response->GetContentLength() > 0)
+		{
+			ProgressContentLength = (int64)Response->GetContentLength();
+		}
+	}
+	static const FHttpProgressSettings DefaultProgressSettings;
+	const FHttpProgressSettings& Settings = ProgressSettingsOverride.IsSet() ? ProgressSettingsOverride.GetValue()
+		: HTTPHelperSubsystem ? HTTPHelperSubsystem->ProgressSettings : DefaultProgressSettings;
+	FHttpRequestProgress Progress;
+	if (!ProgressThrottle.Update(BytesSent, BytesReceived, ProgressContentLength, FPlatformTime::Seconds(), Settings, bFinal, Progress))
+	{
+		return;
+	}
+	OnRequestProgressNative.ExecuteIfBound(Progress);
+	OnRequestDetailedProgress.ExecuteIfBound(Progress);
+	OnRequestProgress.ExecuteIfBound((int32)FMath::Min<int64>(BytesReceived, MAX_int32), (int32)FMath::Clamp<int64>(ProgressContentLength, 0, MAX_int32));
 }
 
 void UHTTPRequest::OnRequestWillRetryEvent(FHttpRequestPtr Request, FHttpResponsePtr Response, float AttemptNumber)
 {
 	OnRequestWillRetry.ExecuteIfBound(AttemptNumber);
+	for (UHTTPRequest* Follower : GetCoalescedFollowers())
+	{
+		Follower->OnRequestWillRetry.ExecuteIfBound(AttemptNumber);
+	}
 }
@@ -0,0 +1,233 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPRequestBatch.h"
+#include "Interfaces/IHttpResponse.h"
+#include "HTTPHelperSubsystem.h"
+#include "Async/Async.h"
+
+FHttpBatchRequestItem::FHttpBatchRequestItem()
+	: Verb(EMethodByte::GET)
+{
+}
+
+void UHTTPRequestBatch::BindBatchComplete(FSimpleHttpBatchCompleteDelegate InDelegate)
+{
+	OnBatchComplete = InDelegate;
+}
+
+void UHTTPRequestBatch::BindBatchComplete(FSimpleHttpBatchCompleteCallback&& InCallback)
+{
+	OnBatchCompleteNative = MoveTemp(InCallback);
+}
+
+FString UHTTPRequestBatch::GetBodyAsString(int32 Index) const
+{
+	const TArrayView<const uint8> Body = GetStoredBody(Index);
+	const FUTF8ToTCHAR BodyChar((const ANSICHAR*)Body.GetData(), Body.Num());
+	return FString(BodyChar.Length(), BodyChar.Get());
+}
+
+TArray<uint8> UHTTPRequestBatch::GetBody(int32 Index) const
+{
+	return TArray<uint8>(GetStoredBody(Index));
+}
+
+TArrayView<const uint8> UHTTPRequestBatch::GetBodyView(int32 Index) const
+{
+	if (!bFinished)
+	{
+		return TArrayView<const uint8>();
+	}
+	return GetStoredBody(Index);
+}
+
+TArrayView<const uint8> UHTTPRequestBatch::GetStoredBody(int32 Index) const
+{
+	if (!Results.IsValidIndex(Index) || Results[Index].BodySize == 0)
+	{
+		return TArrayView<const uint8>();
+	}
+	return TArrayView<const uint8>(Bodies.GetData() + Results[Index].BodyOffset, Results[Index].BodySize);
+}
+
+void UHTTPRequestBatch::Start(UHTTPHelperSubsystem* InSubsystem, const TArray<FHttpBatchRequestItem>& InItems, const FHttpBatchSettings& InSettings)
+{
+	HTTPHelperSubsystem = InSubsystem;
+	Settings = InSettings;
+	Results.SetNum(InItems.Num());
+	Requests.Reserve(InItems.Num());
+	for (int32 Index = 0; Index < InItems.Num(); Index++)
+	{
+		const FHttpBatchRequestItem& Item = InItems[Index];
+		const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = HTTPHelperSubsystem->CreateHTTP_Native(Item.URL, Item.Verb, Item.Headers, Item.Params, Settings.TimeoutSecs, Settings.bAddDefaultHeaders);
+		if (Item.BinaryContent.Num() > 0)
+		{
+			HttpRequest->SetContent(Item.BinaryContent);
+		}
+		else if (!Item.Content.IsEmpty())
+		{
+			HttpRequest->SetContentAsString(Item.Content);
+		}
+		HttpRequest->SetHeader(TEXT("Content-Length"), FString::FromInt(HttpRequest->GetContent().Num()));
+		HttpRequest->OnProcessRequestComplete().BindUObject(this, &UHTTPRequestBatch::OnItemComplete, Index);
+		Requests.Add(HttpRequest);
+	}
+	LaunchPending();
+}
+
+void UHTTPRequestBatch::LaunchPending()
+{
+	while (!bFinished && NextIndex < Requests.Num() && (Settings.MaxConcurrentRequests <= 0 || InFlightCount < Settings.MaxConcurrentRequests))
+	{
+		const int32 Index = NextIndex++;
+		InFlightCount++;
+		//压缩期间也占用并发数，避免同时压缩所有请求体
+		TWeakObjectPtr<UHTTPRequestBatch> WeakThis(this);
+		if (!HTTPHelperSubsystem->CompressNativeRequestBody(Requests[Index].ToSharedRef(), [WeakThis, Index]()
+			{
+				if (UHTTPRequestBatch* This = WeakThis.Get())
+				{
+					This->EnqueueItem(Index);
+				}
+			}))
+		{
+			EnqueueItem(Index);
+		}
+	}
+}
+
+void UHTTPRequestBatch::EnqueueItem(int32 Index)
+{
+	//压缩期间批次可能已经取消
+	if (Results[Index].State != EHttpBatchItemState::Pending || !Requests[Index].IsValid())
+	{
+		return;
+	}
+	TWeakObjectPtr<UHTTPRequestBatch> WeakThis(this);
+	HTTPHelperSubsystem->EnqueueRequest(Requests[Index].ToSharedRef(), Settings.Priority, [WeakThis, Index]()
+		{
+			//调度器仍在发送其他请求，下一帧再处理
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, Index]()
+				{
+					if (UHTTPRequestBatch* This = WeakThis.Get())
+					{
+						if (This->Results[Index].State == EHttpBatchItemState::Pending)
+						{
+							This->FinishItem(Index, EHttpBatchItemState::Failed, nullptr);
+						}
+					}
+				});
+		});
+}
+
+void UHTTPRequestBatch::OnItemComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 Index)
+{
+	if (HTTPHelperSubsystem)
+	{
+		HTTPHelperSubsystem->NotifyRequestFinished(Request);
+	}
+	if (!Results.IsValidIndex(Index) || Results[Index].State != EHttpBatchItemState::Pending)
+	{
+		return;
+	}
+	bool bSucceeded = bWasSuccessful && Response.IsValid();
+	if (bSucceeded && Settings.bHttpErrorsAsFailure)
+	{
+		bSucceeded = EHttpResponseCodes::IsOk(Response->GetResponseCode());
+	}
+	FinishItem(Index, bSucceeded ? EHttpBatchItemState::Succeeded : EHttpBatchItemState::Failed, Response);
+}
+
+void UHTTPRequestBatch::FinishItem(int32 Index, EHttpBatchItemState State, FHttpResponsePtr Response)
+{
+	FHttpBatchItemResult& Result = Results[Index];
+	Result.State = State;
+	if (Response.IsValid())
+	{
+		Result.ResponseCode = Response->GetResponseCode();
+		if (Settings.bCollectBodies)
+		{
+			const TArray<uint8>& Content = Response->GetContent();
+			Result.BodyOffset = Bodies.Num();
+			Result.BodySize = Content.Num();
+			Bodies.Append(Content.GetData(), Content.Num());
+		}
+	}
+	//请求结束后不再需要保留IHttpRequest
+	if (Requests[Index].IsValid())
+	{
+		Requests[Index]->OnProcessRequestComplete().Unbind();
+		Requests[Index].Reset();
+	}
+	InFlightCount--;
+	if (State != EHttpBatchItemState::Succeeded)
+	{
+		bAllSucceeded = false;
+		if (Settings.bFailFast)
+		{
+			CancelRemaining();
+		}
+	}
+	LaunchPending();
+	TryFinish();
+}
+
+void UHTTPRequestBatch::Cancel()
+{
+	if (bFinished)
+	{
+		return;
+	}
+	CancelRemaining();
+	TryFinish();
+}
+
+void UHTTPRequestBatch::CancelRemaining()
+{
+	for (int32 Index = 0; Index < Requests.Num(); Index++)
+	{
+		if (Results[Index].State != EHttpBatchItemState::Pending)
+		{
+			continue;
+		}
+		Results[Index].State = EHttpBatchItemState::Cancelled;
+		bAllSucceeded = false;
+		if (!Requests[Index].IsValid())
+		{
+			continue;
+		}
+		const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = Requests[Index].ToSharedRef();
+		Requests[Index].Reset();
+		Request->OnProcessRequestComplete().Unbind();
+		if (Index < NextIndex)
+		{
+			InFlightCount--;
+			if (HTTPHelperSubsystem && !HTTPHelperSubsystem->RemoveQueuedRequest(Request))
+			{
+				Request->CancelRequest();
+				HTTPHelperSubsystem->NotifyRequestFinished(Request);
+			}
+		}
+	}
+	NextIndex = Requests.Num();
+}
+
+void UHTTPRequestBatch::TryFinish()
+{
+	if (bFinished || InFlightCount > 0 || NextIndex < Requests.Num())
+	{
+		return;
+	}
+	bFinished = true;
+	Requests.Empty();
+	if (HTTPHelperSubsystem)
+	{
+		HTTPHelperSubsystem->OnBatchFinished(this);
+	}
+	if (OnBatchCompleteNative)
+	{
+		OnBatchCompleteNative(bAllSucceeded, this);
+	}
+	OnBatchComplete.ExecuteIfBound(bAllSucceeded, this);
+}
@@ -0,0 +1,219 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPRequestMetrics.h"
+#include "HTTPRequestScheduler.h"
+#include "SimpleHTTPCompat.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#if SIMPLEHTTP_WITH_TRACE_COUNTERS
+#include "ProfilingDebugging/CountersTrace.h"
+#endif
+
+DECLARE_STATS_GROUP(TEXT("SimpleHTTP"), STATGROUP_SimpleHTTP, STATCAT_Advanced);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("In Flight Requests"), STAT_SimpleHTTP_InFlight, STATGROUP_SimpleHTTP);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Queued Requests"), STAT_SimpleHTTP_Queued, STATGROUP_SimpleHTTP);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Completed Requests"), STAT_SimpleHTTP_Completed, STATGROUP_SimpleHTTP);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Failed Requests"), STAT_SimpleHTTP_Failed, STATGROUP_SimpleHTTP);
+//DWORD统计在内部以int64保存，字节数直接以int64累加，不截断大于4GB的传输
+DECLARE_DWORD_COUNTER_STAT(TEXT("Bytes Sent"), STAT_SimpleHTTP_BytesSent, STATGROUP_SimpleHTTP);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Bytes Received"), STAT_SimpleHTTP_BytesReceived, STATGROUP_SimpleHTTP);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Completion Game Thread (ms)"), STAT_SimpleHTTP_CompletionMs, STATGROUP_SimpleHTTP);
+
+CSV_DEFINE_CATEGORY(SimpleHTTP, true);
+
+#if SIMPLEHTTP_WITH_TRACE_COUNTERS
+TRACE_DECLARE_INT_COUNTER(SimpleHTTPInFlight, TEXT("SimpleHTTP/InFlight"));
+TRACE_DECLARE_INT_COUNTER(SimpleHTTPQueued, TEXT("SimpleHTTP/Queued"));
+TRACE_DECLARE_FLOAT_COUNTER(SimpleHTTPLatencyMs, TEXT("SimpleHTTP/LatencyMs"));
+TRACE_DECLARE_MEMORY_COUNTER(SimpleHTTPBytesSent, TEXT("SimpleHTTP/BytesSent"));
+TRACE_DECLARE_MEMORY_COUNTER(SimpleHTTPBytesReceived, TEXT("SimpleHTTP/BytesReceived"));
+#endif
+
+void FHttpRequestTimestamps::MarkQueued()
+{
+	Queued = FPlatformTime::Seconds();
+	Dispatched = 0;
+	HeadersReceived = 0;
+	FirstByte = 0;
+	Completed = 0;
+	BytesSent = 0;
+	BytesReceived = 0;
+}
+
+void FHttpRequestTimestamps::MarkProgress(int64 InBytesSent, int64 InBytesReceived)
+{
+	BytesSent = FMath::Max(BytesSent, InBytesSent);
+	BytesReceived = FMath::Max(BytesReceived, InBytesReceived);
+	if (FirstByte == 0 && InBytesReceived > 0)
+	{
+		FirstByte = FPlatformTime::Seconds();
+	}
+}
+
+void FHttpRequestTimestamps::FillTiming(FHttpRequestTiming& OutTiming) const
+{
+	auto Interval = [](double From, double To)
+	{
+		return From > 0 && To > 0 ? (float)(To - From) : -1.f;
+	};
+	OutTiming.QueueSeconds = Interval(Queued, Dispatched);
+	OutTiming.TimeToHeadersSeconds = Interval(Dispatched, HeadersReceived);
+	OutTiming.TimeToFirstByteSeconds = Interval(Dispatched, FirstByte);
+	OutTiming.TransferSeconds = Interval(Dispatched, Completed);
+	OutTiming.TotalSeconds = Interval(Submitted, Completed);
+	OutTiming.BytesSent = BytesSent;
+	OutTiming.BytesReceived = BytesReceived;
+}
+
+int32 FHttpLatencyHistogram::GetBucketIndex(double Milliseconds)
+{
+	//第一个桶的上限为0.5毫秒，最后一个桶大约为290秒
+	if (Milliseconds <= 0.5)
+	{
+		return 0;
+	}
+	const int32 Index = FMath::CeilToInt(FMath::Loge(Milliseconds / 0.5) / FMath::Loge(1.15));
+	return FMath::Clamp(Index, 0, NumBuckets - 1);
+}
+
+double FHttpLatencyHistogram::GetBucketUpperMs(int32 Index)
+{
+	return 0.5 * FMath::Pow(1.15, (double)Index);
+}
+
+void FHttpLatencyHistogram::Add(double Seconds)
+{
+	if (Seconds < 0)
+	{
+		return;
+	}
+	Buckets[GetBucketIndex(Seconds * 1000.0)]++;
+	Count++;
+	TotalSeconds += Seconds;
+	MaxSeconds = FMath::Max(MaxSeconds, Seconds);
+}
+
+float FHttpLatencyHistogram::GetPercentileMs(float Percentile) const
+{
+	if (Count == 0)
+	{
+		return 0.f;
+	}
+	const int64 Target = FMath::Max<int64>(1, (int64)FMath::CeilToDouble(FMath::Clamp(Percentile, 0.f, 1.f) * Count));
+	int64 Cumulative = 0;
+	for (int32 Index = 0; Index < NumBuckets; Index++)
+	{
+		Cumulative += Buckets[Index];
+		if (Cumulative >= Target)
+		{
+			return (float)FMath::Min(GetBucketUpperMs(Index), MaxSeconds * 1000.0);
+		}
+	}
+	return GetMaxMs();
+}
+
+void FHttpRequestMetrics::Record(const FHttpRequestTiming& Timing)
+{
+	FHostData* Data = Hosts.Find(Timing.Host);
+	if (!Data)
+	{
+		Data = MaxHosts > 0 && Hosts.Num() >= MaxHosts ? &Hosts.FindOrAdd(TEXT("other")) : &Hosts.Add(Timing.Host);
+	}
+	RecordedRequests++;
+	Data->Requests++;
+	Data->Retries += Timing.RetryCount;
+	Data->BytesSent += Timing.BytesSent;
+	Data->BytesReceived += Timing.BytesReceived;
+	if (!Timing.bSucceeded)
+	{
+		Data->FailedRequests++;
+	}
+	Data->Latency.Add(Timing.TransferSeconds);
+	Data->FirstByte.Add(Timing.TimeToFirstByteSeconds);
+	Data->Queue.Add(Timing.QueueSeconds);
+	if (Timing.TimeToFirstByteSeconds >= 0 && Timing.TransferSeconds > Timing.TimeToFirstByteSeconds)
+	{
+		Data->ReceiveSeconds += Timing.TransferSeconds - Timing.TimeToFirstByteSeconds;
+	}
+
+	INC_DWORD_STAT(STAT_SimpleHTTP_Completed);
+	if (!Timing.bSucceeded)
+	{
+		INC_DWORD_STAT(STAT_SimpleHTTP_Failed);
+	}
+	INC_DWORD_STAT_BY(STAT_SimpleHTTP_BytesSent, Timing.BytesSent);
+	INC_DWORD_STAT_BY(STAT_SimpleHTTP_BytesReceived, Timing.BytesReceived);
+#if SIMPLEHTTP_WITH_TRACE_COUNTERS
+	TRACE_COUNTER_ADD(SimpleHTTPBytesSent, Timing.BytesSent);
+	TRACE_COUNTER_ADD(SimpleHTTPBytesReceived, Timing.BytesReceived);
+#endif
+
+	CSV_CUSTOM_STAT(SimpleHTTP, Completed, 1, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(SimpleHTTP, Failed, Timing.bSucceeded ? 0 : 1, ECsvCustomStatOp::Accumulate);
+	CSV_CUSTOM_STAT(SimpleHTTP, KBReceived, (float)(Timing.BytesReceived / 1024.0), ECsvCustomStatOp::Accumulate);
+	if (Timing.TransferSeconds >= 0)
+	{
+		CSV_CUSTOM_STAT(SimpleHTTP, MaxLatencyMs, Timing.TransferSeconds * 1000.f, ECsvCustomStatOp::Max);
+#if SIMPLEHTTP_WITH_TRACE_COUNTERS
+		TRACE_COUNTER_SET(SimpleHTTPLatencyMs, Timing.TransferSeconds * 1000.f);
+#endif
+	}
+}
+
+void FHttpRequestMetrics::UpdateSchedulerStats(const FHttpSchedulerStats& Stats) const
+{
+	const int32 Queued = Stats.QueuedCritical + Stats.QueuedNormal + Stats.QueuedBackground;
+	SET_DWORD_STAT(STAT_SimpleHTTP_InFlight, Stats.InFlight);
+	SET_DWORD_STAT(STAT_SimpleHTTP_Queued, Queued);
+	CSV_CUSTOM_STAT(SimpleHTTP, InFlight, Stats.InFlight, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(SimpleHTTP, Queued, Queued, ECsvCustomStatOp::Set);
+#if SIMPLEHTTP_WITH_TRACE_COUNTERS
+	TRACE_COUNTER_SET(SimpleHTTPInFlight, Stats.InFlight);
+	TRACE_COUNTER_SET(SimpleHTTPQueued, Queued);
+#endif
+}
+
+TArray<FHttpHostMetrics> FHttpRequestMetrics::GetSnapshot() const
+{
+	TArray<FHttpHostMetrics> Snapshot;
+	Snapshot.Reserve(Hosts.Num());
+	for (const TPair<FString, FHostData>& Pair : Hosts)
+	{
+		const FHostData& Data = Pair.Value;
+		FHttpHostMetrics& Metrics = Snapshot.AddDefaulted_GetRef();
+		Metrics.Host = Pair.Key;
+		Metrics.Requests = Data.Requests;
+		Metrics.FailedRequests = Data.FailedRequests;
+		Metrics.Retries = Data.Retries;
+		Metrics.BytesSent = Data.BytesSent;
+		Metrics.BytesReceived = Data.BytesReceived;
+		Metrics.AverageLatencyMs = Data.Latency.GetAverageMs();
+		Metrics.LatencyP50Ms = Data.Latency.GetPercentileMs(0.5f);
+		Metrics.LatencyP95Ms = Data.Latency.GetPercentileMs(0.95f);
+		Metrics.LatencyP99Ms = Data.Latency.GetPercentileMs(0.99f);
+		Metrics.LatencyMaxMs = Data.Latency.GetMaxMs();
+		Metrics.FirstByteP50Ms = Data.FirstByte.GetPercentileMs(0.5f);
+		Metrics.FirstByteP95Ms = Data.FirstByte.GetPercentileMs(0.95f);
+		Metrics.FirstByteP99Ms = Data.FirstByte.GetPercentileMs(0.99f);
+		Metrics.QueueP95Ms = Data.Queue.GetPercentileMs(0.95f);
+		Metrics.AverageReceiveBytesPerSecond = Data.ReceiveSeconds > 0 ? (float)(Data.BytesReceived / Data.ReceiveSeconds) : 0.f;
+	}
+	//最慢的Host排在前面
+	Snapshot.Sort([](const FHttpHostMetrics& A, const FHttpHostMetrics& B) { return A.LatencyP95Ms > B.LatencyP95Ms; });
+	return Snapshot;
+}
+
+void FHttpRequestMetrics::Reset()
+{
+	Hosts.Empty();
+	CompletionSeconds = 0;
+	RecordedRequests = 0;
+}
+
+void FHttpRequestMetrics::AddCompletionCycles(uint32 Cycles)
+{
+	const double Seconds = FPlatformTime::ToSeconds(Cycles);
+	CompletionSeconds += Seconds;
+	INC_FLOAT_STAT_BY(STAT_SimpleHTTP_CompletionMs, (float)(Seconds * 1000.0));
+}
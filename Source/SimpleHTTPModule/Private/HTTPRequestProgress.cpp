@@ -0,0 +1,51 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPRequestProgress.h"
+
+void FHttpProgressThrottle::Reset()
+{
+	*this = FHttpProgressThrottle();
+}
+
+bool FHttpProgressThrottle::Update(int64 BytesSent, int64 BytesReceived, int64 ContentLength, double Now, const FHttpProgressSettings& Settings, bool bFinal, FHttpRequestProgress& OutProgress)
+{
+	if (StartTime == 0)
+	{
+		StartTime = Now;
+		LastReportTime = Now;
+	}
+	const int64 SentDelta = BytesSent - LastBytesSent;
+	const int64 ReceivedDelta = BytesReceived - LastBytesReceived;
+	if (SentDelta == 0 && ReceivedDelta == 0 && (bReported || !bFinal))
+	{
+		return false;
+	}
+	const double Interval = Now - LastReportTime;
+	const bool bDue = bFinal
+		|| Settings.MinIntervalSeconds <= 0
+		|| Interval >= Settings.MinIntervalSeconds
+		|| (Settings.MinByteStep > 0 && SentDelta + ReceivedDelta >= Settings.MinByteStep)
+		|| (ContentLength > 0 && BytesReceived >= ContentLength);
+	if (!bDue)
+	{
+		return false;
+	}
+
+	const double Elapsed = Now - StartTime;
+	OutProgress.BytesSent = BytesSent;
+	OutProgress.BytesReceived = BytesReceived;
+	OutProgress.ContentLength = ContentLength > 0 ? ContentLength : -1;
+	OutProgress.ReceivedFraction = ContentLength > 0 ? (float)FMath::Min(1.0, (double)BytesReceived / ContentLength) : -1.f;
+	OutProgress.ElapsedSeconds = (float)Elapsed;
+	OutProgress.SendBytesPerSecond = Interval > 0 ? (float)(SentDelta / Interval) : 0.f;
+	OutProgress.ReceiveBytesPerSecond = Interval > 0 ? (float)(ReceivedDelta / Interval) : 0.f;
+	OutProgress.AverageSendBytesPerSecond = Elapsed > 0 ? (float)(BytesSent / Elapsed) : 0.f;
+	OutProgress.AverageReceiveBytesPerSecond = Elapsed > 0 ? (float)(BytesReceived / Elapsed) : 0.f;
+
+	LastReportTime = Now;
+	LastBytesSent = BytesSent;
+	LastBytesReceived = BytesReceived;
+	bReported = true;
+	return true;
+}
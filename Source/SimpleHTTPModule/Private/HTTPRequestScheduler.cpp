@@ -0,0 +1,312 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPRequestScheduler.h"
+#include "PlatformHttp.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Misc/ScopeExit.h"
+
+void FHttpRequestScheduler::Enqueue(const FRequestRef& Request, EHttpRequestPriority Priority, TFunction<void()>&& OnDispatchFailed, TFunction<void()>&& OnDispatched)
+{
+	const int32 Class = FMath::Clamp((int32)Priority, 0, (int32)EHttpRequestPriority::Max - 1);
+	FQueuedEntry Entry{ Request, FPlatformHttp::GetUrlDomain(Request->GetURL()), (EHttpRequestPriority)Class, FPlatformTime::Seconds(), MoveTemp(OnDispatchFailed), MoveTemp(OnDispatched) };
+	Queues[Class].Add(MoveTemp(Entry));
+
+	int32 QueueDepth = 0;
+	for (const TArray<FQueuedEntry>& Queue : Queues)
+	{
+		QueueDepth += Queue.Num();
+	}
+	PeakQueueDepth = FMath::Max(PeakQueueDepth, QueueDepth);
+}
+
+bool FHttpRequestScheduler::Remove(const FHttpRequestPtr& Request)
+{
+	for (TArray<FQueuedEntry>& Queue : Queues)
+	{
+		const int32 Index = Queue.IndexOfByPredicate([&Request](const FQueuedEntry& Entry) { return &Entry.Request.Get() == Request.Get(); });
+		if (Index != INDEX_NONE)
+		{
+			Queue.RemoveAt(Index);
+			return true;
+		}
+	}
+	return false;
+}
+
+void FHttpRequestScheduler::NotifyFinished(const FHttpRequestPtr& Request, const FHttpSchedulerSettings& Settings)
+{
+	const int32 Index = InFlight.IndexOfByPredicate([&Request](const FInFlightEntry& Entry) { return &Entry.Request.Get() == Request.Get(); });
+	if (Index != INDEX_NONE)
+	{
+		ReleaseInFlight(Index, Settings);
+	}
+}
+
+FHttpRequestScheduler::FInFlightEntry* FHttpRequestScheduler::FindInFlight(const FHttpRequestPtr& Request)
+{
+	return InFlight.FindByPredicate([&Request](const FInFlightEntry& Entry) { return &Entry.Request.Get() == Request.Get(); });
+}
+
+void FHttpRequestScheduler::AddTransferredBytes(const FHttpRequestPtr& Request, int64 BytesSent, int64 BytesReceived, const FHttpSchedulerSettings& Settings)
+{
+	if (!Settings.Bandwidth.bEnabled)
+	{
+		return;
+	}
+	FInFlightEntry* Entry = FindInFlight(Request);
+	if (!Entry)
+	{
+		return;
+	}
+	//请求体的大小在发送时已经计入，有计数的流由ChargeCounter计入
+	const int64 SentDelta = Entry->SendCounter.IsValid() ? 0 : BytesSent - Entry->ChargedSent;
+	const int64 ReceivedDelta = Entry->ReceiveCounter.IsValid() ? 0 : BytesReceived - Entry->ChargedReceived;
+	if (!Entry->SendCounter.IsValid())
+	{
+		Entry->ChargedSent = FMath::Max(Entry->ChargedSent, BytesSent);
+	}
+	if (!Entry->ReceiveCounter.IsValid())
+	{
+		Entry->ChargedReceived = FMath::Max(Entry->ChargedReceived, BytesReceived);
+	}
+	BandwidthLimiter.Consume(Settings.Bandwidth, Entry->Host, Entry->Priority, SentDelta, ReceivedDelta);
+}
+
+void FHttpRequestScheduler::SetTransferCounters(const FHttpRequestPtr& Request, const TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe>& SendCounter, const TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe>& ReceiveCounter)
+{
+	if (FInFlightEntry* Entry = FindInFlight(Request))
+	{
+		Entry->SendCounter = SendCounter;
+		Entry->ReceiveCounter = ReceiveCounter;
+	}
+}
+
+void FHttpRequestScheduler::ChargeCounter(FInFlightEntry& Entry, const FHttpSchedulerSettings& Settings)
+{
+	//不限速时也取出，避免开启限速时一次计入之前所有的字节
+	const int64 Sent = Entry.SendCounter.IsValid() ? Entry.SendCounter->Take() : 0;
+	const int64 Received = Entry.ReceiveCounter.IsValid() ? Entry.ReceiveCounter->Take() : 0;
+	Entry.ChargedSent += Sent;
+	Entry.ChargedReceived += Received;
+	BandwidthLimiter.Consume(Settings.Bandwidth, Entry.Host, Entry.Priority, Sent, Received);
+}
+
+void FHttpRequestScheduler::UpdatePace(FInFlightEntry& Entry, const FHttpSchedulerSettings& Settings) const
+{
+	const float MaxWaitSeconds = Settings.Bandwidth.MaxStreamPaceMilliseconds / 1000.f;
+	if (Entry.SendCounter.IsValid())
+	{
+		Entry.SendCounter->SetPace(BandwidthLimiter.GetPaceSeconds(Settings.Bandwidth, Entry.Host, Entry.Priority, true), MaxWaitSeconds);
+	}
+	if (Entry.ReceiveCounter.IsValid())
+	{
+		Entry.ReceiveCounter->SetPace(BandwidthLimiter.GetPaceSeconds(Settings.Bandwidth, Entry.Host, Entry.Priority, false), MaxWaitSeconds);
+	}
+}
+
+bool FHttpRequestScheduler::IsQueued(const FHttpRequestPtr& Request) const
+{
+	for (const TArray<FQueuedEntry>& Queue : Queues)
+	{
+		if (Queue.ContainsByPredicate([&Request](const FQueuedEntry& Entry) { return &Entry.Request.Get() == Request.Get(); }))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FHttpRequestScheduler::RaisePriority(const FHttpRequestPtr& Request, EHttpRequestPriority Priority)
+{
+	const int32 NewClass = FMath::Clamp((int32)Priority, 0, (int32)EHttpRequestPriority::Max - 1);
+	for (int32 Class = NewClass + 1; Class < (int32)EHttpRequestPriority::Max; Class++)
+	{
+		TArray<FQueuedEntry>& Queue = Queues[Class];
+		const int32 Index = Queue.IndexOfByPredicate([&Request](const FQueuedEntry& Entry) { return &Entry.Request.Get() == Request.Get(); });
+		if (Index != INDEX_NONE)
+		{
+			FQueuedEntry Entry = MoveTemp(Queue[Index]);
+			Queue.RemoveAt(Index);
+			Entry.Priority = (EHttpRequestPriority)NewClass;
+			Queues[NewClass].Add(MoveTemp(Entry));
+			return true;
+		}
+	}
+	return false;
+}
+
+void FHttpRequestScheduler::ReleaseInFlight(int32 Index, const FHttpSchedulerSettings& Settings)
+{
+	FInFlightEntry& Entry = InFlight[Index];
+	ChargeCounter(Entry, Settings);
+	if (!Entry.ReceiveCounter.IsValid() && Settings.Bandwidth.bEnabled)
+	{
+		//没有进度事件的请求在完成时按实际收到的响应体计入。HEAD和304等没有响应体的请求不按Content-Length计入
+		const FHttpResponsePtr Response = Entry.Request->GetResponse();
+		if (Response.IsValid())
+		{
+			BandwidthLimiter.Consume(Settings.Bandwidth, Entry.Host, Entry.Priority, 0, (int64)Response->GetContent().Num() - Entry.ChargedReceived);
+		}
+	}
+	if (int32* HostCount = InFlightPerHost.Find(InFlight[Index].Host))
+	{
+		if (--(*HostCount) <= 0)
+		{
+			InFlightPerHost.Remove(InFlight[Index].Host);
+		}
+	}
+	InFlight.RemoveAtSwap(Index);
+}
+
+void FHttpRequestScheduler::Pump(const FHttpSchedulerSettings& Settings)
+{
+	//ProcessRequest失败时的回调可能再次发起请求，避免重入
+	if (bPumping)
+	{
+		return;
+	}
+	bPumping = true;
+	ON_SCOPE_EXIT
+	{
+		bPumping = false;
+	};
+
+	BandwidthLimiter.Refill(Settings.Bandwidth, FPlatformTime::Seconds());
+	for (FInFlightEntry& Entry : InFlight)
+	{
+		ChargeCounter(Entry, Settings);
+		UpdatePace(Entry, Settings);
+	}
+	for (int32 Class = 0; Class < (int32)EHttpRequestPriority::Max; Class++)
+	{
+		const bool bCritical = Class == (int32)EHttpRequestPriority::Critical;
+		int32 GlobalLimit = Settings.MaxConcurrentRequests;
+		if (GlobalLimit > 0 && !bCritical)
+		{
+			GlobalLimit = FMath::Max(1, GlobalLimit - FMath::Max(0, Settings.CriticalReservedSlots));
+		}
+		TArray<FQueuedEntry>& Queue = Queues[Class];
+		for (int32 Index = 0; Index < Queue.Num();)
+		{
+			if (GlobalLimit > 0 && InFlight.Num() >= GlobalLimit)
+			{
+				break;
+			}
+			const int32* HostCount = InFlightPerHost.Find(Queue[Index].Host);
+			if (!bCritical && Settings.MaxConcurrentRequestsPerHost > 0 && HostCount && *HostCount >= Settings.MaxConcurrentRequestsPerHost)
+			{
+				//这个Host已经满了，继续看其他Host的请求
+				Index++;
+				continue;
+			}
+			const int64 ContentLength = (int64)Queue[Index].Request->GetContentLength();
+			if (!BandwidthLimiter.CanDispatch(Settings.Bandwidth, Queue[Index].Host, Queue[Index].Priority, ContentLength > 0))
+			{
+				//带宽透支，等待令牌补充后在之后的Tick中发送
+				TotalBandwidthDeferred++;
+				Index++;
+				continue;
+			}
+			FQueuedEntry Entry = MoveTemp(Queue[Index]);
+			Queue.RemoveAt(Index);
+
+			InFlightPerHost.FindOrAdd(Entry.Host)++;
+			InFlight.Add(FInFlightEntry{ Entry.Request, Entry.Host, Entry.Priority });
+			if (Entry.OnDispatched)
+			{
+				//可能设置流的计数
+				Entry.OnDispatched();
+			}
+			//流式的请求体在读取时计入，其他请求体在发送时整个计入
+			if (FInFlightEntry* Dispatched = FindInFlight(Entry.Request))
+			{
+				if (!Dispatched->SendCounter.IsValid())
+				{
+					Dispatched->ChargedSent = ContentLength;
+					BandwidthLimiter.Consume(Settings.Bandwidth, Entry.Host, Entry.Priority, ContentLength, 0);
+				}
+				UpdatePace(*Dispatched, Settings);
+			}
+			if (Entry.Request->ProcessRequest())
+			{
+				TotalDispatched++;
+			}
+			else
+			{
+				TotalDispatchFailed++;
+				NotifyFinished(Entry.Request, Settings);
+				if (Entry.OnDispatchFailed)
+				{
+					Entry.OnDispatchFailed();
+				}
+			}
+		}
+	}
+}
+
+void FHttpRequestScheduler::Tick(const FHttpSchedulerSettings& Settings)
+{
+	const double Now = FPlatformTime::Seconds();
+	if (Settings.StarvationPromoteSeconds > 0)
+	{
+		//只把Background提升为Normal。提升为Critical会绕过Host的并发限制并占用保留的名额，反而让批量请求挤占Critical请求
+		TArray<FQueuedEntry>& Queue = Queues[(int32)EHttpRequestPriority::Background];
+		for (int32 Index = 0; Index < Queue.Num();)
+		{
+			if (Now - Queue[Index].EnqueueTime >= Settings.StarvationPromoteSeconds)
+			{
+				FQueuedEntry Entry = MoveTemp(Queue[Index]);
+				Queue.RemoveAt(Index);
+				Queues[(int32)EHttpRequestPriority::Normal].Add(MoveTemp(Entry));
+				TotalPromoted++;
+			}
+			else
+			{
+				Index++;
+			}
+		}
+	}
+	for (int32 Index = InFlight.Num() - 1; Index >= 0; Index--)
+	{
+		if (EHttpRequestStatus::IsFinished(InFlight[Index].Request->GetStatus()))
+		{
+			ReleaseInFlight(Index, Settings);
+		}
+	}
+	Pump(Settings);
+}
+
+void FHttpRequestScheduler::Reset()
+{
+	for (TArray<FQueuedEntry>& Queue : Queues)
+	{
+		Queue.Empty();
+	}
+	InFlight.Empty();
+	InFlightPerHost.Empty();
+	BandwidthLimiter.Reset();
+}
+
+FHttpSchedulerStats FHttpRequestScheduler::GetStats() const
+{
+	FHttpSchedulerStats Stats;
+	Stats.QueuedCritical = Queues[(int32)EHttpRequestPriority::Critical].Num();
+	Stats.QueuedNormal = Queues[(int32)EHttpRequestPriority::Normal].Num();
+	Stats.QueuedBackground = Queues[(int32)EHttpRequestPriority::Background].Num();
+	Stats.InFlight = InFlight.Num();
+	Stats.PeakQueueDepth = PeakQueueDepth;
+	Stats.TotalDispatched = TotalDispatched;
+	Stats.TotalPromoted = TotalPromoted;
+	Stats.TotalDispatchFailed = TotalDispatchFailed;
+	Stats.TotalBandwidthDeferred = TotalBandwidthDeferred;
+	const double Now = FPlatformTime::Seconds();
+	for (const TArray<FQueuedEntry>& Queue : Queues)
+	{
+		for (const FQueuedEntry& Entry : Queue)
+		{
+			Stats.OldestQueuedSeconds = FMath::Max(Stats.OldestQueuedSeconds, (float)(Now - Entry.EnqueueTime));
+		}
+	}
+	return Stats;
+}
@@ -0,0 +1,56 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPRequestTemplate.h"
+#include "HTTPHelperSubsystem.h"
+#include "HttpModule.h"
+
+void UHTTPRequestTemplate::Initialize(UHTTPHelperSubsystem* InSubsystem, const FString& URL, EMethodByte Verb, const TMap<FString, FString>& Headers, float InTimeoutSecs, bool bAddDefaultHeaders, EHttpRequestPriority InPriority)
+{
+	HTTPHelperSubsystem = InSubsystem;
+	BaseURL = URL;
+	VerbString = UHTTPHelperSubsystem::MethodByteToString(Verb);
+	TimeoutSecs = InTimeoutSecs;
+	Priority = InPriority;
+	bEncodeQueryParams = InSubsystem->bEncodeQueryParams;
+	ResolvedHeaders.Reset();
+	InSubsystem->ForEachRequestHeader(Verb, Headers, bAddDefaultHeaders, [this](const FString& Key, const FString& Value)
+		{
+			ResolvedHeaders.Emplace(Key, Value);
+		});
+}
+
+TSharedRef<IHttpRequest, ESPMode::ThreadSafe> UHTTPRequestTemplate::CreateRequest(const TMap<FString, FString>& Params) const
+{
+	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = FHttpModule::Get().CreateRequest();
+	HttpRequest->SetURL(Params.Num() > 0 ? UHTTPHelperSubsystem::BuildRequestURL(BaseURL, Params, bEncodeQueryParams) : BaseURL);
+	HttpRequest->SetVerb(VerbString);
+	for (const TPair<FString, FString>& Header : ResolvedHeaders)
+	{
+		HttpRequest->AppendToHeader(Header.Key, Header.Value);
+	}
+	HttpRequest->SetTimeout(TimeoutSecs);
+	return HttpRequest;
+}
+
+UHTTPRequest* UHTTPRequestTemplate::Call(const TMap<FString, FString>& Params, const FString& Content)
+{
+	if (!HTTPHelperSubsystem)
+	{
+		return nullptr;
+	}
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateRequest(Params);
+	HttpRequest->SetContentAsString(Content);
+	return HTTPHelperSubsystem->CreateHttpRequestObject(HttpRequest, 0, Priority);
+}
+
+UHTTPRequest* UHTTPRequestTemplate::CallAsBinary(const TMap<FString, FString>& Params, const TArray<uint8>& Content)
+{
+	if (!HTTPHelperSubsystem)
+	{
+		return nullptr;
+	}
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = CreateRequest(Params);
+	HttpRequest->SetContent(Content);
+	return HTTPHelperSubsystem->CreateHttpRequestObject(HttpRequest, 0, Priority);
+}
@@ -0,0 +1,455 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPResponseCache.h"
+#include "Algo/AnyOf.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+
+namespace SimpleHTTPCache
+{
+	static const uint32 FileMagic = 0x53484331;
+	static const int32 FileVersion = 1;
+}
+
+bool FHttpCacheEntry::IsFresh() const
+{
+	return !bNoCache && FDateTime::UtcNow() < ExpireTimeUtc;
+}
+
+FHttpResponseCache::~FHttpResponseCache()
+{
+	MemoryItems.Empty();
+	MemoryLRU.Empty();
+}
+
+void FHttpResponseCache::SetSettings(const FHttpCacheSettings& InSettings)
+{
+	Settings = InSettings;
+	while (MemoryBytes > Settings.MaxMemoryBytes && MemoryLRU.GetTail())
+	{
+		const FString OldestKey = MemoryLRU.GetTail()->GetValue();
+		RemoveFromMemory(OldestKey);
+		Stats.MemoryEvictions++;
+	}
+}
+
+//影响响应内容的请求头，不同的值分开缓存，响应的Vary只包含这些请求头时也可以缓存
+static const TCHAR* const KeyedRequestHeaders[] = { TEXT("Authorization"), TEXT("Accept"), TEXT("Accept-Encoding"), TEXT("Cookie") };
+
+FString FHttpResponseCache::MakeKey(const IHttpRequest& Request)
+{
+	FString Key = Request.GetVerb() + TEXT(" ") + Request.GetURL();
+	FString VaryingHeaders;
+	for (const TCHAR* HeaderName : KeyedRequestHeaders)
+	{
+		const FString Value = Request.GetHeader(HeaderName);
+		if (!Value.IsEmpty())
+		{
+			VaryingHeaders += FString(HeaderName) + TEXT(":") + Value + TEXT("\n");
+		}
+	}
+	if (!VaryingHeaders.IsEmpty())
+	{
+		//不同用户和内容协商的响应分开缓存，只保存摘要避免键中出现凭据
+		Key += TEXT("#") + FMD5::HashAnsiString(*VaryingHeaders);
+	}
+	return Key;
+}
+
+static bool IsVaryCoveredByKey(const FString& Vary)
+{
+	TArray<FString> HeaderNames;
+	Vary.ParseIntoArray(HeaderNames, TEXT(","));
+	for (FString& HeaderName : HeaderNames)
+	{
+		HeaderName.TrimStartAndEndInline();
+		const bool bKeyed = Algo::AnyOf(KeyedRequestHeaders, [&HeaderName](const TCHAR* KeyedHeader) { return HeaderName.Equals(KeyedHeader, ESearchCase::IgnoreCase); });
+		if (!HeaderName.IsEmpty() && !bKeyed)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void FHttpResponseCache::Find(const FString& Key, TFunction<void(FHttpCacheEntryPtr Entry)>&& OnFound)
+{
+	if (FMemoryItem* Item = MemoryItems.Find(Key))
+	{
+		MemoryLRU.RemoveNode(Item->Node);
+		MemoryLRU.AddHead(Key);
+		Item->Node = MemoryLRU.GetHead();
+		OnFound(Item->Entry);
+		return;
+	}
+	if (!Settings.bEnableDiskCache)
+	{
+		OnFound(nullptr);
+		return;
+	}
+	const FString FilePath = GetDiskPath(Key);
+	TWeakPtr<FHttpResponseCache, ESPMode::ThreadSafe> WeakThis = AsShared();
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Key, FilePath, OnFound = MoveTemp(OnFound)]() mutable
+		{
+			FHttpCacheEntryPtr Entry = LoadEntry(Key, FilePath);
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, Entry, OnFound = MoveTemp(OnFound)]()
+				{
+					if (TSharedPtr<FHttpResponseCache, ESPMode::ThreadSafe> This = WeakThis.Pin())
+					{
+						if (Entry.IsValid())
+						{
+							This->Stats.DiskLoads++;
+							This->AddToMemory(Entry);
+						}
+					}
+					OnFound(Entry);
+				});
+		});
+}
+
+void FHttpResponseCache::Store(const FString& Key, const FHttpResponsePtr& Response)
+{
+	if (!Response.IsValid() || Response->GetResponseCode() != EHttpResponseCodes::Ok)
+	{
+		return;
+	}
+	FDateTime ExpireTimeUtc;
+	bool bNoCache = false;
+	if (!ParseFreshness(*Response, ExpireTimeUtc, bNoCache))
+	{
+		return;
+	}
+	//不处理按缓存键以外的请求头区分的响应，包括Vary: *
+	if (!IsVaryCoveredByKey(Response->GetHeader(TEXT("Vary"))))
+	{
+		return;
+	}
+	TSharedPtr<FHttpCacheEntry, ESPMode::ThreadSafe> Entry = MakeShared<FHttpCacheEntry, ESPMode::ThreadSafe>();
+	Entry->Key = Key;
+	Entry->ResponseCode = Response->GetResponseCode();
+	Entry->ContentType = Response->GetContentType();
+	Entry->ETag = Response->GetHeader(TEXT("ETag"));
+	Entry->LastModified = Response->GetHeader(TEXT("Last-Modified"));
+	Entry->ExpireTimeUtc = ExpireTimeUtc;
+	Entry->bNoCache = bNoCache;
+	//既没有有效期也不能验证的响应缓存了也用不上
+	if (!Entry->IsFresh() && !Entry->HasValidator())
+	{
+		return;
+	}
+	Entry->Content = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>(Response->GetContent());
+	Stats.Stores++;
+	AddToMemory(Entry);
+	WriteToDisk(Entry);
+}
+
+FHttpCacheEntryPtr FHttpResponseCache::Revalidate(const FHttpCacheEntryPtr& Entry, const FHttpResponsePtr& Response)
+{
+	TSharedPtr<FHttpCacheEntry, ESPMode::ThreadSafe> NewEntry = MakeShared<FHttpCacheEntry, ESPMode::ThreadSafe>(*Entry);
+	FDateTime ExpireTimeUtc;
+	bool bNoCache = false;
+	if (Response.IsValid() && ParseFreshness(*Response, ExpireTimeUtc, bNoCache))
+	{
+		NewEntry->ExpireTimeUtc = ExpireTimeUtc;
+		NewEntry->bNoCache = bNoCache;
+	}
+	if (Response.IsValid())
+	{
+		const FString ETag = Response->GetHeader(TEXT("ETag"));
+		if (!ETag.IsEmpty())
+		{
+			NewEntry->ETag = ETag;
+		}
+		const FString LastModified = Response->GetHeader(TEXT("Last-Modified"));
+		if (!LastModified.IsEmpty())
+		{
+			NewEntry->LastModified = LastModified;
+		}
+	}
+	Stats.Revalidated++;
+	Stats.BytesSaved += NewEntry->GetContentSize();
+	AddToMemory(NewEntry);
+	WriteToDisk(NewEntry);
+	return NewEntry;
+}
+
+void FHttpResponseCache::AddConditionalHeaders(IHttpRequest& Request, const FHttpCacheEntry& Entry)
+{
+	if (!Entry.ETag.IsEmpty())
+	{
+		Request.SetHeader(TEXT("If-None-Match"), Entry.ETag);
+	}
+	if (!Entry.LastModified.IsEmpty())
+	{
+		Request.SetHeader(TEXT("If-Modified-Since"), Entry.LastModified);
+	}
+}
+
+void FHttpResponseCache::RecordHit(const FHttpCacheEntry& Entry)
+{
+	Stats.Hits++;
+	Stats.BytesSaved += Entry.GetContentSize();
+}
+
+void FHttpResponseCache::RecordMiss()
+{
+	Stats.Misses++;
+}
+
+void FHttpResponseCache::Clear()
+{
+	MemoryItems.Empty();
+	MemoryLRU.Empty();
+	MemoryBytes = 0;
+	EstimatedDiskBytes = INDEX_NONE;
+	const FString Directory = GetDiskDirectory();
+	Async(EAsyncExecution::ThreadPool, [Directory]()
+		{
+			IFileManager::Get().DeleteDirectory(*Directory, false, true);
+		});
+}
+
+FHttpCacheStats FHttpResponseCache::GetStats() const
+{
+	FHttpCacheStats Result = Stats;
+	Result.MemoryBytes = MemoryBytes;
+	Result.MemoryEntries = MemoryItems.Num();
+	return Result;
+}
+
+bool FHttpResponseCache::ParseFreshness(const IHttpResponse& Response, FDateTime& OutExpireTimeUtc, bool& bOutNoCache)
+{
+	const FDateTime Now = FDateTime::UtcNow();
+	OutExpireTimeUtc = Now;
+	bOutNoCache = false;
+	bool bHasMaxAge = false;
+
+	TArray<FString> Directives;
+	Response.GetHeader(TEXT("Cache-Control")).ParseIntoArray(Directives, TEXT(","));
+	for (FString& Directive : Directives)
+	{
+		Directive.TrimStartAndEndInline();
+		if (Directive.Equals(TEXT("no-store"), ESearchCase::IgnoreCase))
+		{
+			return false;
+		}
+		if (Directive.Equals(TEXT("no-cache"), ESearchCase::IgnoreCase))
+		{
+			bOutNoCache = true;
+		}
+		else if (Directive.StartsWith(TEXT("max-age="), ESearchCase::IgnoreCase))
+		{
+			const int64 MaxAge = FCString::Atoi64(*Directive.Mid(8));
+			const int64 Age = FCString::Atoi64(*Response.GetHeader(TEXT("Age")));
+			OutExpireTimeUtc = Now + FTimespan::FromSeconds(FMath::Max<int64>(MaxAge - Age, 0));
+			bHasMaxAge = true;
+		}
+	}
+	//max-age优先于Expires
+	if (!bHasMaxAge)
+	{
+		FDateTime Expires;
+		if (FDateTime::ParseHttpDate(Response.GetHeader(TEXT("Expires")), Expires))
+		{
+			OutExpireTimeUtc = Expires;
+		}
+	}
+	return true;
+}
+
+void FHttpResponseCache::AddToMemory(const FHttpCacheEntryPtr& Entry)
+{
+	RemoveFromMemory(Entry->Key);
+	const int64 EntryBytes = Entry->GetContentSize();
+	if (EntryBytes > Settings.MaxMemoryBytes)
+	{
+		return;
+	}
+	MemoryLRU.AddHead(Entry->Key);
+	FMemoryItem Item;
+	Item.Entry = Entry;
+	Item.Node = MemoryLRU.GetHead();
+	MemoryItems.Add(Entry->Key, Item);
+	MemoryBytes += EntryBytes;
+	while (MemoryBytes > Settings.MaxMemoryBytes && MemoryLRU.GetTail())
+	{
+		const FString OldestKey = MemoryLRU.GetTail()->GetValue();
+		RemoveFromMemory(OldestKey);
+		Stats.MemoryEvictions++;
+	}
+}
+
+void FHttpResponseCache::RemoveFromMemory(const FString& Key)
+{
+	FMemoryItem Item;
+	if (MemoryItems.RemoveAndCopyValue(Key, Item))
+	{
+		MemoryBytes -= Item.Entry->GetContentSize();
+		MemoryLRU.RemoveNode(Item.Node);
+	}
+}
+
+void FHttpResponseCache::WriteToDisk(const FHttpCacheEntryPtr& Entry)
+{
+	if (!Settings.bEnableDiskCache)
+	{
+		return;
+	}
+	const FString Directory = GetDiskDirectory();
+	const FString FilePath = GetDiskPath(Entry->Key);
+	const int64 MaxDiskBytes = Settings.MaxDiskBytes;
+	//第一次写入或者估计超出上限时整理一次磁盘目录
+	const bool bTrim = !bTrimmingDisk && (EstimatedDiskBytes == INDEX_NONE || EstimatedDiskBytes + Entry->GetContentSize() > MaxDiskBytes);
+	if (EstimatedDiskBytes != INDEX_NONE)
+	{
+		EstimatedDiskBytes += Entry->GetContentSize();
+	}
+	bTrimmingDisk |= bTrim;
+
+	TWeakPtr<FHttpResponseCache, ESPMode::ThreadSafe> WeakThis = AsShared();
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Entry, FilePath, Directory, MaxDiskBytes, bTrim]()
+		{
+			SaveEntry(*Entry, FilePath);
+			if (bTrim)
+			{
+				const int64 DiskBytes = TrimDirectory(Directory, MaxDiskBytes);
+				AsyncTask(ENamedThreads::GameThread, [WeakThis, DiskBytes]()
+					{
+						if (TSharedPtr<FHttpResponseCache, ESPMode::ThreadSafe> This = WeakThis.Pin())
+						{
+							This->EstimatedDiskBytes = DiskBytes;
+							This->bTrimmingDisk = false;
+						}
+					});
+			}
+		});
+}
+
+FString FHttpResponseCache::GetDiskDirectory() const
+{
+	if (Settings.DiskCacheDirectory.IsEmpty())
+	{
+		return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SimpleHTTPCache"));
+	}
+	return Settings.DiskCacheDirectory;
+}
+
+FString FHttpResponseCache::GetDiskPath(const FString& Key) const
+{
+	return FPaths::Combine(GetDiskDirectory(), FMD5::HashAnsiString(*Key) + TEXT(".cache"));
+}
+
+bool FHttpResponseCache::SaveEntry(const FHttpCacheEntry& Entry, const FString& FilePath)
+{
+	//先写临时文件再重命名，读取时不会读到写了一半的文件
+	const FString TempPath = FilePath + TEXT(".") + FGuid::NewGuid().ToString() + TEXT(".tmp");
+	TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*TempPath));
+	if (!Writer.IsValid())
+	{
+		return false;
+	}
+	uint32 Magic = SimpleHTTPCache::FileMagic;
+	int32 Version = SimpleHTTPCache::FileVersion;
+	FString Key = Entry.Key;
+	int32 ResponseCode = Entry.ResponseCode;
+	FString ContentType = Entry.ContentType;
+	FString ETag = Entry.ETag;
+	FString LastModified = Entry.LastModified;
+	int64 ExpireTicks = Entry.ExpireTimeUtc.GetTicks();
+	bool bNoCache = Entry.bNoCache;
+	int64 ContentSize = Entry.GetContentSize();
+	*Writer << Magic << Version << Key << ResponseCode << ContentType << ETag << LastModified << ExpireTicks << bNoCache << ContentSize;
+	if (ContentSize > 0)
+	{
+		Writer->Serialize(const_cast<uint8*>(Entry.Content->GetData()), ContentSize);
+	}
+	const bool bWritten = Writer->Close();
+	Writer.Reset();
+	if (!bWritten || !IFileManager::Get().Move(*FilePath, *TempPath, true))
+	{
+		IFileManager::Get().Delete(*TempPath, false, true, true);
+		return false;
+	}
+	return true;
+}
+
+FHttpCacheEntryPtr FHttpResponseCache::LoadEntry(const FString& Key, const FString& FilePath)
+{
+	TUniquePtr<FArchive> Reader(IFileManager::Get().CreateFileReader(*FilePath, FILEREAD_Silent));
+	if (!Reader.IsValid())
+	{
+		return nullptr;
+	}
+	uint32 Magic = 0;
+	int32 Version = 0;
+	*Reader << Magic << Version;
+	if (Magic != SimpleHTTPCache::FileMagic || Version != SimpleHTTPCache::FileVersion)
+	{
+		return nullptr;
+	}
+	TSharedPtr<FHttpCacheEntry, ESPMode::ThreadSafe> Entry = MakeShared<FHttpCacheEntry, ESPMode::ThreadSafe>();
+	int64 ExpireTicks = 0;
+	int64 ContentSize = 0;
+	*Reader << Entry->Key << Entry->ResponseCode << Entry->ContentType << Entry->ETag << Entry->LastModified << ExpireTicks << Entry->bNoCache << ContentSize;
+	//文件名是Key的哈希，需要排除哈希冲突
+	if (Reader->IsError() || Entry->Key != Key || ContentSize < 0 || ContentSize > MAX_int32 || ContentSize > Reader->TotalSize() - Reader->Tell())
+	{
+		return nullptr;
+	}
+	Entry->ExpireTimeUtc = FDateTime(ExpireTicks);
+	TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> Content = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>();
+	Content->SetNumUninitialized((int32)ContentSize);
+	Reader->Serialize(Content->GetData(), ContentSize);
+	if (Reader->IsError())
+	{
+		return nullptr;
+	}
+	Entry->Content = Content;
+	Reader.Reset();
+	//磁盘整理时按修改时间淘汰，读取也算一次使用
+	IFileManager::Get().SetTimeStamp(*FilePath, FDateTime::UtcNow());
+	return Entry;
+}
+
+int64 FHttpResponseCache::TrimDirectory(const FString& Directory, int64 MaxBytes)
+{
+	struct FCacheFile
+	{
+		FString Path;
+		int64 Size;
+		FDateTime Time;
+	};
+	TArray<FCacheFile> Files;
+	int64 TotalBytes = 0;
+	FPlatformFileManager::Get().GetPlatformFile().IterateDirectoryStat(*Directory, [&Files, &TotalBytes](const TCHAR* Path, const FFileStatData& StatData)
+		{
+			if (!StatData.bIsDirectory)
+			{
+				Files.Add(FCacheFile{ Path, StatData.FileSize, StatData.ModificationTime });
+				TotalBytes += StatData.FileSize;
+			}
+			return true;
+		});
+	if (TotalBytes <= MaxBytes)
+	{
+		return TotalBytes;
+	}
+	//删除最久没有使用的文件，直到低于上限的90%
+	Files.Sort([](const FCacheFile& A, const FCacheFile& B) { return A.Time < B.Time; });
+	for (const FCacheFile& File : Files)
+	{
+		if (TotalBytes <= MaxBytes / 10 * 9)
+		{
+			break;
+		}
+		if (IFileManager::Get().Delete(*File.Path, false, true, true))
+		{
+			TotalBytes -= File.Size;
+		}
+	}
+	return TotalBytes;
+}
@@ -0,0 +1,146 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPRetryPolicy.h"
+
+bool FHttpRetryPolicy::IsIdempotentVerb(const FString& Verb)
+{
+	static const TCHAR* IdempotentVerbs[] = {
+		TEXT("GET"),
+		TEXT("HEAD"),
+		TEXT("PUT"),
+		TEXT("DELETE"),
+		TEXT("OPTIONS"),
+		TEXT("PROPFIND"),
+	};
+	for (const TCHAR* IdempotentVerb : IdempotentVerbs)
+	{
+		if (Verb.Equals(IdempotentVerb, ESearchCase::IgnoreCase))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FHttpRetryPolicy::ShouldRetry(const IHttpRequest& Request, const FHttpResponsePtr& Response, bool bWasSuccessful, int32 Attempt) const
+{
+	if (Attempt >= MaxRetries)
+	{
+		return false;
+	}
+	if (!bRetryNonIdempotent && !IsIdempotentVerb(Request.GetVerb()))
+	{
+		return false;
+	}
+	if (!bWasSuccessful || !Response.IsValid())
+	{
+		return bRetryOnConnectionError;
+	}
+	return RetryResponseCodes.Contains(Response->GetResponseCode());
+}
+
+float FHttpRetryPolicy::GetRetryDelay(const FHttpResponsePtr& Response, int32 Attempt) const
+{
+	if (bRespectRetryAfter)
+	{
+		const float RetryAfter = ParseRetryAfter(Response);
+		if (RetryAfter >= 0.f)
+		{
+			return RetryAfter <= MaxRetryAfterSeconds ? RetryAfter : -1.f;
+		}
+	}
+	//完全随机：在0到退避上限之间随机，避免所有客户端在同一时间重试
+	const float Cap = FMath::Min(MaxDelaySeconds, BaseDelaySeconds * FMath::Pow(2.f, (float)FMath::Min(Attempt, 30)));
+	return FMath::FRandRange(0.f, FMath::Max(Cap, 0.f));
+}
+
+float FHttpRetryPolicy::ParseRetryAfter(const FHttpResponsePtr& Response)
+{
+	if (!Response.IsValid())
+	{
+		return -1.f;
+	}
+	const FString RetryAfter = Response->GetHeader(TEXT("Retry-After")).TrimStartAndEnd();
+	if (RetryAfter.IsEmpty())
+	{
+		return -1.f;
+	}
+	if (RetryAfter.IsNumeric())
+	{
+		return FMath::Max(0.f, FCString::Atof(*RetryAfter));
+	}
+	FDateTime RetryTime;
+	if (FDateTime::ParseHttpDate(RetryAfter, RetryTime))
+	{
+		return FMath::Max(0.f, (float)(RetryTime - FDateTime::UtcNow()).GetTotalSeconds());
+	}
+	return -1.f;
+}
+
+void FHttpRetryBudget::SetSettings(const FHttpRetryBudgetSettings& InSettings)
+{
+	Settings = InSettings;
+	Tokens = FMath::Min(Tokens, Settings.MaxRetryTokens);
+}
+
+void FHttpRetryBudget::OnRequestSubmitted()
+{
+	Tokens = FMath::Min(Settings.MaxRetryTokens, Tokens + Settings.RetryRatio);
+}
+
+void FHttpRetryBudget::OnRequestResult(const FString& Host, bool bFailed)
+{
+	if (!bFailed)
+	{
+		Circuits.Remove(Host);
+		return;
+	}
+	if (Settings.CircuitFailureThreshold <= 0)
+	{
+		return;
+	}
+	FCircuit& Circuit = Circuits.FindOrAdd(Host);
+	if (++Circuit.ConsecutiveFailures >= Settings.CircuitFailureThreshold)
+	{
+		Circuit.OpenUntil = FPlatformTime::Seconds() + Settings.CircuitOpenSeconds;
+	}
+}
+
+bool FHttpRetryBudget::IsCircuitOpen(const FString& Host) const
+{
+	const FCircuit* Circuit = Circuits.Find(Host);
+	return Circuit && Circuit->OpenUntil > FPlatformTime::Seconds();
+}
+
+bool FHttpRetryBudget::TryConsumeRetry(const FString& Host)
+{
+	if (IsCircuitOpen(Host))
+	{
+		Stats.SuppressedByCircuit++;
+		return false;
+	}
+	if (Settings.RetryRatio > 0.f)
+	{
+		if (Tokens < 1.f)
+		{
+			Stats.SuppressedByBudget++;
+			return false;
+		}
+		Tokens -= 1.f;
+	}
+	Stats.TotalRetries++;
+	return true;
+}
+
+FHttpRetryStats FHttpRetryBudget::GetStats() const
+{
+	FHttpRetryStats Result = Stats;
+	Result.RetryTokens = Tokens;
+	const double Now = FPlatformTime::Seconds();
+	for (const TPair<FString, FCircuit>& Circuit : Circuits)
+	{
+		Result.OpenCircuits += Circuit.Value.OpenUntil > Now ? 1 : 0;
+	}
+	return Result;
+}
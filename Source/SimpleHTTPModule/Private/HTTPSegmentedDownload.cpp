@@ -0,0 +1,491 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPSegmentedDownload.h"
+#include "Interfaces/IHttpResponse.h"
+#include "HTTPHelperSubsystem.h"
+#include "HTTPDownloadStream.h"
+#include "SimpleHTTPCompat.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonWriter.h"
+#include "Serialization/JsonSerializer.h"
+
+void UHTTPSegmentedDownload::BindDownloadComplete(FSimpleHttpSegmentedDownloadCompleteDelegate InDelegate)
+{
+	OnDownloadComplete = InDelegate;
+}
+
+void UHTTPSegmentedDownload::BindDownloadProgress(FSimpleHttpSegmentedDownloadProgressDelegate InDelegate)
+{
+	OnDownloadProgress = InDelegate;
+}
+
+int64 UHTTPSegmentedDownload::GetBytesReceived() const
+{
+	int64 BytesReceived = CompletedBytes;
+	for (const FSegment& Segment : Segments)
+	{
+		BytesReceived += Segment.bCompleted ? 0 : Segment.ReceivedBytes;
+	}
+	return BytesReceived;
+}
+
+void UHTTPSegmentedDownload::Start(UHTTPHelperSubsystem* InSubsystem, const FString& InURL, const TMap<FString, FString>& InHeaders, const FString& InTargetFilePath, const FHttpSegmentedDownloadSettings& InSettings)
+{
+	HTTPHelperSubsystem = InSubsystem;
+	URL = InURL;
+	Headers = InHeaders;
+	TargetFilePath = InTargetFilePath;
+	Settings = InSettings;
+
+	ProbeRequest = CreateRequest(EMethodByte::HEAD);
+	ProbeRequest->OnProcessRequestComplete().BindUObject(this, &UHTTPSegmentedDownload::OnProbeComplete);
+	TWeakObjectPtr<UHTTPSegmentedDownload> WeakThis(this);
+	HTTPHelperSubsystem->EnqueueRequest(ProbeRequest.ToSharedRef(), Settings.Priority, [WeakThis]()
+		{
+			AsyncTask(ENamedThreads::GameThread, [WeakThis]()
+				{
+					if (UHTTPSegmentedDownload* This = WeakThis.Get())
+					{
+						This->Finish(false);
+					}
+				});
+		});
+}
+
+TSharedRef<IHttpRequest, ESPMode::ThreadSafe> UHTTPSegmentedDownload::CreateRequest(EMethodByte Verb) const
+{
+	const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = HTTPHelperSubsystem->CreateHTTP_Native(URL, Verb, Headers, TMap<FString, FString>(), Settings.TimeoutSecs, Settings.bAddDefaultHeaders);
+	//Range按照未压缩的字节计算
+	Request->SetHeader(TEXT("Accept-Encoding"), TEXT("identity"));
+	return Request;
+}
+
+void UHTTPSegmentedDownload::OnProbeComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+{
+	HTTPHelperSubsystem->NotifyRequestFinished(Request);
+	ProbeRequest.Reset();
+	if (bFinished)
+	{
+		return;
+	}
+	const bool bProbeOk = bWasSuccessful && Response.IsValid() && EHttpResponseCodes::IsOk(Response->GetResponseCode());
+	if (bProbeOk)
+	{
+		TotalBytes = FCString::Atoi64(*Response->GetHeader(TEXT("Content-Length")));
+		ETag = Response->GetHeader(TEXT("ETag"));
+		LastModified = Response->GetHeader(TEXT("Last-Modified"));
+	}
+	if (!bProbeOk || TotalBytes <= 0 || !Response->GetHeader(TEXT("Accept-Ranges")).Contains(TEXT("bytes")))
+	{
+		StartFallback();
+		return;
+	}
+	PrepareSegments();
+	if (!bFinished)
+	{
+		BroadcastProgress();
+		LaunchSegments();
+	}
+}
+
+void UHTTPSegmentedDownload::StartFallback()
+{
+	FallbackRequest = HTTPHelperSubsystem->CallHTTPAndDownloadFile(URL, EMethodByte::GET, Headers, TMap<FString, FString>(), FPaths::GetPath(TargetFilePath), FPaths::GetCleanFilename(TargetFilePath), false, Settings.TimeoutSecs, Settings.bAddDefaultHeaders, Settings.Priority);
+	if (!FallbackRequest)
+	{
+		Finish(false);
+		return;
+	}
+	FSimpleHttpRequestCompleteAsStringDelegate CompleteDelegate;
+	CompleteDelegate.BindUFunction(this, GET_FUNCTION_NAME_CHECKED(UHTTPSegmentedDownload, OnFallbackComplete));
+	FallbackRequest->BindRequestCompleteAsString(CompleteDelegate);
+}
+
+void UHTTPSegmentedDownload::OnFallbackComplete(bool bSuccess, FString FilePath)
+{
+	FallbackRequest = nullptr;
+	if (bFinished)
+	{
+		return;
+	}
+	bFinished = true;
+	if (bSuccess)
+	{
+		TotalBytes = CompletedBytes = IFileManager::Get().FileSize(*FilePath);
+	}
+	HTTPHelperSubsystem->OnSegmentedDownloadFinished(this);
+	OnDownloadComplete.ExecuteIfBound(bSuccess, FilePath);
+}
+
+void UHTTPSegmentedDownload::PrepareSegments()
+{
+	const int64 SegmentSize = FMath::Max<int64>(Settings.SegmentSizeBytes, 64 * 1024);
+	for (int64 Offset = 0; Offset < TotalBytes; Offset += SegmentSize)
+	{
+		FSegment& Segment = Segments.AddDefaulted_GetRef();
+		Segment.Offset = Offset;
+		Segment.Size = FMath::Min(SegmentSize, TotalBytes - Offset);
+	}
+
+	File = MakeShared<FHttpSharedWriteFile, ESPMode::ThreadSafe>();
+	bool bKeptExisting = false;
+	if (!File->Open(TargetFilePath + TEXT(".part"), TotalBytes, bKeptExisting))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Open segmented download file failed: %s.part"), *TargetFilePath);
+		Finish(false);
+		return;
+	}
+	if (bKeptExisting && LoadJournal())
+	{
+		ResumedBytes = CompletedBytes;
+		UE_LOG(LogTemp, Log, TEXT("Resume segmented download %s from %lld bytes"), *TargetFilePath, ResumedBytes);
+	}
+	SaveJournal();
+	if (CompletedBytes >= TotalBytes)
+	{
+		Finish(true);
+	}
+}
+
+void UHTTPSegmentedDownload::LaunchSegments()
+{
+	if (bFinished)
+	{
+		return;
+	}
+	const double Now = FPlatformTime::Seconds();
+	for (int32 Index = 0; Index < Segments.Num() && InFlightCount < FMath::Max(1, Settings.MaxParallelSegments); Index++)
+	{
+		FSegment& Segment = Segments[Index];
+		if (Segment.bCompleted || Segment.Request.IsValid() || Segment.RetryTime > Now)
+		{
+			continue;
+		}
+		const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = CreateRequest(EMethodByte::GET);
+		Request->SetHeader(TEXT("Range"), FString::Printf(TEXT("bytes=%lld-%lld"), Segment.Offset, Segment.Offset + Segment.Size - 1));
+		const FString RangeValidator = GetRangeValidator();
+		if (!RangeValidator.IsEmpty())
+		{
+			//文件在服务器上改变时服务器返回完整内容而不是206，分段会失败而不会写入错误的数据
+			Request->SetHeader(TEXT("If-Range"), RangeValidator);
+		}
+#if SIMPLEHTTP_WITH_RESPONSE_STREAM
+		Segment.Stream = MakeShared<FHttpRangeWriteStream, ESPMode::ThreadSafe>(File.ToSharedRef(), Segment.Offset, Segment.Size);
+		Request->SetResponseBodyReceiveStream(Segment.Stream.ToSharedRef());
+#endif
+		Request->OnProcessRequestComplete().BindUObject(this, &UHTTPSegmentedDownload::OnSegmentComplete, Index);
+		SimpleHttpOnRequestProgress(*Request).BindUObject(this, &UHTTPSegmentedDownload::OnSegmentProgress, Index);
+		Segment.Request = Request;
+		Segment.ReceivedBytes = 0;
+		InFlightCount++;
+
+		TWeakObjectPtr<UHTTPSegmentedDownload> WeakThis(this);
+		HTTPHelperSubsystem->EnqueueRequest(Request, Settings.Priority, [WeakThis, Index]()
+			{
+				AsyncTask(ENamedThreads::GameThread, [WeakThis, Index]()
+					{
+						UHTTPSegmentedDownload* This = WeakThis.Get();
+						if (This && !This->bFinished && This->Segments.IsValidIndex(Index) && This->Segments[Index].Request.IsValid())
+						{
+							const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> FailedRequest = This->Segments[Index].Request.ToSharedRef();
+							This->Segments[Index].Request.Reset();
+							This->Segments[Index].Stream.Reset();
+							This->FinishSegment(Index, false, This->EvaluateSegmentRetry(Index, *FailedRequest, nullptr, false, false));
+						}
+					});
+			},
+			[WeakThis, Index]()
+			{
+				UHTTPSegmentedDownload* This = WeakThis.Get();
+				if (This && This->Segments.IsValidIndex(Index) && This->Segments[Index].Stream.IsValid())
+				{
+					//按写入共享文件的字节计入带宽，写入前按限制等待
+					This->HTTPHelperSubsystem->SetTransferCounters(This->Segments[Index].Request, nullptr, This->Segments[Index].Stream->GetReceiveCounter());
+				}
+			});
+	}
+}
+
+void UHTTPSegmentedDownload::OnSegmentProgress(FHttpRequestPtr Request, FSimpleHttpProgressBytes BytesSent, FSimpleHttpProgressBytes BytesReceived, int32 SegmentIndex)
+{
+	if (Segments.IsValidIndex(SegmentIndex) && Segments[SegmentIndex].Request == Request)
+	{
+		Segments[SegmentIndex].ReceivedBytes = (int64)BytesReceived;
+		HTTPHelperSubsystem->ReportTransferredBytes(Request, (int64)BytesSent, (int64)BytesReceived);
+		BroadcastProgress();
+	}
+}
+
+void UHTTPSegmentedDownload::OnSegmentComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 SegmentIndex)
+{
+	HTTPHelperSubsystem->NotifyRequestFinished(Request);
+	if (bFinished || !Segments.IsValidIndex(SegmentIndex) || Segments[SegmentIndex].Request != Request)
+	{
+		return;
+	}
+	FSegment& Segment = Segments[SegmentIndex];
+	Segment.Request.Reset();
+	//服务器返回200说明忽略了Range或者文件已经改变
+	const bool bResponseOk = bWasSuccessful && Response.IsValid() && Response->GetResponseCode() == 206;
+#if SIMPLEHTTP_WITH_RESPONSE_STREAM
+	const bool bWritten = bResponseOk && !Segment.Stream->IsError() && Segment.Stream->GetBytesWritten() == Segment.Size;
+	Segment.Stream.Reset();
+	FinishSegment(SegmentIndex, bWritten, bWritten ? 0.f : EvaluateSegmentRetry(SegmentIndex, *Request, Response, bWasSuccessful, bResponseOk));
+#else
+	if (!bResponseOk || Response->GetContent().Num() != Segment.Size)
+	{
+		FinishSegment(SegmentIndex, false, EvaluateSegmentRetry(SegmentIndex, *Request, Response, bWasSuccessful, bResponseOk));
+		return;
+	}
+	//在后台线程写入文件，写入完成前这个分段仍然占用并发数量
+	TWeakObjectPtr<UHTTPSegmentedDownload> WeakThis(this);
+	Async(EAsyncExecution::ThreadPool, [WeakThis, WriteFile = File, Response, Offset = Segment.Offset, SegmentIndex]()
+		{
+			const bool bWritten = WriteFile->WriteAt(Offset, Response->GetContent().GetData(), Response->GetContent().Num());
+			AsyncTask(ENamedThreads::GameThread, [WeakThis, SegmentIndex, bWritten]()
+				{
+					if (UHTTPSegmentedDownload* This = WeakThis.Get())
+					{
+						//写入磁盘失败不重试
+						This->FinishSegment(SegmentIndex, bWritten, -1.f);
+					}
+				});
+		});
+#endif
+}
+
+float UHTTPSegmentedDownload::EvaluateSegmentRetry(int32 SegmentIndex, const IHttpRequest& Request, const FHttpResponsePtr& Response, bool bWasSuccessful, bool bResponseOk)
+{
+	//返回了206但内容不完整时按连接中断处理
+	return HTTPHelperSubsystem->EvaluateRetry(Settings.SegmentRetryPolicy, Request, bResponseOk ? nullptr : Response, bWasSuccessful && !bResponseOk, Segments[SegmentIndex].Attempts);
+}
+
+void UHTTPSegmentedDownload::FinishSegment(int32 SegmentIndex, bool bSucceeded, float RetryDelay)
+{
+	if (bFinished)
+	{
+		return;
+	}
+	InFlightCount--;
+	FSegment& Segment = Segments[SegmentIndex];
+	Segment.ReceivedBytes = 0;
+	if (bSucceeded)
+	{
+		Segment.bCompleted = true;
+		CompletedBytes += Segment.Size;
+		SaveJournal();
+		BroadcastProgress();
+		if (CompletedBytes >= TotalBytes)
+		{
+			Finish(true);
+			return;
+		}
+	}
+	else if (RetryDelay < 0.f)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Segment %d of %s failed after %d retries"), SegmentIndex, *URL, Segment.Attempts);
+		Finish(false);
+		return;
+	}
+	else
+	{
+		Segment.Attempts++;
+		Segment.RetryTime = FPlatformTime::Seconds() + RetryDelay;
+		//退避结束后重新下载，期间空出的并发数量给其他分段使用
+		FSimpleHttpTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateWeakLambda(this, [this](float)
+			{
+				LaunchSegments();
+				return false;
+			}), RetryDelay);
+	}
+	LaunchSegments();
+}
+
+void UHTTPSegmentedDownload::Cancel()
+{
+	Finish(false);
+}
+
+void UHTTPSegmentedDownload::Finish(bool bSuccess)
+{
+	if (bFinished)
+	{
+		return;
+	}
+	bFinished = true;
+	auto CancelRequest = [this](const TSharedPtr<IHttpRequest, ESPMode::ThreadSafe>& Request)
+	{
+		Request->OnProcessRequestComplete().Unbind();
+		SimpleHttpOnRequestProgress(*Request).Unbind();
+		if (!HTTPHelperSubsystem->RemoveQueuedRequest(Request))
+		{
+			Request->CancelRequest();
+			HTTPHelperSubsystem->NotifyRequestFinished(Request);
+		}
+	};
+	if (ProbeRequest.IsValid())
+	{
+		CancelRequest(ProbeRequest);
+		ProbeRequest.Reset();
+	}
+	for (FSegment& Segment : Segments)
+	{
+		if (Segment.Request.IsValid())
+		{
+			CancelRequest(Segment.Request);
+			Segment.Request.Reset();
+		}
+		Segment.Stream.Reset();
+	}
+	if (FallbackRequest)
+	{
+		FallbackRequest->OnRequestCompleteAsString.Unbind();
+		if (FallbackRequest->HttpRequest.IsValid())
+		{
+			FallbackRequest->HttpRequest->CancelRequest();
+		}
+		FallbackRequest = nullptr;
+	}
+
+	FString ResultPath;
+	if (File.IsValid())
+	{
+		File->Close();
+		File.Reset();
+		if (bSuccess)
+		{
+			if (JournalWriter.IsValid())
+			{
+				//等待正在写入的journal完成，之后不再写入
+				FScopeLock ScopeLock(&JournalWriter->Lock);
+				JournalWriter->bClosed = true;
+			}
+			if (IFileManager::Get().Move(*TargetFilePath, *(TargetFilePath + TEXT(".part"))))
+			{
+				IFileManager::Get().Delete(*GetJournalPath());
+				ResultPath = TargetFilePath;
+			}
+			else
+			{
+				UE_LOG(LogTemp, Error, TEXT("Move segmented download to %s failed"), *TargetFilePath);
+				bSuccess = false;
+			}
+		}
+	}
+	HTTPHelperSubsystem->OnSegmentedDownloadFinished(this);
+	OnDownloadComplete.ExecuteIfBound(bSuccess, ResultPath);
+}
+
+void UHTTPSegmentedDownload::BroadcastProgress()
+{
+	OnDownloadProgress.ExecuteIfBound(GetBytesReceived(), TotalBytes);
+}
+
+FString UHTTPSegmentedDownload::GetJournalPath() const
+{
+	return TargetFilePath + TEXT(".journal");
+}
+
+FString UHTTPSegmentedDownload::GetRangeValidator() const
+{
+	//If-Range不能使用弱ETag
+	if (!ETag.IsEmpty() && !ETag.StartsWith(TEXT("W/")))
+	{
+		return ETag;
+	}
+	return LastModified;
+}
+
+bool UHTTPSegmentedDownload::LoadJournal()
+{
+	FString JournalString;
+	if (!FFileHelper::LoadFileToString(JournalString, *GetJournalPath()))
+	{
+		return false;
+	}
+	//没有验证器时无法确认服务器上的文件没有改变，已经下载的分段可能来自旧的文件
+	if (GetRangeValidator().IsEmpty())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Segmented download %s has no ETag or Last-Modified, restart instead of resuming"), *TargetFilePath);
+		return false;
+	}
+	TSharedPtr<FJsonObject> Journal;
+	if (!FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(JournalString), Journal) || !Journal.IsValid())
+	{
+		return false;
+	}
+	//服务器上的文件或者分段方式改变时不能继续
+	if (Journal->GetStringField(TEXT("URL")) != URL
+		|| (int64)Journal->GetNumberField(TEXT("TotalBytes")) != TotalBytes
+		|| (int64)Journal->GetNumberField(TEXT("SegmentSize")) != Segments[0].Size
+		|| Journal->GetStringField(TEXT("ETag")) != ETag
+		|| Journal->GetStringField(TEXT("LastModified")) != LastModified)
+	{
+		return false;
+	}
+	const TArray<TSharedPtr<FJsonValue>>* Completed = nullptr;
+	if (!Journal->TryGetArrayField(TEXT("Completed"), Completed))
+	{
+		return false;
+	}
+	for (const TSharedPtr<FJsonValue>& Value : *Completed)
+	{
+		const int32 Index = (int32)Value->AsNumber();
+		if (Segments.IsValidIndex(Index) && !Segments[Index].bCompleted)
+		{
+			Segments[Index].bCompleted = true;
+			CompletedBytes += Segments[Index].Size;
+		}
+	}
+	return true;
+}
+
+void UHTTPSegmentedDownload::SaveJournal()
+{
+	const TSharedRef<FJsonObject> Journal = MakeShared<FJsonObject>();
+	Journal->SetStringField(TEXT("URL"), URL);
+	Journal->SetNumberField(TEXT("TotalBytes"), (double)TotalBytes);
+	Journal->SetNumberField(TEXT("SegmentSize"), Segments.Num() > 0 ? (double)Segments[0].Size : 0.0);
+	Journal->SetStringField(TEXT("ETag"), ETag);
+	Journal->SetStringField(TEXT("LastModified"), LastModified);
+	TArray<TSharedPtr<FJsonValue>> Completed;
+	for (int32 Index = 0; Index < Segments.Num(); Index++)
+	{
+		if (Segments[Index].bCompleted)
+		{
+			Completed.Add(MakeShared<FJsonValueNumber>(Index));
+		}
+	}
+	Journal->SetArrayField(TEXT("Completed"), Completed);
+
+	FString JournalString;
+	FJsonSerializer::Serialize(Journal, TJsonWriterFactory<>::Create(&JournalString));
+	if (!JournalWriter.IsValid())
+	{
+		JournalWriter = MakeShared<FJournalWriter, ESPMode::ThreadSafe>();
+	}
+	Async(EAsyncExecution::ThreadPool, [Writer = JournalWriter.ToSharedRef(), WriteFile = File, Sequence = ++JournalSequence, JournalPath = GetJournalPath(), JournalString = MoveTemp(JournalString)]()
+		{
+			FScopeLock ScopeLock(&Writer->Lock);
+			//后台任务可能乱序执行，已经写入更新的journal时跳过
+			if (Writer->bClosed || Sequence <= Writer->WrittenSequence)
+			{
+				return;
+			}
+			//journal记录的分段必须已经在磁盘上，否则中断后会把没有写入的分段当作已完成
+			if (WriteFile.IsValid() && !WriteFile->Flush())
+			{
+				return;
+			}
+			//journal很小，先写临时文件再替换，避免中断时留下不完整的journal
+			const FString TempPath = JournalPath + TEXT(".tmp");
+			if (FFileHelper::SaveStringToFile(JournalString, *TempPath) && IFileManager::Get().Move(*JournalPath, *TempPath))
+			{
+				Writer->WrittenSequence = Sequence;
+			}
+		});
+}
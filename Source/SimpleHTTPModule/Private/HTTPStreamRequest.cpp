@@ -0,0 +1,497 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HTTPStreamRequest.h"
+#include "Interfaces/IHttpResponse.h"
+#include "HTTPHelperSubsystem.h"
+#include "Async/Async.h"
+#include "Misc/ScopeLock.h"
+#include "Serialization/Archive.h"
+
+FHttpStreamParser::FHttpStreamParser(EHttpStreamFormat InFormat, int32 InMaxRecordBytes)
+	: Format(InFormat)
+	, MaxRecordBytes(InMaxRecordBytes)
+{
+}
+
+bool FHttpStreamParser::Feed(const uint8* Data, int64 Length, TArray<FHttpStreamEvent>& OutEvents)
+{
+	const uint8* Cursor = Data;
+	const uint8* End = Data + Length;
+	while (Cursor < End)
+	{
+		//\r\n被切分到两次数据中
+		if (bLastWasCR && *Cursor == '\n')
+		{
+			bLastWasCR = false;
+			Cursor++;
+			continue;
+		}
+		bLastWasCR = false;
+		const uint8* LineEnd = Cursor;
+		while (LineEnd < End && *LineEnd != '\n' && *LineEnd != '\r')
+		{
+			LineEnd++;
+		}
+		LineBuffer.Append(Cursor, (int32)(LineEnd - Cursor));
+		if (MaxRecordBytes > 0 && LineBuffer.Num() > MaxRecordBytes)
+		{
+			return false;
+		}
+		if (LineEnd == End)
+		{
+			break;
+		}
+		bLastWasCR = *LineEnd == '\r';
+		Cursor = LineEnd + 1;
+		if (!ProcessLine(OutEvents))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void FHttpStreamParser::Flush(TArray<FHttpStreamEvent>& OutEvents)
+{
+	if (Format == EHttpStreamFormat::NewlineDelimited && LineBuffer.Num() > 0)
+	{
+		ProcessLine(OutEvents);
+	}
+	LineBuffer.Empty();
+	bLastWasCR = false;
+	EventType.Empty();
+	EventData.Empty();
+	bHasData = false;
+}
+
+bool FHttpStreamParser::ProcessLine(TArray<FHttpStreamEvent>& OutEvents)
+{
+	int32 Start = 0;
+	if (!bCheckedBOM)
+	{
+		bCheckedBOM = true;
+		if (LineBuffer.Num() >= 3 && LineBuffer[0] == 0xEF && LineBuffer[1] == 0xBB && LineBuffer[2] == 0xBF)
+		{
+			Start = 3;
+		}
+	}
+	//只转换完整的一行，多字节字符不会被切分
+	const FUTF8ToTCHAR Converter((const ANSICHAR*)LineBuffer.GetData() + Start, LineBuffer.Num() - Start);
+	FString Line(Converter.Length(), Converter.Get());
+	LineBuffer.Reset();
+	if (Format == EHttpStreamFormat::ServerSentEvents)
+	{
+		return ProcessEventLine(Line, OutEvents);
+	}
+	Line.TrimStartAndEndInline();
+	if (!Line.IsEmpty())
+	{
+		OutEvents.AddDefaulted_GetRef().Data = MoveTemp(Line);
+	}
+	return true;
+}
+
+bool FHttpStreamParser::ProcessEventLine(const FString& Line, TArray<FHttpStreamEvent>& OutEvents)
+{
+	//空行结束一个事件
+	if (Line.IsEmpty())
+	{
+		if (bHasData)
+		{
+			FHttpStreamEvent& Event = OutEvents.AddDefaulted_GetRef();
+			Event.EventType = EventType.IsEmpty() ? TEXT("message") : MoveTemp(EventType);
+			Event.Data = MoveTemp(EventData);
+			Event.Id = LastEventId;
+			Event.RetryMilliseconds = RetryMilliseconds;
+		}
+		EventType.Empty();
+		EventData.Empty();
+		bHasData = false;
+		return true;
+	}
+	//注释，通常用于保持连接
+	if (Line[0] == TEXT(':'))
+	{
+		return true;
+	}
+	FString Field = Line;
+	FString Value;
+	int32 ColonIndex;
+	if (Line.FindChar(TEXT(':'), ColonIndex))
+	{
+		Field = Line.Left(ColonIndex);
+		Value = Line.Mid(ColonIndex + 1);
+		if (Value.StartsWith(TEXT(" "), ESearchCase::CaseSensitive))
+		{
+			Value.RightChopInline(1);
+		}
+	}
+	if (Field.Equals(TEXT("data"), ESearchCase::CaseSensitive))
+	{
+		if (bHasData)
+		{
+			EventData += TEXT('\n');
+		}
+		EventData += Value;
+		bHasData = true;
+		return MaxRecordBytes <= 0 || EventData.Len() <= MaxRecordBytes;
+	}
+	if (Field.Equals(TEXT("event"), ESearchCase::CaseSensitive))
+	{
+		EventType = MoveTemp(Value);
+	}
+	else if (Field.Equals(TEXT("id"), ESearchCase::CaseSensitive))
+	{
+		LastEventId = MoveTemp(Value);
+	}
+	else if (Field.Equals(TEXT("retry"), ESearchCase::CaseSensitive) && !Value.IsEmpty() && Value.IsNumeric())
+	{
+		RetryMilliseconds = FCString::Atoi(*Value);
+	}
+	return true;
+}
+
+/**
+ * 作为IHttpRequest的接收流，在HTTP线程解析收到的数据，然后通知游戏线程取走。
+ * 游戏线程还没有取走前只安排一次通知。
+ * 只有2xx的响应体按流解析，其他响应体作为错误内容保存，响应码还不知道时先缓存收到的数据。
+ */
+class FHttpStreamReceiver : public FArchive, public TSharedFromThis<FHttpStreamReceiver, ESPMode::ThreadSafe>
+{
+public:
+	//错误响应体只保存开头的部分
+	static constexpr int32 MaxErrorBodyBytes = 64 * 1024;
+
+	FHttpStreamReceiver(UHTTPStreamRequest* InOwner, const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& InRequest, EHttpStreamFormat InFormat, int32 InMaxRecordBytes)
+		: Owner(InOwner)
+		, WeakRequest(InRequest)
+		, Format(InFormat)
+		, MaxRecordBytes(InMaxRecordBytes)
+		, Parser(InFormat, InMaxRecordBytes)
+	{
+		SetIsSaving(true);
+		SetIsPersistent(false);
+	}
+
+	virtual void Serialize(void* Data, int64 Length) override
+	{
+		bool bScheduleDelivery = false;
+		{
+			FScopeLock ScopeLock(&Lock);
+			Receive(static_cast<const uint8*>(Data), Length);
+			if (!bDeliveryScheduled && (PendingChunks.Num() > 0 || PendingEvents.Num() > 0))
+			{
+				bDeliveryScheduled = true;
+				bScheduleDelivery = true;
+			}
+		}
+		if (bScheduleDelivery)
+		{
+			AsyncTask(ENamedThreads::GameThread, [WeakOwner = Owner]()
+				{
+					if (UHTTPStreamRequest* StreamRequest = WeakOwner.Get())
+					{
+						StreamRequest->DeliverReceived();
+					}
+				});
+		}
+	}
+	virtual int64 Tell() override { return BytesReceived; }
+	virtual int64 TotalSize() override { return BytesReceived; }
+	virtual FString GetArchiveName() const override { return TEXT("FHttpStreamReceiver"); }
+
+	//在游戏线程取出还没有触发的数据
+	void TakeReceived(TArray<TArray<uint8>>& OutChunks, TArray<FHttpStreamEvent>& OutEvents)
+	{
+		FScopeLock ScopeLock(&Lock);
+		OutChunks = MoveTemp(PendingChunks);
+		PendingChunks.Reset();
+		OutEvents = MoveTemp(PendingEvents);
+		PendingEvents.Reset();
+		bDeliveryScheduled = false;
+	}
+
+	//请求完成时调用，Content为不支持接收流的引擎上的完整响应体
+	void Finish(const TArray<uint8>* Content, int32 ResponseCode)
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (BodyState == EBodyState::Unknown)
+		{
+			SetBodyState(ResponseCode);
+		}
+		if (Content)
+		{
+			Receive(Content->GetData(), Content->Num());
+		}
+		if (!bStopped && BodyState == EBodyState::Ok)
+		{
+			Parser.Flush(PendingEvents);
+		}
+		bStopped = true;
+	}
+
+	void Stop()
+	{
+		FScopeLock ScopeLock(&Lock);
+		bStopped = true;
+		PendingChunks.Empty();
+		PendingEvents.Empty();
+	}
+
+	bool HasFailed()
+	{
+		FScopeLock ScopeLock(&Lock);
+		return IsError();
+	}
+
+	//非2xx响应的响应体
+	TArray<uint8> TakeErrorBody()
+	{
+		FScopeLock ScopeLock(&Lock);
+		return MoveTemp(ErrorBody);
+	}
+
+private:
+	enum class EBodyState : uint8
+	{
+		Unknown,
+		Ok,
+		Error,
+	};
+
+	//响应码为0表示还没有收到响应头
+	void SetBodyState(int32 ResponseCode)
+	{
+		if (ResponseCode <= 0)
+		{
+			return;
+		}
+		BodyState = EHttpResponseCodes::IsOk(ResponseCode) ? EBodyState::Ok : EBodyState::Error;
+		TArray<uint8> Held = MoveTemp(HeldBody);
+		HeldBody.Empty();
+		ReceiveBody(Held.GetData(), Held.Num());
+	}
+
+	void Receive(const uint8* Data, int64 Length)
+	{
+		if (bStopped || Length <= 0)
+		{
+			return;
+		}
+		BytesReceived += Length;
+		if (BodyState == EBodyState::Unknown)
+		{
+			//第一次收到数据时响应头已经到达，引擎的响应对象可以读取响应码
+			const TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> Request = WeakRequest.Pin();
+			const FHttpResponsePtr Response = Request.IsValid() ? Request->GetResponse() : nullptr;
+			SetBodyState(Response.IsValid() ? Response->GetResponseCode() : 0);
+		}
+		if (BodyState == EBodyState::Unknown)
+		{
+			HeldBody.Append(Data, Length);
+			if (MaxRecordBytes > 0 && HeldBody.Num() > FMath::Max(MaxRecordBytes, MaxErrorBodyBytes))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Stream response code is unknown after %lld bytes, stop receiving"), HeldBody.Num());
+				bStopped = true;
+				SetError();
+			}
+			return;
+		}
+		ReceiveBody(Data, Length);
+	}
+
+	void ReceiveBody(const uint8* Data, int64 Length)
+	{
+		if (Length <= 0)
+		{
+			return;
+		}
+		if (BodyState == EBodyState::Error)
+		{
+			ErrorBody.Append(Data, (int32)FMath::Min<int64>(Length, MaxErrorBodyBytes - ErrorBody.Num()));
+			return;
+		}
+		if (Format == EHttpStreamFormat::Raw)
+		{
+			PendingChunks.Emplace(Data, (int32)Length);
+		}
+		else if (!Parser.Feed(Data, Length, PendingEvents))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Stream record exceeds MaxRecordBytes, stop receiving"));
+			bStopped = true;
+			//引擎看到错误后停止接收
+			SetError();
+		}
+	}
+
+	TWeakObjectPtr<UHTTPStreamRequest> Owner;
+	TWeakPtr<IHttpRequest, ESPMode::ThreadSafe> WeakRequest;
+	EHttpStreamFormat Format;
+	int32 MaxRecordBytes = 0;
+	FCriticalSection Lock;
+	FHttpStreamParser Parser;
+	EBodyState BodyState = EBodyState::Unknown;
+	//还不知道响应码时收到的数据
+	TArray64<uint8> HeldBody;
+	TArray<uint8> ErrorBody;
+	TArray<TArray<uint8>> PendingChunks;
+	TArray<FHttpStreamEvent> PendingEvents;
+	int64 BytesReceived = 0;
+	bool bDeliveryScheduled = false;
+	bool bStopped = false;
+};
+
+FString UHTTPStreamRequest::GetErrorContent() const
+{
+	const FUTF8ToTCHAR Converter((const ANSICHAR*)ErrorContent.GetData(), ErrorContent.Num());
+	return FString(Converter.Length(), Converter.Get());
+}
+
+void UHTTPStreamRequest::BindStreamChunk(FSimpleHttpStreamChunkDelegate InDelegate)
+{
+	OnStreamChunk = InDelegate;
+}
+
+void UHTTPStreamRequest::BindStreamEvent(FSimpleHttpStreamEventDelegate InDelegate)
+{
+	OnStreamEvent = InDelegate;
+}
+
+void UHTTPStreamRequest::BindStreamComplete(FSimpleHttpStreamCompleteDelegate InDelegate)
+{
+	OnStreamComplete = InDelegate;
+}
+
+void UHTTPStreamRequest::Cancel()
+{
+	Finish(false, 0);
+}
+
+void UHTTPStreamRequest::Start(UHTTPHelperSubsystem* InSubsystem, const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& InRequest, const FHttpStreamSettings& InSettings)
+{
+	HTTPHelperSubsystem = InSubsystem;
+	Settings = InSettings;
+	HttpRequest = InRequest;
+	StartTime = FPlatformTime::Seconds();
+	Receiver = MakeShared<FHttpStreamReceiver, ESPMode::ThreadSafe>(this, InRequest, Settings.Format, Settings.MaxRecordBytes);
+#if SIMPLEHTTP_WITH_RESPONSE_STREAM
+	InRequest->SetResponseBodyReceiveStream(Receiver.ToSharedRef());
+#endif
+	InRequest->OnProcessRequestComplete().BindUObject(this, &UHTTPStreamRequest::OnRequestComplete);
+	SimpleHttpOnRequestProgress(*InRequest).BindUObject(this, &UHTTPStreamRequest::OnRequestProgress);
+
+	TWeakObjectPtr<UHTTPStreamRequest> WeakThis(this);
+	HTTPHelperSubsystem->EnqueueRequest(InRequest, Settings.Priority, [WeakThis]()
+		{
+			AsyncTask(ENamedThreads::GameThread, [WeakThis]()
+				{
+					if (UHTTPStreamRequest* This = WeakThis.Get())
+					{
+						This->HttpRequest.Reset();
+						This->Finish(false, 0);
+					}
+				});
+		});
+}
+
+void UHTTPStreamRequest::DeliverReceived()
+{
+	if (bFinished || !Receiver.IsValid())
+	{
+		return;
+	}
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_SimpleHTTP_StreamDeliver);
+	TArray<TArray<uint8>> Chunks;
+	TArray<FHttpStreamEvent> Events;
+	Receiver->TakeReceived(Chunks, Events);
+	if (FirstDeliverySeconds < 0 && (Chunks.Num() > 0 || Events.Num() > 0))
+	{
+		FirstDeliverySeconds = (float)(FPlatformTime::Seconds() - StartTime);
+	}
+	for (const TArray<uint8>& Chunk : Chunks)
+	{
+		OnStreamChunkNative.ExecuteIfBound(Chunk);
+		OnStreamChunk.ExecuteIfBound(Chunk);
+		//在委托中取消
+		if (bFinished)
+		{
+			return;
+		}
+	}
+	for (const FHttpStreamEvent& Event : Events)
+	{
+		EventCount++;
+		if (Settings.Format == EHttpStreamFormat::ServerSentEvents)
+		{
+			LastEventId = Event.Id;
+		}
+		OnStreamEvent.ExecuteIfBound(Event);
+		if (bFinished)
+		{
+			return;
+		}
+	}
+}
+
+void UHTTPStreamRequest::OnRequestProgress(FHttpRequestPtr Request, FSimpleHttpProgressBytes InBytesSent, FSimpleHttpProgressBytes InBytesReceived)
+{
+	if (Request == HttpRequest)
+	{
+		BytesReceived = (int64)InBytesReceived;
+		HTTPHelperSubsystem->ReportTransferredBytes(Request, (int64)InBytesSent, (int64)InBytesReceived);
+	}
+}
+
+void UHTTPStreamRequest::OnRequestComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful)
+{
+	HTTPHelperSubsystem->NotifyRequestFinished(Request);
+	if (bFinished || Request != HttpRequest)
+	{
+		return;
+	}
+	HttpRequest.Reset();
+	const int32 ResponseCode = Response.IsValid() ? Response->GetResponseCode() : 0;
+	const bool bResponseOk = bWasSuccessful && EHttpResponseCodes::IsOk(ResponseCode);
+#if SIMPLEHTTP_WITH_RESPONSE_STREAM
+	Receiver->Finish(nullptr, ResponseCode);
+#else
+	BytesReceived = bWasSuccessful && Response.IsValid() ? Response->GetContent().Num() : 0;
+	Receiver->Finish(bWasSuccessful && Response.IsValid() ? &Response->GetContent() : nullptr, ResponseCode);
+#endif
+	ErrorContent = Receiver->TakeErrorBody();
+	//完成前触发剩余的数据，包括最后一行
+	DeliverReceived();
+	if (!bFinished)
+	{
+		Finish(bResponseOk && !Receiver->HasFailed(), ResponseCode);
+	}
+}
+
+void UHTTPStreamRequest::Finish(bool bSuccess, int32 ResponseCode)
+{
+	if (bFinished)
+	{
+		return;
+	}
+	bFinished = true;
+	if (HttpRequest.IsValid())
+	{
+		HttpRequest->OnProcessRequestComplete().Unbind();
+		SimpleHttpOnRequestProgress(*HttpRequest).Unbind();
+		if (!HTTPHelperSubsystem->RemoveQueuedRequest(HttpRequest))
+		{
+			HttpRequest->CancelRequest();
+			HTTPHelperSubsystem->NotifyRequestFinished(HttpRequest);
+		}
+		HttpRequest.Reset();
+	}
+	if (Receiver.IsValid())
+	{
+		//HTTP线程可能还在写入，之后收到的数据直接丢弃
+		Receiver->Stop();
+		Receiver.Reset();
+	}
+	HTTPHelperSubsystem->OnStreamRequestFinished(this);
+	OnStreamComplete.ExecuteIfBound(bSuccess, ResponseCode);
+}
@@ -0,0 +1,196 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && SIMPLEHTTP_WITH_LOOPBACK_TESTS
+#include "Tests/HTTPTestHelpers.h"
+#include "HTTPBenchmark.h"
+#include "HTTPHelperSubsystem.h"
+#include "Misc/AutomationTest.h"
+#include "UObject/StrongObjectPtr.h"
+#include "WebHttpServer.h"
+
+namespace SimpleHTTPBenchmarkTest
+{
+	static const int32 RequestsPerRun = 64;
+	static const int32 Concurrencies[] = { 1, 8, 32 };
+	static const int32 PayloadSizes[] = { 1024, 64 * 1024, 1024 * 1024 };
+	static const EHttpBenchmarkMode Modes[] = { EHttpBenchmarkMode::Binary, EHttpBenchmarkMode::SaveAsFile };
+
+	struct FState
+	{
+		TSharedPtr<FWebHttpServer, ESPMode::ThreadSafe> Server;
+		UGameInstance* GameInstance = nullptr;
+		TWeakObjectPtr<UHTTPHelperSubsystem> Subsystem;
+		FString BaseURL;
+		//矩阵中所有的组合，依次运行避免互相影响
+		TArray<FHttpBenchmarkSettings> Runs;
+		int32 NextRun = 0;
+		TStrongObjectPtr<UHTTPBenchmark> Benchmark;
+		TArray<FHttpBenchmarkResult> Results;
+		double StartTime = 0;
+	};
+	typedef TSharedRef<FState, ESPMode::ThreadSafe> FStateRef;
+
+	static bool StartNextRun(FAutomationTestBase& Test, FState& State)
+	{
+		UHTTPHelperSubsystem* Subsystem = State.Subsystem.Get();
+		if (!Subsystem || !State.Runs.IsValidIndex(State.NextRun))
+		{
+			State.Benchmark.Reset();
+			return false;
+		}
+		const FHttpBenchmarkSettings& Settings = State.Runs[State.NextRun++];
+		State.Benchmark.Reset(Subsystem->RunBenchmark(Settings));
+		return Test.TestTrue(TEXT("Benchmark started"), State.Benchmark.IsValid());
+	}
+}
+
+//一组测试完成后开始下一组，全部完成后输出结果并关闭服务器
+class FSimpleHttpBenchmarkWaitCommand : public IAutomationLatentCommand
+{
+public:
+	FSimpleHttpBenchmarkWaitCommand(FAutomationTestBase* InTest, const SimpleHTTPBenchmarkTest::FStateRef& InState)
+		: Test(InTest)
+		, State(InState)
+	{
+	}
+
+	virtual bool Update() override
+	{
+		using namespace SimpleHTTPBenchmarkTest;
+		//矩阵比较大，每组给一次完整的超时时间
+		const bool bTimedOut = FPlatformTime::Seconds() - State->StartTime > SimpleHTTPTest::TimeoutSeconds * State->Runs.Num();
+		if (State->Benchmark.IsValid() && !State->Benchmark->IsFinished() && !bTimedOut)
+		{
+			return false;
+		}
+		if (bTimedOut)
+		{
+			Test->AddError(FString::Printf(TEXT("Benchmark matrix timed out after %d of %d runs"), State->Results.Num(), State->Runs.Num()));
+		}
+		else if (State->Benchmark.IsValid())
+		{
+			const FHttpBenchmarkResult Result = State->Benchmark->GetResult();
+			const FString Name = UHTTPBenchmark::ResultToString(Result);
+			Test->TestEqual(Name + TEXT(": all requests completed"), Result.CompletedRequests, Result.Settings.Requests);
+			Test->TestEqual(Name + TEXT(": no request failed"), Result.FailedRequests, 0);
+			State->Results.Add(Result);
+			if (StartNextRun(*Test, *State))
+			{
+				return false;
+			}
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("SimpleHTTP benchmark matrix against the loopback server (%d requests per run):"), RequestsPerRun);
+		UE_LOG(LogTemp, Display, TEXT("%-10s %11s %12s %10s %10s %10s %10s %12s"), TEXT("Mode"), TEXT("Concurrency"), TEXT("Payload"), TEXT("req/s"), TEXT("p50 ms"), TEXT("p99 ms"), TEXT("GT ms"), TEXT("Memory MB"));
+		for (const FHttpBenchmarkResult& Result : State->Results)
+		{
+			UE_LOG(LogTemp, Display, TEXT("%-10s %11d %12d %10.1f %10.2f %10.2f %10.3f %12.1f"),
+				*StaticEnum<EHttpBenchmarkMode>()->GetNameStringByValue((int64)Result.Settings.Mode),
+				Result.Settings.Concurrency, Result.Settings.PayloadBytes, Result.RequestsPerSecond,
+				Result.LatencyP50Ms, Result.LatencyP99Ms, Result.GameThreadMsPerCompletion, Result.PeakMemoryGrowthMB);
+		}
+
+		State->Benchmark.Reset();
+		SimpleHTTPTest::ShutdownGameInstance(State->GameInstance);
+		State->GameInstance = nullptr;
+		State->Server->Shutdown();
+		return true;
+	}
+
+private:
+	FAutomationTestBase* Test;
+	SimpleHTTPBenchmarkTest::FStateRef State;
+};
+
+/**
+ * 在本机启动FWebHttpServer，按照模式、并发数量和内容大小的组合依次运行UHTTPBenchmark，
+ * 检查所有请求都成功，并把吞吐量、延迟、游戏线程耗时和内存增长输出到日志。
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSimpleHttpBenchmarkMatrixTest, "SimpleHTTP.Benchmark", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSimpleHttpBenchmarkMatrixTest::RunTest(const FString& Parameters)
+{
+	using namespace SimpleHTTPBenchmarkTest;
+	const FStateRef State = MakeShared<FState, ESPMode::ThreadSafe>();
+
+	//下载的内容按大小提前准备，路由在工作线程只读取共享的内容
+	TMap<FString, TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe>> Downloads;
+	for (const int32 PayloadBytes : PayloadSizes)
+	{
+		Downloads.Add(FString::FromInt(PayloadBytes), MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(SimpleHTTPTest::MakePayload(PayloadBytes)));
+	}
+	State->Server = MakeShared<FWebHttpServer, ESPMode::ThreadSafe>();
+	State->Server->AddRoute(TEXT("POST"), TEXT("/echo"), [](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+		{
+			Response.Body = Request.Body;
+			Response.ContentType = TEXT("application/octet-stream");
+		});
+	State->Server->AddRoute(TEXT("GET"), TEXT("/download/:bytes"), [Downloads](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+		{
+			const TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe>* Body = Downloads.Find(Request.PathParams.FindRef(TEXT("bytes")));
+			if (!Body)
+			{
+				Response.StatusCode = 404;
+				return;
+			}
+			Response.SetShared(*Body, TEXT("application/octet-stream"));
+		});
+	FWebHttpServerSettings ServerSettings;
+	ServerSettings.Port = 0;
+	ServerSettings.WorkerThreads = 8;
+	if (!TestTrue(TEXT("Loopback server started"), State->Server->Start(ServerSettings)))
+	{
+		return false;
+	}
+	State->BaseURL = FString::Printf(TEXT("http://127.0.0.1:%d"), State->Server->GetPort());
+
+	State->GameInstance = SimpleHTTPTest::CreateGameInstance();
+	UHTTPHelperSubsystem* Subsystem = State->GameInstance->GetSubsystem<UHTTPHelperSubsystem>();
+	if (!TestNotNull(TEXT("HTTP subsystem"), Subsystem))
+	{
+		SimpleHTTPTest::ShutdownGameInstance(State->GameInstance);
+		State->Server->Shutdown();
+		return false;
+	}
+	State->Subsystem = Subsystem;
+	//并发只受测试设置的限制，同一个主机的限制也放开
+	int32 MaxConcurrency = 1;
+	for (const int32 Concurrency : Concurrencies)
+	{
+		MaxConcurrency = FMath::Max(MaxConcurrency, Concurrency);
+	}
+	Subsystem->SchedulerSettings.MaxConcurrentRequests = MaxConcurrency;
+	Subsystem->SchedulerSettings.MaxConcurrentRequestsPerHost = MaxConcurrency;
+	//统计完成回调的游戏线程耗时
+	Subsystem->bCollectRequestMetrics = true;
+
+	for (const EHttpBenchmarkMode Mode : Modes)
+	{
+		for (const int32 Concurrency : Concurrencies)
+		{
+			for (const int32 PayloadBytes : PayloadSizes)
+			{
+				FHttpBenchmarkSettings& Settings = State->Runs.AddDefaulted_GetRef();
+				Settings.Mode = Mode;
+				Settings.URL = Mode == EHttpBenchmarkMode::SaveAsFile ? FString::Printf(TEXT("%s/download/%d"), *State->BaseURL, PayloadBytes) : State->BaseURL + TEXT("/echo");
+				Settings.Requests = RequestsPerRun;
+				Settings.Concurrency = Concurrency;
+				Settings.PayloadBytes = PayloadBytes;
+			}
+		}
+	}
+
+	State->StartTime = FPlatformTime::Seconds();
+	if (!StartNextRun(*this, *State))
+	{
+		SimpleHTTPTest::ShutdownGameInstance(State->GameInstance);
+		State->Server->Shutdown();
+		return false;
+	}
+	ADD_LATENT_AUTOMATION_COMMAND(FSimpleHttpBenchmarkWaitCommand(this, State));
+	return true;
+}
+#endif
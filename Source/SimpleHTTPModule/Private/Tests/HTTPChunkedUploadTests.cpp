@@ -0,0 +1,426 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && SIMPLEHTTP_WITH_LOOPBACK_TESTS
+#include "Tests/HTTPTestHelpers.h"
+#include "HTTPChunkedUpload.h"
+#include "HTTPHelperSubsystem.h"
+#include "HAL/FileManager.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/StrongObjectPtr.h"
+#include "WebHttpServer.h"
+
+namespace SimpleHTTPTusTest
+{
+	using namespace SimpleHTTPTest;
+
+	static const int64 PartBytes = 1024 * 1024;
+	static const int64 PatchBytes = 256 * 1024;
+	//不是分块大小的整数倍，最后一个分块和最后一个PATCH都比较小
+	static const int32 FileBytes = 3 * 1024 * 1024 + 123;
+	//第一次上传在服务器收到这么多字节后取消
+	static const int32 CancelAfterBytes = 1024 * 1024;
+
+	/**
+	 * 只实现测试需要的tus 1.0：creation、按Upload-Offset续传和可选的concatenation。
+	 * 路由在服务器的工作线程执行，所有状态由Lock保护。
+	 */
+	struct FTusServerState
+	{
+		struct FUpload
+		{
+			TArray<uint8> Data;
+			int64 Length = 0;
+			bool bPartial = false;
+		};
+
+		FCriticalSection Lock;
+		TMap<FString, FUpload> Uploads;
+		int32 NextId = 1;
+		bool bConcatenation = false;
+		//模拟连接中断，第几个PATCH只保存一半内容后返回500，0表示不中断
+		int32 FailPatchNumber = 0;
+		//每个PATCH处理前等待，让测试有机会在上传中途取消
+		float PatchDelaySeconds = 0.f;
+
+		int32 OptionsRequests = 0;
+		int32 SingleCreates = 0;
+		int32 PartialCreates = 0;
+		int32 FinalCreates = 0;
+		int32 Patches = 0;
+		int64 MaxPatchBytes = 0;
+
+		int64 GetMaxOffset()
+		{
+			FScopeLock ScopeLock(&Lock);
+			int64 MaxOffset = 0;
+			for (const TPair<FString, FUpload>& Upload : Uploads)
+			{
+				MaxOffset = FMath::Max<int64>(MaxOffset, Upload.Value.Data.Num());
+			}
+			return MaxOffset;
+		}
+
+		bool GetUploadData(const FString& UploadURL, TArray<uint8>& OutData)
+		{
+			FScopeLock ScopeLock(&Lock);
+			FString Id;
+			if (!UploadURL.Split(TEXT("/files/"), nullptr, &Id))
+			{
+				return false;
+			}
+			const FUpload* Upload = Uploads.Find(Id);
+			if (!Upload || Upload->Data.Num() != Upload->Length)
+			{
+				return false;
+			}
+			OutData = Upload->Data;
+			return true;
+		}
+	};
+	typedef TSharedRef<FTusServerState, ESPMode::ThreadSafe> FTusServerStateRef;
+
+	static void SetTusHeaders(FWebHttpServerResponse& Response)
+	{
+		Response.Headers.Add(TEXT("Tus-Resumable"), TEXT("1.0.0"));
+		Response.Headers.Add(TEXT("Cache-Control"), TEXT("no-store"));
+	}
+
+	static void AddTusRoutes(FWebHttpServer& Server, const FTusServerStateRef& State)
+	{
+		Server.AddRoute(TEXT("OPTIONS"), TEXT("/files"), [State](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+			{
+				FScopeLock ScopeLock(&State->Lock);
+				State->OptionsRequests++;
+				SetTusHeaders(Response);
+				Response.StatusCode = 204;
+				Response.Headers.Add(TEXT("Tus-Version"), TEXT("1.0.0"));
+				Response.Headers.Add(TEXT("Tus-Extension"), State->bConcatenation ? TEXT("creation, concatenation") : TEXT("creation"));
+			});
+
+		Server.AddRoute(TEXT("POST"), TEXT("/files"), [State](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+			{
+				FScopeLock ScopeLock(&State->Lock);
+				SetTusHeaders(Response);
+				FTusServerState::FUpload Upload;
+				const FString* Concat = Request.Headers.Find(TEXT("Upload-Concat"));
+				if (Concat && !State->bConcatenation)
+				{
+					Response.StatusCode = 400;
+					return;
+				}
+				if (Concat && Concat->StartsWith(TEXT("final;")))
+				{
+					//按顺序合并已经完成的partial upload
+					TArray<FString> PartURLs;
+					Concat->Mid(6).ParseIntoArray(PartURLs, TEXT(" "));
+					for (const FString& PartURL : PartURLs)
+					{
+						FString PartId;
+						const FTusServerState::FUpload* Part = PartURL.Split(TEXT("/files/"), nullptr, &PartId) ? State->Uploads.Find(PartId) : nullptr;
+						if (!Part || !Part->bPartial || Part->Data.Num() != Part->Length)
+						{
+							Response.StatusCode = 400;
+							return;
+						}
+						Upload.Data.Append(Part->Data);
+					}
+					Upload.Length = Upload.Data.Num();
+					State->FinalCreates++;
+				}
+				else
+				{
+					const FString* Length = Request.Headers.Find(TEXT("Upload-Length"));
+					if (!Length)
+					{
+						Response.StatusCode = 400;
+						return;
+					}
+					Upload.Length = FCString::Atoi64(**Length);
+					Upload.bPartial = Concat != nullptr;
+					(Upload.bPartial ? State->PartialCreates : State->SingleCreates)++;
+				}
+				const FString Id = FString::FromInt(State->NextId++);
+				State->Uploads.Add(Id, MoveTemp(Upload));
+				Response.StatusCode = 201;
+				Response.Headers.Add(TEXT("Location"), TEXT("/files/") + Id);
+			});
+
+		Server.AddRoute(TEXT("HEAD"), TEXT("/files/:id"), [State](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+			{
+				FScopeLock ScopeLock(&State->Lock);
+				SetTusHeaders(Response);
+				const FTusServerState::FUpload* Upload = State->Uploads.Find(Request.PathParams.FindRef(TEXT("id")));
+				if (!Upload)
+				{
+					Response.StatusCode = 404;
+					return;
+				}
+				Response.Headers.Add(TEXT("Upload-Offset"), FString::Printf(TEXT("%d"), Upload->Data.Num()));
+				Response.Headers.Add(TEXT("Upload-Length"), FString::Printf(TEXT("%lld"), Upload->Length));
+			});
+
+		Server.AddRoute(TEXT("PATCH"), TEXT("/files/:id"), [State](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+			{
+				float Delay = 0.f;
+				{
+					FScopeLock ScopeLock(&State->Lock);
+					Delay = State->PatchDelaySeconds;
+				}
+				if (Delay > 0.f)
+				{
+					FPlatformProcess::Sleep(Delay);
+				}
+				FScopeLock ScopeLock(&State->Lock);
+				SetTusHeaders(Response);
+				FTusServerState::FUpload* Upload = State->Uploads.Find(Request.PathParams.FindRef(TEXT("id")));
+				if (!Upload)
+				{
+					Response.StatusCode = 404;
+					return;
+				}
+				const FString* Offset = Request.Headers.Find(TEXT("Upload-Offset"));
+				if (!Offset || FCString::Atoi64(**Offset) != Upload->Data.Num())
+				{
+					Response.StatusCode = 409;
+					return;
+				}
+				if (Upload->Data.Num() + Request.Body.Num() > Upload->Length)
+				{
+					Response.StatusCode = 400;
+					return;
+				}
+				State->Patches++;
+				State->MaxPatchBytes = FMath::Max<int64>(State->MaxPatchBytes, Request.Body.Num());
+				if (State->Patches == State->FailPatchNumber)
+				{
+					//只收到了一半内容时连接中断
+					Upload->Data.Append(Request.Body.GetData(), Request.Body.Num() / 2);
+					Response.StatusCode = 500;
+					return;
+				}
+				Upload->Data.Append(Request.Body);
+				Response.StatusCode = 204;
+				Response.Headers.Add(TEXT("Upload-Offset"), FString::Printf(TEXT("%d"), Upload->Data.Num()));
+			});
+	}
+
+	enum class EPhase : uint8
+	{
+		//服务器不支持concatenation，上传到一半时取消
+		SequentialBeforeCancel,
+		//再次上传同一个文件，从服务器确认的位置继续
+		SequentialResume,
+		//服务器支持concatenation，分块并行上传后合并
+		Concatenate,
+		//不并行时不查询OPTIONS，也不合并
+		SingleParallelism,
+		Done,
+	};
+
+	struct FState
+	{
+		TSharedPtr<FWebHttpServer, ESPMode::ThreadSafe> Server;
+		TSharedPtr<FTusServerState, ESPMode::ThreadSafe> TusState;
+		UGameInstance* GameInstance = nullptr;
+		TWeakObjectPtr<UHTTPHelperSubsystem> Subsystem;
+		FString Endpoint;
+		FString WorkingDirectory;
+		TArray<uint8> Payload;
+		TStrongObjectPtr<UHTTPChunkedUpload> Upload;
+		EPhase Phase = EPhase::SequentialBeforeCancel;
+		double StartTime = 0;
+		int32 OptionsBeforePhase = 0;
+		int32 PatchesBeforePhase = 0;
+	};
+	typedef TSharedRef<FState, ESPMode::ThreadSafe> FStateRef;
+
+	static FHttpChunkedUploadSettings MakeSettings(int32 MaxParallelParts)
+	{
+		FHttpChunkedUploadSettings Settings;
+		Settings.MaxParallelParts = MaxParallelParts;
+		Settings.PartSizeBytes = PartBytes;
+		Settings.PatchSizeBytes = PatchBytes;
+		Settings.MaxPartRetries = 3;
+		Settings.TimeoutSecs = 30.f;
+		return Settings;
+	}
+
+	//每个阶段上传不同的文件，journal互不影响
+	static bool StartUpload(FAutomationTestBase& Test, FState& State, const TCHAR* FileName, int32 MaxParallelParts)
+	{
+		const FString FilePath = FPaths::Combine(State.WorkingDirectory, FileName);
+		if (!FPaths::FileExists(FilePath) && !FFileHelper::SaveArrayToFile(State.Payload, *FilePath))
+		{
+			Test.AddError(FString::Printf(TEXT("Write upload file %s failed"), *FilePath));
+			return false;
+		}
+		{
+			FScopeLock ScopeLock(&State.TusState->Lock);
+			State.OptionsBeforePhase = State.TusState->OptionsRequests;
+			State.PatchesBeforePhase = State.TusState->Patches;
+		}
+		UHTTPHelperSubsystem* Subsystem = State.Subsystem.Get();
+		State.Upload.Reset(Subsystem ? Subsystem->CallHTTPAndUploadFileChunked(State.Endpoint, TMap<FString, FString>(), FilePath, MakeSettings(MaxParallelParts)) : nullptr);
+		return Test.TestTrue(FString::Printf(TEXT("Chunked upload of %s started"), FileName), State.Upload.IsValid());
+	}
+
+	static void TestUploadedData(FAutomationTestBase& Test, FState& State, const FString& What)
+	{
+		TArray<uint8> Uploaded;
+		const FString UploadURL = State.Upload->GetUploadURL();
+		Test.TestFalse(What + TEXT(" succeeded"), UploadURL.IsEmpty());
+		Test.TestTrue(What + TEXT(" stored the whole file"), State.TusState->GetUploadData(UploadURL, Uploaded) && Uploaded == State.Payload);
+	}
+}
+
+//按阶段依次上传并检查服务器上的结果，全部完成或者超时后关闭服务器
+class FSimpleHttpTusWaitCommand : public IAutomationLatentCommand
+{
+public:
+	FSimpleHttpTusWaitCommand(FAutomationTestBase* InTest, const SimpleHTTPTusTest::FStateRef& InState)
+		: Test(InTest)
+		, State(InState)
+	{
+	}
+
+	virtual bool Update() override
+	{
+		using namespace SimpleHTTPTusTest;
+		if (FPlatformTime::Seconds() - State->StartTime > TimeoutSeconds)
+		{
+			Test->AddError(FString::Printf(TEXT("Chunked upload test timed out in phase %d"), (int32)State->Phase));
+			State->Phase = EPhase::Done;
+		}
+		FTusServerState& Tus = *State->TusState;
+		switch (State->Phase)
+		{
+		case EPhase::SequentialBeforeCancel:
+			if (State->Upload->IsFinished())
+			{
+				Test->AddError(TEXT("Upload finished before it could be interrupted"));
+				State->Phase = EPhase::Done;
+			}
+			else if (Tus.GetMaxOffset() >= CancelAfterBytes)
+			{
+				State->Upload->Cancel();
+				{
+					FScopeLock ScopeLock(&Tus.Lock);
+					Tus.PatchDelaySeconds = 0.f;
+				}
+				State->Phase = StartUpload(*Test, *State, TEXT("sequential.bin"), 4) ? EPhase::SequentialResume : EPhase::Done;
+			}
+			return false;
+
+		case EPhase::SequentialResume:
+			if (!State->Upload->IsFinished())
+			{
+				return false;
+			}
+			TestUploadedData(*Test, *State, TEXT("Sequential upload"));
+			Test->TestTrue(TEXT("Resumed from the offset the server confirmed"), State->Upload->GetResumedBytes() >= CancelAfterBytes);
+			{
+				FScopeLock ScopeLock(&Tus.Lock);
+				Test->TestEqual(TEXT("Extensions probed with OPTIONS"), Tus.OptionsRequests, 2);
+				Test->TestEqual(TEXT("One upload created without concatenation"), Tus.SingleCreates, 1);
+				Test->TestEqual(TEXT("No partial uploads without concatenation"), Tus.PartialCreates, 0);
+				Test->TestTrue(TEXT("File sent in several PATCH requests"), Tus.Patches > 1);
+				Test->TestTrue(TEXT("PATCH bodies bounded by PatchSizeBytes"), Tus.MaxPatchBytes > 0 && Tus.MaxPatchBytes <= PatchBytes);
+				Tus.bConcatenation = true;
+			}
+			State->Phase = StartUpload(*Test, *State, TEXT("concatenate.bin"), 3) ? EPhase::Concatenate : EPhase::Done;
+			return false;
+
+		case EPhase::Concatenate:
+			if (!State->Upload->IsFinished())
+			{
+				return false;
+			}
+			TestUploadedData(*Test, *State, TEXT("Concatenated upload"));
+			{
+				FScopeLock ScopeLock(&Tus.Lock);
+				Test->TestEqual(TEXT("One partial upload per part"), Tus.PartialCreates, (int32)FMath::DivideAndRoundUp<int64>(FileBytes, PartBytes));
+				Test->TestEqual(TEXT("Parts concatenated once"), Tus.FinalCreates, 1);
+			}
+			State->Phase = StartUpload(*Test, *State, TEXT("single.bin"), 1) ? EPhase::SingleParallelism : EPhase::Done;
+			return false;
+
+		case EPhase::SingleParallelism:
+			if (!State->Upload->IsFinished())
+			{
+				return false;
+			}
+			TestUploadedData(*Test, *State, TEXT("Upload without parallelism"));
+			{
+				FScopeLock ScopeLock(&Tus.Lock);
+				Test->TestEqual(TEXT("No OPTIONS without parallelism"), Tus.OptionsRequests, State->OptionsBeforePhase);
+				Test->TestEqual(TEXT("No concatenation without parallelism"), Tus.FinalCreates, 1);
+				Test->TestEqual(TEXT("Sent in bounded PATCH requests"), Tus.Patches - State->PatchesBeforePhase, (int32)FMath::DivideAndRoundUp<int64>(FileBytes, PatchBytes));
+			}
+			State->Phase = EPhase::Done;
+			return false;
+
+		case EPhase::Done:
+		default:
+			break;
+		}
+
+		State->Upload.Reset();
+		ShutdownGameInstance(State->GameInstance);
+		State->GameInstance = nullptr;
+		State->Server->Shutdown();
+		IFileManager::Get().DeleteDirectory(*State->WorkingDirectory, false, true);
+		return true;
+	}
+
+private:
+	FAutomationTestBase* Test;
+	SimpleHTTPTusTest::FStateRef State;
+};
+
+/**
+ * 在本机启动实现了tus的FWebHttpServer，检查分块上传：服务器不支持concatenation时依次PATCH同一个上传，
+ * PATCH中途失败和取消后都从服务器确认的位置继续；支持时分块并行上传后合并。
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSimpleHttpChunkedUploadTest, "SimpleHTTP.ChunkedUpload", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSimpleHttpChunkedUploadTest::RunTest(const FString& Parameters)
+{
+	using namespace SimpleHTTPTusTest;
+	const FStateRef State = MakeShared<FState, ESPMode::ThreadSafe>();
+	State->Payload = MakePayload(FileBytes);
+	State->WorkingDirectory = MakeWorkingDirectory(TEXT("ChunkedUploadTest"));
+	State->TusState = MakeShared<FTusServerState, ESPMode::ThreadSafe>();
+	//第二个PATCH中断，之后放慢PATCH以便在上传到一半时取消
+	State->TusState->FailPatchNumber = 2;
+	State->TusState->PatchDelaySeconds = 0.05f;
+
+	State->Server = MakeShared<FWebHttpServer, ESPMode::ThreadSafe>();
+	AddTusRoutes(*State->Server, State->TusState.ToSharedRef());
+	FWebHttpServerSettings ServerSettings;
+	ServerSettings.Port = 0;
+	if (!TestTrue(TEXT("Loopback tus server started"), State->Server->Start(ServerSettings)))
+	{
+		return false;
+	}
+	State->Endpoint = FString::Printf(TEXT("http://127.0.0.1:%d/files"), State->Server->GetPort());
+
+	State->GameInstance = CreateGameInstance();
+	State->Subsystem = State->GameInstance->GetSubsystem<UHTTPHelperSubsystem>();
+	State->StartTime = FPlatformTime::Seconds();
+	if (!TestTrue(TEXT("HTTP subsystem"), State->Subsystem.IsValid()) || !StartUpload(*this, *State, TEXT("sequential.bin"), 4))
+	{
+		ShutdownGameInstance(State->GameInstance);
+		State->Server->Shutdown();
+		IFileManager::Get().DeleteDirectory(*State->WorkingDirectory, false, true);
+		return false;
+	}
+
+	ADD_LATENT_AUTOMATION_COMMAND(FSimpleHttpTusWaitCommand(this, State));
+	return true;
+}
+#endif
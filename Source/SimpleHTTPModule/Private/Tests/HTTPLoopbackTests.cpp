@@ -0,0 +1,228 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && SIMPLEHTTP_WITH_LOOPBACK_TESTS
+#include "Tests/HTTPTestHelpers.h"
+#include "HTTPHelperSubsystem.h"
+#include "HAL/FileManager.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "WebHttpServer.h"
+
+namespace SimpleHTTPLoopbackTest
+{
+	using namespace SimpleHTTPTest;
+
+	static const int32 DownloadBytes = 256 * 1024;
+
+	static bool ContainsBytes(const TArray<uint8>& Haystack, const TArray<uint8>& Needle)
+	{
+		for (int32 Index = 0; Index + Needle.Num() <= Haystack.Num(); Index++)
+		{
+			if (FMemory::Memcmp(Haystack.GetData() + Index, Needle.GetData(), Needle.Num()) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//一个请求在完成委托中记录的结果
+	struct FCallResult
+	{
+		bool bCompleted = false;
+		bool bSuccess = false;
+		TArray<uint8> Content;
+		FHttpRequestTiming Timing;
+		int32 ProgressEvents = 0;
+		int64 LastBytesReceived = 0;
+		bool bSaved = false;
+	};
+
+	struct FState
+	{
+		TSharedPtr<FWebHttpServer, ESPMode::ThreadSafe> Server;
+		UGameInstance* GameInstance = nullptr;
+		FString BaseURL;
+		FString WorkingDirectory;
+		TArray<uint8> DownloadPayload;
+		TArray<uint8> FilePayload;
+		FCallResult StringCall;
+		FCallResult BinaryCall;
+		FCallResult FilesCall;
+		FCallResult DownloadCall;
+		double StartTime = 0;
+
+		bool IsCompleted() const
+		{
+			return StringCall.bCompleted && BinaryCall.bCompleted && FilesCall.bCompleted && DownloadCall.bCompleted;
+		}
+	};
+	typedef TSharedRef<FState, ESPMode::ThreadSafe> FStateRef;
+
+	//超时后测试结束，之后完成的请求不能再写入结果
+	static void Track(UHTTPRequest* Request, const FStateRef& State, FCallResult FState::* Member, const FString& SaveDirectory = FString())
+	{
+		if (!Request)
+		{
+			(State.Get().*Member).bCompleted = true;
+			return;
+		}
+		const TWeakPtr<FState, ESPMode::ThreadSafe> WeakState = State;
+		Request->OnRequestProgressNative.BindLambda([WeakState, Member](const FHttpRequestProgress& Progress)
+			{
+				if (const TSharedPtr<FState, ESPMode::ThreadSafe> PinnedState = WeakState.Pin())
+				{
+					FCallResult& Result = PinnedState.Get()->*Member;
+					Result.ProgressEvents++;
+					Result.LastBytesReceived = Progress.BytesReceived;
+				}
+			});
+		Request->OnRequestCompleteAsView.BindLambda([WeakState, Member, Request, SaveDirectory](bool bSuccess, TArrayView<const uint8> Content)
+			{
+				const TSharedPtr<FState, ESPMode::ThreadSafe> PinnedState = WeakState.Pin();
+				if (!PinnedState.IsValid())
+				{
+					return;
+				}
+				FCallResult& Result = PinnedState.Get()->*Member;
+				Result.bCompleted = true;
+				Result.bSuccess = bSuccess;
+				Result.Content = TArray<uint8>(Content.GetData(), Content.Num());
+				Result.Timing = Request->GetTiming();
+				if (bSuccess && !SaveDirectory.IsEmpty())
+				{
+					Result.bSaved = Request->SaveAsFile(SaveDirectory, TEXT("download.bin"), false);
+				}
+			});
+	}
+
+	static void TestTiming(FAutomationTestBase& Test, const FString& Name, const FCallResult& Result)
+	{
+		Test.TestTrue(Name + TEXT(" succeeded"), Result.bSuccess);
+		Test.TestEqual(Name + TEXT(" response code"), Result.Timing.ResponseCode, 200);
+		Test.TestTrue(Name + TEXT(" total time recorded"), Result.Timing.TotalSeconds > 0.f && Result.Timing.TotalSeconds < TimeoutSeconds);
+		Test.TestTrue(Name + TEXT(" headers before completion"), Result.Timing.TimeToHeadersSeconds >= 0.f && Result.Timing.TimeToHeadersSeconds <= Result.Timing.TransferSeconds);
+	}
+}
+
+//等待所有请求完成后检查结果并关闭服务器
+class FSimpleHttpLoopbackWaitCommand : public IAutomationLatentCommand
+{
+public:
+	FSimpleHttpLoopbackWaitCommand(FAutomationTestBase* InTest, const SimpleHTTPLoopbackTest::FStateRef& InState)
+		: Test(InTest)
+		, State(InState)
+	{
+	}
+
+	virtual bool Update() override
+	{
+		using namespace SimpleHTTPLoopbackTest;
+		const bool bTimedOut = FPlatformTime::Seconds() - State->StartTime > TimeoutSeconds;
+		if (!State->IsCompleted() && !bTimedOut)
+		{
+			return false;
+		}
+		Test->TestFalse(TEXT("Requests finished before the timeout"), bTimedOut);
+		if (State->IsCompleted())
+		{
+			TestTiming(*Test, TEXT("CallHTTP"), State->StringCall);
+			Test->TestEqual(TEXT("CallHTTP echoed body"), BytesToString(State->StringCall.Content), FString(TEXT("SimpleHTTP loopback string")));
+
+			TestTiming(*Test, TEXT("CallHTTPAsBinary"), State->BinaryCall);
+			Test->TestTrue(TEXT("CallHTTPAsBinary echoed body"), State->BinaryCall.Content == State->DownloadPayload);
+
+			TestTiming(*Test, TEXT("CallHTTPAsFiles"), State->FilesCall);
+			Test->TestTrue(TEXT("CallHTTPAsFiles uploaded the file part"), ContainsBytes(State->FilesCall.Content, State->FilePayload));
+
+			TestTiming(*Test, TEXT("SaveAsFile"), State->DownloadCall);
+			Test->TestTrue(TEXT("Download body"), State->DownloadCall.Content == State->DownloadPayload);
+			Test->TestTrue(TEXT("Download progress events"), State->DownloadCall.ProgressEvents > 0);
+			Test->TestEqual(TEXT("Final progress covers the body"), State->DownloadCall.LastBytesReceived, (int64)State->DownloadPayload.Num());
+			TArray<uint8> Saved;
+			Test->TestTrue(TEXT("SaveAsFile wrote the body"), State->DownloadCall.bSaved && FFileHelper::LoadFileToArray(Saved, *FPaths::Combine(State->WorkingDirectory, TEXT("download.bin"))) && Saved == State->DownloadPayload);
+		}
+
+		ShutdownGameInstance(State->GameInstance);
+		State->GameInstance = nullptr;
+		State->Server->Shutdown();
+		IFileManager::Get().DeleteDirectory(*State->WorkingDirectory, false, true);
+		return true;
+	}
+
+private:
+	FAutomationTestBase* Test;
+	SimpleHTTPLoopbackTest::FStateRef State;
+};
+
+/**
+ * 在本机启动FWebHttpServer，通过CallHTTP、CallHTTPAsBinary、CallHTTPAsFiles和SaveAsFile完成请求，
+ * 检查响应内容、进度事件和请求耗时。
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSimpleHttpLoopbackTest, "SimpleHTTP.Loopback", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSimpleHttpLoopbackTest::RunTest(const FString& Parameters)
+{
+	using namespace SimpleHTTPLoopbackTest;
+	const FStateRef State = MakeShared<FState, ESPMode::ThreadSafe>();
+	State->DownloadPayload = MakePayload(DownloadBytes);
+	const FTCHARToUTF8 FileText(TEXT("SimpleHTTP loopback file part"));
+	State->FilePayload.Append((const uint8*)FileText.Get(), FileText.Length());
+	State->WorkingDirectory = MakeWorkingDirectory(TEXT("LoopbackTest"));
+
+	//路由在工作线程执行，只读取共享的内容
+	State->Server = MakeShared<FWebHttpServer, ESPMode::ThreadSafe>();
+	State->Server->AddRoute(TEXT("POST"), TEXT("/echo"), [](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+		{
+			Response.Body = Request.Body;
+			Response.ContentType = TEXT("application/octet-stream");
+		});
+	const TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> DownloadBody = MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(State->DownloadPayload);
+	State->Server->AddRoute(TEXT("GET"), TEXT("/download"), [DownloadBody](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+		{
+			Response.SetShared(DownloadBody, TEXT("application/octet-stream"));
+		});
+	FWebHttpServerSettings ServerSettings;
+	ServerSettings.Port = 0;
+	if (!TestTrue(TEXT("Loopback server started"), State->Server->Start(ServerSettings)))
+	{
+		return false;
+	}
+	State->BaseURL = FString::Printf(TEXT("http://127.0.0.1:%d"), State->Server->GetPort());
+
+	State->GameInstance = CreateGameInstance();
+	UHTTPHelperSubsystem* Subsystem = State->GameInstance->GetSubsystem<UHTTPHelperSubsystem>();
+	if (!TestNotNull(TEXT("HTTP subsystem"), Subsystem))
+	{
+		ShutdownGameInstance(State->GameInstance);
+		State->Server->Shutdown();
+		return false;
+	}
+	//每次进度都触发，以便检查最后的进度
+	Subsystem->ProgressSettings.MinIntervalSeconds = 0.f;
+
+	const TMap<FString, FString> Headers;
+	const TMap<FString, FString> Params;
+	State->StartTime = FPlatformTime::Seconds();
+	Track(Subsystem->CallHTTP(State->BaseURL + TEXT("/echo"), EMethodByte::POST, Headers, Params, TEXT("SimpleHTTP loopback string")), State, &FState::StringCall);
+	Track(Subsystem->CallHTTPAsBinary(State->BaseURL + TEXT("/echo"), EMethodByte::POST, Headers, Params, State->DownloadPayload), State, &FState::BinaryCall);
+
+	const FString UploadPath = FPaths::Combine(State->WorkingDirectory, TEXT("upload.txt"));
+	TestTrue(TEXT("Upload file written"), FFileHelper::SaveArrayToFile(State->FilePayload, *UploadPath));
+	TArray<FHttpRequestFileCreator> Files;
+	FHttpRequestFileCreator& File = Files.AddDefaulted_GetRef();
+	File.bIsFile = true;
+	File.KeyName = TEXT("file");
+	File.ContentInfo = UploadPath;
+	Track(Subsystem->CallHTTPAsFiles(State->BaseURL + TEXT("/echo"), Headers, Params, Files), State, &FState::FilesCall);
+
+	Track(Subsystem->CallHTTP(State->BaseURL + TEXT("/download"), EMethodByte::GET, Headers, Params, FString()), State, &FState::DownloadCall, State->WorkingDirectory);
+
+	ADD_LATENT_AUTOMATION_COMMAND(FSimpleHttpLoopbackWaitCommand(this, State));
+	return true;
+}
+#endif
@@ -0,0 +1,63 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && SIMPLEHTTP_WITH_LOOPBACK_TESTS
+#include "Engine/Engine.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+
+//本地回环测试共用的工具函数
+namespace SimpleHTTPTest
+{
+	//测试超时时间，超时后结束测试并关闭服务器
+	static const double TimeoutSeconds = 60.0;
+
+	inline TArray<uint8> MakePayload(int32 Bytes)
+	{
+		TArray<uint8> Payload;
+		Payload.SetNumUninitialized(Bytes);
+		for (int32 Index = 0; Index < Bytes; Index++)
+		{
+			Payload[Index] = (uint8)(Index * 31 + 7);
+		}
+		return Payload;
+	}
+
+	inline FString BytesToString(const TArray<uint8>& Bytes)
+	{
+		const FUTF8ToTCHAR Converter((const ANSICHAR*)Bytes.GetData(), Bytes.Num());
+		return FString(Converter.Length(), Converter.Get());
+	}
+
+	//Subsystem属于GameInstance，测试使用独立的GameInstance
+	inline UGameInstance* CreateGameInstance()
+	{
+		UGameInstance* GameInstance = NewObject<UGameInstance>(GEngine);
+		//等待期间不能被回收
+		GameInstance->AddToRoot();
+		GameInstance->InitializeStandalone();
+		return GameInstance;
+	}
+
+	//Deinitialize中Subsystem取消还没有完成的请求
+	inline void ShutdownGameInstance(UGameInstance* GameInstance)
+	{
+		UWorld* World = GameInstance->GetWorld();
+		GameInstance->Shutdown();
+		if (World)
+		{
+			GEngine->DestroyWorldContext(World);
+			World->DestroyWorld(false);
+		}
+		GameInstance->RemoveFromRoot();
+	}
+
+	inline FString MakeWorkingDirectory(const TCHAR* TestName)
+	{
+		return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SimpleHTTP"), TestName, FGuid::NewGuid().ToString());
+	}
+}
+#endif
@@ -0,0 +1,132 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeCounter64.h"
+#include "HTTPBandwidthLimiter.generated.h"
+
+enum class EHttpRequestPriority : uint8;
+
+//上传和下载的速度上限，字节每秒，小于等于0表示不限制
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpBandwidthLimit
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int64 UploadBytesPerSecond = 0;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int64 DownloadBytesPerSecond = 0;
+	//空闲后可以一次发送的量，为多少秒的速度
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float BurstSeconds = 1.f;
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpBandwidthSettings
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bEnabled = false;
+	//所有请求的总速度
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpBandwidthLimit Global;
+	//Normal优先级请求的总速度
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpBandwidthLimit Normal;
+	//Background优先级请求的总速度
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpBandwidthLimit Background;
+	//按Host限制的速度，Key为不带端口的域名
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	TMap<FString, FHttpBandwidthLimit> HostLimits;
+	//为false时Critical请求不等待，但是收发的字节仍然计入全局和Host的限制
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bLimitCritical = false;
+	/**
+	 * 流式的请求体和写入文件的响应体在传输中途也按限制等待：请求自己的桶透支时，每次读写在HTTP线程最多等待这么多毫秒。
+	 * HTTP线程由所有请求共用，等待期间其他请求的收发也会推迟，所以每次只等待很短的时间。小于等于0表示只在发送前限制。
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float MaxStreamPaceMilliseconds = 5.f;
+};
+
+/**
+ * 流在HTTP线程读写时累计的字节数，调度器在游戏线程取出后计入带宽。
+ * 按实际经过流的字节计入，不依赖进度事件，也不会把响应头中的Content-Length当作已经收到的字节。
+ * 调度器同时设置请求的透支什么时候还清，流在读写之前调用Pace等待。
+ */
+class SIMPLEHTTPMODULE_API FHttpTransferCounter
+{
+public:
+	void Add(int64 Bytes) { Uncharged.Add(Bytes); }
+	//取出还没有计入带宽的字节数
+	int64 Take() { return Uncharged.Set(0); }
+
+	//在游戏线程调用，PaceSeconds小于等于0时不再等待
+	void SetPace(double PaceSeconds, float MaxWaitSeconds);
+	//在HTTP线程读写之前调用，透支还没有还清时最多等待MaxWaitSeconds
+	void Pace() const;
+
+private:
+	FThreadSafeCounter64 Uncharged;
+	FThreadSafeCounter64 PaceUntilCycles;
+	FThreadSafeCounter64 MaxWaitMicroseconds;
+};
+
+/**
+ * 令牌桶限速，由FHttpRequestScheduler在发送请求前检查。只能在游戏线程使用。
+ * 令牌可以透支：请求发送时扣除请求体的大小，接收的字节在进度和完成时扣除，长期的平均速度不超过设置的速度。
+ * 透支按请求的优先级记在各自的名下，补充的令牌先还优先级高的透支。全局和Host的桶透支时只有透支的优先级和更低的优先级继续排队，
+ * Background下载造成的透支不会阻塞Normal和Critical请求。
+ */
+class SIMPLEHTTPMODULE_API FHttpBandwidthLimiter
+{
+public:
+	//按当前设置补充令牌，设置可以在运行时修改
+	void Refill(const FHttpBandwidthSettings& Settings, double Now);
+	//有请求体的请求检查上传的桶，所有请求都检查下载的桶
+	bool CanDispatch(const FHttpBandwidthSettings& Settings, const FString& Host, EHttpRequestPriority Priority, bool bHasContent) const;
+	void Consume(const FHttpBandwidthSettings& Settings, const FString& Host, EHttpRequestPriority Priority, int64 BytesSent, int64 BytesReceived);
+	//请求相关的桶还清这个优先级和更高优先级的透支需要的秒数，不需要等待时返回0
+	double GetPaceSeconds(const FHttpBandwidthSettings& Settings, const FString& Host, EHttpRequestPriority Priority, bool bUpload) const;
+	void Reset();
+
+private:
+	//和EHttpRequestPriority::Max相同，这里只有前置声明
+	static constexpr int32 NumPriorities = 3;
+
+	struct FTokenBucket
+	{
+		double Tokens = 0;
+		//令牌不足的部分按优先级记录
+		double Debt[NumPriorities] = {};
+		bool bInitialized = false;
+
+		void Refill(int64 BytesPerSecond, float BurstSeconds, double DeltaSeconds);
+		void Consume(int64 Bytes, EHttpRequestPriority Priority);
+		//这个优先级和更高优先级的透支
+		double GetDebt(EHttpRequestPriority Priority) const;
+	};
+	struct FBucketPair
+	{
+		FTokenBucket Upload;
+		FTokenBucket Download;
+
+		void Refill(const FHttpBandwidthLimit& Limit, double DeltaSeconds);
+		bool CanDispatch(const FHttpBandwidthLimit& Limit, EHttpRequestPriority Priority, bool bHasContent) const;
+		void Consume(const FHttpBandwidthLimit& Limit, EHttpRequestPriority Priority, int64 BytesSent, int64 BytesReceived);
+		double GetPaceSeconds(const FHttpBandwidthLimit& Limit, EHttpRequestPriority Priority, bool bUpload) const;
+	};
+	//Priority对应的设置，没有单独限制时返回空
+	static const FHttpBandwidthLimit* GetClassLimit(const FHttpBandwidthSettings& Settings, EHttpRequestPriority Priority);
+	FBucketPair* GetClassBuckets(EHttpRequestPriority Priority);
+
+	FBucketPair GlobalBuckets;
+	FBucketPair NormalBuckets;
+	FBucketPair BackgroundBuckets;
+	TMap<FString, FBucketPair> HostBuckets;
+	double LastRefillTime = 0;
+};
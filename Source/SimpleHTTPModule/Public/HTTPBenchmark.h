@@ -0,0 +1,136 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "HTTPRequestMetrics.h"
+#include "HTTPBenchmark.generated.h"
+
+class UHTTPHelperSubsystem;
+class UHTTPRequest;
+
+UENUM(BlueprintType)
+enum class EHttpBenchmarkMode : uint8
+{
+	//CallHTTP发送文本，绑定字符委托
+	String,
+	//CallHTTPAsBinary发送二进制，绑定二进制委托
+	Binary,
+	//CallHTTPAsFiles上传一个文件
+	Files,
+	//GET请求后在完成委托中调用SaveAsFile
+	SaveAsFile,
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpBenchmarkSettings
+{
+	GENERATED_BODY()
+public:
+	//测试使用的服务器地址，建议使用本机的服务器避免网络的影响
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FString URL;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	EHttpBenchmarkMode Mode = EHttpBenchmarkMode::String;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 Requests = 200;
+	//同时进行的请求数量，仍然受SchedulerSettings的并发限制
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 Concurrency = 16;
+	//发送的内容大小，SaveAsFile模式不发送内容
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 PayloadBytes = 4096;
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpBenchmarkResult
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	FHttpBenchmarkSettings Settings;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 CompletedRequests = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 FailedRequests = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float WallSeconds = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float RequestsPerSecond = 0.f;
+	//从提交到完成委托执行的时间
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float LatencyP50Ms = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float LatencyP95Ms = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float LatencyP99Ms = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float LatencyMaxMs = 0.f;
+	//测试期间进程使用的物理内存比开始时增加的最大值
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float PeakMemoryGrowthMB = 0.f;
+	//每个请求完成时在游戏线程花费的平均时间，需要开启bCollectRequestMetrics
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float GameThreadMsPerCompletion = 0.f;
+};
+
+DECLARE_DYNAMIC_DELEGATE_OneParam(FSimpleHttpBenchmarkCompleteDelegate, const FHttpBenchmarkResult&, Result);
+
+/**
+ * 按照固定的并发数量和内容大小发送请求，统计吞吐量、延迟百分位数、内存增长和完成回调的游戏线程耗时。
+ * 也可以在控制台使用SimpleHTTP.Benchmark命令运行，结果输出到日志。
+ */
+UCLASS(BlueprintType)
+class SIMPLEHTTPMODULE_API UHTTPBenchmark : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Benchmark", meta = (DisplayName = "绑定测试完成的委托"))
+	void BindBenchmarkComplete(FSimpleHttpBenchmarkCompleteDelegate InDelegate);
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Benchmark")
+	bool IsFinished() const { return bFinished; }
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Benchmark")
+	FHttpBenchmarkResult GetResult() const { return Result; }
+
+	static FString ResultToString(const FHttpBenchmarkResult& InResult);
+
+private:
+	friend class UHTTPHelperSubsystem;
+
+	void Start(UHTTPHelperSubsystem* InSubsystem, const FHttpBenchmarkSettings& InSettings);
+	void LaunchRequests();
+	UHTTPRequest* SendRequest(int32 Index);
+	void OnRequestComplete(bool bSuccess, TArrayView<const uint8> Content, UHTTPRequest* Request);
+	//只用于触发字符和二进制的转换
+	UFUNCTION()
+	void OnStringComplete(bool bSuccess, FString Content);
+	UFUNCTION()
+	void OnBinaryComplete(bool bSuccess, const TArray<uint8>& Content);
+	void SampleMemory();
+	void Finish();
+
+	UPROPERTY()
+	UHTTPHelperSubsystem* HTTPHelperSubsystem = nullptr;
+
+	FHttpBenchmarkSettings Settings;
+	FHttpBenchmarkResult Result;
+	FString StringPayload;
+	TArray<uint8> BinaryPayload;
+	FString WorkingDirectory;
+
+	int32 Launched = 0;
+	int32 InFlight = 0;
+	double StartTime = 0;
+	uint64 StartUsedPhysical = 0;
+	uint64 PeakUsedPhysical = 0;
+	double StartCompletionSeconds = 0;
+	int64 StartRecordedRequests = 0;
+	FHttpLatencyHistogram Latency;
+	bool bFinished = false;
+
+	FSimpleHttpBenchmarkCompleteDelegate OnBenchmarkComplete;
+};
@@ -0,0 +1,75 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTTPBodyCompression.generated.h"
+
+UENUM(BlueprintType)
+enum class EHttpContentEncoding : uint8
+{
+	Gzip UMETA(DisplayName = "gzip"),
+	//HTTP中的deflate为zlib格式
+	Deflate UMETA(DisplayName = "deflate"),
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpCompressionSettings
+{
+	GENERATED_BODY()
+public:
+	//启用后请求体在后台线程压缩，需要服务器支持对应的Content-Encoding
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bEnabled = false;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	EHttpContentEncoding Encoding = EHttpContentEncoding::Gzip;
+	//小于该字节数的请求体不压缩
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MinSizeBytes = 1024;
+	//压缩后大小超过原大小的该比例时发送原内容
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float MaxCompressedRatio = 0.9f;
+	//Content-Type以这些前缀开头的请求体已经压缩过或者服务器通常不解压，不再压缩
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	TArray<FString> SkippedContentTypes = {
+		TEXT("image/"),
+		TEXT("video/"),
+		TEXT("audio/"),
+		TEXT("font/woff"),
+		TEXT("multipart/"),
+		TEXT("application/zip"),
+		TEXT("application/gzip"),
+		TEXT("application/x-gzip"),
+		TEXT("application/x-7z-compressed"),
+		TEXT("application/x-rar-compressed"),
+		TEXT("application/zstd"),
+		TEXT("application/pdf"),
+	};
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpCompressionStats
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 CompressedRequests = 0;
+	//压缩效果不够而发送原内容的请求数量
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 IneffectiveRequests = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 UncompressedBytes = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 CompressedBytes = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float TotalCompressSeconds = 0.f;
+};
+
+struct SIMPLEHTTPMODULE_API FHttpBodyCompression
+{
+	static const TCHAR* GetEncodingName(EHttpContentEncoding Encoding);
+	//根据设置判断请求体是否需要压缩，只读取请求头和内容大小，可以在游戏线程调用
+	static bool ShouldCompress(const FHttpCompressionSettings& Settings, const FString& ContentType, int64 ContentSize);
+	//压缩失败或者压缩后不够小时返回false，可以在任意线程调用
+	static bool Compress(EHttpContentEncoding Encoding, float MaxCompressedRatio, TArrayView<const uint8> Content, TArray<uint8>& OutCompressed);
+};
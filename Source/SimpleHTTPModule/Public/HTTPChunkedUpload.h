@@ -0,0 +1,170 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Interfaces/IHttpRequest.h"
+#include "HTTPRequestScheduler.h"
+#include "SimpleHTTPCompat.h"
+#include "HTTPChunkedUpload.generated.h"
+
+class UHTTPHelperSubsystem;
+enum class EMethodByte : uint8;
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpChunkedUploadSettings
+{
+	GENERATED_BODY()
+public:
+	//同时上传的分块数量。大于1且服务器在OPTIONS的Tus-Extension中声明了concatenation时并行上传，否则整个文件依次上传
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxParallelParts = 4;
+	//并行上传时每个分块的字节数
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int64 PartSizeBytes = 8 * 1024 * 1024;
+	//每个PATCH请求最多发送的字节数，也是读取到内存中的上限。分块大于它时分成多个PATCH依次发送
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int64 PatchSizeBytes = 4 * 1024 * 1024;
+	//单个分块失败后的重试次数，重试时先用HEAD查询服务器已经收到的位置
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxPartRetries = 3;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float TimeoutSecs = 100.f;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bAddDefaultHeaders = true;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	EHttpRequestPriority Priority = EHttpRequestPriority::Background;
+};
+
+DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpChunkedUploadCompleteDelegate, bool, bSuccess, const FString&, UploadURL);
+DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpChunkedUploadProgressDelegate, int64, BytesSent, int64, TotalBytes);
+
+/**
+ * 按tus 1.0协议分块上传文件。MaxParallelParts大于1时先用OPTIONS查询服务器支持的扩展，支持concatenation时
+ * 文件分成多个分块，每个分块创建一个partial upload并行上传，全部完成后用final upload合并；否则整个文件作为一个上传，
+ * 用多个PATCH依次发送。服务器返回的上传地址和已完成的分块记录在Saved/SimpleHTTP/Uploads下的journal中，
+ * 中断后再次上传同一个文件时用HEAD查询每个分块已经收到的位置，从该位置继续上传。
+ */
+UCLASS(BlueprintType)
+class SIMPLEHTTPMODULE_API UHTTPChunkedUpload : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Upload", meta = (DisplayName = "绑定上传完成的委托"))
+	void BindUploadComplete(FSimpleHttpChunkedUploadCompleteDelegate InDelegate);
+
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Upload", meta = (DisplayName = "绑定上传进度的委托"))
+	void BindUploadProgress(FSimpleHttpChunkedUploadProgressDelegate InDelegate);
+
+	//取消上传，服务器上已经收到的内容和journal保留，之后可以继续上传
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Upload", meta = (DisplayName = "取消上传"))
+	void Cancel();
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Upload")
+	bool IsFinished() const { return bFinished; }
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Upload")
+	int64 GetBytesSent() const;
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Upload")
+	int64 GetTotalBytes() const { return TotalBytes; }
+
+	//从上次中断的上传中恢复的字节数
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Upload")
+	int64 GetResumedBytes() const { return ResumedBytes; }
+
+	//上传完成后服务器上文件的地址
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Upload")
+	FString GetUploadURL() const { return UploadURL; }
+
+private:
+	friend class UHTTPHelperSubsystem;
+
+	struct FPart
+	{
+		int64 Offset = 0;
+		int64 Size = 0;
+		//服务器为这个分块创建的上传地址
+		FString URL;
+		//服务器确认收到的字节数，相对分块开头
+		int64 ConfirmedBytes = 0;
+		//ConfirmedBytes是否和服务器一致，失败后需要用HEAD重新查询
+		bool bOffsetKnown = false;
+		bool bCompleted = false;
+		//正在后台线程读取分块内容
+		bool bReading = false;
+		int32 Attempts = 0;
+		TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> Request;
+		int64 SentBytes = 0;
+	};
+
+	void Start(UHTTPHelperSubsystem* InSubsystem, const FString& InEndpoint, const TMap<FString, FString>& InHeaders, const FString& InFilePath, const FHttpChunkedUploadSettings& InSettings);
+	//Start的下一帧开始上传。文件不存在或者journal中所有分块都已完成时会直接结束，推迟后调用者才有机会绑定完成委托
+	bool OnStartTick(float DeltaTime);
+	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> CreateRequest(const FString& InURL, EMethodByte Verb) const;
+	void SendRequest(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& Request, int32 PartIndex);
+	//只有服务器支持concatenation时才会分成多个分块
+	bool IsMultiPart() const { return Parts.Num() > 1; }
+
+	//查询服务器是否支持concatenation扩展，失败时按不支持处理
+	void SendOptions();
+	void OnOptionsComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful);
+	//划分分块并加载journal，然后开始上传
+	void StartParts(bool bConcatenate);
+
+	void LaunchParts();
+	//根据分块的状态发送下一个请求：创建上传地址、查询位置或者上传剩余内容
+	void AdvancePart(int32 PartIndex);
+	void SendCreate(int32 PartIndex);
+	void SendQuery(int32 PartIndex);
+	void SendPatch(int32 PartIndex);
+	void OnCreateComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 PartIndex);
+	void OnQueryComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 PartIndex);
+	void OnPatchComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 PartIndex);
+	void OnPatchProgress(FHttpRequestPtr Request, FSimpleHttpProgressBytes BytesSent, FSimpleHttpProgressBytes BytesReceived, int32 PartIndex);
+	//返回false表示请求已经过期或者上传已经结束
+	bool ClaimResponse(const FHttpRequestPtr& Request, int32 PartIndex);
+	void FailPart(int32 PartIndex);
+	void CompletePart(int32 PartIndex);
+	void OnAllPartsCompleted();
+
+	void SendConcatenate();
+	void OnConcatenateComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful);
+	void Finish(bool bSuccess);
+	void BroadcastProgress();
+
+	//把服务器返回的Location转换为完整地址
+	FString ResolveLocation(const FString& Location) const;
+	FString GetUploadMetadata() const;
+
+	FString GetJournalPath() const;
+	bool LoadJournal();
+	void SaveJournal() const;
+
+	UPROPERTY()
+	UHTTPHelperSubsystem* HTTPHelperSubsystem = nullptr;
+
+	FString Endpoint;
+	TMap<FString, FString> Headers;
+	FString FilePath;
+	FHttpChunkedUploadSettings Settings;
+
+	int64 TotalBytes = 0;
+	int64 CompletedBytes = 0;
+	int64 ResumedBytes = 0;
+	FDateTime FileTimeStamp;
+	FString UploadURL;
+
+	TArray<FPart> Parts;
+	int32 InFlightCount = 0;
+	TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> OptionsRequest;
+	TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> ConcatenateRequest;
+	int32 ConcatenateAttempts = 0;
+	bool bFinished = false;
+	FSimpleHttpTickerHandle StartTickHandle;
+
+	FSimpleHttpChunkedUploadCompleteDelegate OnUploadComplete;
+	FSimpleHttpChunkedUploadProgressDelegate OnUploadProgress;
+};
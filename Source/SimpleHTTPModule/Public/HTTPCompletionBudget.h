@@ -0,0 +1,41 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTTPCompletionBudget.generated.h"
+
+//每帧在游戏线程执行的请求完成回调的上限，小于等于0表示不限制
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpCompletionBudgetSettings
+{
+	GENERATED_BODY()
+public:
+	//每帧最多执行的完成回调数量
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxCompletionsPerFrame = 0;
+	//每帧完成回调最多花费的毫秒数，超过后剩余的完成推迟到下一帧
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float MaxMillisecondsPerFrame = 0.f;
+};
+
+/**
+ * 统计当前帧已经执行的完成回调数量和耗时，由UHTTPHelperSubsystem决定完成是否推迟。只能在游戏线程使用。
+ * 耗时在回调执行后才知道，所以单个耗时很长的回调仍然会超出预算，之后的回调推迟到下一帧。
+ */
+class SIMPLEHTTPMODULE_API FHttpCompletionBudget
+{
+public:
+	static bool IsEnabled(const FHttpCompletionBudgetSettings& Settings);
+	//当前帧是否还有剩余的预算
+	bool HasBudget(const FHttpCompletionBudgetSettings& Settings);
+	void Consume(uint32 Cycles);
+
+private:
+	//进入新的一帧时清空计数
+	void Refresh();
+
+	uint64 Frame = 0;
+	int32 Completions = 0;
+	double Seconds = 0;
+};
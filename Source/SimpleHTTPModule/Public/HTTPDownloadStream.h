@@ -0,0 +1,115 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/Archive.h"
+#include "HAL/CriticalSection.h"
+#include "HTTPBandwidthLimiter.h"
+
+class IFileHandle;
+
+/**
+ * 把HTTP响应体直接写入临时文件的流。
+ * HTTP线程收到的数据块被放入队列，由后台写入任务写到磁盘，HTTP线程不会等待磁盘。
+ * 队列中的数据超过MaxPendingBytes（磁盘长时间跟不上网络）时流进入错误状态，下载失败，所以内存占用有上限。
+ * 下载完成后调用Finalize把临时文件重命名为目标文件，没有Finalize的临时文件在流销毁时删除。
+ */
+class SIMPLEHTTPMODULE_API FHttpFileDownloadStream : public FArchive, public TSharedFromThis<FHttpFileDownloadStream, ESPMode::ThreadSafe>
+{
+public:
+	FHttpFileDownloadStream(const FString& InTempFilePath, int64 InMaxPendingBytes = 64 * 1024 * 1024);
+	virtual ~FHttpFileDownloadStream() override;
+
+	bool Open();
+
+	virtual void Serialize(void* Data, int64 Length) override;
+	virtual int64 Tell() override { return BytesReceived; }
+	virtual int64 TotalSize() override { return BytesReceived; }
+	//等待所有数据写入磁盘并关闭文件，会阻塞调用线程。超过CloseTimeoutSeconds时放弃剩余的数据并返回false
+	virtual bool Close() override;
+	virtual FString GetArchiveName() const override { return TEXT("FHttpFileDownloadStream"); }
+
+	//关闭并把临时文件移动到目标路径
+	bool Finalize(const FString& TargetFilePath);
+	//关闭并删除临时文件
+	void Discard();
+
+	const FString& GetTempFilePath() const { return TempFilePath; }
+	//Serialize收到的字节，由调度器计入带宽限制并设置写入前的等待
+	TSharedRef<FHttpTransferCounter, ESPMode::ThreadSafe> GetReceiveCounter() const { return ReceiveCounter; }
+
+private:
+	void WriterLoop();
+
+	//写入任务没有在运行时调用，关闭文件并按需要删除临时文件
+	void CloseFile();
+
+	FString TempFilePath;
+	int64 MaxPendingBytes = 0;
+	int64 BytesReceived = 0;
+	float CloseTimeoutSeconds = 30.f;
+	TSharedRef<FHttpTransferCounter, ESPMode::ThreadSafe> ReceiveCounter = MakeShared<FHttpTransferCounter, ESPMode::ThreadSafe>();
+
+	FCriticalSection Lock;
+	TArray<TArray<uint8>> PendingChunks;
+	TArray<TArray<uint8>> FreeChunks;
+	int64 PendingBytes = 0;
+	bool bWriterActive = false;
+	bool bWriteFailed = false;
+	//Close之后不再接收数据
+	bool bClosed = false;
+	//临时文件已经移动到目标路径
+	bool bFinalized = false;
+	//文件关闭后删除临时文件
+	bool bDeleteOnClose = false;
+	FEvent* WriterIdleEvent = nullptr;
+
+	TUniquePtr<IFileHandle> File;
+};
+
+/**
+ * 多个线程按偏移写入同一个文件，分段下载时使用。写入之间互斥。
+ */
+class SIMPLEHTTPMODULE_API FHttpSharedWriteFile
+{
+public:
+	~FHttpSharedWriteFile();
+
+	//打开文件。大小与TotalSize不一致时重新创建并预分配，否则保留已有内容。返回是否保留了已有内容
+	bool Open(const FString& InFilePath, int64 TotalSize, bool& bOutKeptExisting);
+	bool WriteAt(int64 Offset, const uint8* Data, int64 Length);
+	//把已经写入的数据刷到磁盘，文件已经关闭时返回true
+	bool Flush();
+	void Close();
+
+private:
+	FCriticalSection Lock;
+	TUniquePtr<IFileHandle> File;
+};
+
+/**
+ * 把一个Range请求的响应体直接写入共享文件的对应偏移，超过范围时设置错误。
+ */
+class SIMPLEHTTPMODULE_API FHttpRangeWriteStream : public FArchive
+{
+public:
+	FHttpRangeWriteStream(const TSharedRef<FHttpSharedWriteFile, ESPMode::ThreadSafe>& InFile, int64 InOffset, int64 InSize);
+
+	virtual void Serialize(void* Data, int64 Length) override;
+	virtual int64 Tell() override { return BytesWritten; }
+	virtual int64 TotalSize() override { return BytesWritten; }
+	virtual FString GetArchiveName() const override { return TEXT("FHttpRangeWriteStream"); }
+
+	//可以在其他线程读取，用于显示进度
+	int64 GetBytesWritten() const { return FPlatformAtomics::AtomicRead(&BytesWritten); }
+	//写入的字节，由调度器计入带宽限制
+	TSharedRef<FHttpTransferCounter, ESPMode::ThreadSafe> GetReceiveCounter() const { return ReceiveCounter; }
+
+private:
+	TSharedRef<FHttpSharedWriteFile, ESPMode::ThreadSafe> File;
+	int64 Offset = 0;
+	int64 Size = 0;
+	volatile int64 BytesWritten = 0;
+	TSharedRef<FHttpTransferCounter, ESPMode::ThreadSafe> ReceiveCounter = MakeShared<FHttpTransferCounter, ESPMode::ThreadSafe>();
+};
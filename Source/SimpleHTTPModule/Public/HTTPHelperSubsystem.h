@@ -7,6 +7,21 @@
 #include "Subsystems/GameInstanceSubsystem.h"
 #include "Interfaces/IHttpRequest.h"
 #include "HTTPRequest.h"
+#include "HTTPMultipartStream.h"
+#include "HTTPRequestScheduler.h"
+#include "HTTPResponseCache.h"
+#include "HTTPRequestBatch.h"
+#include "HTTPSegmentedDownload.h"
+#include "HTTPChunkedUpload.h"
+#include "HTTPRetryPolicy.h"
+#include "HTTPBodyCompression.h"
+#include "HTTPRequestMetrics.h"
+#include "HTTPBenchmark.h"
+#include "HTTPRequestTemplate.h"
+#include "HTTPNativeRequestQueue.h"
+#include "HTTPCompletionBudget.h"
+#include "HTTPStreamRequest.h"
+#include "SimpleHTTPCompat.h"
 #include "HTTPHelperSubsystem.generated.h"
 
 UENUM(BlueprintType)
@@ -85,6 +100,10 @@ public:
 	FString KeyName;
 	TArray64<uint8> FileContent;
 	virtual bool CheckValid() const;
+	//上传的内容，默认为FileContent
+	virtual TArrayView64<const uint8> GetContentView() const { return FileContent; }
+	//内容来自映射的文件时返回映射，生成上传的流时共享而不复制
+	virtual TSharedPtr<FHttpMappedFile, ESPMode::ThreadSafe> GetMappedFile() const { return nullptr; }
 
 };
 
@@ -108,6 +127,51 @@ public:
 	bool LoadFile();
 };
 
+/**
+ * 映射文件而不是加载文件内容的Wapper，生成上传内容时直接从映射的内存读取。
+ * 平台不支持映射时退回到加载文件内容。
+ */
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpRequestMappedFileWapper : public FHttpRequestFileWapper
+{
+	GENERATED_BODY()
+public:
+	FHttpRequestMappedFileWapper() = default;
+	FHttpRequestMappedFileWapper(const FString& InKeyName, const FString& InFilePath);
+
+	bool MapFile();
+	bool IsMapped() const { return MappedFile.IsValid(); }
+	virtual TArrayView64<const uint8> GetContentView() const override;
+	virtual TSharedPtr<FHttpMappedFile, ESPMode::ThreadSafe> GetMappedFile() const override { return MappedFile; }
+
+private:
+	TSharedPtr<FHttpMappedFile, ESPMode::ThreadSafe> MappedFile;
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpFileLoadStats
+{
+	GENERATED_BODY()
+public:
+	//CallHTTPAsFiles加载文件的次数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalLoads = 0;
+	//有文件加载失败而没有发送的次数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 FailedLoads = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalFiles = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalBytes = 0;
+	//最近一次并行加载所有文件花费的秒数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float LastLoadSeconds = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float MaxLoadSeconds = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float TotalLoadSeconds = 0.f;
+};
+
 /**
  * 
  */
@@ -116,46 +180,176 @@ class SIMPLEHTTPMODULE_API UHTTPHelperSubsystem : public UGameInstanceSubsystem
 {
 	GENERATED_BODY()
 public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
 
-	UFUNCTION(BlueprintCallable,Category = "SimpleHTTP",DisplayName = "开始HTTP请求")
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "开始HTTP请求", meta = (AutoCreateRefTerm = "Headers,Params"))
 	UHTTPRequest* CallHTTP(
 		FString URL,
 		EMethodByte Verb,
-		TMap<FString, FString> Headers,
-		TMap<FString, FString> Params,
+		const TMap<FString, FString>& Headers,
+		const TMap<FString, FString>& Params,
 		FString Content,
 		float InTimeoutSecs = 100,
-		bool bAddDefaultHeaders = true);
-	UFUNCTION(BlueprintCallable,Category = "SimpleHTTP",DisplayName = "上传文件的HTTP请求")
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "上传文件的HTTP请求", meta = (AutoCreateRefTerm = "Headers,Params"))
 	UHTTPRequest* CallHTTPAndUploadFile(
 		FString URL,
 		EMethodByte Verb,
-		TMap<FString, FString> Headers,
-		TMap<FString, FString> Params,
+		const TMap<FString, FString>& Headers,
+		const TMap<FString, FString>& Params,
 		FString FilePath,
 		float InTimeoutSecs = 100,
-		bool bAddDefaultHeaders = true);
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
+
+	/**
+	* 按tus协议分块上传文件，URL为服务器创建上传的地址。服务器支持concatenation时分块并行上传，否则依次上传，
+	* 中断后再次上传同一个文件时从服务器确认的位置继续。
+	* 完成委托中的字符串为服务器上文件的地址。文件不存在时返回空。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "分块上传文件", meta = (AutoCreateRefTerm = "Headers"))
+	UHTTPChunkedUpload* CallHTTPAndUploadFileChunked(FString URL, const TMap<FString, FString>& Headers, FString FilePath, FHttpChunkedUploadSettings Settings);
+
+	/**
+	* 下载文件，响应体在接收的同时由后台线程写入临时文件，完成后重命名为目标文件，内存占用与文件大小无关。
+	* 完成委托中的字符串为保存的文件路径，二进制内容为空。低于UE5.3的版本会在完成后由后台线程保存。
+	* @param SavePath 保存文件的目录不能为空。
+	* @param FileName 文件名。可以为空，但是UsingReceivedFileName必须为true。
+	* @param UsingReceivedFileName 使用默认服务器给定的文件名。当为false时则使用FileName变量作为文件名。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "下载文件的HTTP请求", meta = (AutoCreateRefTerm = "Headers,Params"))
+	UHTTPRequest* CallHTTPAndDownloadFile(
+		FString URL,
+		EMethodByte Verb,
+		const TMap<FString, FString>& Headers,
+		const TMap<FString, FString>& Params,
+		FString SavePath,
+		FString FileName,
+		bool UsingReceivedFileName = true,
+		float InTimeoutSecs = 100,
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
 
-	UFUNCTION(BlueprintCallable,Category = "SimpleHTTP",DisplayName = "二进制的Content提交HTTP请求")
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "二进制的Content提交HTTP请求", meta = (AutoCreateRefTerm = "Headers,Params,Content"))
 	UHTTPRequest* CallHTTPAsBinary(
 		FString URL,
 		EMethodByte Verb,
-		TMap<FString, FString> Headers,
-		TMap<FString, FString> Params,
-		TArray<uint8> Content,
+		const TMap<FString, FString>& Headers,
+		const TMap<FString, FString>& Params,
+		const TArray<uint8>& Content,
 		int32 ContentLength = 0,
 		float InTimeoutSecs = 100,
-		bool bAddDefaultHeaders = true);
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
 
-	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "多文件的Content提交HTTP请求")
+	/**
+	* 以multipart/form-data提交多个文件或文本。文件在后台线程并行加载，请求对象立即返回，内容生成后再发送。
+	* 名称为空、内容为空或者文件无法读取的Part会被跳过并输出警告，所有Part都无效时返回空或者请求以失败完成。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "多文件的Content提交HTTP请求", meta = (AutoCreateRefTerm = "Headers,Params"))
 	UHTTPRequest* CallHTTPAsFiles(
 		FString URL,
-		TMap<FString, FString> Headers,
-		TMap<FString, FString> Params,
+		const TMap<FString, FString>& Headers,
+		const TMap<FString, FString>& Params,
 		UPARAM(ref) TArray<FHttpRequestFileCreator>& Files,
 		EMethodByte Verb = EMethodByte::POST,
 		float InTimeoutSecs = 100,
-		bool bAddDefaultHeaders = true);
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
+
+	/**
+	* 以流的方式提交multipart/form-data。文件不会预先加载到内存，而是在发送时从磁盘分块读取。
+	* Content-Length在发送前根据各个Part的大小计算。低于UE5的版本会退回到CallHTTPAsFiles。
+	* 无效Part的处理和CallHTTPAsFiles相同，所有Part都无效时返回空。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "多文件的流式Content提交HTTP请求", meta = (AutoCreateRefTerm = "Headers,Params"))
+	UHTTPRequest* CallHTTPAsFilesStreamed(
+		FString URL,
+		const TMap<FString, FString>& Headers,
+		const TMap<FString, FString>& Params,
+		const TArray<FHttpRequestFileCreator>& Files,
+		EMethodByte Verb = EMethodByte::POST,
+		float InTimeoutSecs = 100,
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
+
+	/**
+	* 把结构体序列化为JSON作为请求体提交，序列化在后台线程进行，完成后再发送请求。
+	* 返回的请求对象可以立即绑定委托。Headers中没有Content-Type时使用application/json。
+	*/
+	UFUNCTION(BlueprintCallable, CustomThunk, Category = "SimpleHTTP", meta = (CustomStructureParam = "Body", DisplayName = "结构体作为JSON提交HTTP请求"))
+	UHTTPRequest* CallHTTPAsStruct(
+		FString URL,
+		EMethodByte Verb,
+		TMap<FString, FString> Headers,
+		TMap<FString, FString> Params,
+		const int32& Body,
+		float InTimeoutSecs = 100,
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
+	DECLARE_FUNCTION(execCallHTTPAsStruct);
+
+	UHTTPRequest* CallHTTPAsStruct_Native(
+		FString URL,
+		EMethodByte Verb,
+		const TMap<FString, FString>& Headers,
+		const TMap<FString, FString>& Params,
+		const UScriptStruct* StructType,
+		const void* StructData,
+		float InTimeoutSecs = 100,
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
+
+	template<typename StructType>
+	UHTTPRequest* CallHTTPAsStruct_Native(
+		FString URL,
+		EMethodByte Verb,
+		const TMap<FString, FString>& Headers,
+		const TMap<FString, FString>& Params,
+		const StructType& Body,
+		float InTimeoutSecs = 100,
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal)
+	{
+		return CallHTTPAsStruct_Native(URL, Verb, Headers, Params, StructType::StaticStruct(), &Body, InTimeoutSecs, bAddDefaultHeaders, Priority);
+	}
+
+	/**
+	* 批量发送一组请求，在Settings的并发上限内发送，全部结束（或者FailFast时第一个失败）后触发一次批次完成委托。
+	* 单个请求的状态和响应内容在批次对象中获取。Items为空时返回空。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "批量HTTP请求")
+	UHTTPRequestBatch* CallHTTPBatch(const TArray<FHttpBatchRequestItem>& Items, FHttpBatchSettings Settings);
+
+	/**
+	* 分段并行下载文件，服务器支持Range时按SegmentSizeBytes分段并行下载，不支持时使用普通下载。
+	* 下载过程中记录已完成的分段，中断后再次下载同一个文件会从已完成的位置继续。FileName为空时使用URL中的文件名。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "分段下载文件")
+	UHTTPSegmentedDownload* CallHTTPSegmentedDownload(FString URL, const TMap<FString, FString>& Headers, FString SavePath, FString FileName, FHttpSegmentedDownloadSettings Settings);
+
+	/**
+	* 流式接收响应，用于SSE、NDJSON等长时间的响应。收到的数据不保存，解析出的数据块或记录在游戏线程依次触发。
+	* 没有设置Accept时按Format设置，SSE请求不使用压缩以免服务器缓冲。
+	* 需要5.3以上的引擎，之前的版本只有开启Settings.bAllowBufferedFallback时在完成后整体解析，否则返回空。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "流式接收的HTTP请求")
+	UHTTPStreamRequest* CallHTTPStream(FString URL, EMethodByte Verb, const TMap<FString, FString>& Headers, const TMap<FString, FString>& Params, FString Content, FHttpStreamSettings Settings);
+
+	/**
+	* 创建请求模板，地址、方法、请求头（包括默认请求头）和超时只解析一次，之后每次发送只传入参数和内容。
+	* URL中可以已经带有固定的参数。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "创建HTTP请求模板")
+	UHTTPRequestTemplate* CreateRequestTemplate(
+		FString URL,
+		EMethodByte Verb,
+		const TMap<FString, FString>& Headers,
+		float InTimeoutSecs = 100,
+		bool bAddDefaultHeaders = true,
+		EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
 
 	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> CreateHTTP_Native(
 		FString URL,
@@ -164,15 +358,90 @@ public:
 		const TMap<FString, FString>& Params,
 		float InTimeoutSecs = 100,
 		bool bAddDefaultHeaders = true);
+	//依次访问请求需要的请求头，Headers优先，再加上Headers中没有的默认请求头
+	void ForEachRequestHeader(EMethodByte Verb, const TMap<FString, FString>& Headers, bool bAddDefaultHeaders, TFunctionRef<void(const FString&, const FString&)> Visitor) const;
+	//把参数追加到URL后面，URL中已经有参数时使用&连接。bEncode为true时按RFC 3986编码参数名和值
+	static FString BuildRequestURL(const FString& URL, const TMap<FString, FString>& Params, bool bEncode = true);
+
+	UHTTPRequest* CreateHttpRequestObject(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest,uint32 ContentLength = 0, EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
+	//创建请求对象但不发送，用于在发送前设置请求对象。ContentLength为0时按已设置的内容设置Content-Length
+	UHTTPRequest* PrepareHttpRequestObject(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest, uint32 ContentLength);
+	//同上，但不设置Content-Length，用于内容来自流、文件或者之后在后台生成的请求
+	UHTTPRequest* PrepareHttpRequestObject(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest);
+	//发送PrepareHttpRequestObject创建的请求对象，启用压缩时请求体先在后台线程压缩，启用缓存时GET请求会先查找缓存
+	void SubmitHttpRequestObject(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority = EHttpRequestPriority::Normal);
+	//需要压缩时在后台线程压缩请求体，完成后在游戏线程更新请求并调用OnEncoded，返回false时不会调用
+	bool CompressNativeRequestBody(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest, TFunction<void()>&& OnEncoded);
+	//把请求交给调度器排队，在并发上限内发送。OnDispatchFailed在ProcessRequest失败时调用
+	void EnqueueRequest(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest, EHttpRequestPriority Priority, TFunction<void()>&& OnDispatchFailed = nullptr, TFunction<void()>&& OnDispatched = nullptr);
+	//请求完成后通知调度器释放并发数量
+	void NotifyRequestFinished(const FHttpRequestPtr& HttpRequest);
+	//收发的字节按流的计数计入带宽限制，流在传输中途也按限制等待。在EnqueueRequest的OnDispatched中调用
+	void SetTransferCounters(const FHttpRequestPtr& HttpRequest, const TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe>& SendCounter, const TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe>& ReceiveCounter);
+	//请求进度事件中调用，收发的字节计入带宽限制
+	void ReportTransferredBytes(const FHttpRequestPtr& HttpRequest, int64 BytesSent, int64 BytesReceived);
+	//移除还在排队的请求，已经发送的请求返回false
+	bool RemoveQueuedRequest(const FHttpRequestPtr& HttpRequest);
+	//计算请求合并使用的Key，包含方法、完整URL和所有请求头。带有条件请求头或者Range的请求不合并，返回空
+	static FString MakeCoalesceKey(const IHttpRequest& Request);
+
+	//请求没有设置重试策略时使用Host的策略，没有Host的策略时使用DefaultRetryPolicy
+	const FHttpRetryPolicy& GetRetryPolicy(const UHTTPRequest* RequestObject) const;
+	/**
+	* 线程安全的请求提交队列，在游戏线程获取后可以交给任意线程使用。
+	* 通过队列提交的请求不创建UHTTPRequest对象，经过调度器和带宽限制发送，不使用重试、缓存和请求合并。
+	*/
+	TSharedPtr<FHttpNativeRequestQueue, ESPMode::ThreadSafe> GetNativeRequestQueue() const { return NativeRequestQueue; }
+
+	//按重试策略、重试额度和Host的断路器计算下一次重试前等待的秒数，不应该重试时返回负数。
+	//分段下载等自己管理请求的功能也通过它重试。Attempt为已经重试的次数
+	float EvaluateRetry(const FHttpRetryPolicy& Policy, const IHttpRequest& Request, const FHttpResponsePtr& Response, bool bWasSuccessful, int32 Attempt);
+	//请求完成时调用，需要重试时安排重试并返回true，此时不应该执行完成委托
+	bool TryScheduleRetry(UHTTPRequest* RequestObject, const FHttpResponsePtr& Response, bool bWasSuccessful);
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTP", DisplayName = "获取重试统计")
+	FHttpRetryStats GetRetryStats() const;
+
+	//Host连续失败后断开期间不会重试该Host的请求
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTP", DisplayName = "Host是否断开")
+	bool IsHostCircuitOpen(const FString& Host) const;
 
-	UHTTPRequest* CreateHttpRequestObject(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& HttpRequest,uint32 ContentLength = 0);
-	//创建多个上传文件内容的Content
-	bool CreateFileContentAndHeadersForFromData(
+	//批次完成时调用，不再持有批次对象
+	void OnBatchFinished(UHTTPRequestBatch* Batch);
+	//分段下载结束时调用，不再持有下载对象
+	void OnSegmentedDownloadFinished(UHTTPSegmentedDownload* Download);
+	//流式请求结束时调用，不再持有请求对象
+	void OnStreamRequestFinished(UHTTPStreamRequest* StreamRequest);
+	//分块上传结束时调用，不再持有上传对象
+	void OnChunkedUploadFinished(UHTTPChunkedUpload* Upload);
+	//性能测试结束时调用，不再持有测试对象
+	void OnBenchmarkFinished(UHTTPBenchmark* Benchmark);
+
+	//从对象池中取出请求对象，对象池为空时创建新的对象
+	UHTTPRequest* AcquireRequestObject();
+	//请求完成委托执行后调用，在下一次Tick时根据是否固定决定保留或者回收
+	void OnRequestObjectCompleted(UHTTPRequest* RequestObject);
+	//请求对象被使用时调用，用于历史记录的LRU淘汰
+	void TouchRequestObject(UHTTPRequest* RequestObject);
+	//从所有记录中移除，不放回对象池
+	void ForgetRequestObject(UHTTPRequest* RequestObject);
+	//创建多个上传文件内容的Content，可以在任意线程调用
+	static bool CreateFileContentAndHeadersForFromData(
 	const TArray<FHttpRequestFileWapperBase*>& FileWappers,
 		TMap<FString, FString> & Headers,
 		TArray<uint8>& Content,
 		int32& ContentLength
 		);
+	//创建多个上传文件内容的流，文件内容不会被加载
+	TSharedPtr<FHttpMultipartFormDataStream, ESPMode::ThreadSafe> CreateFileStreamAndHeadersForFromData(
+		const TArray<FHttpRequestFileCreator>& Files,
+		TMap<FString, FString>& Headers
+		);
+	//使用已经加载或者映射的内容创建上传的流，映射的文件直接作为流的内容，不复制。可以在任意线程调用
+	static TSharedPtr<FHttpMultipartFormDataStream, ESPMode::ThreadSafe> CreateFileStreamAndHeadersForFromData(
+		const TArray<FHttpRequestFileWapperBase*>& FileWappers,
+		TMap<FString, FString>& Headers
+		);
 
 	UFUNCTION(BlueprintPure, Category = "SimpleHTTP")
 	static FString MethodByteToString(EMethodByte MethodByte);
@@ -180,14 +449,134 @@ public:
 	UFUNCTION(BlueprintPure, Category = "SimpleHTTP")
 	static TMap<FString, FString> MakeDefaultContentType(EHttpHelperContentType HttpContentType = EHttpHelperContentType::application_json);
 
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTP", DisplayName = "获取响应缓存统计")
+	FHttpCacheStats GetCacheStats() const;
+
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "清空响应缓存")
+	void ClearResponseCache();
+
+	FHttpResponseCache& GetResponseCache();
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTP", DisplayName = "获取请求调度统计")
+	FHttpSchedulerStats GetSchedulerStats() const;
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTP", DisplayName = "获取文件加载统计")
+	FHttpFileLoadStats GetFileLoadStats() const;
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTP", DisplayName = "获取请求体压缩统计")
+	FHttpCompressionStats GetCompressionStats() const;
+
+	//按Host汇总的请求耗时，P95延迟最高的Host排在前面
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTP", DisplayName = "获取请求耗时统计")
+	TArray<FHttpHostMetrics> GetRequestMetrics() const;
+
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "重置请求耗时统计")
+	void ResetRequestMetrics();
+
+	//请求最终完成时调用，重试中的请求不记录
+	void RecordRequestTiming(const FHttpRequestTiming& Timing);
+	void RecordCompletionCycles(uint32 Cycles);
+	//当前帧的完成预算已经用完时保存完成事件并返回true，之后在Tick中按顺序执行。Critical请求不推迟
+	bool DeferCompletion(UHTTPRequest* RequestObject, const FHttpRequestPtr& Request, const FHttpResponsePtr& Response, bool bWasSuccessful);
+	//后台转换响应后在游戏线程继续的完成，同样排在已经推迟的完成后面。推迟时移走Continuation并返回true，执行时传入的请求对象在释放后为空
+	bool DeferCompletion(UHTTPRequest* RequestObject, TFunction<void(UHTTPRequest*)>& Continuation);
+
+	//因为超过完成预算而等待执行的完成事件数量
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTP", DisplayName = "获取推迟的完成数量")
+	int32 GetDeferredCompletionCount() const { return DeferredCompletions.Num(); }
+	const FHttpRequestMetrics& GetRequestMetricsCollector() const { return RequestMetrics; }
+
+	/**
+	* 按照设置的并发数量和内容大小循环发送请求，结束后把吞吐量、延迟百分位数、内存增长和完成回调的游戏线程耗时输出到日志。
+	* 控制台命令：SimpleHTTP.Benchmark <URL> Mode= Requests= Concurrency= PayloadBytes=
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTP", DisplayName = "开始HTTP性能测试")
+	UHTTPBenchmark* RunBenchmark(FHttpBenchmarkSettings Settings);
+
 	UPROPERTY(BlueprintReadOnly,VisibleAnywhere, Category = "SimpleHTTP")
 	TSet<UHTTPRequest*> HistoryHttpRequests;
 
+	/**
+	* 请求完成后把未固定的请求对象放回对象池复用。默认关闭，所有完成的请求都保留在历史中（受MaxRetainedRequests限制），
+	* 被淘汰的请求只释放响应内容，不会被复用，所以调用者持有的请求对象不会变成另一个请求。
+	* 开启后请求对象在完成的下一帧被复用，调用者不能在完成委托之后继续使用未固定的请求对象（包括调用SaveAsFile和FreeRequest）。
+	*/
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bAutoReleaseCompletedRequests = false;
+	//完成后保留的请求数量上限，超过时淘汰最久没有使用的请求。小于等于0表示不限制
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxRetainedRequests = 64;
+	//对象池中缓存的请求对象数量上限，只在bAutoReleaseCompletedRequests开启时使用
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxPooledRequestObjects = 32;
+
+	//启用后GET请求的响应按照Cache-Control/Expires缓存，过期后使用ETag/Last-Modified向服务器验证
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bEnableResponseCache = false;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpCacheSettings CacheSettings;
+
+	/**
+	* 启用后相同的GET/HEAD请求（方法、URL、参数和所有请求头相同）在前一个请求完成前只发送一次，响应、响应头、进度和重试事件会分发给所有请求对象。
+	* 合并的请求使用其中最高的优先级发送。带有条件请求头或者Range的请求不合并。
+	*/
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bCoalesceIdenticalRequests = false;
+	//因为合并而没有发送的请求数量
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalCoalescedRequests = 0;
+
+	//绑定了字符委托时，超过该字节数的响应体在后台线程转换为字符串，小于等于0表示总是在游戏线程转换
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 AsyncDecodeThresholdBytes = 256 * 1024;
+
+	//请求体压缩，只压缩内容在内存中的请求（包括批量请求），已经设置了Content-Encoding的请求不会再压缩
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpCompressionSettings CompressionSettings;
+
+	//请求进度委托的默认触发频率
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpProgressSettings ProgressSettings;
+
+	//对URL参数的名称和值进行百分号编码。默认关闭，参数和以前一样原样拼接，已经编码过的参数不会被再次编码
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bEncodeQueryParams = false;
+
+	//记录每个请求的耗时并按Host汇总
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bCollectRequestMetrics = true;
+	//单独统计的Host数量上限，超过的Host合并统计
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxMetricsHosts = 64;
+
+	//默认的重试策略，默认不重试。请求内容来自流（上传文件、multipart流）和下载到文件的请求不会重试
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpRetryPolicy DefaultRetryPolicy = FHttpRetryPolicy(0);
+	//按Host设置的重试策略，Key为不带端口的域名
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	TMap<FString, FHttpRetryPolicy> HostRetryPolicies;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpRetryBudgetSettings RetryBudgetSettings;
+
+	//请求调度的并发和带宽限制，运行时修改后在下一次调度时生效
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpSchedulerSettings SchedulerSettings;
+
+	//限制每帧在游戏线程执行的完成回调，大量请求同时完成时分摊到之后的几帧
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpCompletionBudgetSettings CompletionBudgetSettings;
+	//因为超过完成预算而推迟过的完成数量
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalDeferredCompletions = 0;
+
 	
 
 	static FString ConvertPathToLinuxPath(FString Path);
 	//计算文件对应的ContentType
 	static FString GetFileContentType(const FString& FilePath);
+	static FString MakeFormDataBoundary();
+	//生成form-data中一个Part的头部
+	static FString MakeFormDataPartHeader(const FString& KeyName, const FString& FilePath, bool bIsFile);
 	UPROPERTY(BlueprintReadWrite, Category = "SimpleHTTP")
 	TMap<FString, FString> DefaultHeaders = { {"Content-Type","application/x-www-form-urlencoded"},
 		{"User-Agent","UnrealWebUtilsByXiChen"} ,
@@ -198,5 +587,80 @@ public:
 		{"Cache-Control", "no-cache"},
 	};
 private:
-	
+	bool Tick(float DeltaTime);
+	void ProcessCompletedRequestObjects();
+	//发送工作线程提交到NativeRequestQueue的请求
+	void ProcessNativeRequests();
+	//在完成预算内执行推迟的完成，每次至少执行一个
+	void ProcessDeferredCompletions();
+	void SendNativeRequest(FHttpNativeRequest&& Request, FHttpNativeRequestCallback&& OnComplete);
+	//需要压缩时在后台线程压缩请求体，完成后继续发送并返回true
+	bool CompressRequestBody(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority);
+	//请求体已经准备好之后的发送流程
+	void SubmitEncodedRequestObject(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority);
+	void EnqueueHttpRequestObject(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority);
+	//交给调度器发送，重试时也使用
+	void DispatchHttpRequestObject(UHTTPRequest* HttpRequestObject, EHttpRequestPriority Priority);
+	void ProcessPendingRetries();
+	void ReleaseRequestObject(UHTTPRequest* RequestObject, bool bReturnToPool);
+	//主请求完成或者被释放时调用
+	void RemoveCoalescedRequest(UHTTPRequest* Leader);
+	//主请求在完成前被释放时，把正在进行的请求交给第一个跟随的请求对象并返回该对象，没有可以接手的对象时返回空
+	UHTTPRequest* HandOverCoalescedRequest(UHTTPRequest* Leader);
+
+	//等待回收的已完成请求
+	UPROPERTY()
+	TArray<UHTTPRequest*> CompletedRequestObjects;
+	//完成后保留的请求，按使用顺序排列，最久没有使用的在最前面
+	UPROPERTY()
+	TArray<UHTTPRequest*> RetainedRequestObjects;
+	UPROPERTY()
+	TArray<UHTTPRequest*> RequestObjectPool;
+	//还没有完成的批次
+	UPROPERTY()
+	TArray<UHTTPRequestBatch*> ActiveBatches;
+	//还没有结束的分段下载
+	UPROPERTY()
+	TArray<UHTTPSegmentedDownload*> ActiveSegmentedDownloads;
+	//还没有结束的流式请求
+	UPROPERTY()
+	TArray<UHTTPStreamRequest*> ActiveStreamRequests;
+	//还没有结束的分块上传
+	UPROPERTY()
+	TArray<UHTTPChunkedUpload*> ActiveChunkedUploads;
+	//还没有结束的性能测试
+	UPROPERTY()
+	TArray<UHTTPBenchmark*> ActiveBenchmarks;
+	TSharedPtr<FHttpNativeRequestQueue, ESPMode::ThreadSafe> NativeRequestQueue;
+	//通过NativeRequestQueue发送还没有完成的请求
+	TSet<FHttpRequestPtr> ActiveNativeRequests;
+	//正在进行的可合并请求，Key为MakeCoalesceKey的结果
+	TMap<FString, TWeakObjectPtr<UHTTPRequest>> CoalescedRequests;
+
+	FHttpRequestScheduler Scheduler;
+	FHttpRetryBudget RetryBudget;
+	struct FPendingRetry
+	{
+		TWeakObjectPtr<UHTTPRequest> RequestObject;
+		double RetryTime = 0;
+	};
+	TArray<FPendingRetry> PendingRetries;
+	struct FDeferredCompletion
+	{
+		TWeakObjectPtr<UHTTPRequest> RequestObject;
+		FHttpRequestPtr Request;
+		FHttpResponsePtr Response;
+		bool bWasSuccessful = false;
+		//不为空时执行它而不是ProcessCompletion
+		TFunction<void(UHTTPRequest*)> Continuation;
+	};
+	//是否需要把完成推迟到之后的帧
+	bool ShouldDeferCompletion(const UHTTPRequest* RequestObject);
+	TArray<FDeferredCompletion> DeferredCompletions;
+	FHttpCompletionBudget CompletionBudget;
+	FHttpFileLoadStats FileLoadStats;
+	FHttpCompressionStats CompressionStats;
+	FHttpRequestMetrics RequestMetrics;
+	TSharedPtr<FHttpResponseCache, ESPMode::ThreadSafe> ResponseCache;
+	FSimpleHttpTickerHandle TickHandle;
 };
@@ -0,0 +1,30 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * 只读映射整个文件，用于上传时直接从映射的内存读取文件内容而不需要复制到堆上。
+ * 创建后可以在任意线程读取。
+ */
+class SIMPLEHTTPMODULE_API FHttpMappedFile
+{
+public:
+	//平台不支持映射、文件不存在或者为空时返回空
+	static TSharedPtr<FHttpMappedFile, ESPMode::ThreadSafe> Open(const FString& InFilePath);
+	~FHttpMappedFile();
+
+	TArrayView64<const uint8> GetView() const;
+	const FString& GetFilePath() const { return FilePath; }
+
+private:
+	FHttpMappedFile() = default;
+
+	FString FilePath;
+	TUniquePtr<IMappedFileHandle> Handle;
+	TUniquePtr<IMappedFileRegion> Region;
+};
@@ -0,0 +1,61 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/Archive.h"
+#include "HTTPMappedFile.h"
+#include "HTTPBandwidthLimiter.h"
+
+class IFileHandle;
+
+/**
+ * multipart/form-data 的只读流。
+ * 边界行、Part头部以及文本内容保存在内存中，文件内容在HTTP线程读取时才从磁盘或者映射的内存读出，直接写入请求的发送缓冲区。
+ * 总长度在构建时就已经确定，可以直接作为Content-Length。
+ */
+class SIMPLEHTTPMODULE_API FHttpMultipartFormDataStream : public FArchive
+{
+public:
+	FHttpMultipartFormDataStream();
+	virtual ~FHttpMultipartFormDataStream() override;
+
+	void AddBytes(TArray<uint8>&& InBytes);
+	//以UTF8写入
+	void AddString(const FString& InString);
+	//添加整个文件作为内容，文件不存在或为空时返回false
+	bool AddFile(const FString& InFilePath);
+	//添加映射的文件作为内容，读取时直接从映射的内存复制
+	void AddMappedFile(const TSharedRef<FHttpMappedFile, ESPMode::ThreadSafe>& InMappedFile);
+
+	virtual void Serialize(void* Data, int64 Length) override;
+	virtual void Seek(int64 InPos) override;
+	virtual int64 Tell() override { return Pos; }
+	virtual int64 TotalSize() override { return Size; }
+	virtual bool Close() override;
+	virtual FString GetArchiveName() const override { return TEXT("FHttpMultipartFormDataStream"); }
+
+	//Serialize读出的字节，由调度器计入带宽限制并设置读取前的等待
+	TSharedRef<FHttpTransferCounter, ESPMode::ThreadSafe> GetSendCounter() const { return SendCounter; }
+
+private:
+	struct FSegment
+	{
+		int64 Offset = 0;
+		int64 Size = 0;
+		TArray<uint8> Bytes;
+		FString FilePath;
+		TSharedPtr<FHttpMappedFile, ESPMode::ThreadSafe> MappedFile;
+	};
+
+	const FSegment& FindSegment(int64 InPos);
+
+	TArray<FSegment> Segments;
+	int64 Size = 0;
+	int64 Pos = 0;
+	int32 CurrentSegment = 0;
+
+	TUniquePtr<IFileHandle> CurrentFile;
+	int32 CurrentFileSegment = INDEX_NONE;
+	TSharedRef<FHttpTransferCounter, ESPMode::ThreadSafe> SendCounter = MakeShared<FHttpTransferCounter, ESPMode::ThreadSafe>();
+};
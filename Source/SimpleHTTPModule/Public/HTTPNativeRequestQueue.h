@@ -0,0 +1,89 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Containers/Queue.h"
+#include "HAL/CriticalSection.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HTTPRequestScheduler.h"
+#include "HTTPNativeRequestQueue.generated.h"
+
+//C++完成回调执行的线程
+UENUM(BlueprintType)
+enum class EHttpCompletionThread : uint8
+{
+	GameThread,
+	//后台线程池，适合在后台任务中处理响应
+	ThreadPool,
+	//直接在HTTP线程执行，回调需要尽快返回。引擎不支持时（UE5.1以前）改为在线程池执行
+	HttpThread,
+};
+
+//不创建UObject的请求，可以在任意线程创建和提交
+struct SIMPLEHTTPMODULE_API FHttpNativeRequest
+{
+	FString URL;
+	FString Verb = TEXT("GET");
+	TMap<FString, FString> Headers;
+	TMap<FString, FString> Params;
+	TArray<uint8> Content;
+	float TimeoutSecs = 100;
+	bool bAddDefaultHeaders = true;
+	EHttpRequestPriority Priority = EHttpRequestPriority::Normal;
+	EHttpCompletionThread CompletionThread = EHttpCompletionThread::ThreadPool;
+};
+
+struct SIMPLEHTTPMODULE_API FHttpNativeResponse
+{
+	//收到响应并且响应码为2xx
+	bool bSuccess = false;
+	//0表示没有收到响应
+	int32 ResponseCode = 0;
+	TArray<uint8> Content;
+	TArray<FString> Headers;
+	FString ContentType;
+
+	FString GetContentAsString() const;
+};
+
+typedef TFunction<void(const FHttpNativeResponse&)> FHttpNativeRequestCallback;
+
+/**
+ * 线程安全的请求提交队列。提交时只写入无锁的多生产者队列，Subsystem在游戏线程的Tick中取出并发送。
+ * 在游戏线程通过UHTTPHelperSubsystem::GetNativeRequestQueue获取后交给后台任务持有。
+ * Subsystem关闭后提交的请求立即以失败完成。
+ */
+class SIMPLEHTTPMODULE_API FHttpNativeRequestQueue : public TSharedFromThis<FHttpNativeRequestQueue, ESPMode::ThreadSafe>
+{
+public:
+	~FHttpNativeRequestQueue();
+
+	TFuture<FHttpNativeResponse> Submit(FHttpNativeRequest&& Request);
+	void Submit(FHttpNativeRequest&& Request, FHttpNativeRequestCallback&& OnComplete);
+	bool IsOpen() const { return !bClosed; }
+
+	//在Request.CompletionThread指定的线程执行完成回调，HttpThread在游戏线程调用时改为线程池
+	static void Deliver(EHttpCompletionThread Thread, const FHttpNativeRequestCallback& OnComplete, FHttpNativeResponse&& Response);
+
+private:
+	friend class UHTTPHelperSubsystem;
+
+	struct FSubmission
+	{
+		FHttpNativeRequest Request;
+		FHttpNativeRequestCallback OnComplete;
+	};
+
+	//只由Subsystem在游戏线程调用
+	bool Dequeue(FSubmission& OutSubmission);
+	//不再接受请求，还在队列中的请求以失败完成
+	void Close();
+	void FailPending();
+
+	TQueue<FSubmission, EQueueMode::Mpsc> Pending;
+	//只在取出时使用，提交不需要加锁
+	FCriticalSection DequeueLock;
+	FThreadSafeBool bClosed = false;
+};
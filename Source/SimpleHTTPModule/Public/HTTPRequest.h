@@ -5,13 +5,31 @@
 #include "CoreMinimal.h"
 #include "UObject/Object.h"
 #include "Interfaces/IHttpRequest.h"
+#include "UObject/StructOnScope.h"
+#include "HTTPResponseCache.h"
+#include "HTTPRequestScheduler.h"
+#include "HTTPRetryPolicy.h"
+#include "HTTPRequestMetrics.h"
+#include "HTTPRequestProgress.h"
+#include "HTTPNativeRequestQueue.h"
+#include "SimpleHTTPCompat.h"
 #include "HTTPRequest.generated.h"
 
+class FHttpFileDownloadStream;
+
 DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpRequestCompleteAsStringDelegate, bool, bSuccess, FString, ContentString);
 DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpRequestCompleteAsBinaryDelegate, bool, bSuccess, const TArray<uint8>&, ContentBinary);
 DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpRequestHeaderReceivedDelegate,const FString&, HeaderName, const FString&, NewHeaderValue);
 DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpRequestProgressDelegate, int32, BytesReceived, int32, ContentLength);
+DECLARE_DYNAMIC_DELEGATE_OneParam(FSimpleHttpRequestDetailedProgressDelegate, const FHttpRequestProgress&, Progress);
+//C++使用的进度委托
+DECLARE_DELEGATE_OneParam(FSimpleHttpRequestProgressNativeDelegate, const FHttpRequestProgress& /*Progress*/);
 DECLARE_DYNAMIC_DELEGATE_OneParam(FSimpleHttpRequestWillRetryDelegate,float ,SecondsToRetry);
+//C++使用的完成委托，直接引用响应内容，只在委托执行期间有效
+DECLARE_DELEGATE_TwoParams(FSimpleHttpRequestCompleteAsViewDelegate, bool /*bSuccess*/, TArrayView<const uint8> /*Content*/);
+DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpRequestCompleteAsStructDelegate, bool, bSuccess, const FString&, ErrorMessage);
+//C++使用的结构体完成回调，Struct在解析失败时为空
+typedef TFunction<void(bool bSuccess, const FStructOnScope* Struct, const FString& ErrorMessage)> FSimpleHttpRequestCompleteAsStructCallback;
 
 /**
  * 
@@ -26,7 +44,11 @@ public:
 	FSimpleHttpRequestCompleteAsBinaryDelegate OnRequestCompleteAsBinary;
 	FSimpleHttpRequestHeaderReceivedDelegate OnRequestHeaderReceived;
 	FSimpleHttpRequestProgressDelegate OnRequestProgress;
+	FSimpleHttpRequestDetailedProgressDelegate OnRequestDetailedProgress;
+	FSimpleHttpRequestProgressNativeDelegate OnRequestProgressNative;
 	FSimpleHttpRequestWillRetryDelegate OnRequestWillRetry;
+	//不复制响应内容的完成委托，先于其他完成委托执行
+	FSimpleHttpRequestCompleteAsViewDelegate OnRequestCompleteAsView;
 
 	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "绑定请求完成的委托（字符类型）"))
 	void BindRequestCompleteAsString(FSimpleHttpRequestCompleteAsStringDelegate InDelegate);
@@ -37,13 +59,54 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "绑定请求头部接收的委托"))
 	void BindRequestHeaderReceived(FSimpleHttpRequestHeaderReceivedDelegate InDelegate);
 
+	//字节数超过int32时会被截断，大文件请使用BindRequestDetailedProgress
 	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request",meta = (DisplayName = "绑定接受数据进程的委托"))
 	void BindRequestProgress(FSimpleHttpRequestProgressDelegate InDelegate);
 
+	//64位的收发字节数和速度，按照ProgressSettings合并触发
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "绑定收发进度的委托（详细）"))
+	void BindRequestDetailedProgress(FSimpleHttpRequestDetailedProgressDelegate InDelegate);
+
+	//设置这个请求的进度触发频率，覆盖Subsystem的ProgressSettings
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "设置进度触发频率"))
+	void SetProgressSettings(const FHttpProgressSettings& InProgressSettings);
+
 	//bind event on Request WillRetry
 	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "绑定请求将重试的委托"))
 	void BindRequestWillRetry(FSimpleHttpRequestWillRetryDelegate InDelegate);
 
+	/**
+	* 绑定请求完成后把JSON响应解析为结构体的委托。解析在后台线程进行，完成后在委托中调用GetParsedStruct获取结果。
+	* 结构体中不要包含UObject引用。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "绑定请求完成的委托（结构体类型）"))
+	void BindRequestCompleteAsStruct(UScriptStruct* StructType, FSimpleHttpRequestCompleteAsStructDelegate InDelegate);
+
+	void BindRequestCompleteAsStruct(UScriptStruct* StructType, FSimpleHttpRequestCompleteAsStructCallback&& InCallback);
+
+	template<typename StructType>
+	void BindRequestCompleteAsStruct(TFunction<void(bool bSuccess, const StructType& Result, const FString& ErrorMessage)>&& InCallback)
+	{
+		BindRequestCompleteAsStruct(StructType::StaticStruct(), [Callback = MoveTemp(InCallback)](bool bSuccess, const FStructOnScope* Struct, const FString& ErrorMessage)
+			{
+				Callback(bSuccess, Struct ? *(const StructType*)Struct->GetStructMemory() : StructType(), ErrorMessage);
+			});
+	}
+
+	/**
+	* 绑定在Thread指定的线程执行的C++完成回调，回调中不能访问UObject。先于游戏线程的完成委托交出，和它们并行执行。
+	* 重试、缓存和合并请求仍然在游戏线程处理，回调只在最终完成时执行一次，响应内容复制一份交给回调，下载到文件时内容为空。
+	* 这时已经回到了游戏线程，HttpThread等同于ThreadPool。进度和头部委托总是在游戏线程执行。
+	*/
+	void BindRequestCompleteNative(EHttpCompletionThread Thread, FHttpNativeRequestCallback&& InCallback);
+
+	//获取BindRequestCompleteAsStruct解析的结构体，类型不一致或者解析失败时返回false
+	UFUNCTION(BlueprintCallable, CustomThunk, Category = "SimpleHTTPModule|Request", meta = (CustomStructureParam = "OutStruct", DisplayName = "获取解析的结构体"))
+	bool GetParsedStruct(int32& OutStruct);
+	DECLARE_FUNCTION(execGetParsedStruct);
+
+	bool CopyParsedStruct(const UScriptStruct* StructType, void* OutStruct) const;
+
 	/**
 	* 保存接受的文件
 	* @param SavePath 报错文件路径不能为空。
@@ -53,9 +116,39 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "保存接收的文件"))
 	bool SaveAsFile(FString SavePath,FString FileName,bool UsingReceivedFileName = true);
 
+	//使用CallHTTPAndDownloadFile下载完成后保存的文件路径，未完成或失败时为空
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "获取下载的文件路径"))
+	FString GetDownloadedFilePath() const { return DownloadedFilePath; }
+
+	//响应内容的视图，不复制内容。请求对象被回收后失效
+	TArrayView<const uint8> GetResponseContentView() const;
+
+	//设置这个请求的重试策略，覆盖Subsystem中按Host或者默认的策略。需要在请求完成前设置
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "设置重试策略"))
+	void SetRetryPolicy(const FHttpRetryPolicy& InRetryPolicy);
+
+	//已经重试的次数
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "获取重试次数"))
+	int32 GetRetryCount() const { return RetryCount; }
+
+	//请求各个阶段的耗时和收发字节数，完成前只有已经到达的阶段有效
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "获取请求耗时"))
+	FHttpRequestTiming GetTiming() const;
+
 	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "释放请求内存空间"))
 	void FreeRequest();
 
+	/**
+	* 固定请求。开启了Subsystem的bAutoReleaseCompletedRequests时，未固定的请求在完成委托执行后会被回收（释放响应内容并放回对象池复用），
+	* 之后不要再使用该对象。固定的请求在完成后保留在HistoryHttpRequests中，可以继续调用SaveAsFile等函数，但仍受MaxRetainedRequests限制。
+	* 在完成委托中调用也有效。
+	*/
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "固定请求"))
+	void SetPinned(bool bInPinned);
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Request", meta = (DisplayName = "是否固定请求"))
+	bool IsPinned() const { return bPinned; }
+
 	TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> HttpRequest = nullptr;
 	//TArray<uint8> BinaryContent;
 private:
@@ -64,9 +157,114 @@ private:
 	friend class UHTTPHelperSubsystem;
 
 	void BindAllDelegate(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe> InHttpRequest);
+	void SetupDownloadToFile(const TSharedPtr<FHttpFileDownloadStream, ESPMode::ThreadSafe>& InDownloadStream, const FString& InSavePath, const FString& InFileName, bool bInUsingReceivedFileName);
+	//从Content-Disposition或者URL中获取文件名
+	bool ResolveReceivedFileName(FString& OutFileName) const;
+	void FinishDownloadToFile(FHttpResponsePtr Response, bool bWasSuccessful);
+	//完成委托执行后通知Subsystem回收
+	void NotifyCompleted();
+	//放回对象池前清理所有状态
+	void ResetForReuse();
+
+	struct FDecodedStruct
+	{
+		const UScriptStruct* StructType = nullptr;
+		TSharedPtr<FStructOnScope, ESPMode::ThreadSafe> Struct;
+		FString ErrorMessage;
+	};
+	//后台线程转换的响应内容
+	struct FDecodedContent
+	{
+		FString String;
+		bool bHasString = false;
+		TArray<FDecodedStruct> Structs;
+	};
 
+	static FString DecodeContentString(const TArray<uint8>& Content);
+	//转换为字符串并解析每种结构体，可以在任意线程调用
+	static void DecodeContent(const TArray<uint8>& Content, const TArray<const UScriptStruct*>& StructTypes, FDecodedContent& OutDecoded);
+	//执行当前对象的完成委托，Decoded中没有需要的内容时在游戏线程转换
+	void ExecuteCompleteDelegates(bool bSuccess, const TArray<uint8>& Content, const FDecodedContent* Decoded);
+	//响应码为2xx或者内容来自缓存，只有这时响应内容才按结构体解析
+	bool HasOkResponse() const;
+	//把结果交给BindRequestCompleteNative绑定的回调
+	void DeliverNativeComplete(bool bSuccess, TArrayView<const uint8> Content);
+	static void DeliverComplete(UHTTPRequest* Leader, const TArray<UHTTPRequest*>& Followers, bool bSuccess, const TArray<uint8>& Content, const FDecodedContent* Decoded, const FHttpCacheEntryPtr& ContentEntry);
+	/**
+	* 执行完成委托并分发给合并到该请求的所有请求对象。只有绑定了字符委托时才转换字符串，
+	* 超过AsyncDecodeThresholdBytes的内容和JSON结构体在后台线程处理。
+	*/
+	void BroadcastComplete(bool bSuccess, const TArray<uint8>& Content, const FHttpResponsePtr& ContentResponse, const FHttpCacheEntryPtr& ContentEntry);
+	//合并到该请求，不再发送自己的请求
+	void AddCoalescedFollower(UHTTPRequest* Follower);
+	//还有效的合并请求，委托中可能释放其他请求，所以返回副本
+	TArray<UHTTPRequest*> GetCoalescedFollowers() const;
+
+	//记录完成时间并交给Subsystem汇总
+	void RecordCompleted(const FHttpResponsePtr& Response, bool bWasSuccessful);
+	//调度器调用ProcessRequest失败
+	void OnDispatchFailed();
+	//使用缓存的响应完成请求
+	void CompleteFromCache(const FHttpCacheEntryPtr& Entry);
 	void OnProcessRequestCompleteEvent(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful);
+	//重试、缓存和执行完成委托，超过完成预算时由Subsystem推迟调用
+	void ProcessCompletion(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful);
 	void OnHeaderReceivedEvent(FHttpRequestPtr Request, const FString& HeaderName, const FString& NewHeaderValue);
-	void OnRequestProgressEvent(FHttpRequestPtr Request, int32 BytesSent, int32 BytesReceived);
+	void OnRequestProgressEvent(FHttpRequestPtr Request, FSimpleHttpProgressBytes BytesSent, FSimpleHttpProgressBytes BytesReceived);
+	//合并进度更新后执行进度委托，bFinal为true时不等待间隔
+	void UpdateProgress(const FHttpRequestPtr& Request, int64 BytesSent, int64 BytesReceived, bool bFinal);
 	void OnRequestWillRetryEvent(FHttpRequestPtr Request, FHttpResponsePtr Response, float AttemptNumber);
+
+	bool bPinned = false;
+	EHttpRequestPriority RequestPriority = EHttpRequestPriority::Normal;
+	TOptional<FHttpRetryPolicy> RetryPolicyOverride;
+	int32 RetryCount = 0;
+	FHttpRequestTimestamps Timestamps;
+	//最终的响应码，0表示没有收到响应
+	int32 FinalResponseCode = 0;
+	bool bFinalSucceeded = false;
+	TOptional<FHttpProgressSettings> ProgressSettingsOverride;
+	FHttpProgressThrottle ProgressThrottle;
+	//缓存的响应Content-Length，-1表示还不知道
+	int64 ProgressContentLength = -1;
+
+	//请求内容来自流（文件流或者multipart流），发送后流已经被读取，同一个IHttpRequest不能重新发送
+	bool bStreamedContent = false;
+	//流式的请求体读取的字节，由调度器计入带宽限制
+	TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe> SendCounter;
+
+	//完成委托等待后台转换的结果，对象被回收复用时清除，后台的结果不再分发给这个对象
+	bool bDecodingCompletion = false;
+	//ProcessCompletion中已经花费的时间，和后台转换后的部分合并后只记录一次
+	uint32 PendingCompletionCycles = 0;
+
+	//下载到文件的模式
+	bool bDownloadToFile = false;
+	TSharedPtr<FHttpFileDownloadStream, ESPMode::ThreadSafe> DownloadStream;
+	FString DownloadSavePath;
+	FString DownloadFileName;
+	bool bDownloadUsingReceivedFileName = true;
+	FString DownloadedFilePath;
+
+	//启用响应缓存时的缓存Key，为空表示不使用缓存
+	FString CacheKey;
+	//用于验证的缓存，或者最终提供响应的缓存
+	FHttpCacheEntryPtr CachedEntry;
+
+	//需要解析的结构体类型
+	UPROPERTY()
+	UScriptStruct* ParseStructType = nullptr;
+	TSharedPtr<FStructOnScope, ESPMode::ThreadSafe> ParsedStruct;
+	FSimpleHttpRequestCompleteAsStructDelegate OnRequestCompleteAsStruct;
+	FSimpleHttpRequestCompleteAsStructCallback OnRequestCompleteAsStructNative;
+	FHttpNativeRequestCallback OnRequestCompleteNative;
+	EHttpCompletionThread NativeCompletionThread = EHttpCompletionThread::ThreadPool;
+
+	//作为合并请求的主请求时的Key
+	FString CoalesceKey;
+	//合并到该请求的其他请求对象，共享同一个IHttpRequest
+	UPROPERTY()
+	TArray<UHTTPRequest*> CoalescedFollowers;
+	//合并到的主请求
+	TWeakObjectPtr<UHTTPRequest> CoalesceLeader;
 };
@@ -0,0 +1,159 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Interfaces/IHttpRequest.h"
+#include "HTTPRequestScheduler.h"
+#include "HTTPRequestBatch.generated.h"
+
+enum class EMethodByte : uint8;
+
+UENUM(BlueprintType)
+enum class EHttpBatchItemState : uint8
+{
+	Pending,
+	Succeeded,
+	Failed,
+	//被Cancel或者FailFast取消
+	Cancelled,
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpBatchRequestItem
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FString URL;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	EMethodByte Verb;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	TMap<FString, FString> Headers;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	TMap<FString, FString> Params;
+	//字符类型的Content，BinaryContent不为空时忽略
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FString Content;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	TArray<uint8> BinaryContent;
+
+	FHttpBatchRequestItem();
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpBatchSettings
+{
+	GENERATED_BODY()
+public:
+	//这个批次同时进行的请求数量上限，仍然受Subsystem的调度限制。小于等于0表示不限制
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxConcurrentRequests = 4;
+	//有请求失败时立即取消剩余的请求并完成批次
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bFailFast = false;
+	//响应码不是2xx时视为失败
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bHttpErrorsAsFailure = true;
+	//是否保存响应内容，只关心状态时可以关闭
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bCollectBodies = true;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float TimeoutSecs = 100.f;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bAddDefaultHeaders = true;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	EHttpRequestPriority Priority = EHttpRequestPriority::Normal;
+};
+
+//单个请求的结果，响应内容保存在批次的Bodies中
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpBatchItemResult
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	EHttpBatchItemState State = EHttpBatchItemState::Pending;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 ResponseCode = 0;
+	//所有响应内容的总大小可能超过2GB，偏移使用64位
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 BodyOffset = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 BodySize = 0;
+};
+
+class UHTTPHelperSubsystem;
+class UHTTPRequestBatch;
+
+DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpBatchCompleteDelegate, bool, bAllSucceeded, UHTTPRequestBatch*, Batch);
+typedef TFunction<void(bool bAllSucceeded, UHTTPRequestBatch* Batch)> FSimpleHttpBatchCompleteCallback;
+
+/**
+ * 一组请求，在批次自己的并发上限内发送，全部结束后只触发一次完成委托。
+ * 单个请求不创建UHTTPRequest对象，所有响应内容连续保存在Bodies中。
+ */
+UCLASS(BlueprintType)
+class SIMPLEHTTPMODULE_API UHTTPRequestBatch : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Batch", meta = (DisplayName = "绑定批次完成的委托"))
+	void BindBatchComplete(FSimpleHttpBatchCompleteDelegate InDelegate);
+	void BindBatchComplete(FSimpleHttpBatchCompleteCallback&& InCallback);
+
+	//取消还没有完成的请求，已经完成的结果保留，随后触发完成委托
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Batch", meta = (DisplayName = "取消批次"))
+	void Cancel();
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Batch")
+	bool IsFinished() const { return bFinished; }
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Batch")
+	int32 Num() const { return Results.Num(); }
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Batch")
+	const TArray<FHttpBatchItemResult>& GetResults() const { return Results; }
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Batch", meta = (DisplayName = "获取响应内容（字符类型）"))
+	FString GetBodyAsString(int32 Index) const;
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Batch", meta = (DisplayName = "获取响应内容（二进制类型）"))
+	TArray<uint8> GetBody(int32 Index) const;
+
+	//响应内容的视图，不复制内容。之后完成的请求追加内容时存储会重新分配，所以批次完成前返回空视图，
+	//视图在批次对象释放前一直有效。批次完成前需要内容时使用GetBody复制
+	TArrayView<const uint8> GetBodyView(int32 Index) const;
+
+private:
+	friend class UHTTPHelperSubsystem;
+
+	void Start(UHTTPHelperSubsystem* InSubsystem, const TArray<FHttpBatchRequestItem>& InItems, const FHttpBatchSettings& InSettings);
+	void LaunchPending();
+	//请求体压缩完成后交给调度器
+	void EnqueueItem(int32 Index);
+	void OnItemComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 Index);
+	void FinishItem(int32 Index, EHttpBatchItemState State, FHttpResponsePtr Response);
+	void CancelRemaining();
+	void TryFinish();
+	TArrayView<const uint8> GetStoredBody(int32 Index) const;
+
+	UPROPERTY()
+	UHTTPHelperSubsystem* HTTPHelperSubsystem = nullptr;
+
+	FHttpBatchSettings Settings;
+	TArray<FHttpBatchItemResult> Results;
+	//所有响应内容，按完成顺序连续保存
+	TArray64<uint8> Bodies;
+	//还没有发送的请求，发送后置空
+	TArray<TSharedPtr<IHttpRequest, ESPMode::ThreadSafe>> Requests;
+	int32 NextIndex = 0;
+	int32 InFlightCount = 0;
+	bool bFinished = false;
+	bool bAllSucceeded = true;
+
+	FSimpleHttpBatchCompleteDelegate OnBatchComplete;
+	FSimpleHttpBatchCompleteCallback OnBatchCompleteNative;
+};
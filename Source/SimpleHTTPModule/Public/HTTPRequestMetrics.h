@@ -0,0 +1,170 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTTPRequestMetrics.generated.h"
+
+struct FHttpSchedulerStats;
+
+//单个请求的耗时，时间为秒，没有到达的阶段为-1
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpRequestTiming
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	FString Host;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	FString Verb;
+	//0表示没有收到响应
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 ResponseCode = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	bool bSucceeded = false;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 RetryCount = 0;
+	//最后一次发送在调度器中排队的时间
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float QueueSeconds = -1.f;
+	//从发送到收到响应头
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float TimeToHeadersSeconds = -1.f;
+	//从发送到收到第一个字节的响应体
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float TimeToFirstByteSeconds = -1.f;
+	//从发送到完成
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float TransferSeconds = -1.f;
+	//从提交到完成，包括压缩、缓存查找、排队和所有重试
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float TotalSeconds = -1.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 BytesSent = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 BytesReceived = 0;
+};
+
+//请求各个阶段的时间点（FPlatformTime::Seconds），0表示还没有到达
+struct SIMPLEHTTPMODULE_API FHttpRequestTimestamps
+{
+	double Submitted = 0;
+	double Queued = 0;
+	double Dispatched = 0;
+	double HeadersReceived = 0;
+	double FirstByte = 0;
+	double Completed = 0;
+	int64 BytesSent = 0;
+	int64 BytesReceived = 0;
+
+	//重新排队时清除上一次发送的时间点
+	void MarkQueued();
+	void MarkProgress(int64 InBytesSent, int64 InBytesReceived);
+	void FillTiming(FHttpRequestTiming& OutTiming) const;
+};
+
+//一个Host的请求统计，时间为毫秒
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpHostMetrics
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	FString Host;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 Requests = 0;
+	//没有响应或者响应码大于等于400的请求
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 FailedRequests = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 Retries = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 BytesSent = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 BytesReceived = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float AverageLatencyMs = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float LatencyP50Ms = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float LatencyP95Ms = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float LatencyP99Ms = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float LatencyMaxMs = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float FirstByteP50Ms = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float FirstByteP95Ms = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float FirstByteP99Ms = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float QueueP95Ms = 0.f;
+	//响应体接收的平均速度，字节每秒
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float AverageReceiveBytesPerSecond = 0.f;
+};
+
+/**
+ * 对数分桶的延迟直方图，相邻桶的上限相差15%，百分位数的误差在同样的范围内。
+ * 内存固定，记录和查询都不需要排序。
+ */
+class SIMPLEHTTPMODULE_API FHttpLatencyHistogram
+{
+public:
+	void Add(double Seconds);
+	//返回毫秒，没有数据时返回0
+	float GetPercentileMs(float Percentile) const;
+	float GetAverageMs() const { return Count > 0 ? (float)(TotalSeconds * 1000.0 / Count) : 0.f; }
+	float GetMaxMs() const { return (float)(MaxSeconds * 1000.0); }
+	int64 GetCount() const { return Count; }
+
+private:
+	static constexpr int32 NumBuckets = 96;
+	static int32 GetBucketIndex(double Milliseconds);
+	static double GetBucketUpperMs(int32 Index);
+
+	uint32 Buckets[NumBuckets] = {};
+	int64 Count = 0;
+	double TotalSeconds = 0;
+	double MaxSeconds = 0;
+};
+
+/**
+ * 按Host汇总请求耗时，只能在游戏线程使用。
+ * 同时输出到stat SimpleHTTP、CSV Profiler的SimpleHTTP分类和Insights的计数器。
+ */
+class SIMPLEHTTPMODULE_API FHttpRequestMetrics
+{
+public:
+	void Record(const FHttpRequestTiming& Timing);
+	//每次Tick更新排队和进行中的请求数量
+	void UpdateSchedulerStats(const FHttpSchedulerStats& Stats) const;
+	TArray<FHttpHostMetrics> GetSnapshot() const;
+	void Reset();
+	//记录完成回调（包括转换内容和执行完成委托）在游戏线程花费的时间
+	void AddCompletionCycles(uint32 Cycles);
+	double GetCompletionSeconds() const { return CompletionSeconds; }
+	int64 GetRecordedRequests() const { return RecordedRequests; }
+	//超过上限的Host合并到"other"中，避免URL中的域名过多时占用过多内存
+	void SetMaxHosts(int32 InMaxHosts) { MaxHosts = InMaxHosts; }
+
+private:
+	struct FHostData
+	{
+		int64 Requests = 0;
+		int64 FailedRequests = 0;
+		int64 Retries = 0;
+		int64 BytesSent = 0;
+		int64 BytesReceived = 0;
+		double ReceiveSeconds = 0;
+		FHttpLatencyHistogram Latency;
+		FHttpLatencyHistogram FirstByte;
+		FHttpLatencyHistogram Queue;
+	};
+
+	TMap<FString, FHostData> Hosts;
+	int32 MaxHosts = 64;
+	double CompletionSeconds = 0;
+	int64 RecordedRequests = 0;
+};
@@ -0,0 +1,68 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HTTPRequestProgress.generated.h"
+
+//进度委托的触发频率，满足任意一个条件时触发，发送或接收完成时总是触发
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpProgressSettings
+{
+	GENERATED_BODY()
+public:
+	//两次进度委托之间的最小间隔，小于等于0表示每次收到数据都触发
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float MinIntervalSeconds = 0.1f;
+	//距离上一次触发收发的字节数达到该值时不等待间隔，小于等于0表示只按间隔触发
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int64 MinByteStep = 0;
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpRequestProgress
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 BytesSent = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 BytesReceived = 0;
+	//响应的Content-Length，未知时为-1
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 ContentLength = -1;
+	//接收的比例（0-1），ContentLength未知时为-1
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float ReceivedFraction = -1.f;
+	//这一次发送开始后经过的时间
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float ElapsedSeconds = 0.f;
+	//距离上一次触发的平均速度，字节每秒
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float SendBytesPerSecond = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float ReceiveBytesPerSecond = 0.f;
+	//这一次发送开始后的平均速度，字节每秒
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float AverageSendBytesPerSecond = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float AverageReceiveBytesPerSecond = 0.f;
+};
+
+//按照FHttpProgressSettings合并进度更新，并计算速度
+struct SIMPLEHTTPMODULE_API FHttpProgressThrottle
+{
+	//重新发送时清除上一次的进度
+	void Reset();
+	//需要触发进度委托时返回true并填充OutProgress。bFinal为true时只要有新的进度就触发
+	bool Update(int64 BytesSent, int64 BytesReceived, int64 ContentLength, double Now, const FHttpProgressSettings& Settings, bool bFinal, FHttpRequestProgress& OutProgress);
+	//收发的字节数比上一次少，说明请求重新发送了
+	bool IsRestarted(int64 BytesSent, int64 BytesReceived) const { return BytesSent < LastBytesSent || BytesReceived < LastBytesReceived; }
+
+private:
+	double StartTime = 0;
+	double LastReportTime = 0;
+	int64 LastBytesSent = 0;
+	int64 LastBytesReceived = 0;
+	bool bReported = false;
+};
@@ -0,0 +1,147 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Interfaces/IHttpRequest.h"
+#include "HTTPBandwidthLimiter.h"
+#include "HTTPRequestScheduler.generated.h"
+
+UENUM(BlueprintType)
+enum class EHttpRequestPriority : uint8
+{
+	//游戏逻辑相关的请求，总是最先发送并且不受单个Host的并发限制
+	Critical UMETA(DisplayName = "Critical"),
+	Normal UMETA(DisplayName = "Normal"),
+	//批量、遥测等不关心延迟的请求
+	Background UMETA(DisplayName = "Background"),
+	Max UMETA(Hidden)
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpSchedulerSettings
+{
+	GENERATED_BODY()
+public:
+	//同时进行的请求数量上限，小于等于0表示不限制
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxConcurrentRequests = 16;
+	//同一个Host同时进行的请求数量上限，小于等于0表示不限制
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxConcurrentRequestsPerHost = 6;
+	//为Critical请求保留的并发数量，Normal和Background请求不能占用
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 CriticalReservedSlots = 2;
+	//排队超过该时间（秒）的Background请求提升为Normal，防止饿死。不会提升为Critical，小于等于0表示不提升
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float StarvationPromoteSeconds = 3.f;
+	//带宽限制，超过限制时请求继续排队
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpBandwidthSettings Bandwidth;
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpSchedulerStats
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 QueuedCritical = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 QueuedNormal = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 QueuedBackground = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 InFlight = 0;
+	//历史最大排队数量
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 PeakQueueDepth = 0;
+	//当前排队时间最长的请求已经等待的秒数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float OldestQueuedSeconds = 0.f;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalDispatched = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalPromoted = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalDispatchFailed = 0;
+	//因为带宽限制而推迟发送的次数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalBandwidthDeferred = 0;
+};
+
+/**
+ * UHTTPHelperSubsystem使用的请求调度器，只能在游戏线程使用。
+ * 请求按优先级排队，在全局和单个Host的并发上限以及带宽限制内调用ProcessRequest。
+ */
+class SIMPLEHTTPMODULE_API FHttpRequestScheduler
+{
+public:
+	typedef TSharedRef<IHttpRequest, ESPMode::ThreadSafe> FRequestRef;
+
+	//OnDispatchFailed在ProcessRequest返回false时调用，OnDispatched在调用ProcessRequest之前调用
+	void Enqueue(const FRequestRef& Request, EHttpRequestPriority Priority, TFunction<void()>&& OnDispatchFailed, TFunction<void()>&& OnDispatched = nullptr);
+	//从队列中移除还未发送的请求
+	bool Remove(const FHttpRequestPtr& Request);
+	//请求完成后释放占用的并发数量，没有计入带宽的响应字节在这时计入
+	void NotifyFinished(const FHttpRequestPtr& Request, const FHttpSchedulerSettings& Settings);
+	/**
+	 * 请求体或者响应体经过流时改为按流的计数计入带宽，忽略进度事件中对应方向的字节数。
+	 * 在OnDispatched中设置时流式的请求体不在发送时整个计入。流在传输中途按调度器设置的等待时间限速。
+	 */
+	void SetTransferCounters(const FHttpRequestPtr& Request, const TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe>& SendCounter, const TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe>& ReceiveCounter);
+	//请求收发的累计字节数，用于带宽限制
+	void AddTransferredBytes(const FHttpRequestPtr& Request, int64 BytesSent, int64 BytesReceived, const FHttpSchedulerSettings& Settings);
+	bool IsQueued(const FHttpRequestPtr& Request) const;
+	//把还在排队的请求移到更高优先级的队列，已经发送或者优先级不更高时返回false
+	bool RaisePriority(const FHttpRequestPtr& Request, EHttpRequestPriority Priority);
+
+	void Pump(const FHttpSchedulerSettings& Settings);
+	//提升排队过久的请求，回收已经结束但没有通知的请求，然后发送
+	void Tick(const FHttpSchedulerSettings& Settings);
+	void Reset();
+
+	FHttpSchedulerStats GetStats() const;
+
+private:
+	struct FQueuedEntry
+	{
+		FRequestRef Request;
+		FString Host;
+		//提交时的优先级，提升后仍然按这个优先级计入带宽
+		EHttpRequestPriority Priority;
+		double EnqueueTime = 0;
+		TFunction<void()> OnDispatchFailed;
+		TFunction<void()> OnDispatched;
+	};
+	struct FInFlightEntry
+	{
+		FRequestRef Request;
+		FString Host;
+		EHttpRequestPriority Priority;
+		//已经计入带宽的字节数
+		int64 ChargedSent = 0;
+		int64 ChargedReceived = 0;
+		TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe> SendCounter;
+		TSharedPtr<FHttpTransferCounter, ESPMode::ThreadSafe> ReceiveCounter;
+	};
+
+	FInFlightEntry* FindInFlight(const FHttpRequestPtr& Request);
+	void ReleaseInFlight(int32 Index, const FHttpSchedulerSettings& Settings);
+	//把流在HTTP线程累计的字节计入带宽
+	void ChargeCounter(FInFlightEntry& Entry, const FHttpSchedulerSettings& Settings);
+	//按请求的桶还清透支需要的时间设置流的等待
+	void UpdatePace(FInFlightEntry& Entry, const FHttpSchedulerSettings& Settings) const;
+
+	TArray<FQueuedEntry> Queues[(int32)EHttpRequestPriority::Max];
+	TArray<FInFlightEntry> InFlight;
+	TMap<FString, int32> InFlightPerHost;
+	FHttpBandwidthLimiter BandwidthLimiter;
+	bool bPumping = false;
+
+	int32 PeakQueueDepth = 0;
+	int64 TotalDispatched = 0;
+	int64 TotalPromoted = 0;
+	int64 TotalDispatchFailed = 0;
+	int64 TotalBandwidthDeferred = 0;
+};
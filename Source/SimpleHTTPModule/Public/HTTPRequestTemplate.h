@@ -0,0 +1,52 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Interfaces/IHttpRequest.h"
+#include "HTTPRequestScheduler.h"
+#include "HTTPRequestTemplate.generated.h"
+
+class UHTTPHelperSubsystem;
+class UHTTPRequest;
+enum class EMethodByte : uint8;
+
+/**
+ * 预先解析好地址、方法、合并后的请求头和超时的请求模板，适合频繁发送同一个接口的请求。
+ * 每次发送只需要传入变化的参数和内容。创建后修改Subsystem的DefaultHeaders不会影响已经创建的模板。
+ * 模板对象需要由调用者持有。
+ */
+UCLASS(BlueprintType)
+class SIMPLEHTTPMODULE_API UHTTPRequestTemplate : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Template", meta = (DisplayName = "使用模板发送HTTP请求", AutoCreateRefTerm = "Params"))
+	UHTTPRequest* Call(const TMap<FString, FString>& Params, const FString& Content);
+
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Template", meta = (DisplayName = "使用模板发送二进制HTTP请求", AutoCreateRefTerm = "Params"))
+	UHTTPRequest* CallAsBinary(const TMap<FString, FString>& Params, const TArray<uint8>& Content);
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Template")
+	FString GetBaseURL() const { return BaseURL; }
+
+	//按照模板创建请求但不发送
+	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> CreateRequest(const TMap<FString, FString>& Params) const;
+
+private:
+	friend class UHTTPHelperSubsystem;
+
+	void Initialize(UHTTPHelperSubsystem* InSubsystem, const FString& URL, EMethodByte Verb, const TMap<FString, FString>& Headers, float InTimeoutSecs, bool bAddDefaultHeaders, EHttpRequestPriority InPriority);
+
+	UPROPERTY()
+	UHTTPHelperSubsystem* HTTPHelperSubsystem = nullptr;
+
+	FString BaseURL;
+	FString VerbString;
+	TArray<TPair<FString, FString>> ResolvedHeaders;
+	float TimeoutSecs = 100;
+	EHttpRequestPriority Priority = EHttpRequestPriority::Normal;
+	bool bEncodeQueryParams = false;
+};
@@ -0,0 +1,135 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Interfaces/IHttpRequest.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Containers/List.h"
+#include "HTTPResponseCache.generated.h"
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpCacheSettings
+{
+	GENERATED_BODY()
+public:
+	//内存缓存的字节上限
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int64 MaxMemoryBytes = 16 * 1024 * 1024;
+	//是否启用磁盘缓存
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bEnableDiskCache = true;
+	//磁盘缓存的字节上限
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int64 MaxDiskBytes = 256 * 1024 * 1024;
+	//磁盘缓存目录，为空时使用Saved/SimpleHTTPCache
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FString DiskCacheDirectory;
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpCacheStats
+{
+	GENERATED_BODY()
+public:
+	//未过期直接使用缓存的次数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 Hits = 0;
+	//服务器返回304后使用缓存的次数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 Revalidated = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 Misses = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 Stores = 0;
+	//从磁盘缓存加载的次数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 DiskLoads = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 MemoryEvictions = 0;
+	//由缓存提供而不需要从网络下载的响应体字节数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 BytesSaved = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 MemoryBytes = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 MemoryEntries = 0;
+};
+
+//缓存的响应，创建后不再修改，可以在线程间共享
+struct SIMPLEHTTPMODULE_API FHttpCacheEntry
+{
+	FString Key;
+	int32 ResponseCode = 0;
+	FString ContentType;
+	FString ETag;
+	FString LastModified;
+	FDateTime ExpireTimeUtc;
+	//Cache-Control: no-cache，每次使用前都需要验证
+	bool bNoCache = false;
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> Content;
+
+	bool IsFresh() const;
+	bool HasValidator() const { return !ETag.IsEmpty() || !LastModified.IsEmpty(); }
+	int64 GetContentSize() const { return Content.IsValid() ? Content->Num() : 0; }
+};
+
+typedef TSharedPtr<const FHttpCacheEntry, ESPMode::ThreadSafe> FHttpCacheEntryPtr;
+
+/**
+ * 内存LRU加磁盘两级的HTTP响应缓存，遵守Cache-Control/Expires，支持ETag和Last-Modified验证。
+ * 只能在游戏线程调用，磁盘读写在后台线程进行。
+ */
+class SIMPLEHTTPMODULE_API FHttpResponseCache : public TSharedFromThis<FHttpResponseCache, ESPMode::ThreadSafe>
+{
+public:
+	~FHttpResponseCache();
+
+	void SetSettings(const FHttpCacheSettings& InSettings);
+
+	static FString MakeKey(const IHttpRequest& Request);
+
+	//查找缓存，内存中存在时立即回调，否则在后台读取磁盘后回到游戏线程回调。没有缓存时Entry为空
+	void Find(const FString& Key, TFunction<void(FHttpCacheEntryPtr Entry)>&& OnFound);
+	//根据响应头存储响应，不可缓存的响应会被忽略
+	void Store(const FString& Key, const FHttpResponsePtr& Response);
+	//服务器返回304时更新缓存的有效期，返回更新后的缓存
+	FHttpCacheEntryPtr Revalidate(const FHttpCacheEntryPtr& Entry, const FHttpResponsePtr& Response);
+	//给请求加上If-None-Match和If-Modified-Since
+	static void AddConditionalHeaders(IHttpRequest& Request, const FHttpCacheEntry& Entry);
+
+	void RecordHit(const FHttpCacheEntry& Entry);
+	void RecordMiss();
+
+	void Clear();
+	FHttpCacheStats GetStats() const;
+
+private:
+	struct FMemoryItem
+	{
+		FHttpCacheEntryPtr Entry;
+		TDoubleLinkedList<FString>::TDoubleLinkedListNode* Node = nullptr;
+	};
+
+	//解析Cache-Control和Expires，返回false表示不能缓存
+	static bool ParseFreshness(const IHttpResponse& Response, FDateTime& OutExpireTimeUtc, bool& bOutNoCache);
+	void AddToMemory(const FHttpCacheEntryPtr& Entry);
+	void RemoveFromMemory(const FString& Key);
+	void WriteToDisk(const FHttpCacheEntryPtr& Entry);
+	FString GetDiskDirectory() const;
+	FString GetDiskPath(const FString& Key) const;
+
+	static bool SaveEntry(const FHttpCacheEntry& Entry, const FString& FilePath);
+	static FHttpCacheEntryPtr LoadEntry(const FString& Key, const FString& FilePath);
+	static int64 TrimDirectory(const FString& Directory, int64 MaxBytes);
+
+	FHttpCacheSettings Settings;
+	TMap<FString, FMemoryItem> MemoryItems;
+	//最近使用的在最前面
+	TDoubleLinkedList<FString> MemoryLRU;
+	int64 MemoryBytes = 0;
+	int64 EstimatedDiskBytes = INDEX_NONE;
+	bool bTrimmingDisk = false;
+
+	FHttpCacheStats Stats;
+};
@@ -0,0 +1,126 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Interfaces/IHttpRequest.h"
+#include "Interfaces/IHttpResponse.h"
+#include "HTTPRetryPolicy.generated.h"
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpRetryPolicy
+{
+	GENERATED_BODY()
+public:
+	FHttpRetryPolicy() = default;
+	explicit FHttpRetryPolicy(int32 InMaxRetries) : MaxRetries(InMaxRetries) {}
+
+	//最大重试次数，0表示不重试
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxRetries = 3;
+	//第一次重试的退避上限（秒），之后每次翻倍
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float BaseDelaySeconds = 0.5f;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float MaxDelaySeconds = 30.f;
+	//是否重试POST、PATCH等非幂等的请求
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bRetryNonIdempotent = false;
+	//连接失败、超时等没有响应的情况是否重试
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bRetryOnConnectionError = true;
+	//需要重试的响应码
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	TArray<int32> RetryResponseCodes = { 408, 429, 500, 502, 503, 504 };
+	//服务器返回Retry-After时按照它的时间重试
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bRespectRetryAfter = true;
+	//Retry-After超过该秒数时不再重试
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float MaxRetryAfterSeconds = 60.f;
+
+	static bool IsIdempotentVerb(const FString& Verb);
+	//是否需要重试，Attempt为已经重试的次数
+	bool ShouldRetry(const IHttpRequest& Request, const FHttpResponsePtr& Response, bool bWasSuccessful, int32 Attempt) const;
+	//计算下一次重试前等待的秒数，使用完全随机的指数退避。返回负数表示Retry-After太长而不应该重试
+	float GetRetryDelay(const FHttpResponsePtr& Response, int32 Attempt) const;
+	//解析Retry-After（秒数或者HTTP日期），没有时返回负数
+	static float ParseRetryAfter(const FHttpResponsePtr& Response);
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpRetryBudgetSettings
+{
+	GENERATED_BODY()
+public:
+	//每个新请求增加的重试额度，重试总数大约不超过请求数乘以该比例。小于等于0表示不限制
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float RetryRatio = 0.1f;
+	//重试额度上限，也是初始额度
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float MaxRetryTokens = 10.f;
+	//同一个Host连续失败达到该次数后断开，断开期间不再重试该Host的请求。小于等于0表示不使用
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 CircuitFailureThreshold = 5;
+	//断开后经过该时间（秒）再允许重试
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float CircuitOpenSeconds = 30.f;
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpRetryStats
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 TotalRetries = 0;
+	//重试后成功的请求数量
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 RecoveredRequests = 0;
+	//重试次数用完仍然失败的请求数量
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 ExhaustedRequests = 0;
+	//因为重试额度不足没有重试的次数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 SuppressedByBudget = 0;
+	//因为Host断开没有重试的次数
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int64 SuppressedByCircuit = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	float RetryTokens = 0.f;
+	//当前断开的Host数量
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 OpenCircuits = 0;
+};
+
+/**
+ * 全局的重试额度和按Host的断路器，防止服务器故障时所有客户端同时不断重试。只能在游戏线程使用。
+ */
+class SIMPLEHTTPMODULE_API FHttpRetryBudget
+{
+public:
+	void SetSettings(const FHttpRetryBudgetSettings& InSettings);
+	//发起新请求时调用，增加重试额度
+	void OnRequestSubmitted();
+	//请求结束时调用，更新Host的断路器
+	void OnRequestResult(const FString& Host, bool bFailed);
+	bool IsCircuitOpen(const FString& Host) const;
+	//检查断路器和额度，允许时消耗一次重试额度
+	bool TryConsumeRetry(const FString& Host);
+
+	void RecordRecovered() { Stats.RecoveredRequests++; }
+	void RecordExhausted() { Stats.ExhaustedRequests++; }
+	FHttpRetryStats GetStats() const;
+
+private:
+	struct FCircuit
+	{
+		int32 ConsecutiveFailures = 0;
+		double OpenUntil = 0;
+	};
+
+	FHttpRetryBudgetSettings Settings;
+	float Tokens = 10.f;
+	TMap<FString, FCircuit> Circuits;
+	FHttpRetryStats Stats;
+};
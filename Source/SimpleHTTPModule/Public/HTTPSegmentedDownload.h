@@ -0,0 +1,158 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Interfaces/IHttpRequest.h"
+#include "HTTPRequestScheduler.h"
+#include "HTTPRetryPolicy.h"
+#include "HAL/CriticalSection.h"
+#include "SimpleHTTPCompat.h"
+#include "HTTPSegmentedDownload.generated.h"
+
+class UHTTPHelperSubsystem;
+class FHttpSharedWriteFile;
+class FHttpRangeWriteStream;
+enum class EMethodByte : uint8;
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpSegmentedDownloadSettings
+{
+	GENERATED_BODY()
+public:
+	//同时下载的分段数量
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxParallelSegments = 4;
+	//每个分段的字节数，也是断点续传的粒度
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int64 SegmentSizeBytes = 8 * 1024 * 1024;
+	//单个分段失败后的重试策略，和普通请求一样使用指数退避、重试额度和Host的断路器
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	FHttpRetryPolicy SegmentRetryPolicy = FHttpRetryPolicy(3);
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float TimeoutSecs = 100.f;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bAddDefaultHeaders = true;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	EHttpRequestPriority Priority = EHttpRequestPriority::Background;
+};
+
+DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpSegmentedDownloadCompleteDelegate, bool, bSuccess, const FString&, FilePath);
+DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpSegmentedDownloadProgressDelegate, int64, BytesReceived, int64, TotalBytes);
+
+/**
+ * 分段并行下载。先用HEAD获取文件大小和是否支持Range，然后把文件分成多个分段并行下载，直接写入预分配文件的对应位置。
+ * 下载进度记录在目标文件旁边的.journal文件中，中断后再次下载同一个文件时只下载缺少的分段。
+ * 服务器不支持Range时退回到CallHTTPAndDownloadFile。
+ */
+UCLASS(BlueprintType)
+class SIMPLEHTTPMODULE_API UHTTPSegmentedDownload : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Download", meta = (DisplayName = "绑定下载完成的委托"))
+	void BindDownloadComplete(FSimpleHttpSegmentedDownloadCompleteDelegate InDelegate);
+
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Download", meta = (DisplayName = "绑定下载进度的委托"))
+	void BindDownloadProgress(FSimpleHttpSegmentedDownloadProgressDelegate InDelegate);
+
+	//取消下载，已完成的分段保留在磁盘上，之后可以继续下载
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Download", meta = (DisplayName = "取消下载"))
+	void Cancel();
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Download")
+	bool IsFinished() const { return bFinished; }
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Download")
+	int64 GetBytesReceived() const;
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Download")
+	int64 GetTotalBytes() const { return TotalBytes; }
+
+	//从上次中断的下载中恢复的字节数
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Download")
+	int64 GetResumedBytes() const { return ResumedBytes; }
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Download")
+	FString GetFilePath() const { return TargetFilePath; }
+
+private:
+	friend class UHTTPHelperSubsystem;
+
+	struct FSegment
+	{
+		int64 Offset = 0;
+		int64 Size = 0;
+		bool bCompleted = false;
+		int32 Attempts = 0;
+		TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> Request;
+		TSharedPtr<FHttpRangeWriteStream, ESPMode::ThreadSafe> Stream;
+		//正在下载的分段已经收到的字节数
+		int64 ReceivedBytes = 0;
+		//失败后等待到该时间再重新下载
+		double RetryTime = 0;
+	};
+
+	//journal在后台线程按顺序写入，完成后不再写入
+	struct FJournalWriter
+	{
+		FCriticalSection Lock;
+		int64 WrittenSequence = 0;
+		bool bClosed = false;
+	};
+
+	void Start(UHTTPHelperSubsystem* InSubsystem, const FString& InURL, const TMap<FString, FString>& InHeaders, const FString& InTargetFilePath, const FHttpSegmentedDownloadSettings& InSettings);
+	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> CreateRequest(EMethodByte Verb) const;
+	void OnProbeComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful);
+	void StartFallback();
+	UFUNCTION()
+	void OnFallbackComplete(bool bSuccess, FString FilePath);
+
+	void PrepareSegments();
+	void LaunchSegments();
+	void OnSegmentComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful, int32 SegmentIndex);
+	void OnSegmentProgress(FHttpRequestPtr Request, FSimpleHttpProgressBytes BytesSent, FSimpleHttpProgressBytes BytesReceived, int32 SegmentIndex);
+	//分段失败时RetryDelay为重试前等待的秒数，小于0表示不再重试
+	void FinishSegment(int32 SegmentIndex, bool bSucceeded, float RetryDelay);
+	float EvaluateSegmentRetry(int32 SegmentIndex, const IHttpRequest& Request, const FHttpResponsePtr& Response, bool bWasSuccessful, bool bResponseOk);
+	void Finish(bool bSuccess);
+	void BroadcastProgress();
+
+	//journal中记录已完成的分段，以及用于判断服务器上的文件是否改变的信息
+	FString GetJournalPath() const;
+	bool LoadJournal();
+	//在游戏线程生成journal，在后台线程先刷新.part文件再写入journal
+	void SaveJournal();
+	//If-Range使用的验证器，优先使用强ETag，否则使用Last-Modified，都没有时返回空
+	FString GetRangeValidator() const;
+
+	UPROPERTY()
+	UHTTPHelperSubsystem* HTTPHelperSubsystem = nullptr;
+
+	FString URL;
+	TMap<FString, FString> Headers;
+	FString TargetFilePath;
+	FHttpSegmentedDownloadSettings Settings;
+
+	TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> ProbeRequest;
+	FString ETag;
+	FString LastModified;
+	int64 TotalBytes = 0;
+	int64 CompletedBytes = 0;
+	int64 ResumedBytes = 0;
+
+	TSharedPtr<FHttpSharedWriteFile, ESPMode::ThreadSafe> File;
+	TArray<FSegment> Segments;
+	int32 InFlightCount = 0;
+	TSharedPtr<FJournalWriter, ESPMode::ThreadSafe> JournalWriter;
+	int64 JournalSequence = 0;
+	bool bFinished = false;
+
+	UPROPERTY()
+	class UHTTPRequest* FallbackRequest = nullptr;
+
+	FSimpleHttpSegmentedDownloadCompleteDelegate OnDownloadComplete;
+	FSimpleHttpSegmentedDownloadProgressDelegate OnDownloadProgress;
+};
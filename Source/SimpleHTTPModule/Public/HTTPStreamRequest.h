@@ -0,0 +1,189 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "Interfaces/IHttpRequest.h"
+#include "HTTPRequestScheduler.h"
+#include "SimpleHTTPCompat.h"
+#include "HTTPStreamRequest.generated.h"
+
+class UHTTPHelperSubsystem;
+class FHttpStreamReceiver;
+enum class EMethodByte : uint8;
+
+//流式响应的格式
+UENUM(BlueprintType)
+enum class EHttpStreamFormat : uint8
+{
+	//不解析，按收到的数据块触发
+	Raw,
+	//text/event-stream，每个事件触发一次
+	ServerSentEvents,
+	//每行一条记录（NDJSON、JSON Lines、日志），空行被忽略
+	NewlineDelimited,
+};
+
+//解析出的一条记录
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpStreamEvent
+{
+	GENERATED_BODY()
+public:
+	//SSE的event字段，没有时为message。按行解析时为空
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	FString EventType;
+	//SSE多个data字段用换行连接；按行解析时为一行的内容
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	FString Data;
+	//SSE最后收到的id，重新连接时作为Last-Event-ID
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	FString Id;
+	//SSE的retry字段，毫秒，-1表示没有
+	UPROPERTY(BlueprintReadOnly, Category = "SimpleHTTP")
+	int32 RetryMilliseconds = -1;
+};
+
+USTRUCT(BlueprintType)
+struct SIMPLEHTTPMODULE_API FHttpStreamSettings
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	EHttpStreamFormat Format = EHttpStreamFormat::ServerSentEvents;
+	//整个请求的超时，长时间的流需要设置得足够长
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	float TimeoutSecs = 3600.f;
+	//单条记录的字节数上限，超过时请求失败，避免格式错误的流占用大量内存
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	int32 MaxRecordBytes = 1024 * 1024;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bAddDefaultHeaders = true;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	EHttpRequestPriority Priority = EHttpRequestPriority::Normal;
+	//5.3之前的引擎不能在接收时读取响应，整个响应在完成后一次解析，并且完整保存在内存中。
+	//默认在这些版本上拒绝创建流式请求，开启后使用这种缓冲方式，只适合有限长度的响应
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "SimpleHTTP")
+	bool bAllowBufferedFallback = false;
+};
+
+/**
+ * SSE和按行分隔的增量解析器，数据可以在任意位置被切分。只保存还没有结束的一行和一个事件，可以在任意线程使用。
+ */
+class SIMPLEHTTPMODULE_API FHttpStreamParser
+{
+public:
+	FHttpStreamParser(EHttpStreamFormat InFormat, int32 InMaxRecordBytes);
+
+	//解析新的数据，完整的记录添加到OutEvents。记录超过上限时返回false
+	bool Feed(const uint8* Data, int64 Length, TArray<FHttpStreamEvent>& OutEvents);
+	//流结束时调用。按行解析时最后一行没有换行也会输出，SSE没有以空行结束的事件按规范丢弃
+	void Flush(TArray<FHttpStreamEvent>& OutEvents);
+
+private:
+	//处理LineBuffer中完整的一行，记录超过上限时返回false
+	bool ProcessLine(TArray<FHttpStreamEvent>& OutEvents);
+	bool ProcessEventLine(const FString& Line, TArray<FHttpStreamEvent>& OutEvents);
+
+	EHttpStreamFormat Format;
+	int32 MaxRecordBytes = 0;
+	TArray<uint8> LineBuffer;
+	//上一个字节是\r，紧跟的\n不再算作一行
+	bool bLastWasCR = false;
+	bool bCheckedBOM = false;
+
+	//SSE正在接收的事件
+	FString EventType;
+	FString EventData;
+	bool bHasData = false;
+	FString LastEventId;
+	int32 RetryMilliseconds = -1;
+};
+
+DECLARE_DYNAMIC_DELEGATE_OneParam(FSimpleHttpStreamChunkDelegate, const TArray<uint8>&, Chunk);
+DECLARE_DYNAMIC_DELEGATE_OneParam(FSimpleHttpStreamEventDelegate, const FHttpStreamEvent&, Event);
+DECLARE_DYNAMIC_DELEGATE_TwoParams(FSimpleHttpStreamCompleteDelegate, bool, bSuccess, int32, ResponseCode);
+//C++使用的数据块委托，直接引用收到的数据，只在委托执行期间有效
+DECLARE_DELEGATE_OneParam(FSimpleHttpStreamChunkNativeDelegate, TArrayView<const uint8> /*Chunk*/);
+
+/**
+ * 流式接收的请求，用于SSE、NDJSON等长时间的响应。UE5.3以上响应体不写入内存，HTTP线程收到数据后立即解析，
+ * 解析出的数据块或记录在游戏线程按顺序触发委托，所以第一条记录的延迟接近首字节时间。
+ * UE5.3以前引擎不支持接收流，只有开启bAllowBufferedFallback时才能创建，所有记录在请求完成时一次触发。
+ * 响应码不是2xx时响应体不按流解析，请求以失败结束，响应体可以通过GetErrorContent读取。
+ * 不使用重试、缓存和请求合并。
+ */
+UCLASS(BlueprintType)
+class SIMPLEHTTPMODULE_API UHTTPStreamRequest : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	FSimpleHttpStreamChunkNativeDelegate OnStreamChunkNative;
+
+	//Format为Raw时按收到的数据块触发
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Stream", meta = (DisplayName = "绑定收到数据的委托"))
+	void BindStreamChunk(FSimpleHttpStreamChunkDelegate InDelegate);
+
+	//Format为ServerSentEvents或者NewlineDelimited时每条记录触发一次
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Stream", meta = (DisplayName = "绑定收到记录的委托"))
+	void BindStreamEvent(FSimpleHttpStreamEventDelegate InDelegate);
+
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Stream", meta = (DisplayName = "绑定流结束的委托"))
+	void BindStreamComplete(FSimpleHttpStreamCompleteDelegate InDelegate);
+
+	//停止接收，以失败结束
+	UFUNCTION(BlueprintCallable, Category = "SimpleHTTPModule|Stream", meta = (DisplayName = "取消流式请求"))
+	void Cancel();
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Stream")
+	bool IsFinished() const { return bFinished; }
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Stream")
+	int64 GetBytesReceived() const { return BytesReceived; }
+
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Stream")
+	int64 GetEventCount() const { return EventCount; }
+
+	//从发送到第一个数据块或记录在游戏线程触发的秒数，还没有收到时为-1
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Stream")
+	float GetFirstDeliverySeconds() const { return FirstDeliverySeconds; }
+
+	//SSE最后收到的事件id
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Stream")
+	FString GetLastEventId() const { return LastEventId; }
+
+	//响应码不是2xx时的响应体（最多64KB），这时不会触发数据块和记录的委托
+	UFUNCTION(BlueprintPure, Category = "SimpleHTTPModule|Stream")
+	FString GetErrorContent() const;
+
+private:
+	friend class UHTTPHelperSubsystem;
+	friend class FHttpStreamReceiver;
+
+	void Start(UHTTPHelperSubsystem* InSubsystem, const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& InRequest, const FHttpStreamSettings& InSettings);
+	//在游戏线程触发HTTP线程解析出的数据
+	void DeliverReceived();
+	void OnRequestComplete(FHttpRequestPtr Request, FHttpResponsePtr Response, bool bWasSuccessful);
+	void OnRequestProgress(FHttpRequestPtr Request, FSimpleHttpProgressBytes InBytesSent, FSimpleHttpProgressBytes InBytesReceived);
+	void Finish(bool bSuccess, int32 ResponseCode);
+
+	UPROPERTY()
+	UHTTPHelperSubsystem* HTTPHelperSubsystem = nullptr;
+
+	FHttpStreamSettings Settings;
+	TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> HttpRequest;
+	TSharedPtr<FHttpStreamReceiver, ESPMode::ThreadSafe> Receiver;
+	double StartTime = 0;
+	float FirstDeliverySeconds = -1.f;
+	int64 BytesReceived = 0;
+	int64 EventCount = 0;
+	FString LastEventId;
+	TArray<uint8> ErrorContent;
+	bool bFinished = false;
+
+	FSimpleHttpStreamChunkDelegate OnStreamChunk;
+	FSimpleHttpStreamEventDelegate OnStreamEvent;
+	FSimpleHttpStreamCompleteDelegate OnStreamComplete;
+};
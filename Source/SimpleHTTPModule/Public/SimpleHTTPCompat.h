@@ -0,0 +1,56 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Runtime/Launch/Resources/Version.h"
+#include "Containers/Ticker.h"
+#include "Interfaces/IHttpRequest.h"
+
+//IHttpRequest::SetContentFromStream 是否可用
+#define SIMPLEHTTP_WITH_REQUEST_STREAM (ENGINE_MAJOR_VERSION > 4)
+//IHttpRequest::SetResponseBodyReceiveStream 是否可用（UE5.3加入）
+#define SIMPLEHTTP_WITH_RESPONSE_STREAM (ENGINE_MAJOR_VERSION > 5 || (ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 3))
+//IHttpRequest::OnRequestProgress64 是否可用（UE5.4加入，原来的32位进度委托被弃用）
+#define SIMPLEHTTP_WITH_PROGRESS64 (ENGINE_MAJOR_VERSION > 5 || (ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 4))
+//IHttpRequest::SetDelegateThreadPolicy 是否可用（UE5.1加入）
+#define SIMPLEHTTP_WITH_DELEGATE_THREAD_POLICY (ENGINE_MAJOR_VERSION > 5 || (ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 1))
+//Insights的计数器（CountersTrace.h）是否可用
+#define SIMPLEHTTP_WITH_TRACE_COUNTERS (ENGINE_MAJOR_VERSION > 4)
+
+//UE5中FTicker被FTSTicker替代
+#if ENGINE_MAJOR_VERSION > 4
+typedef FTSTicker FSimpleHttpTicker;
+typedef FTSTicker::FDelegateHandle FSimpleHttpTickerHandle;
+#else
+typedef FTicker FSimpleHttpTicker;
+typedef FDelegateHandle FSimpleHttpTickerHandle;
+#endif
+
+//IHttpRequest进度委托的字节数类型
+#if SIMPLEHTTP_WITH_PROGRESS64
+typedef uint64 FSimpleHttpProgressBytes;
+#else
+typedef int32 FSimpleHttpProgressBytes;
+#endif
+
+//与引擎版本对应的进度委托，参数为FSimpleHttpProgressBytes
+inline decltype(auto) SimpleHttpOnRequestProgress(IHttpRequest& Request)
+{
+#if SIMPLEHTTP_WITH_PROGRESS64
+	return Request.OnRequestProgress64();
+#else
+	return Request.OnRequestProgress();
+#endif
+}
+
+//让IHttpRequest的委托直接在HTTP线程执行，引擎不支持时返回false，委托仍然在游戏线程执行
+inline bool SimpleHttpCompleteOnHttpThread(IHttpRequest& Request)
+{
+#if SIMPLEHTTP_WITH_DELEGATE_THREAD_POLICY
+	Request.SetDelegateThreadPolicy(EHttpRequestDelegateThreadPolicy::CompleteOnHttpThread);
+	return true;
+#else
+	return false;
+#endif
+}
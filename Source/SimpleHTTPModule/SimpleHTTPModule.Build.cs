@@ -21,8 +21,18 @@ public class SimpleHTTPModule : ModuleRules
                 "Slate",
                 "SlateCore",
                 "Http",
+                "Json",
+                "JsonUtilities",
 
             }
         );
+
+        //本地回环的自动化测试使用UnrealWebUtils中的HTTP服务器，只在带开发工具的非Shipping版本中编译
+        bool bWithLoopbackTests = Target.bBuildDeveloperTools && Target.Configuration != UnrealTargetConfiguration.Shipping;
+        if (bWithLoopbackTests)
+        {
+            PrivateDependencyModuleNames.Add("UnrealWebUtils");
+        }
+        PrivateDefinitions.Add("SIMPLEHTTP_WITH_LOOPBACK_TESTS=" + (bWithLoopbackTests ? "1" : "0"));
     }
 }
\ No newline at end of file
@@ -0,0 +1,521 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CoreMinimal.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+#include "WebSocketSubsystem.h"
+#include "WebSocketMessageBatch.h"
+#include "Engine/Engine.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/ThreadSafeBool.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/Base64.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/SecureHash.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "IPAddress.h"
+
+namespace WebSocketLoopbackTest
+{
+	static const double TimeoutSeconds = 30.0;
+	static const int32 BatchedMessages = 16;
+	static const int32 PlainMessages = 3;
+	static const int32 MessageBytes = 256;
+	//包含2字节、3字节和4字节UTF-8字符的文本，字符数和字节数不同
+	static const uint8 TextUtf8[] = { 'h', 0xC3, 0xA9, 'l', 'l', 'o', ' ', 0xE4, 0xB8, 0x96, 0xE7, 0x95, 0x8C, ' ', 0xF0, 0x9F, 0x98, 0x80 };
+
+	//每16个字节相同，合并后的帧压缩后一定变小
+	static TArray<uint8> MakeMessage(int32 Index)
+	{
+		TArray<uint8> Message;
+		Message.SetNumUninitialized(MessageBytes);
+		for (int32 ByteIndex = 0; ByteIndex < MessageBytes; ByteIndex++)
+		{
+			Message[ByteIndex] = (uint8)((Index + ByteIndex / 16) & 0xFF);
+		}
+		return Message;
+	}
+
+	/**
+	 * 只用于测试的最小WebSocket回显服务器。一个线程轮询所有连接，完成握手后把收到的数据帧去掉掩码原样返回，
+	 * 不支持扩展，所以合并和压缩的帧也原样返回。记录每条二进制消息的前4个字节和收到的文本，用于检查线路上的格式。
+	 */
+	class FEchoServer : public FRunnable
+	{
+	public:
+		virtual ~FEchoServer() override
+		{
+			Shutdown();
+		}
+
+		bool Start()
+		{
+			ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+			const TSharedRef<FInternetAddr> Address = SocketSubsystem->CreateInternetAddr();
+			bool bValidAddress = false;
+			Address->SetIp(TEXT("127.0.0.1"), bValidAddress);
+			Address->SetPort(0);
+			ListenSocket = SocketSubsystem->CreateSocket(NAME_Stream, TEXT("WebSocketEchoServer"), Address->GetProtocolType());
+			if (!ListenSocket || !ListenSocket->Bind(*Address) || !ListenSocket->Listen(16))
+			{
+				return false;
+			}
+			ListenSocket->SetNonBlocking(true);
+			Port = ListenSocket->GetPortNo();
+			Thread = FRunnableThread::Create(this, TEXT("WebSocketEchoServer"));
+			return Thread != nullptr;
+		}
+
+		void Shutdown()
+		{
+			bStopping = true;
+			if (Thread)
+			{
+				Thread->WaitForCompletion();
+				delete Thread;
+				Thread = nullptr;
+			}
+			ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+			for (FConnection& Connection : Connections)
+			{
+				Connection.Socket->Close();
+				SocketSubsystem->DestroySocket(Connection.Socket);
+			}
+			Connections.Empty();
+			if (ListenSocket)
+			{
+				ListenSocket->Close();
+				SocketSubsystem->DestroySocket(ListenSocket);
+				ListenSocket = nullptr;
+			}
+		}
+
+		int32 GetPort() const { return Port; }
+
+		TArray<TArray<uint8>> GetBinaryHeaders() const
+		{
+			FScopeLock ScopeLock(&Lock);
+			return BinaryHeaders;
+		}
+
+		TArray<TArray<uint8>> GetTexts() const
+		{
+			FScopeLock ScopeLock(&Lock);
+			return Texts;
+		}
+
+		virtual uint32 Run() override
+		{
+			while (!bStopping)
+			{
+				bool bPending = false;
+				while (ListenSocket->HasPendingConnection(bPending) && bPending)
+				{
+					if (FSocket* Socket = ListenSocket->Accept(TEXT("WebSocketEchoConnection")))
+					{
+						Socket->SetNonBlocking(false);
+						Socket->SetNoDelay(true);
+						Connections.AddDefaulted_GetRef().Socket = Socket;
+					}
+				}
+				for (int32 Index = Connections.Num() - 1; Index >= 0; Index--)
+				{
+					if (!Poll(Connections[Index]))
+					{
+						Connections[Index].Socket->Close();
+						ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Connections[Index].Socket);
+						Connections.RemoveAt(Index);
+					}
+				}
+				ListenSocket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromMilliseconds(1));
+			}
+			return 0;
+		}
+
+	private:
+		struct FConnection
+		{
+			FSocket* Socket = nullptr;
+			TArray<uint8> Buffer;
+			bool bUpgraded = false;
+		};
+
+		//返回false时关闭连接
+		bool Poll(FConnection& Connection)
+		{
+			if (!Connection.Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::Zero()))
+			{
+				return true;
+			}
+			uint8 Chunk[16 * 1024];
+			int32 BytesRead = 0;
+			if (!Connection.Socket->Recv(Chunk, sizeof(Chunk), BytesRead) || BytesRead <= 0)
+			{
+				return false;
+			}
+			Connection.Buffer.Append(Chunk, BytesRead);
+			if (!Connection.bUpgraded)
+			{
+				return Upgrade(Connection);
+			}
+			return EchoFrames(Connection);
+		}
+
+		bool Upgrade(FConnection& Connection)
+		{
+			const FString Received = BytesToString(Connection.Buffer);
+			const int32 HeaderEnd = Received.Find(TEXT("\r\n\r\n"));
+			if (HeaderEnd == INDEX_NONE)
+			{
+				return true;
+			}
+			FString Key;
+			TArray<FString> Lines;
+			Received.Left(HeaderEnd).ParseIntoArrayLines(Lines);
+			for (const FString& Line : Lines)
+			{
+				FString Name, Value;
+				if (Line.Split(TEXT(":"), &Name, &Value) && Name.TrimStartAndEnd().Equals(TEXT("Sec-WebSocket-Key"), ESearchCase::IgnoreCase))
+				{
+					Key = Value.TrimStartAndEnd();
+				}
+			}
+			if (Key.IsEmpty())
+			{
+				return false;
+			}
+			const FTCHARToUTF8 AcceptSource(*(Key + TEXT("258EAFA5-E914-47DA-95CA-C5AB0DC85B11")));
+			TArray<uint8> Hash;
+			Hash.SetNumUninitialized(20);
+			FSHA1::HashBuffer(AcceptSource.Get(), AcceptSource.Length(), Hash.GetData());
+			const FString Response = FString::Printf(TEXT("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n"), *FBase64::Encode(Hash));
+			const FTCHARToUTF8 ResponseUtf8(*Response);
+			//请求头只有ASCII字符，字符数就是字节数
+			Connection.Buffer.RemoveAt(0, HeaderEnd + 4);
+			Connection.bUpgraded = true;
+			return SendAll(Connection.Socket, (const uint8*)ResponseUtf8.Get(), ResponseUtf8.Length()) && EchoFrames(Connection);
+		}
+
+		bool EchoFrames(FConnection& Connection)
+		{
+			TArray<uint8>& Buffer = Connection.Buffer;
+			while (Buffer.Num() >= 2)
+			{
+				const uint8 Opcode = Buffer[0] & 0x0F;
+				const bool bMasked = (Buffer[1] & 0x80) != 0;
+				uint64 Length = Buffer[1] & 0x7F;
+				int32 Offset = 2;
+				if (Length == 126)
+				{
+					if (Buffer.Num() < 4)
+					{
+						return true;
+					}
+					Length = ((uint64)Buffer[2] << 8) | Buffer[3];
+					Offset = 4;
+				}
+				else if (Length == 127)
+				{
+					if (Buffer.Num() < 10)
+					{
+						return true;
+					}
+					Length = 0;
+					for (int32 Index = 2; Index < 10; Index++)
+					{
+						Length = (Length << 8) | Buffer[Index];
+					}
+					Offset = 10;
+				}
+				const int32 MaskOffset = Offset;
+				Offset += bMasked ? 4 : 0;
+				if (Length > (uint64)(MAX_int32 - Offset) || Buffer.Num() < Offset + (int32)Length)
+				{
+					return Length <= (uint64)(MAX_int32 - Offset);
+				}
+				TArray<uint8> Payload(Buffer.GetData() + Offset, (int32)Length);
+				if (bMasked)
+				{
+					for (int32 Index = 0; Index < Payload.Num(); Index++)
+					{
+						Payload[Index] ^= Buffer[MaskOffset + (Index & 3)];
+					}
+				}
+				const uint8 FirstByte = Buffer[0];
+				Buffer.RemoveAt(0, Offset + (int32)Length, false);
+
+				if (Opcode == 0x1 || Opcode == 0x2)
+				{
+					FScopeLock ScopeLock(&Lock);
+					if (Opcode == 0x1)
+					{
+						Texts.Add(Payload);
+					}
+					else
+					{
+						BinaryHeaders.Emplace(Payload.GetData(), FMath::Min(4, Payload.Num()));
+					}
+				}
+				//ping回复pong，关闭帧原样返回后关闭连接，其他帧（包括分片）原样返回
+				const uint8 ReplyFirstByte = Opcode == 0x9 ? (uint8)(0x80 | 0xA) : FirstByte;
+				if (Opcode != 0xA && !SendFrame(Connection.Socket, ReplyFirstByte, Payload))
+				{
+					return false;
+				}
+				if (Opcode == 0x8)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		static bool SendFrame(FSocket* Socket, uint8 FirstByte, const TArray<uint8>& Payload)
+		{
+			TArray<uint8> Frame;
+			Frame.Add(FirstByte);
+			if (Payload.Num() < 126)
+			{
+				Frame.Add((uint8)Payload.Num());
+			}
+			else if (Payload.Num() <= 0xFFFF)
+			{
+				Frame.Add(126);
+				Frame.Add((uint8)(Payload.Num() >> 8));
+				Frame.Add((uint8)(Payload.Num() & 0xFF));
+			}
+			else
+			{
+				Frame.Add(127);
+				for (int32 Shift = 56; Shift >= 0; Shift -= 8)
+				{
+					Frame.Add((uint8)(((uint64)Payload.Num() >> Shift) & 0xFF));
+				}
+			}
+			Frame.Append(Payload);
+			return SendAll(Socket, Frame.GetData(), Frame.Num());
+		}
+
+		static bool SendAll(FSocket* Socket, const uint8* Data, int32 Length)
+		{
+			while (Length > 0)
+			{
+				int32 BytesSent = 0;
+				if (!Socket->Send(Data, Length, BytesSent) || BytesSent <= 0)
+				{
+					return false;
+				}
+				Data += BytesSent;
+				Length -= BytesSent;
+			}
+			return true;
+		}
+
+		static FString BytesToString(const TArray<uint8>& Bytes)
+		{
+			const FUTF8ToTCHAR Converter((const ANSICHAR*)Bytes.GetData(), Bytes.Num());
+			return FString(Converter.Length(), Converter.Get());
+		}
+
+		FSocket* ListenSocket = nullptr;
+		FRunnableThread* Thread = nullptr;
+		int32 Port = 0;
+		FThreadSafeBool bStopping = false;
+		//只由服务器线程访问
+		TArray<FConnection> Connections;
+		mutable FCriticalSection Lock;
+		TArray<TArray<uint8>> BinaryHeaders;
+		TArray<TArray<uint8>> Texts;
+	};
+
+	struct FState
+	{
+		TSharedPtr<FEchoServer> Server;
+		UGameInstance* GameInstance = nullptr;
+		TWeakObjectPtr<UWebSocketConnection> Batched;
+		TWeakObjectPtr<UWebSocketConnection> Plain;
+		TArray<TArray<uint8>> BatchedReceived;
+		TArray<TArray<uint8>> PlainReceived;
+		double StartTime = 0;
+
+		bool IsCompleted() const
+		{
+			const UWebSocketConnection* PlainConnection = Plain.Get();
+			return BatchedReceived.Num() >= BatchedMessages && PlainReceived.Num() >= PlainMessages
+				&& PlainConnection && PlainConnection->GetStats().MessagesReceived >= PlainMessages + 1;
+		}
+	};
+	typedef TSharedRef<FState> FStateRef;
+
+	static UWebSocketConnection* Connect(UWebSocketSubsystem* Subsystem, const FStateRef& State, const FWebSocketSettings& Settings, TArray<TArray<uint8>> FState::* Received)
+	{
+		const FString URL = FString::Printf(TEXT("ws://127.0.0.1:%d"), State->Server->GetPort());
+		UWebSocketConnection* Connection = Subsystem->Connect(URL, TMap<FString, FString>(), Settings);
+		const TWeakPtr<FState> WeakState = State;
+		Connection->OnBinaryMessageNative.BindLambda([WeakState, Received](TArrayView<const uint8> Message)
+			{
+				if (const TSharedPtr<FState> PinnedState = WeakState.Pin())
+				{
+					(PinnedState.Get()->*Received).Emplace(Message.GetData(), Message.Num());
+				}
+			});
+		return Connection;
+	}
+
+	static void Cleanup(FState& State)
+	{
+		if (State.GameInstance)
+		{
+			UWorld* World = State.GameInstance->GetWorld();
+			//Deinitialize中关闭所有连接
+			State.GameInstance->Shutdown();
+			if (World)
+			{
+				GEngine->DestroyWorldContext(World);
+				World->DestroyWorld(false);
+			}
+			State.GameInstance->RemoveFromRoot();
+			State.GameInstance = nullptr;
+		}
+		State.Server->Shutdown();
+	}
+}
+
+//等待回显完成后检查线路上的格式、统计的字节数和收到的消息
+class FWebSocketLoopbackWaitCommand : public IAutomationLatentCommand
+{
+public:
+	FWebSocketLoopbackWaitCommand(FAutomationTestBase* InTest, const WebSocketLoopbackTest::FStateRef& InState)
+		: Test(InTest)
+		, State(InState)
+	{
+	}
+
+	virtual bool Update() override
+	{
+		using namespace WebSocketLoopbackTest;
+		const bool bTimedOut = FPlatformTime::Seconds() - State->StartTime > TimeoutSeconds;
+		if (!State->IsCompleted() && !bTimedOut)
+		{
+			return false;
+		}
+		if (bTimedOut)
+		{
+			Test->AddError(FString::Printf(TEXT("WebSocket echo timed out, batched %d/%d, plain %d/%d"), State->BatchedReceived.Num(), BatchedMessages, State->PlainReceived.Num(), PlainMessages));
+		}
+		else if (Test->TestNotNull(TEXT("Plain connection"), State->Plain.Get()) && Test->TestNotNull(TEXT("Batched connection"), State->Batched.Get()))
+		{
+			const int32 TextBytes = UE_ARRAY_COUNT(TextUtf8);
+			const TArray<TArray<uint8>> Texts = State->Server->GetTexts();
+			if (Test->TestEqual(TEXT("Server received one text frame"), Texts.Num(), 1))
+			{
+				Test->TestTrue(TEXT("Text is sent as UTF-8"), Texts[0] == TArray<uint8>(TextUtf8, TextBytes));
+			}
+			const FWebSocketStats PlainStats = State->Plain->GetStats();
+			Test->TestEqual(TEXT("Plain frames sent"), PlainStats.FramesSent, (int64)PlainMessages + 1);
+			Test->TestEqual(TEXT("Plain bytes sent count UTF-8 bytes"), PlainStats.BytesSent, (int64)(TextBytes + PlainMessages * MessageBytes));
+			Test->TestEqual(TEXT("Plain bytes received count UTF-8 bytes"), PlainStats.BytesReceived, (int64)(TextBytes + PlainMessages * MessageBytes));
+
+			const FWebSocketStats BatchedStats = State->Batched->GetStats();
+			Test->TestEqual(TEXT("Batched messages sent"), BatchedStats.MessagesSent, (int64)BatchedMessages);
+			Test->TestEqual(TEXT("Batched messages sent in one frame"), BatchedStats.FramesSent, (int64)1);
+			Test->TestEqual(TEXT("Batched frame received"), BatchedStats.FramesReceived, (int64)1);
+			Test->TestEqual(TEXT("Batched messages received"), BatchedStats.MessagesReceived, (int64)BatchedMessages);
+
+			//批量合并默认关闭，普通连接的每条消息单独一帧，只有开启合并的连接发送"UWB"帧
+			int32 BatchFrames = 0;
+			int32 CompressedBatchFrames = 0;
+			const TArray<TArray<uint8>> BinaryHeaders = State->Server->GetBinaryHeaders();
+			for (const TArray<uint8>& Header : BinaryHeaders)
+			{
+				if (FWebSocketMessageBatch::IsBatchFrame(Header))
+				{
+					BatchFrames++;
+					//标志第0位表示内容经过zlib压缩
+					CompressedBatchFrames += (Header[3] & 1) ? 1 : 0;
+				}
+			}
+			Test->TestEqual(TEXT("Server received binary frames"), BinaryHeaders.Num(), PlainMessages + 1);
+			Test->TestEqual(TEXT("Only the batched connection sends UWB frames"), BatchFrames, 1);
+			Test->TestEqual(TEXT("Batch frame is zlib compressed"), CompressedBatchFrames, 1);
+
+			for (int32 Index = 0; Index < BatchedMessages; Index++)
+			{
+				if (!Test->TestTrue(FString::Printf(TEXT("Batched message %d matches"), Index), State->BatchedReceived[Index] == MakeMessage(Index)))
+				{
+					break;
+				}
+			}
+			for (int32 Index = 0; Index < PlainMessages; Index++)
+			{
+				Test->TestTrue(FString::Printf(TEXT("Plain message %d matches"), Index), State->PlainReceived[Index] == MakeMessage(Index));
+			}
+		}
+		Cleanup(*State);
+		return true;
+	}
+
+private:
+	FAutomationTestBase* Test;
+	WebSocketLoopbackTest::FStateRef State;
+};
+
+/**
+ * 在本机启动最小的WebSocket回显服务器，检查文本消息按UTF-8字节统计、默认不合并发送，
+ * 以及开启合并和压缩后多条消息作为一个"UWB"帧发送并在收到后拆分。
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FWebSocketLoopbackTest, "UnrealWebUtils.WebSocket.Loopback", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FWebSocketLoopbackTest::RunTest(const FString& Parameters)
+{
+	using namespace WebSocketLoopbackTest;
+	const FStateRef State = MakeShared<FState>();
+	State->Server = MakeShared<FEchoServer>();
+	if (!TestTrue(TEXT("Echo server started"), State->Server->Start()))
+	{
+		State->Server->Shutdown();
+		return false;
+	}
+
+	State->GameInstance = NewObject<UGameInstance>(GEngine);
+	State->GameInstance->AddToRoot();
+	State->GameInstance->InitializeStandalone();
+	UWebSocketSubsystem* Subsystem = State->GameInstance->GetSubsystem<UWebSocketSubsystem>();
+	if (!TestNotNull(TEXT("WebSocket subsystem"), Subsystem))
+	{
+		Cleanup(*State);
+		return false;
+	}
+
+	FWebSocketSettings PlainSettings;
+	PlainSettings.bAutoReconnect = false;
+	UWebSocketConnection* Plain = Connect(Subsystem, State, PlainSettings, &FState::PlainReceived);
+	State->Plain = Plain;
+	const FUTF8ToTCHAR TextConverter((const ANSICHAR*)TextUtf8, UE_ARRAY_COUNT(TextUtf8));
+	Plain->SendText(FString(TextConverter.Length(), TextConverter.Get()));
+	for (int32 Index = 0; Index < PlainMessages; Index++)
+	{
+		Plain->SendBinary(MakeMessage(Index));
+	}
+
+	FWebSocketSettings BatchedSettings = PlainSettings;
+	BatchedSettings.bBatchBinaryMessages = true;
+	BatchedSettings.bCompressBatches = true;
+	UWebSocketConnection* Batched = Connect(Subsystem, State, BatchedSettings, &FState::BatchedReceived);
+	State->Batched = Batched;
+	//连接成功前的消息在连接后一起发送，合并为一帧
+	for (int32 Index = 0; Index < BatchedMessages; Index++)
+	{
+		Batched->SendBinary(MakeMessage(Index));
+	}
+
+	State->StartTime = FPlatformTime::Seconds();
+	ADD_LATENT_AUTOMATION_COMMAND(FWebSocketLoopbackWaitCommand(this, State));
+	return true;
+}
+#endif
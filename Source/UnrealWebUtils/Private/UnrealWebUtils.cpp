@@ -1,6 +1,8 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "UnrealWebUtils.h"
+#include "CoreGlobals.h"
+#include "HAL/IConsoleManager.h"
 
 #define LOCTEXT_NAMESPACE "FUnrealWebUtilsModule"
 
@@ -14,8 +16,90 @@ void FUnrealWebUtilsModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	StopDebugHttpServer();
 }
 
+bool FUnrealWebUtilsModule::StartDebugHttpServer(const FWebHttpServerSettings& Settings)
+{
+	StopDebugHttpServer();
+	const TSharedRef<FWebHttpServer, ESPMode::ThreadSafe> Server = MakeShared<FWebHttpServer, ESPMode::ThreadSafe>();
+	//所有响应共享同一份内容，不复制
+	const TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> HealthBody = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>(TArray<uint8>{ 'O', 'K' });
+	Server->AddRoute(TEXT("GET"), TEXT("/health"), [HealthBody](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+		{
+			Response.SetShared(HealthBody, TEXT("text/plain; charset=utf-8"));
+		});
+	const TWeakPtr<FWebHttpServer, ESPMode::ThreadSafe> WeakServer = Server;
+	Server->AddRoute(TEXT("GET"), TEXT("/stats"), [WeakServer](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+		{
+			const TSharedPtr<FWebHttpServer, ESPMode::ThreadSafe> PinnedServer = WeakServer.Pin();
+			const FWebHttpServerStats Stats = PinnedServer.IsValid() ? PinnedServer->GetStats() : FWebHttpServerStats();
+			Response.SetText(FString::Printf(TEXT("{\"requests\":%lld,\"bytesReceived\":%lld,\"bytesSent\":%lld,\"activeConnections\":%d,\"acceptedConnections\":%lld,\"rejectedConnections\":%lld}"),
+				Stats.Requests, Stats.BytesReceived, Stats.BytesSent, Stats.ActiveConnections, Stats.AcceptedConnections, Stats.RejectedConnections), TEXT("application/json"));
+		});
+	Server->AddRoute(TEXT(""), TEXT("/echo/:text"), [](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+		{
+			Response.SetText(Request.PathParams.FindRef(TEXT("text")) + Request.GetBodyAsString());
+		});
+	//在游戏线程执行的示例
+	Server->AddRoute(TEXT("GET"), TEXT("/frame"), [](const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)
+		{
+			Response.SetText(FString::Printf(TEXT("%llu"), (uint64)GFrameCounter));
+		}, EWebHttpHandlerThread::GameThread);
+	if (!Server->Start(Settings))
+	{
+		return false;
+	}
+	DebugHttpServer = Server;
+	return true;
+}
+
+void FUnrealWebUtilsModule::StopDebugHttpServer()
+{
+	if (DebugHttpServer.IsValid())
+	{
+		DebugHttpServer->Shutdown();
+		DebugHttpServer.Reset();
+	}
+}
+
+static FAutoConsoleCommand GWebHttpServerStartCommand(
+	TEXT("WebUtils.HttpServer.Start"),
+	TEXT("WebUtils.HttpServer.Start [Port=8080] [Bind=127.0.0.1] [Workers=4]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			FWebHttpServerSettings Settings;
+			for (const FString& Arg : Args)
+			{
+				FString Key, Value;
+				if (!Arg.Split(TEXT("="), &Key, &Value))
+				{
+					continue;
+				}
+				if (Key == TEXT("Port"))
+				{
+					Settings.Port = FCString::Atoi(*Value);
+				}
+				else if (Key == TEXT("Bind"))
+				{
+					Settings.BindAddress = Value;
+				}
+				else if (Key == TEXT("Workers"))
+				{
+					Settings.WorkerThreads = FMath::Max(1, FCString::Atoi(*Value));
+				}
+			}
+			FModuleManager::GetModuleChecked<FUnrealWebUtilsModule>(TEXT("UnrealWebUtils")).StartDebugHttpServer(Settings);
+		}));
+
+static FAutoConsoleCommand GWebHttpServerStopCommand(
+	TEXT("WebUtils.HttpServer.Stop"),
+	TEXT("Stop the server started by WebUtils.HttpServer.Start"),
+	FConsoleCommandDelegate::CreateLambda([]()
+		{
+			FModuleManager::GetModuleChecked<FUnrealWebUtilsModule>(TEXT("UnrealWebUtils")).StopDebugHttpServer();
+		}));
+
 #undef LOCTEXT_NAMESPACE
 	
 IMPLEMENT_MODULE(FUnrealWebUtilsModule, UnrealWebUtils)
\ No newline at end of file
@@ -0,0 +1,956 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WebHttpServer.h"
+#include "Async/Async.h"
+#include "GenericPlatform/GenericPlatformHttp.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/QueuedThreadPool.h"
+#include "Misc/ScopeLock.h"
+#include "SocketSubsystem.h"
+#include "Sockets.h"
+#include "IPAddress.h"
+
+//工作线程处理一个连接的任务
+class FWebHttpConnectionWork : public IQueuedWork
+{
+public:
+	FWebHttpConnectionWork(FWebHttpServer* InServer, FWebHttpServer::FConnection* InConnection)
+		: Server(InServer)
+		, Connection(InConnection)
+	{
+	}
+
+	//发送游戏线程处理完的响应，之后继续处理连接
+	FWebHttpConnectionWork(FWebHttpServer* InServer, FWebHttpServer::FConnection* InConnection, FWebHttpServerRequest&& InRequest, FWebHttpServerResponse&& InResponse, bool bInKeepAlive)
+		: Server(InServer)
+		, Connection(InConnection)
+		, Request(MoveTemp(InRequest))
+		, Response(MoveTemp(InResponse))
+		, bKeepAlive(bInKeepAlive)
+		, bHasResponse(true)
+	{
+	}
+
+	virtual void DoThreadedWork() override
+	{
+		if (bHasResponse)
+		{
+			Server->ResumeConnection(Connection, Request, Response, bKeepAlive);
+		}
+		else
+		{
+			Server->ServeConnection(Connection);
+		}
+		delete this;
+	}
+
+	//线程池关闭时还没有执行的任务
+	virtual void Abandon() override
+	{
+		Server->CloseConnection(Connection);
+		delete this;
+	}
+
+private:
+	FWebHttpServer* Server;
+	FWebHttpServer::FConnection* Connection;
+	FWebHttpServerRequest Request;
+	FWebHttpServerResponse Response;
+	bool bKeepAlive = false;
+	bool bHasResponse = false;
+};
+
+namespace WebHttpServer
+{
+	//在这个大小以内的响应体和响应头一起发送
+	static const int64 InlineBodyBytes = 16 * 1024;
+	static const int32 ReceiveChunkBytes = 16 * 1024;
+	//监听线程每次轮询一个连接最多读取的次数，接收请求体时不让一个连接占用监听线程
+	static const int32 ReceivesPerPoll = 16;
+	static const float MinPollIntervalSeconds = 0.001f;
+	static const ANSICHAR Continue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+	static void SplitPath(const FString& Path, TArray<FString>& OutSegments)
+	{
+		Path.ParseIntoArray(OutSegments, TEXT("/"), true);
+	}
+
+	static FString DecodeQueryComponent(const FString& Value)
+	{
+		return FGenericPlatformHttp::UrlDecode(Value.Replace(TEXT("+"), TEXT(" ")));
+	}
+
+	//根据请求头计算整个请求的字节数。请求体的长度无效或者不支持时返回0，请求立即交给工作线程返回错误
+	static int64 GetRequestBytes(const TArray<uint8>& Buffer, int32 HeaderEnd, int64 MaxBodyBytes, bool& bOutExpectContinue)
+	{
+		const FUTF8ToTCHAR HeaderConverter((const ANSICHAR*)Buffer.GetData(), HeaderEnd);
+		const FString HeaderText(HeaderConverter.Length(), HeaderConverter.Get());
+		TArray<FString> Lines;
+		HeaderText.ParseIntoArray(Lines, TEXT("\r\n"), true);
+		int64 ContentLength = 0;
+		for (int32 Index = 1; Index < Lines.Num(); Index++)
+		{
+			FString Key, Value;
+			if (!Lines[Index].Split(TEXT(":"), &Key, &Value))
+			{
+				return 0;
+			}
+			Key.TrimStartAndEndInline();
+			Value.TrimStartAndEndInline();
+			if (Key == TEXT("Content-Length"))
+			{
+				if (!Value.IsNumeric())
+				{
+					return 0;
+				}
+				ContentLength = FCString::Atoi64(*Value);
+			}
+			else if (Key == TEXT("Transfer-Encoding") && Value != TEXT("identity"))
+			{
+				return 0;
+			}
+			else if (Key == TEXT("Expect") && Value == TEXT("100-continue"))
+			{
+				bOutExpectContinue = true;
+			}
+		}
+		if (ContentLength < 0 || ContentLength > MaxBodyBytes)
+		{
+			return 0;
+		}
+		return HeaderEnd + 4 + ContentLength;
+	}
+}
+
+FString FWebHttpServerRequest::GetBodyAsString() const
+{
+	const FUTF8ToTCHAR Converter((const ANSICHAR*)Body.GetData(), Body.Num());
+	return FString(Converter.Length(), Converter.Get());
+}
+
+void FWebHttpServerResponse::SetText(const FString& Text, const FString& InContentType)
+{
+	const FTCHARToUTF8 Converter(*Text);
+	Body.Reset();
+	Body.Append((const uint8*)Converter.Get(), Converter.Length());
+	ContentType = InContentType;
+}
+
+void FWebHttpServerResponse::SetShared(const TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe>& InBody, const FString& InContentType)
+{
+	SharedBody = InBody;
+	ContentType = InContentType;
+}
+
+void FWebHttpServerResponse::SetFile(const FString& InFilePath, const FString& InContentType)
+{
+	FilePath = InFilePath;
+	ContentType = InContentType;
+}
+
+FWebHttpServer::FWebHttpServer()
+{
+}
+
+FWebHttpServer::~FWebHttpServer()
+{
+	Shutdown();
+}
+
+bool FWebHttpServer::AddRoute(const FString& Method, const FString& Path, FWebHttpRouteHandler&& Handler, EWebHttpHandlerThread Thread)
+{
+	//运行中路由被工作线程读取，不能修改
+	if (bRunning || !Handler)
+	{
+		return false;
+	}
+	FRoute Route;
+	Route.Method = Method.ToUpper();
+	Route.Handler = MoveTemp(Handler);
+	Route.Thread = Thread;
+	WebHttpServer::SplitPath(Path, Route.Segments);
+	bool bPattern = false;
+	for (int32 Index = 0; Index < Route.Segments.Num(); Index++)
+	{
+		const FString& Segment = Route.Segments[Index];
+		if (Segment == TEXT("*"))
+		{
+			if (Index != Route.Segments.Num() - 1)
+			{
+				return false;
+			}
+			Route.bWildcard = true;
+			bPattern = true;
+		}
+		else if (Segment.StartsWith(TEXT(":")))
+		{
+			bPattern = true;
+		}
+	}
+	if (Route.bWildcard)
+	{
+		Route.Segments.Pop();
+	}
+	if (bPattern)
+	{
+		PatternRoutes.Add(MoveTemp(Route));
+	}
+	else
+	{
+		const FString Key = Route.Method + TEXT(" ") + NormalizePath(Route.Segments);
+		StaticRoutes.Add(Key, MoveTemp(Route));
+	}
+	return true;
+}
+
+bool FWebHttpServer::Start(const FWebHttpServerSettings& InSettings)
+{
+	if (bRunning)
+	{
+		return false;
+	}
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (!SocketSubsystem)
+	{
+		return false;
+	}
+	Settings = InSettings;
+	const TSharedRef<FInternetAddr> Address = SocketSubsystem->CreateInternetAddr();
+	bool bValidAddress = false;
+	Address->SetIp(*Settings.BindAddress, bValidAddress);
+	if (!bValidAddress)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WebHttpServer invalid bind address %s"), *Settings.BindAddress);
+		return false;
+	}
+	Address->SetPort(Settings.Port);
+	ListenSocket = SocketSubsystem->CreateSocket(NAME_Stream, TEXT("WebHttpServer"), Address->GetProtocolType());
+	if (!ListenSocket)
+	{
+		return false;
+	}
+	ListenSocket->SetReuseAddr(true);
+	if (!ListenSocket->Bind(*Address) || !ListenSocket->Listen(128))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WebHttpServer failed to listen on %s:%d"), *Settings.BindAddress, Settings.Port);
+		SocketSubsystem->DestroySocket(ListenSocket);
+		ListenSocket = nullptr;
+		return false;
+	}
+	ListenSocket->SetNonBlocking(true);
+	BoundPort = ListenSocket->GetPortNo();
+
+	WorkerPool = FQueuedThreadPool::Allocate();
+	WorkerPool->Create(FMath::Max(1, Settings.WorkerThreads), 128 * 1024, TPri_Normal, TEXT("WebHttpServerWorker"));
+	bStopping = false;
+	bRunning = true;
+	ListenThread = FRunnableThread::Create(this, TEXT("WebHttpServerListener"), 128 * 1024, TPri_Normal);
+	UE_LOG(LogTemp, Log, TEXT("WebHttpServer listening on %s:%d"), *Settings.BindAddress, BoundPort);
+	return true;
+}
+
+void FWebHttpServer::Shutdown()
+{
+	if (!bRunning)
+	{
+		return;
+	}
+	bStopping = true;
+	if (ListenThread)
+	{
+		ListenThread->WaitForCompletion();
+		delete ListenThread;
+		ListenThread = nullptr;
+	}
+	//等待正在处理的连接结束
+	if (WorkerPool)
+	{
+		WorkerPool->Destroy();
+		delete WorkerPool;
+		WorkerPool = nullptr;
+	}
+	//还在等待游戏线程的请求直接关闭连接，之后游戏线程不会再访问服务器
+	TSharedPtr<FGameThreadCall, ESPMode::ThreadSafe> StartedCall;
+	while (StartedGameThreadCalls.Dequeue(StartedCall))
+	{
+		PendingGameThreadCalls.Add(StartedCall.ToSharedRef());
+	}
+	for (const FGameThreadCallRef& Call : PendingGameThreadCalls)
+	{
+		FinishGameThreadCall(Call, true);
+	}
+	PendingGameThreadCalls.Empty();
+	FConnection* Connection = nullptr;
+	while (ReturnedConnections.Dequeue(Connection))
+	{
+		IdleConnections.Add(Connection);
+	}
+	for (FConnection* IdleConnection : IdleConnections)
+	{
+		CloseConnection(IdleConnection);
+	}
+	IdleConnections.Empty();
+	if (ListenSocket)
+	{
+		ListenSocket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ListenSocket);
+		ListenSocket = nullptr;
+	}
+	BoundPort = 0;
+	bRunning = false;
+}
+
+FWebHttpServerStats FWebHttpServer::GetStats() const
+{
+	FWebHttpServerStats Stats;
+	Stats.Requests = StatRequests.GetValue();
+	Stats.BytesReceived = StatBytesReceived.GetValue();
+	Stats.BytesSent = StatBytesSent.GetValue();
+	Stats.ActiveConnections = StatActiveConnections.GetValue();
+	Stats.AcceptedConnections = StatAcceptedConnections.GetValue();
+	Stats.RejectedConnections = StatRejectedConnections.GetValue();
+	return Stats;
+}
+
+uint32 FWebHttpServer::Run()
+{
+	float PollIntervalSeconds = WebHttpServer::MinPollIntervalSeconds;
+	while (!bStopping)
+	{
+		bool bActive = AcceptConnections();
+		FConnection* Connection = nullptr;
+		const double Now = FPlatformTime::Seconds();
+		while (ReturnedConnections.Dequeue(Connection))
+		{
+			Connection->LastActiveTime = Now;
+			IdleConnections.Add(Connection);
+			bActive = true;
+		}
+		bActive |= PollIdleConnections();
+		PollGameThreadCalls();
+		//有活动时保持最短的间隔，空闲时逐渐延长，减少对每个空闲连接的检查。有新连接时立即返回
+		PollIntervalSeconds = bActive ? WebHttpServer::MinPollIntervalSeconds : FMath::Min(PollIntervalSeconds * 2.f, FMath::Max(WebHttpServer::MinPollIntervalSeconds, Settings.MaxPollIntervalSeconds));
+		ListenSocket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromSeconds(PollIntervalSeconds));
+	}
+	return 0;
+}
+
+void FWebHttpServer::Stop()
+{
+	bStopping = true;
+}
+
+bool FWebHttpServer::AcceptConnections()
+{
+	bool bAccepted = false;
+	bool bPending = false;
+	while (ListenSocket->HasPendingConnection(bPending) && bPending)
+	{
+		FSocket* Socket = ListenSocket->Accept(TEXT("WebHttpConnection"));
+		if (!Socket)
+		{
+			break;
+		}
+		if (StatActiveConnections.GetValue() >= Settings.MaxConnections)
+		{
+			StatRejectedConnections.Increment();
+			Socket->Close();
+			ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Socket);
+			continue;
+		}
+		//工作线程使用带超时的Wait后阻塞读取
+		Socket->SetNonBlocking(false);
+		Socket->SetNoDelay(true);
+		FConnection* Connection = new FConnection();
+		Connection->Socket = Socket;
+		Connection->LastActiveTime = FPlatformTime::Seconds();
+		StatActiveConnections.Increment();
+		StatAcceptedConnections.Increment();
+		IdleConnections.Add(Connection);
+		bAccepted = true;
+	}
+	return bAccepted;
+}
+
+bool FWebHttpServer::PollIdleConnections()
+{
+	bool bActive = false;
+	const double Now = FPlatformTime::Seconds();
+	for (int32 Index = IdleConnections.Num() - 1; Index >= 0; Index--)
+	{
+		FConnection* Connection = IdleConnections[Index];
+		bool bReady = false;
+		if (Connection->Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::Zero()))
+		{
+			bActive = true;
+			//对方关闭的连接也是可读的，读取时关闭
+			bool bOpen = ReceiveAvailable(Connection);
+			uint32 PendingBytes = 0;
+			for (int32 Receive = 1; bOpen && Receive < WebHttpServer::ReceivesPerPoll && Connection->Socket->HasPendingData(PendingBytes) && PendingBytes > 0; Receive++)
+			{
+				bOpen = ReceiveAvailable(Connection);
+			}
+			if (!bOpen)
+			{
+				IdleConnections.RemoveAtSwap(Index);
+				CloseConnection(Connection);
+				continue;
+			}
+			Connection->LastActiveTime = Now;
+			bReady = IsRequestReady(Connection, Now);
+			//请求头要求100-continue时，由监听线程回复后继续接收请求体
+			if (!bReady && Connection->bExpectContinue && !Connection->bContinueSent)
+			{
+				Connection->bContinueSent = true;
+				if (!SendAll(Connection->Socket, (const uint8*)WebHttpServer::Continue, sizeof(WebHttpServer::Continue) - 1))
+				{
+					IdleConnections.RemoveAtSwap(Index);
+					CloseConnection(Connection);
+					continue;
+				}
+			}
+		}
+		else if (Connection->ReadBuffer.Num() > 0)
+		{
+			//不完整的请求超时后交给工作线程返回408
+			bReady = Now - Connection->RequestStartTime >= Settings.RequestTimeoutSeconds;
+		}
+		else if (Now - Connection->LastActiveTime > Settings.KeepAliveTimeoutSeconds)
+		{
+			IdleConnections.RemoveAtSwap(Index);
+			CloseConnection(Connection);
+			continue;
+		}
+		if (bReady)
+		{
+			bActive = true;
+			IdleConnections.RemoveAtSwap(Index);
+			WorkerPool->AddQueuedWork(new FWebHttpConnectionWork(this, Connection));
+		}
+	}
+	return bActive;
+}
+
+void FWebHttpServer::CloseConnection(FConnection* Connection)
+{
+	Connection->Socket->Close();
+	ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Connection->Socket);
+	delete Connection;
+	StatActiveConnections.Decrement();
+}
+
+void FWebHttpServer::ServeConnection(FConnection* Connection)
+{
+	bool bKeepAlive = true;
+	while (bKeepAlive && !bStopping && IsRequestReady(Connection, FPlatformTime::Seconds()))
+	{
+		bool bPending = false;
+		bKeepAlive = ServeRequest(Connection, bPending);
+		if (bPending)
+		{
+			return;
+		}
+		//管线化的请求可能已经在缓冲区中或者已经到达，不等待还没有到达的请求，请求不完整时交还给监听线程
+		if (bKeepAlive && !IsRequestReady(Connection, FPlatformTime::Seconds())
+			&& Connection->Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::Zero()))
+		{
+			bKeepAlive = ReceiveAvailable(Connection);
+		}
+	}
+	if (!bKeepAlive || bStopping)
+	{
+		CloseConnection(Connection);
+		return;
+	}
+	Connection->LastActiveTime = FPlatformTime::Seconds();
+	ReturnedConnections.Enqueue(Connection);
+}
+
+void FWebHttpServer::ResumeConnection(FConnection* Connection, const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response, bool bKeepAlive)
+{
+	if (!SendResponse(Connection, Request, Response, bKeepAlive) || !bKeepAlive)
+	{
+		CloseConnection(Connection);
+		return;
+	}
+	//游戏线程处理期间到达的请求
+	if (!IsRequestReady(Connection, FPlatformTime::Seconds()) && Connection->Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::Zero()) && !ReceiveAvailable(Connection))
+	{
+		CloseConnection(Connection);
+		return;
+	}
+	ServeConnection(Connection);
+}
+
+bool FWebHttpServer::ServeRequest(FConnection* Connection, bool& bOutPending)
+{
+	FWebHttpServerRequest Request;
+	bool bKeepAlive = false;
+	int32 ErrorCode = 0;
+	if (!ReadRequest(Connection, Request, bKeepAlive, ErrorCode))
+	{
+		if (ErrorCode != 0)
+		{
+			FWebHttpServerResponse Response;
+			Response.StatusCode = ErrorCode;
+			Response.SetText(GetReasonPhrase(ErrorCode));
+			SendResponse(Connection, Request, Response, false);
+		}
+		return false;
+	}
+	StatRequests.Increment();
+	Connection->RequestsServed++;
+	if (Settings.MaxRequestsPerConnection > 0 && Connection->RequestsServed >= Settings.MaxRequestsPerConnection)
+	{
+		bKeepAlive = false;
+	}
+
+	FWebHttpServerResponse Response;
+	TMap<FString, FString> PathParams;
+	if (const FRoute* Route = FindRoute(Request, PathParams))
+	{
+		Request.PathParams = MoveTemp(PathParams);
+		if (Route->Thread == EWebHttpHandlerThread::GameThread)
+		{
+			StartGameThreadCall(Connection, *Route, MoveTemp(Request), bKeepAlive);
+			bOutPending = true;
+			return true;
+		}
+		Route->Handler(Request, Response);
+	}
+	else
+	{
+		Response.StatusCode = 404;
+		Response.SetText(GetReasonPhrase(404));
+	}
+	return SendResponse(Connection, Request, Response, bKeepAlive) && bKeepAlive;
+}
+
+bool FWebHttpServer::ReadRequest(FConnection* Connection, FWebHttpServerRequest& OutRequest, bool& bOutKeepAlive, int32& OutErrorCode)
+{
+	//监听线程只在请求完整、请求头出错或者超时后交给工作线程，这里不再等待网络数据
+	TArray<uint8>& Buffer = Connection->ReadBuffer;
+	const int32 HeaderEnd = FindHeaderEnd(Buffer, 0);
+	if (HeaderEnd == INDEX_NONE)
+	{
+		OutErrorCode = Buffer.Num() > Settings.MaxHeaderBytes ? 431 : 408;
+		return false;
+	}
+
+	const FUTF8ToTCHAR HeaderConverter((const ANSICHAR*)Buffer.GetData(), HeaderEnd);
+	const FString HeaderText(HeaderConverter.Length(), HeaderConverter.Get());
+	TArray<FString> Lines;
+	HeaderText.ParseIntoArray(Lines, TEXT("\r\n"), true);
+	TArray<FString> RequestLine;
+	if (Lines.Num() > 0)
+	{
+		Lines[0].ParseIntoArrayWS(RequestLine);
+	}
+	if (RequestLine.Num() != 3 || !RequestLine[2].StartsWith(TEXT("HTTP/1.")))
+	{
+		OutErrorCode = 400;
+		return false;
+	}
+	OutRequest.Method = RequestLine[0].ToUpper();
+	bOutKeepAlive = RequestLine[2] == TEXT("HTTP/1.1");
+	for (int32 Index = 1; Index < Lines.Num(); Index++)
+	{
+		FString Key, Value;
+		if (!Lines[Index].Split(TEXT(":"), &Key, &Value))
+		{
+			OutErrorCode = 400;
+			return false;
+		}
+		Key.TrimStartAndEndInline();
+		Value.TrimStartAndEndInline();
+		if (FString* Existing = OutRequest.Headers.Find(Key))
+		{
+			Existing->Append(TEXT(", ")).Append(Value);
+		}
+		else
+		{
+			OutRequest.Headers.Add(Key, Value);
+		}
+	}
+	if (const FString* ConnectionHeader = OutRequest.Headers.Find(TEXT("Connection")))
+	{
+		if (ConnectionHeader->Contains(TEXT("close")))
+		{
+			bOutKeepAlive = false;
+		}
+		else if (ConnectionHeader->Contains(TEXT("keep-alive")))
+		{
+			bOutKeepAlive = true;
+		}
+	}
+
+	FString PathPart, QueryPart;
+	if (!RequestLine[1].Split(TEXT("?"), &PathPart, &QueryPart))
+	{
+		PathPart = RequestLine[1];
+	}
+	OutRequest.Path = FGenericPlatformHttp::UrlDecode(PathPart);
+	TArray<FString> Pairs;
+	QueryPart.ParseIntoArray(Pairs, TEXT("&"), true);
+	for (const FString& Pair : Pairs)
+	{
+		FString Key, Value;
+		if (!Pair.Split(TEXT("="), &Key, &Value))
+		{
+			Key = Pair;
+		}
+		OutRequest.QueryParams.Add(WebHttpServer::DecodeQueryComponent(Key), WebHttpServer::DecodeQueryComponent(Value));
+	}
+
+	//不支持分块上传的请求体
+	const FString* TransferEncoding = OutRequest.Headers.Find(TEXT("Transfer-Encoding"));
+	if (TransferEncoding && *TransferEncoding != TEXT("identity"))
+	{
+		OutErrorCode = 501;
+		return false;
+	}
+	int64 ContentLength = 0;
+	if (const FString* ContentLengthHeader = OutRequest.Headers.Find(TEXT("Content-Length")))
+	{
+		if (!ContentLengthHeader->IsNumeric())
+		{
+			OutErrorCode = 400;
+			return false;
+		}
+		ContentLength = FCString::Atoi64(**ContentLengthHeader);
+	}
+	if (ContentLength < 0)
+	{
+		OutErrorCode = 400;
+		return false;
+	}
+	if (ContentLength > Settings.MaxBodyBytes)
+	{
+		OutErrorCode = 413;
+		return false;
+	}
+	const int64 BodyStart = HeaderEnd + 4;
+	const int64 RequestBytes = BodyStart + ContentLength;
+	//请求体在超时前没有收完
+	if (Buffer.Num() < RequestBytes)
+	{
+		OutErrorCode = 408;
+		return false;
+	}
+	OutRequest.Body.Append(Buffer.GetData() + BodyStart, (int32)ContentLength);
+	//后面管线化的请求留在缓冲区中
+	Buffer.RemoveAt(0, (int32)RequestBytes);
+	Connection->RequestStartTime = Buffer.Num() > 0 ? FPlatformTime::Seconds() : 0;
+	Connection->RequestBytes = -1;
+	Connection->HeaderSearchFrom = 0;
+	Connection->bExpectContinue = false;
+	Connection->bContinueSent = false;
+	StatBytesReceived.Add(RequestBytes);
+	return true;
+}
+
+bool FWebHttpServer::IsRequestReady(FConnection* Connection, double Now) const
+{
+	TArray<uint8>& Buffer = Connection->ReadBuffer;
+	if (Buffer.Num() == 0)
+	{
+		return false;
+	}
+	//超时时工作线程立即返回错误
+	if (Now - Connection->RequestStartTime >= Settings.RequestTimeoutSeconds)
+	{
+		return true;
+	}
+	if (Connection->RequestBytes < 0)
+	{
+		const int32 HeaderEnd = FindHeaderEnd(Buffer, Connection->HeaderSearchFrom);
+		if (HeaderEnd == INDEX_NONE)
+		{
+			Connection->HeaderSearchFrom = FMath::Max(0, Buffer.Num() - 3);
+			return Buffer.Num() > Settings.MaxHeaderBytes;
+		}
+		Connection->RequestBytes = WebHttpServer::GetRequestBytes(Buffer, HeaderEnd, Settings.MaxBodyBytes, Connection->bExpectContinue);
+		//请求体不超过MaxBodyBytes，一次分配好
+		Buffer.Reserve((int32)FMath::Min<int64>(Connection->RequestBytes, MAX_int32));
+	}
+	return Buffer.Num() >= Connection->RequestBytes;
+}
+
+int32 FWebHttpServer::FindHeaderEnd(const TArray<uint8>& Buffer, int32 SearchFrom)
+{
+	for (int32 Index = SearchFrom; Index + 3 < Buffer.Num(); Index++)
+	{
+		if (Buffer[Index] == '\r' && Buffer[Index + 1] == '\n' && Buffer[Index + 2] == '\r' && Buffer[Index + 3] == '\n')
+		{
+			return Index;
+		}
+	}
+	return INDEX_NONE;
+}
+
+bool FWebHttpServer::ReceiveAvailable(FConnection* Connection)
+{
+	TArray<uint8>& Buffer = Connection->ReadBuffer;
+	const int32 Offset = Buffer.Num();
+	Buffer.AddUninitialized(WebHttpServer::ReceiveChunkBytes);
+	int32 BytesRead = 0;
+	const bool bSuccess = Connection->Socket->Recv(Buffer.GetData() + Offset, WebHttpServer::ReceiveChunkBytes, BytesRead);
+	Buffer.SetNum(Offset + (bSuccess ? BytesRead : 0));
+	if (Offset == 0 && Buffer.Num() > 0)
+	{
+		Connection->RequestStartTime = FPlatformTime::Seconds();
+	}
+	return bSuccess && BytesRead > 0;
+}
+
+FString FWebHttpServer::NormalizePath(const TArray<FString>& Segments)
+{
+	return TEXT("/") + FString::Join(Segments, TEXT("/"));
+}
+
+const FWebHttpServer::FRoute* FWebHttpServer::FindRoute(const FWebHttpServerRequest& Request, TMap<FString, FString>& OutPathParams) const
+{
+	TArray<FString> Segments;
+	WebHttpServer::SplitPath(Request.Path, Segments);
+	const FString Path = NormalizePath(Segments);
+	if (const FRoute* Route = StaticRoutes.Find(Request.Method + TEXT(" ") + Path))
+	{
+		return Route;
+	}
+	if (const FRoute* Route = StaticRoutes.Find(TEXT(" ") + Path))
+	{
+		return Route;
+	}
+	for (const FRoute& Route : PatternRoutes)
+	{
+		if (!Route.Method.IsEmpty() && Route.Method != Request.Method)
+		{
+			continue;
+		}
+		if (Route.bWildcard ? Segments.Num() < Route.Segments.Num() : Segments.Num() != Route.Segments.Num())
+		{
+			continue;
+		}
+		bool bMatch = true;
+		OutPathParams.Reset();
+		for (int32 Index = 0; Index < Route.Segments.Num() && bMatch; Index++)
+		{
+			const FString& RouteSegment = Route.Segments[Index];
+			if (RouteSegment.StartsWith(TEXT(":")))
+			{
+				OutPathParams.Add(RouteSegment.Mid(1), Segments[Index]);
+			}
+			else
+			{
+				bMatch = RouteSegment == Segments[Index];
+			}
+		}
+		if (!bMatch)
+		{
+			continue;
+		}
+		if (Route.bWildcard)
+		{
+			TArray<FString> Rest(Segments.GetData() + Route.Segments.Num(), Segments.Num() - Route.Segments.Num());
+			OutPathParams.Add(TEXT("*"), FString::Join(Rest, TEXT("/")));
+		}
+		return &Route;
+	}
+	OutPathParams.Reset();
+	return nullptr;
+}
+
+void FWebHttpServer::StartGameThreadCall(FConnection* Connection, const FRoute& Route, FWebHttpServerRequest&& Request, bool bKeepAlive)
+{
+	const FGameThreadCallRef Call = MakeShared<FGameThreadCall, ESPMode::ThreadSafe>();
+	Call->Server = this;
+	Call->Connection = Connection;
+	Call->Request = MoveTemp(Request);
+	Call->bKeepAlive = bKeepAlive;
+	Call->Deadline = FPlatformTime::Seconds() + Settings.GameThreadTimeoutSeconds;
+	StartedGameThreadCalls.Enqueue(Call);
+	AsyncTask(ENamedThreads::GameThread, [Call, Handler = Route.Handler]()
+		{
+			//已经超时返回了503，或者服务器已经关闭
+			if (Call->bClaimed)
+			{
+				return;
+			}
+			Handler(Call->Request, Call->Response);
+			FinishGameThreadCall(Call, false);
+		});
+}
+
+void FWebHttpServer::FinishGameThreadCall(const FGameThreadCallRef& Call, bool bTimedOut)
+{
+	FScopeLock ScopeLock(&Call->Lock);
+	if (Call->bClaimed)
+	{
+		return;
+	}
+	Call->bClaimed = true;
+	FWebHttpServer* Server = Call->Server;
+	if (Server->bStopping)
+	{
+		Server->CloseConnection(Call->Connection);
+		return;
+	}
+	//超时时游戏线程可能正在写入Call->Response，只复制发送响应需要的请求方法
+	FWebHttpServerRequest Request;
+	Request.Method = Call->Request.Method;
+	FWebHttpServerResponse Response;
+	if (bTimedOut)
+	{
+		Response.StatusCode = 503;
+		Response.SetText(GetReasonPhrase(503));
+	}
+	else
+	{
+		Response = MoveTemp(Call->Response);
+	}
+	Server->WorkerPool->AddQueuedWork(new FWebHttpConnectionWork(Server, Call->Connection, MoveTemp(Request), MoveTemp(Response), Call->bKeepAlive));
+}
+
+void FWebHttpServer::PollGameThreadCalls()
+{
+	TSharedPtr<FGameThreadCall, ESPMode::ThreadSafe> StartedCall;
+	while (StartedGameThreadCalls.Dequeue(StartedCall))
+	{
+		PendingGameThreadCalls.Add(StartedCall.ToSharedRef());
+	}
+	const double Now = FPlatformTime::Seconds();
+	for (int32 Index = PendingGameThreadCalls.Num() - 1; Index >= 0; Index--)
+	{
+		const FGameThreadCallRef& Call = PendingGameThreadCalls[Index];
+		if (Call->bClaimed)
+		{
+			PendingGameThreadCalls.RemoveAtSwap(Index);
+		}
+		else if (Now >= Call->Deadline)
+		{
+			FinishGameThreadCall(Call, true);
+			PendingGameThreadCalls.RemoveAtSwap(Index);
+		}
+	}
+}
+
+bool FWebHttpServer::SendResponse(FConnection* Connection, const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response, bool bKeepAlive)
+{
+	TUniquePtr<IFileHandle> File;
+	if (!Response.FilePath.IsEmpty())
+	{
+		File.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*Response.FilePath));
+		if (!File)
+		{
+			Response.FilePath.Empty();
+			Response.SharedBody.Reset();
+			Response.StatusCode = 404;
+			Response.SetText(GetReasonPhrase(404));
+		}
+	}
+	const TArray<uint8>& Body = Response.SharedBody.IsValid() ? *Response.SharedBody : Response.Body;
+	const int64 ContentLength = File ? File->Size() : Body.Num();
+
+	FString Header = FString::Printf(TEXT("HTTP/1.1 %d %s\r\nServer: UnrealWebUtils\r\nContent-Type: %s\r\nContent-Length: %lld\r\n"),
+		Response.StatusCode, GetReasonPhrase(Response.StatusCode), *Response.ContentType, ContentLength);
+	if (bKeepAlive)
+	{
+		Header += FString::Printf(TEXT("Connection: keep-alive\r\nKeep-Alive: timeout=%d\r\n"), FMath::CeilToInt(Settings.KeepAliveTimeoutSeconds));
+	}
+	else
+	{
+		Header += TEXT("Connection: close\r\n");
+	}
+	for (const TPair<FString, FString>& Pair : Response.Headers)
+	{
+		Header += Pair.Key + TEXT(": ") + Pair.Value + TEXT("\r\n");
+	}
+	Header += TEXT("\r\n");
+	const FTCHARToUTF8 HeaderConverter(*Header);
+
+	const bool bSendBody = Request.Method != TEXT("HEAD") && ContentLength > 0;
+	TArray<uint8>& SendBuffer = Connection->SendBuffer;
+	SendBuffer.Reset();
+	SendBuffer.Append((const uint8*)HeaderConverter.Get(), HeaderConverter.Length());
+	int64 BytesSent = SendBuffer.Num();
+	//小的响应体和响应头一起发送，大的直接从原来的内存发送
+	if (bSendBody && !File && ContentLength <= WebHttpServer::InlineBodyBytes)
+	{
+		SendBuffer.Append(Body.GetData(), Body.Num());
+	}
+	if (!SendAll(Connection->Socket, SendBuffer.GetData(), SendBuffer.Num()))
+	{
+		return false;
+	}
+	if (bSendBody && !File && ContentLength > WebHttpServer::InlineBodyBytes)
+	{
+		if (!SendAll(Connection->Socket, Body.GetData(), ContentLength))
+		{
+			return false;
+		}
+	}
+	if (bSendBody && File)
+	{
+		const int32 ChunkBytes = FMath::Max(4 * 1024, Settings.FileChunkBytes);
+		SendBuffer.SetNumUninitialized(ChunkBytes);
+		int64 Remaining = ContentLength;
+		while (Remaining > 0)
+		{
+			const int32 ReadBytes = (int32)FMath::Min<int64>(Remaining, ChunkBytes);
+			//读取失败时已经发送了响应头，只能关闭连接
+			if (!File->Read(SendBuffer.GetData(), ReadBytes) || !SendAll(Connection->Socket, SendBuffer.GetData(), ReadBytes))
+			{
+				return false;
+			}
+			Remaining -= ReadBytes;
+		}
+	}
+	if (bSendBody)
+	{
+		BytesSent += ContentLength;
+	}
+	StatBytesSent.Add(BytesSent);
+	return true;
+}
+
+bool FWebHttpServer::SendAll(FSocket* Socket, const uint8* Data, int64 Length)
+{
+	while (Length > 0)
+	{
+		int32 BytesSent = 0;
+		if (!Socket->Send(Data, (int32)FMath::Min<int64>(Length, MAX_int32), BytesSent) || BytesSent <= 0)
+		{
+			return false;
+		}
+		Data += BytesSent;
+		Length -= BytesSent;
+	}
+	return true;
+}
+
+const TCHAR* FWebHttpServer::GetReasonPhrase(int32 StatusCode)
+{
+	switch (StatusCode)
+	{
+	case 200: return TEXT("OK");
+	case 201: return TEXT("Created");
+	case 204: return TEXT("No Content");
+	case 301: return TEXT("Moved Permanently");
+	case 302: return TEXT("Found");
+	case 304: return TEXT("Not Modified");
+	case 400: return TEXT("Bad Request");
+	case 401: return TEXT("Unauthorized");
+	case 403: return TEXT("Forbidden");
+	case 404: return TEXT("Not Found");
+	case 405: return TEXT("Method Not Allowed");
+	case 408: return TEXT("Request Timeout");
+	case 413: return TEXT("Payload Too Large");
+	case 431: return TEXT("Request Header Fields Too Large");
+	case 500: return TEXT("Internal Server Error");
+	case 501: return TEXT("Not Implemented");
+	case 503: return TEXT("Service Unavailable");
+	default: return TEXT("Unknown");
+	}
+}
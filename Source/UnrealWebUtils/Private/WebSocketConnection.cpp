@@ -0,0 +1,361 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WebSocketConnection.h"
+#include "WebSocketSubsystem.h"
+#include "WebSocketsModule.h"
+#include "IWebSocket.h"
+
+void UWebSocketConnection::BindConnected(FWebSocketConnectedDelegate InDelegate)
+{
+	OnConnected = InDelegate;
+}
+
+void UWebSocketConnection::BindConnectionError(FWebSocketErrorDelegate InDelegate)
+{
+	OnConnectionError = InDelegate;
+}
+
+void UWebSocketConnection::BindClosed(FWebSocketClosedDelegate InDelegate)
+{
+	OnClosed = InDelegate;
+}
+
+void UWebSocketConnection::BindReconnecting(FWebSocketReconnectingDelegate InDelegate)
+{
+	OnReconnecting = InDelegate;
+}
+
+void UWebSocketConnection::BindTextMessage(FWebSocketTextMessageDelegate InDelegate)
+{
+	OnTextMessage = InDelegate;
+}
+
+void UWebSocketConnection::BindBinaryMessage(FWebSocketBinaryMessageDelegate InDelegate)
+{
+	OnBinaryMessage = InDelegate;
+}
+
+bool UWebSocketConnection::SendText(const FString& Message)
+{
+	const FTCHARToUTF8 Converter(*Message);
+	return Send(TArrayView<const uint8>((const uint8*)Converter.Get(), Converter.Length()), false);
+}
+
+bool UWebSocketConnection::SendBinary(const TArray<uint8>& Message)
+{
+	return Send(Message, true);
+}
+
+bool UWebSocketConnection::Send(TArrayView<const uint8> Message, bool bBinary)
+{
+	if (State == EWebSocketState::Closed)
+	{
+		return false;
+	}
+	if (Settings.MaxQueuedBytes > 0 && QueuedBytes + Message.Num() > Settings.MaxQueuedBytes)
+	{
+		Stats.DroppedMessages++;
+		return false;
+	}
+	FOutgoingMessage& Outgoing = SendQueue.AddDefaulted_GetRef();
+	Outgoing.Payload = BufferPool.Acquire();
+	Outgoing.Payload.Append(Message.GetData(), Message.Num());
+	Outgoing.bBinary = bBinary;
+	QueuedBytes += Message.Num();
+	return true;
+}
+
+void UWebSocketConnection::Flush()
+{
+	SendQueued();
+}
+
+void UWebSocketConnection::Close(int32 StatusCode, const FString& Reason)
+{
+	if (State == EWebSocketState::Closed)
+	{
+		return;
+	}
+	SendQueued();
+	Finish();
+	if (Socket.IsValid() && Socket->IsConnected())
+	{
+		//委托仍然绑定，关闭完成后触发OnClosed
+		Socket->Close(StatusCode, Reason);
+	}
+}
+
+void UWebSocketConnection::Start(UWebSocketSubsystem* InSubsystem, const FString& InURL, const TMap<FString, FString>& InHeaders, const FWebSocketSettings& InSettings)
+{
+	WebSocketSubsystem = InSubsystem;
+	URL = InURL;
+	Headers = InHeaders;
+	Settings = InSettings;
+	BufferPool.SetLimits(Settings.MaxPooledBuffers, Settings.MaxMessageBytes);
+	CreateSocket();
+}
+
+void UWebSocketConnection::Tick(double Now)
+{
+	if (State == EWebSocketState::Reconnecting && Now >= NextReconnectTime)
+	{
+		CreateSocket();
+	}
+	else if (State == EWebSocketState::Connected)
+	{
+		SendQueued();
+	}
+}
+
+void UWebSocketConnection::CreateSocket()
+{
+	ReleaseSocket();
+	State = EWebSocketState::Connecting;
+	Socket = FWebSocketsModule::Get().CreateWebSocket(URL, Settings.Protocols, Headers);
+	Socket->OnConnected().AddUObject(this, &UWebSocketConnection::OnSocketConnected);
+	Socket->OnConnectionError().AddUObject(this, &UWebSocketConnection::OnSocketConnectionError);
+	Socket->OnClosed().AddUObject(this, &UWebSocketConnection::OnSocketClosed);
+	Socket->OnMessage().AddUObject(this, &UWebSocketConnection::OnSocketMessage);
+	Socket->OnBinaryMessage().AddUObject(this, &UWebSocketConnection::OnSocketBinaryMessage);
+	Socket->Connect();
+}
+
+void UWebSocketConnection::ReleaseSocket()
+{
+	if (!Socket.IsValid())
+	{
+		return;
+	}
+	Socket->OnConnected().RemoveAll(this);
+	Socket->OnConnectionError().RemoveAll(this);
+	Socket->OnClosed().RemoveAll(this);
+	Socket->OnMessage().RemoveAll(this);
+	Socket->OnBinaryMessage().RemoveAll(this);
+	if (Socket->IsConnected())
+	{
+		Socket->Close();
+	}
+	Socket.Reset();
+	//未完成的分片消息和合并的消息属于旧的连接
+	if (bReceivingFragments)
+	{
+		BufferPool.Release(MoveTemp(ReceiveBuffer));
+		bReceivingFragments = false;
+	}
+	bDiscardingMessage = false;
+}
+
+void UWebSocketConnection::HandleDisconnected()
+{
+	ReleaseSocket();
+	if (!Settings.bAutoReconnect || (Settings.MaxReconnectAttempts > 0 && ReconnectAttempt >= Settings.MaxReconnectAttempts))
+	{
+		Finish();
+		return;
+	}
+	ReconnectAttempt++;
+	float Delay = Settings.ReconnectInitialDelaySeconds * FMath::Pow(FMath::Max(1.f, Settings.ReconnectBackoffMultiplier), (float)(ReconnectAttempt - 1));
+	Delay = FMath::Min(Delay, Settings.ReconnectMaxDelaySeconds);
+	Delay = FMath::Max(0.f, Delay * (1.f + FMath::FRandRange(-Settings.ReconnectJitter, Settings.ReconnectJitter)));
+	NextReconnectTime = FPlatformTime::Seconds() + Delay;
+	State = EWebSocketState::Reconnecting;
+	OnReconnecting.ExecuteIfBound(ReconnectAttempt, Delay);
+}
+
+void UWebSocketConnection::Finish()
+{
+	if (State == EWebSocketState::Closed)
+	{
+		return;
+	}
+	State = EWebSocketState::Closed;
+	for (FOutgoingMessage& Outgoing : SendQueue)
+	{
+		BufferPool.Release(MoveTemp(Outgoing.Payload));
+	}
+	SendQueue.Empty();
+	QueuedBytes = 0;
+	Batch.Reset();
+	WebSocketSubsystem->OnConnectionClosed(this);
+}
+
+void UWebSocketConnection::SendQueued()
+{
+	if (State != EWebSocketState::Connected || !Socket.IsValid() || SendQueue.Num() == 0)
+	{
+		return;
+	}
+	for (FOutgoingMessage& Outgoing : SendQueue)
+	{
+		if (Settings.bBatchBinaryMessages && Outgoing.bBinary)
+		{
+			if (!Batch.IsEmpty() && Batch.GetSizeWith(Outgoing.Payload.Num()) > Settings.MaxBatchBytes)
+			{
+				SendBatch();
+			}
+			//超过上限的消息也使用合并的格式，接收方才能区分
+			Batch.Add(Outgoing.Payload);
+		}
+		else
+		{
+			//保持消息的顺序
+			SendBatch();
+			SendFrame(Outgoing.Payload, Outgoing.bBinary);
+		}
+		Stats.MessagesSent++;
+		BufferPool.Release(MoveTemp(Outgoing.Payload));
+	}
+	SendBatch();
+	SendQueue.Reset();
+	QueuedBytes = 0;
+}
+
+void UWebSocketConnection::SendBatch()
+{
+	if (Batch.IsEmpty())
+	{
+		return;
+	}
+	Batch.Encode(Settings.bCompressBatches, Settings.CompressThresholdBytes, FrameBuffer);
+	Batch.Reset();
+	SendFrame(FrameBuffer, true);
+}
+
+void UWebSocketConnection::SendFrame(const TArray<uint8>& Frame, bool bBinary)
+{
+	Socket->Send(Frame.GetData(), Frame.Num(), bBinary);
+	Stats.FramesSent++;
+	Stats.BytesSent += Frame.Num();
+}
+
+void UWebSocketConnection::OnSocketConnected()
+{
+	State = EWebSocketState::Connected;
+	if (ReconnectAttempt > 0)
+	{
+		Stats.Reconnects++;
+	}
+	ReconnectAttempt = 0;
+	OnConnected.ExecuteIfBound();
+	SendQueued();
+}
+
+void UWebSocketConnection::OnSocketConnectionError(const FString& Error)
+{
+	UE_LOG(LogTemp, Warning, TEXT("WebSocket %s error: %s"), *URL, *Error);
+	OnConnectionError.ExecuteIfBound(Error);
+	if (State != EWebSocketState::Closed)
+	{
+		HandleDisconnected();
+	}
+}
+
+void UWebSocketConnection::OnSocketClosed(int32 StatusCode, const FString& Reason, bool bWasClean)
+{
+	OnClosed.ExecuteIfBound(StatusCode, Reason, bWasClean);
+	if (State != EWebSocketState::Closed)
+	{
+		HandleDisconnected();
+	}
+}
+
+void UWebSocketConnection::OnSocketMessage(const FString& Message)
+{
+	//统计和上限都按线路上的UTF-8字节数，而不是字符数
+	const int64 MessageBytes = FTCHARToUTF8(*Message).Length();
+	Stats.FramesReceived++;
+	Stats.BytesReceived += MessageBytes;
+	if (Settings.MaxMessageBytes > 0 && MessageBytes > Settings.MaxMessageBytes)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WebSocket %s message exceeds MaxMessageBytes, dropped"), *URL);
+		Stats.DroppedMessages++;
+		return;
+	}
+	Stats.MessagesReceived++;
+	OnTextMessage.ExecuteIfBound(Message);
+}
+
+void UWebSocketConnection::OnSocketBinaryMessage(const void* Data, SIZE_T Size, bool bIsLastFragment)
+{
+	const uint8* Bytes = static_cast<const uint8*>(Data);
+	//完整的一帧直接使用引擎的缓冲区
+	if (!bReceivingFragments && !bDiscardingMessage && bIsLastFragment)
+	{
+		DispatchBinaryFrame(TArrayView<const uint8>(Bytes, (int32)Size));
+		return;
+	}
+	if (!bDiscardingMessage)
+	{
+		if (!bReceivingFragments)
+		{
+			ReceiveBuffer = BufferPool.Acquire();
+			bReceivingFragments = true;
+		}
+		if (Settings.MaxMessageBytes > 0 && ReceiveBuffer.Num() + (int64)Size > Settings.MaxMessageBytes)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("WebSocket %s message exceeds MaxMessageBytes, dropped"), *URL);
+			Stats.DroppedMessages++;
+			BufferPool.Release(MoveTemp(ReceiveBuffer));
+			bReceivingFragments = false;
+			bDiscardingMessage = true;
+		}
+		else
+		{
+			ReceiveBuffer.Append(Bytes, (int32)Size);
+		}
+	}
+	if (!bIsLastFragment)
+	{
+		return;
+	}
+	if (bDiscardingMessage)
+	{
+		bDiscardingMessage = false;
+		return;
+	}
+	TArray<uint8> Message = MoveTemp(ReceiveBuffer);
+	bReceivingFragments = false;
+	DispatchBinaryFrame(Message);
+	BufferPool.Release(MoveTemp(Message));
+}
+
+void UWebSocketConnection::DispatchBinaryFrame(TArrayView<const uint8> Frame)
+{
+	Stats.FramesReceived++;
+	Stats.BytesReceived += Frame.Num();
+	if (!Settings.bBatchBinaryMessages || !FWebSocketMessageBatch::IsBatchFrame(Frame))
+	{
+		DispatchBinaryMessage(Frame);
+		return;
+	}
+	if (!FWebSocketMessageBatch::Decode(Frame, Settings.MaxMessageBytes, DecodeBuffer, DecodedMessages))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("WebSocket %s received invalid batch frame"), *URL);
+		Stats.DroppedMessages++;
+		return;
+	}
+	for (const TArrayView<const uint8>& Message : DecodedMessages)
+	{
+		DispatchBinaryMessage(Message);
+		//在委托中关闭了连接
+		if (State == EWebSocketState::Closed)
+		{
+			break;
+		}
+	}
+	DecodedMessages.Reset();
+}
+
+void UWebSocketConnection::DispatchBinaryMessage(TArrayView<const uint8> Message)
+{
+	Stats.MessagesReceived++;
+	OnBinaryMessageNative.ExecuteIfBound(Message);
+	if (OnBinaryMessage.IsBound())
+	{
+		TArray<uint8> Buffer = BufferPool.Acquire();
+		Buffer.Append(Message.GetData(), Message.Num());
+		OnBinaryMessage.Execute(Buffer);
+		BufferPool.Release(MoveTemp(Buffer));
+	}
+}
@@ -0,0 +1,146 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WebSocketMessageBatch.h"
+#include "Misc/Compression.h"
+
+namespace WebSocketMessageBatch
+{
+	static const uint8 Magic[3] = { 'U', 'W', 'B' };
+	static const uint8 FlagCompressed = 1;
+	static const int32 HeaderBytes = 4;
+
+	static void WriteUInt32(TArray<uint8>& Out, uint32 Value)
+	{
+		const uint8 Bytes[4] = { (uint8)(Value & 0xFF), (uint8)((Value >> 8) & 0xFF), (uint8)((Value >> 16) & 0xFF), (uint8)((Value >> 24) & 0xFF) };
+		Out.Append(Bytes, 4);
+	}
+
+	static uint32 ReadUInt32(const uint8* Data)
+	{
+		return (uint32)Data[0] | ((uint32)Data[1] << 8) | ((uint32)Data[2] << 16) | ((uint32)Data[3] << 24);
+	}
+}
+
+void FWebSocketBufferPool::SetLimits(int32 InMaxBuffers, int32 InMaxBufferBytes)
+{
+	MaxBuffers = FMath::Max(0, InMaxBuffers);
+	MaxBufferBytes = InMaxBufferBytes;
+	while (Buffers.Num() > MaxBuffers)
+	{
+		Buffers.Pop();
+	}
+}
+
+TArray<uint8> FWebSocketBufferPool::Acquire()
+{
+	if (Buffers.Num() == 0)
+	{
+		return TArray<uint8>();
+	}
+	TArray<uint8> Buffer = Buffers.Pop();
+	Buffer.Reset();
+	return Buffer;
+}
+
+void FWebSocketBufferPool::Release(TArray<uint8>&& Buffer)
+{
+	if (Buffers.Num() < MaxBuffers && (MaxBufferBytes <= 0 || Buffer.Max() <= MaxBufferBytes))
+	{
+		Buffers.Add(MoveTemp(Buffer));
+	}
+}
+
+void FWebSocketMessageBatch::Add(TArrayView<const uint8> Message)
+{
+	WebSocketMessageBatch::WriteUInt32(Body, (uint32)Message.Num());
+	Body.Append(Message.GetData(), Message.Num());
+	Count++;
+}
+
+void FWebSocketMessageBatch::Reset()
+{
+	Body.Reset();
+	Count = 0;
+}
+
+void FWebSocketMessageBatch::Encode(bool bCompress, int32 CompressThresholdBytes, TArray<uint8>& OutFrame) const
+{
+	using namespace WebSocketMessageBatch;
+	OutFrame.Reset();
+	OutFrame.Append(Magic, 3);
+	if (bCompress && Body.Num() >= CompressThresholdBytes)
+	{
+		int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, Body.Num());
+		OutFrame.AddUninitialized(1 + 4 + CompressedSize);
+		uint8* CompressedData = OutFrame.GetData() + HeaderBytes + 4;
+		if (FCompression::CompressMemory(NAME_Zlib, CompressedData, CompressedSize, Body.GetData(), Body.Num()) && CompressedSize < Body.Num())
+		{
+			OutFrame[3] = FlagCompressed;
+			OutFrame.SetNum(HeaderBytes + 4 + CompressedSize);
+			const uint32 RawSize = (uint32)Body.Num();
+			OutFrame[4] = (uint8)(RawSize & 0xFF);
+			OutFrame[5] = (uint8)((RawSize >> 8) & 0xFF);
+			OutFrame[6] = (uint8)((RawSize >> 16) & 0xFF);
+			OutFrame[7] = (uint8)((RawSize >> 24) & 0xFF);
+			return;
+		}
+		OutFrame.SetNum(3);
+	}
+	OutFrame.Add(0);
+	OutFrame.Append(Body);
+}
+
+bool FWebSocketMessageBatch::IsBatchFrame(TArrayView<const uint8> Frame)
+{
+	using namespace WebSocketMessageBatch;
+	return Frame.Num() >= HeaderBytes && Frame[0] == Magic[0] && Frame[1] == Magic[1] && Frame[2] == Magic[2] && (Frame[3] & ~FlagCompressed) == 0;
+}
+
+bool FWebSocketMessageBatch::Decode(TArrayView<const uint8> Frame, int32 MaxBytes, TArray<uint8>& Scratch, TArray<TArrayView<const uint8>>& OutMessages)
+{
+	using namespace WebSocketMessageBatch;
+	OutMessages.Reset();
+	if (!IsBatchFrame(Frame))
+	{
+		return false;
+	}
+	const uint8* Data = Frame.GetData() + HeaderBytes;
+	int32 Size = Frame.Num() - HeaderBytes;
+	if (Frame[3] & FlagCompressed)
+	{
+		if (Size < 4)
+		{
+			return false;
+		}
+		const uint32 RawSize = ReadUInt32(Data);
+		if (RawSize > (uint32)MAX_int32 || (MaxBytes > 0 && RawSize > (uint32)MaxBytes))
+		{
+			return false;
+		}
+		Scratch.SetNumUninitialized((int32)RawSize);
+		if (!FCompression::UncompressMemory(NAME_Zlib, Scratch.GetData(), Scratch.Num(), Data + 4, Size - 4))
+		{
+			return false;
+		}
+		Data = Scratch.GetData();
+		Size = Scratch.Num();
+	}
+	int32 Offset = 0;
+	while (Offset < Size)
+	{
+		if (Size - Offset < 4)
+		{
+			return false;
+		}
+		const uint32 MessageSize = ReadUInt32(Data + Offset);
+		Offset += 4;
+		if (MessageSize > (uint32)(Size - Offset))
+		{
+			return false;
+		}
+		OutMessages.Emplace(Data + Offset, (int32)MessageSize);
+		Offset += (int32)MessageSize;
+	}
+	return true;
+}
@@ -0,0 +1,159 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WebSocketSubsystem.h"
+#include "WebSocketsModule.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+namespace WebSocketEcho
+{
+	struct FEchoState
+	{
+		int32 Messages = 0;
+		int32 Bytes = 0;
+		int32 Received = 0;
+		int32 Mismatches = 0;
+		double StartTime = 0;
+	};
+
+	static void MakeMessage(int32 Index, int32 Bytes, TArray<uint8>& OutMessage)
+	{
+		OutMessage.SetNumUninitialized(Bytes);
+		for (int32 ByteIndex = 0; ByteIndex < Bytes; ByteIndex++)
+		{
+			OutMessage[ByteIndex] = (uint8)((Index + ByteIndex) & 0xFF);
+		}
+		FMemory::Memcpy(OutMessage.GetData(), &Index, FMath::Min<int32>(Bytes, sizeof(Index)));
+	}
+}
+
+//发送Messages条消息，检查服务器是否按顺序原样返回
+static FAutoConsoleCommandWithWorldAndArgs GWebSocketEchoCommand(
+	TEXT("WebUtils.WebSocketEcho"),
+	TEXT("WebUtils.WebSocketEcho <URL> [Messages=1000] [Bytes=64] [Batch=0] [Compress=0]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+		{
+			UGameInstance* GameInstance = World ? World->GetGameInstance() : nullptr;
+			UWebSocketSubsystem* Subsystem = GameInstance ? GameInstance->GetSubsystem<UWebSocketSubsystem>() : nullptr;
+			if (!Subsystem || Args.Num() == 0)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Usage: WebUtils.WebSocketEcho <URL> [Messages=1000] [Bytes=64] [Batch=0] [Compress=0]"));
+				return;
+			}
+			const TSharedRef<WebSocketEcho::FEchoState> Echo = MakeShared<WebSocketEcho::FEchoState>();
+			Echo->Messages = 1000;
+			Echo->Bytes = 64;
+			FWebSocketSettings Settings;
+			Settings.bAutoReconnect = false;
+			Settings.MaxQueuedBytes = 0;
+			for (int32 Index = 1; Index < Args.Num(); Index++)
+			{
+				FString Key, Value;
+				if (!Args[Index].Split(TEXT("="), &Key, &Value))
+				{
+					continue;
+				}
+				if (Key == TEXT("Messages"))
+				{
+					Echo->Messages = FMath::Max(1, FCString::Atoi(*Value));
+				}
+				else if (Key == TEXT("Bytes"))
+				{
+					Echo->Bytes = FMath::Max(4, FCString::Atoi(*Value));
+				}
+				else if (Key == TEXT("Batch"))
+				{
+					Settings.bBatchBinaryMessages = FCString::ToBool(*Value);
+				}
+				else if (Key == TEXT("Compress"))
+				{
+					Settings.bCompressBatches = FCString::ToBool(*Value);
+				}
+			}
+			UWebSocketConnection* Connection = Subsystem->Connect(Args[0], TMap<FString, FString>(), Settings);
+			if (!Connection)
+			{
+				return;
+			}
+			TWeakObjectPtr<UWebSocketConnection> WeakConnection(Connection);
+			Connection->OnBinaryMessageNative.BindLambda([Echo, WeakConnection](TArrayView<const uint8> Message)
+				{
+					int32 MessageIndex = INDEX_NONE;
+					if (Message.Num() == Echo->Bytes)
+					{
+						FMemory::Memcpy(&MessageIndex, Message.GetData(), sizeof(MessageIndex));
+					}
+					if (MessageIndex != Echo->Received)
+					{
+						Echo->Mismatches++;
+					}
+					Echo->Received++;
+					if (Echo->Received < Echo->Messages)
+					{
+						return;
+					}
+					const double Elapsed = FPlatformTime::Seconds() - Echo->StartTime;
+					UWebSocketConnection* EchoConnection = WeakConnection.Get();
+					const FWebSocketStats Stats = EchoConnection ? EchoConnection->GetStats() : FWebSocketStats();
+					UE_LOG(LogTemp, Log, TEXT("WebSocket echo %s: %d messages, %d mismatches, %.3f s, %lld frames sent, %lld bytes sent"),
+						Echo->Mismatches == 0 ? TEXT("passed") : TEXT("failed"), Echo->Received, Echo->Mismatches, Elapsed, Stats.FramesSent, Stats.BytesSent);
+					if (EchoConnection)
+					{
+						EchoConnection->Close();
+					}
+				});
+			Echo->StartTime = FPlatformTime::Seconds();
+			TArray<uint8> Message;
+			for (int32 Index = 0; Index < Echo->Messages; Index++)
+			{
+				WebSocketEcho::MakeMessage(Index, Echo->Bytes, Message);
+				Connection->SendBinary(Message);
+			}
+		}));
+
+void UWebSocketSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	FModuleManager::LoadModuleChecked<FWebSocketsModule>(TEXT("WebSockets"));
+	TickHandle = FWebUtilsTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UWebSocketSubsystem::Tick));
+}
+
+void UWebSocketSubsystem::Deinitialize()
+{
+	FWebUtilsTicker::GetCoreTicker().RemoveTicker(TickHandle);
+	for (UWebSocketConnection* Connection : TArray<UWebSocketConnection*>(ActiveConnections))
+	{
+		Connection->Close(1001, TEXT("Shutdown"));
+	}
+	ActiveConnections.Empty();
+	Super::Deinitialize();
+}
+
+UWebSocketConnection* UWebSocketSubsystem::Connect(FString URL, const TMap<FString, FString>& Headers, FWebSocketSettings Settings)
+{
+	if (URL.IsEmpty())
+	{
+		return nullptr;
+	}
+	UWebSocketConnection* Connection = NewObject<UWebSocketConnection>(this);
+	ActiveConnections.Add(Connection);
+	Connection->Start(this, URL, Headers, Settings);
+	return Connection;
+}
+
+void UWebSocketSubsystem::OnConnectionClosed(UWebSocketConnection* Connection)
+{
+	ActiveConnections.Remove(Connection);
+}
+
+bool UWebSocketSubsystem::Tick(float DeltaTime)
+{
+	const double Now = FPlatformTime::Seconds();
+	for (UWebSocketConnection* Connection : TArray<UWebSocketConnection*>(ActiveConnections))
+	{
+		Connection->Tick(Now);
+	}
+	return true;
+}
@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
+#include "WebHttpServer.h"
 
 class FUnrealWebUtilsModule : public IModuleInterface
 {
@@ -12,4 +13,11 @@ public:
 	/** IModuleInterface implementation */
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
+
+	//控制台命令WebUtils.HttpServer.Start启动的调试服务器，提供/health、/stats、/echo/:text和/frame
+	bool StartDebugHttpServer(const FWebHttpServerSettings& Settings);
+	void StopDebugHttpServer();
+
+private:
+	TSharedPtr<FWebHttpServer, ESPMode::ThreadSafe> DebugHttpServer;
 };
@@ -0,0 +1,226 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "HAL/CriticalSection.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "HAL/ThreadSafeCounter64.h"
+
+class FSocket;
+class FRunnableThread;
+class FQueuedThreadPool;
+
+//路由处理函数执行的线程
+enum class EWebHttpHandlerThread : uint8
+{
+	//服务器的工作线程，不经过游戏线程
+	Worker,
+	//在游戏线程执行，用于需要访问UObject的调试控制接口。等待期间不占用工作线程，执行完后由工作线程发送响应
+	GameThread,
+};
+
+struct UNREALWEBUTILS_API FWebHttpServerSettings
+{
+	//默认只监听本机，对外提供服务时设置为0.0.0.0
+	FString BindAddress = TEXT("127.0.0.1");
+	//0表示由系统分配，启动后通过GetPort获取
+	int32 Port = 8080;
+	//处理请求的工作线程数量
+	int32 WorkerThreads = 4;
+	int32 MaxConnections = 256;
+	//保持连接的空闲时间，超过后关闭
+	float KeepAliveTimeoutSeconds = 5.f;
+	int32 MaxRequestsPerConnection = 1000;
+	//接收一个请求（请求头和请求体）的最长时间，从收到请求的第一个字节开始计算
+	float RequestTimeoutSeconds = 10.f;
+	//监听线程没有活动时轮询空闲连接的间隔逐渐延长到这个值，有活动时为1毫秒。
+	//越大空闲时占用的CPU越少，但空闲的保持连接上下一个请求的延迟越大
+	float MaxPollIntervalSeconds = 0.01f;
+	int32 MaxHeaderBytes = 16 * 1024;
+	int64 MaxBodyBytes = 8 * 1024 * 1024;
+	//发送文件时每次读取的字节数
+	int32 FileChunkBytes = 64 * 1024;
+	//等待游戏线程处理请求的最长时间，超时返回503，之后游戏线程不再执行这个请求的处理函数
+	float GameThreadTimeoutSeconds = 5.f;
+};
+
+struct UNREALWEBUTILS_API FWebHttpServerRequest
+{
+	FString Method;
+	//解码后的路径，不包含参数
+	FString Path;
+	TMap<FString, FString> QueryParams;
+	//路由中:name对应的值，*对应剩余的路径
+	TMap<FString, FString> PathParams;
+	//Key不区分大小写
+	TMap<FString, FString> Headers;
+	TArray<uint8> Body;
+
+	FString GetBodyAsString() const;
+};
+
+/**
+ * 响应内容可以来自Body、SharedBody或者FilePath。SharedBody可以在多个响应间共享，发送时不复制；
+ * 文件按FileChunkBytes分块读取发送，不会整个读入内存。
+ */
+struct UNREALWEBUTILS_API FWebHttpServerResponse
+{
+	int32 StatusCode = 200;
+	FString ContentType = TEXT("text/plain; charset=utf-8");
+	TMap<FString, FString> Headers;
+	TArray<uint8> Body;
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> SharedBody;
+	FString FilePath;
+
+	void SetText(const FString& Text, const FString& InContentType = TEXT("text/plain; charset=utf-8"));
+	void SetShared(const TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe>& InBody, const FString& InContentType);
+	//文件不存在时返回404
+	void SetFile(const FString& InFilePath, const FString& InContentType = TEXT("application/octet-stream"));
+};
+
+typedef TFunction<void(const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response)> FWebHttpRouteHandler;
+
+struct FWebHttpServerStats
+{
+	int64 Requests = 0;
+	int64 BytesReceived = 0;
+	int64 BytesSent = 0;
+	int32 ActiveConnections = 0;
+	int64 AcceptedConnections = 0;
+	//超过MaxConnections被拒绝的连接
+	int64 RejectedConnections = 0;
+};
+
+/**
+ * 嵌入的HTTP/1.1服务器，用于健康检查、统计和调试接口，也可以作为测试用的本地后端。
+ * 监听线程接受连接并读取空闲连接上到达的请求头和请求体，收到完整的请求后才交给工作线程池解析请求、执行路由并发送响应，
+ * 所以发送很慢或者只发送部分请求的连接不会占用工作线程，工作线程也不会等待网络数据。
+ * 同一连接上已经到达的连续请求（包括管线化的请求）由同一个工作线程处理，之后立即交还给监听线程。
+ * 路由需要在Start之前注册，之后只读，处理函数可以被多个工作线程同时调用。
+ */
+class UNREALWEBUTILS_API FWebHttpServer : public FRunnable, public TSharedFromThis<FWebHttpServer, ESPMode::ThreadSafe>
+{
+public:
+	FWebHttpServer();
+	virtual ~FWebHttpServer() override;
+
+	/**
+	* 注册路由。Method为空时匹配所有方法。Path中以:开头的段匹配任意一段，最后一段为*时匹配剩余的路径。
+	* 不包含参数的路由按完整路径查找，优先于包含参数的路由。
+	*/
+	bool AddRoute(const FString& Method, const FString& Path, FWebHttpRouteHandler&& Handler, EWebHttpHandlerThread Thread = EWebHttpHandlerThread::Worker);
+
+	bool Start(const FWebHttpServerSettings& InSettings);
+	//关闭所有连接并等待工作线程结束，会阻塞调用线程
+	void Shutdown();
+	bool IsRunning() const { return bRunning; }
+	int32 GetPort() const { return BoundPort; }
+	FWebHttpServerStats GetStats() const;
+
+	//FRunnable，监听线程
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	struct FRoute
+	{
+		FString Method;
+		TArray<FString> Segments;
+		bool bWildcard = false;
+		FWebHttpRouteHandler Handler;
+		EWebHttpHandlerThread Thread = EWebHttpHandlerThread::Worker;
+	};
+	struct FConnection
+	{
+		FSocket* Socket = nullptr;
+		//已经收到但还没有处理的数据，管线化的请求会留在这里
+		TArray<uint8> ReadBuffer;
+		//小的响应和响应头合并后一次发送，发送文件时作为读取的缓冲区
+		TArray<uint8> SendBuffer;
+		double LastActiveTime = 0;
+		//收到当前请求第一个字节的时间，缓冲区中没有数据时为0
+		double RequestStartTime = 0;
+		//当前请求的总字节数（请求头和请求体），请求头还不完整时为-1
+		int64 RequestBytes = -1;
+		//下一次查找请求头结尾的位置，避免每次从头查找
+		int32 HeaderSearchFrom = 0;
+		bool bExpectContinue = false;
+		bool bContinueSent = false;
+		int32 RequestsServed = 0;
+	};
+	//在游戏线程处理的请求。处理函数执行完和超时由先到的一方认领，之后交给工作线程发送响应
+	struct FGameThreadCall
+	{
+		FWebHttpServer* Server = nullptr;
+		FConnection* Connection = nullptr;
+		FWebHttpServerRequest Request;
+		FWebHttpServerResponse Response;
+		bool bKeepAlive = false;
+		double Deadline = 0;
+		FCriticalSection Lock;
+		FThreadSafeBool bClaimed = false;
+	};
+	typedef TSharedRef<FGameThreadCall, ESPMode::ThreadSafe> FGameThreadCallRef;
+	friend class FWebHttpConnectionWork;
+
+	//返回是否有新的连接
+	bool AcceptConnections();
+	//返回是否收到了数据或者有连接交给了工作线程
+	bool PollIdleConnections();
+	void CloseConnection(FConnection* Connection);
+	//在工作线程处理连接上已经收到请求头的请求，之后交还给监听线程或者关闭
+	void ServeConnection(FConnection* Connection);
+	//游戏线程处理完请求后在工作线程发送响应，然后继续处理连接
+	void ResumeConnection(FConnection* Connection, const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response, bool bKeepAlive);
+	//返回false时关闭连接。请求交给游戏线程时bOutPending为true，连接由游戏线程的调用持有
+	bool ServeRequest(FConnection* Connection, bool& bOutPending);
+	bool ReadRequest(FConnection* Connection, FWebHttpServerRequest& OutRequest, bool& bOutKeepAlive, int32& OutErrorCode);
+	//收到了完整的请求（请求头和请求体），或者请求已经出错（请求头过大、请求头错误、超时），可以交给工作线程而不会阻塞。
+	//请求头完整后记录请求的总字节数
+	bool IsRequestReady(FConnection* Connection, double Now) const;
+	//读取一次已经到达的数据，返回false表示连接已经关闭或者出错
+	bool ReceiveAvailable(FConnection* Connection);
+	static int32 FindHeaderEnd(const TArray<uint8>& Buffer, int32 SearchFrom);
+	const FRoute* FindRoute(const FWebHttpServerRequest& Request, TMap<FString, FString>& OutPathParams) const;
+	void StartGameThreadCall(FConnection* Connection, const FRoute& Route, FWebHttpServerRequest&& Request, bool bKeepAlive);
+	//认领调用并交给工作线程发送响应，已经被认领时什么也不做。服务器正在关闭时直接关闭连接
+	static void FinishGameThreadCall(const FGameThreadCallRef& Call, bool bTimedOut);
+	//在监听线程检查游戏线程调用是否超时
+	void PollGameThreadCalls();
+	bool SendResponse(FConnection* Connection, const FWebHttpServerRequest& Request, FWebHttpServerResponse& Response, bool bKeepAlive);
+	bool SendAll(FSocket* Socket, const uint8* Data, int64 Length);
+	static const TCHAR* GetReasonPhrase(int32 StatusCode);
+	//去掉多余的/，路由和请求使用相同的形式
+	static FString NormalizePath(const TArray<FString>& Segments);
+
+	FWebHttpServerSettings Settings;
+	TMap<FString, FRoute> StaticRoutes;
+	TArray<FRoute> PatternRoutes;
+
+	FSocket* ListenSocket = nullptr;
+	int32 BoundPort = 0;
+	FRunnableThread* ListenThread = nullptr;
+	FQueuedThreadPool* WorkerPool = nullptr;
+	FThreadSafeBool bRunning = false;
+	FThreadSafeBool bStopping = false;
+
+	//只由监听线程访问
+	TArray<FConnection*> IdleConnections;
+	//工作线程处理完后交还的连接
+	TQueue<FConnection*, EQueueMode::Mpsc> ReturnedConnections;
+	//工作线程开始的游戏线程调用，由监听线程检查超时
+	TQueue<TSharedPtr<FGameThreadCall, ESPMode::ThreadSafe>, EQueueMode::Mpsc> StartedGameThreadCalls;
+	//只由监听线程访问，监听线程结束后由Shutdown处理
+	TArray<FGameThreadCallRef> PendingGameThreadCalls;
+
+	FThreadSafeCounter64 StatRequests;
+	FThreadSafeCounter64 StatBytesReceived;
+	FThreadSafeCounter64 StatBytesSent;
+	FThreadSafeCounter StatActiveConnections;
+	FThreadSafeCounter64 StatAcceptedConnections;
+	FThreadSafeCounter64 StatRejectedConnections;
+};
@@ -0,0 +1,227 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "WebSocketMessageBatch.h"
+#include "WebSocketConnection.generated.h"
+
+class IWebSocket;
+class UWebSocketSubsystem;
+
+UENUM(BlueprintType)
+enum class EWebSocketState : uint8
+{
+	Connecting,
+	Connected,
+	//连接断开，等待重新连接
+	Reconnecting,
+	Closed,
+};
+
+USTRUCT(BlueprintType)
+struct UNREALWEBUTILS_API FWebSocketSettings
+{
+	GENERATED_BODY()
+public:
+	//Sec-WebSocket-Protocol
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	TArray<FString> Protocols;
+
+	//连接失败或者断开后自动重新连接，调用Close关闭的连接不会重新连接
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	bool bAutoReconnect = true;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	float ReconnectInitialDelaySeconds = 1.f;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	float ReconnectMaxDelaySeconds = 30.f;
+	//每次重新连接失败后延迟乘以该值
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	float ReconnectBackoffMultiplier = 2.f;
+	//延迟随机浮动的比例，避免大量客户端同时重新连接
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	float ReconnectJitter = 0.2f;
+	//连续重新连接的次数上限，小于等于0表示不限制
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	int32 MaxReconnectAttempts = 0;
+
+	//同一帧内发送的二进制消息合并为一帧发送。这是插件自定义的格式，服务器需要支持FWebSocketMessageBatch，所以默认关闭。文本消息总是单独发送
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	bool bBatchBinaryMessages = false;
+	//合并后一帧的字节数上限，超过上限的单条消息单独成为一帧
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	int32 MaxBatchBytes = 64 * 1024;
+	//用zlib压缩合并后的帧
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	bool bCompressBatches = false;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	int32 CompressThresholdBytes = 1024;
+
+	//等待发送的字节数上限，超过时Send返回false。小于等于0表示不限制
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	int64 MaxQueuedBytes = 8 * 1024 * 1024;
+	//接收的单条消息的字节数上限，超过的消息被丢弃
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	int32 MaxMessageBytes = 16 * 1024 * 1024;
+	//收发缓冲区对象池的数量
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "WebUtils|WebSocket")
+	int32 MaxPooledBuffers = 16;
+};
+
+USTRUCT(BlueprintType)
+struct UNREALWEBUTILS_API FWebSocketStats
+{
+	GENERATED_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "WebUtils|WebSocket")
+	int64 MessagesSent = 0;
+	//实际发送的帧数，合并发送时小于MessagesSent
+	UPROPERTY(BlueprintReadOnly, Category = "WebUtils|WebSocket")
+	int64 FramesSent = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "WebUtils|WebSocket")
+	int64 BytesSent = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "WebUtils|WebSocket")
+	int64 MessagesReceived = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "WebUtils|WebSocket")
+	int64 FramesReceived = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "WebUtils|WebSocket")
+	int64 BytesReceived = 0;
+	//发送队列已满或者接收的消息过大被丢弃的消息数量
+	UPROPERTY(BlueprintReadOnly, Category = "WebUtils|WebSocket")
+	int64 DroppedMessages = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "WebUtils|WebSocket")
+	int32 Reconnects = 0;
+};
+
+DECLARE_DYNAMIC_DELEGATE(FWebSocketConnectedDelegate);
+DECLARE_DYNAMIC_DELEGATE_OneParam(FWebSocketErrorDelegate, const FString&, Error);
+DECLARE_DYNAMIC_DELEGATE_ThreeParams(FWebSocketClosedDelegate, int32, StatusCode, const FString&, Reason, bool, bWasClean);
+DECLARE_DYNAMIC_DELEGATE_TwoParams(FWebSocketReconnectingDelegate, int32, Attempt, float, DelaySeconds);
+DECLARE_DYNAMIC_DELEGATE_OneParam(FWebSocketTextMessageDelegate, const FString&, Message);
+DECLARE_DYNAMIC_DELEGATE_OneParam(FWebSocketBinaryMessageDelegate, const TArray<uint8>&, Message);
+//C++使用的二进制消息委托，直接引用接收缓冲区，只在委托执行期间有效
+DECLARE_DELEGATE_OneParam(FWebSocketBinaryMessageNativeDelegate, TArrayView<const uint8> /*Message*/);
+
+/**
+ * WebSocket连接。发送的消息先放入队列，在Subsystem的Tick中一起发送，断开期间的消息在重新连接后发送。
+ * 收到的分片消息拼接在对象池的缓冲区中，委托执行后缓冲区放回对象池。所有函数和委托都在游戏线程。
+ * 引擎的WebSocket不支持设置permessage-deflate，需要压缩时使用bCompressBatches在合并的帧上压缩。
+ */
+UCLASS(BlueprintType)
+class UNREALWEBUTILS_API UWebSocketConnection : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	FWebSocketBinaryMessageNativeDelegate OnBinaryMessageNative;
+
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "绑定连接成功的委托"))
+	void BindConnected(FWebSocketConnectedDelegate InDelegate);
+
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "绑定连接错误的委托"))
+	void BindConnectionError(FWebSocketErrorDelegate InDelegate);
+
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "绑定连接关闭的委托"))
+	void BindClosed(FWebSocketClosedDelegate InDelegate);
+
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "绑定重新连接的委托"))
+	void BindReconnecting(FWebSocketReconnectingDelegate InDelegate);
+
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "绑定收到文本消息的委托"))
+	void BindTextMessage(FWebSocketTextMessageDelegate InDelegate);
+
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "绑定收到二进制消息的委托"))
+	void BindBinaryMessage(FWebSocketBinaryMessageDelegate InDelegate);
+
+	//放入发送队列，队列已满或者连接已经关闭时返回false
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "发送文本消息"))
+	bool SendText(const FString& Message);
+
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "发送二进制消息"))
+	bool SendBinary(const TArray<uint8>& Message);
+
+	bool Send(TArrayView<const uint8> Message, bool bBinary);
+
+	//立即发送队列中的消息，不等待Tick
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "立即发送"))
+	void Flush();
+
+	//发送队列中的消息后关闭连接，不再重新连接
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", meta = (DisplayName = "关闭连接"))
+	void Close(int32 StatusCode = 1000, const FString& Reason = TEXT(""));
+
+	UFUNCTION(BlueprintPure, Category = "WebUtils|WebSocket")
+	EWebSocketState GetState() const { return State; }
+
+	UFUNCTION(BlueprintPure, Category = "WebUtils|WebSocket")
+	bool IsConnected() const { return State == EWebSocketState::Connected; }
+
+	UFUNCTION(BlueprintPure, Category = "WebUtils|WebSocket")
+	FWebSocketStats GetStats() const { return Stats; }
+
+	UFUNCTION(BlueprintPure, Category = "WebUtils|WebSocket")
+	FString GetURL() const { return URL; }
+
+private:
+	friend class UWebSocketSubsystem;
+
+	struct FOutgoingMessage
+	{
+		TArray<uint8> Payload;
+		bool bBinary = true;
+	};
+
+	void Start(UWebSocketSubsystem* InSubsystem, const FString& InURL, const TMap<FString, FString>& InHeaders, const FWebSocketSettings& InSettings);
+	void Tick(double Now);
+	void CreateSocket();
+	void ReleaseSocket();
+	//连接失败或者断开后安排重新连接，不再重新连接时关闭
+	void HandleDisconnected();
+	void Finish();
+
+	void SendQueued();
+	void SendBatch();
+	void SendFrame(const TArray<uint8>& Frame, bool bBinary);
+
+	void OnSocketConnected();
+	void OnSocketConnectionError(const FString& Error);
+	void OnSocketClosed(int32 StatusCode, const FString& Reason, bool bWasClean);
+	void OnSocketMessage(const FString& Message);
+	void OnSocketBinaryMessage(const void* Data, SIZE_T Size, bool bIsLastFragment);
+	//处理一个完整的二进制帧，合并的帧拆分后逐条触发
+	void DispatchBinaryFrame(TArrayView<const uint8> Frame);
+	void DispatchBinaryMessage(TArrayView<const uint8> Message);
+
+	UPROPERTY()
+	UWebSocketSubsystem* WebSocketSubsystem = nullptr;
+
+	FString URL;
+	TMap<FString, FString> Headers;
+	FWebSocketSettings Settings;
+	TSharedPtr<IWebSocket> Socket;
+	EWebSocketState State = EWebSocketState::Connecting;
+	int32 ReconnectAttempt = 0;
+	double NextReconnectTime = 0;
+	FWebSocketStats Stats;
+
+	TArray<FOutgoingMessage> SendQueue;
+	int64 QueuedBytes = 0;
+	FWebSocketMessageBatch Batch;
+	TArray<uint8> FrameBuffer;
+
+	FWebSocketBufferPool BufferPool;
+	//正在拼接的分片消息
+	TArray<uint8> ReceiveBuffer;
+	bool bReceivingFragments = false;
+	bool bDiscardingMessage = false;
+	TArray<uint8> DecodeBuffer;
+	TArray<TArrayView<const uint8>> DecodedMessages;
+
+	FWebSocketConnectedDelegate OnConnected;
+	FWebSocketErrorDelegate OnConnectionError;
+	FWebSocketClosedDelegate OnClosed;
+	FWebSocketReconnectingDelegate OnReconnecting;
+	FWebSocketTextMessageDelegate OnTextMessage;
+	FWebSocketBinaryMessageDelegate OnBinaryMessage;
+};
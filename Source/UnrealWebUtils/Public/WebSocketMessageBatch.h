@@ -0,0 +1,52 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * 收发缓冲区的对象池，只能在游戏线程使用。归还的缓冲区保留容量，之后相近大小的消息不需要重新分配内存。
+ */
+class UNREALWEBUTILS_API FWebSocketBufferPool
+{
+public:
+	//超过MaxBufferBytes的缓冲区不放回对象池
+	void SetLimits(int32 InMaxBuffers, int32 InMaxBufferBytes);
+	TArray<uint8> Acquire();
+	void Release(TArray<uint8>&& Buffer);
+	int32 Num() const { return Buffers.Num(); }
+
+private:
+	TArray<TArray<uint8>> Buffers;
+	int32 MaxBuffers = 8;
+	int32 MaxBufferBytes = 1024 * 1024;
+};
+
+/**
+ * 把多条二进制消息合并为一帧。帧的格式为4字节的头部"UWB"+标志，标志第0位表示内容经过zlib压缩，此时后面跟4字节原始长度。
+ * 内容为多条[4字节小端长度][消息]。服务器需要使用相同的格式（README中的测试服务器原样返回收到的帧）。
+ */
+class UNREALWEBUTILS_API FWebSocketMessageBatch
+{
+public:
+	void Add(TArrayView<const uint8> Message);
+	void Reset();
+	bool IsEmpty() const { return Count == 0; }
+	int32 Num() const { return Count; }
+	//加上一条消息后的内容长度
+	int32 GetSizeWith(int32 MessageBytes) const { return Body.Num() + 4 + MessageBytes; }
+
+	//生成要发送的帧，内容不小于CompressThresholdBytes时压缩，压缩后没有变小时不压缩
+	void Encode(bool bCompress, int32 CompressThresholdBytes, TArray<uint8>& OutFrame) const;
+
+	static bool IsBatchFrame(TArrayView<const uint8> Frame);
+	/**
+	* 拆分一帧。压缩的内容解压到Scratch中，OutMessages中的视图引用Frame或者Scratch。
+	* 格式错误或者解压后超过MaxBytes时返回false。
+	*/
+	static bool Decode(TArrayView<const uint8> Frame, int32 MaxBytes, TArray<uint8>& Scratch, TArray<TArrayView<const uint8>>& OutMessages);
+
+private:
+	TArray<uint8> Body;
+	int32 Count = 0;
+};
@@ -0,0 +1,41 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "WebSocketConnection.h"
+#include "WebUtilsCompat.h"
+#include "WebSocketSubsystem.generated.h"
+
+/**
+ * 管理WebSocket连接，在Tick中发送每个连接队列中的消息和处理重新连接。
+ * 控制台命令WebUtils.WebSocketEcho可以使用README中的回显服务器在本地检查收发、合并和压缩。
+ */
+UCLASS()
+class UNREALWEBUTILS_API UWebSocketSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	//创建连接并开始连接，连接前发送的消息在连接成功后发送。URL为ws://或者wss://
+	UFUNCTION(BlueprintCallable, Category = "WebUtils|WebSocket", DisplayName = "连接WebSocket")
+	UWebSocketConnection* Connect(FString URL, const TMap<FString, FString>& Headers, FWebSocketSettings Settings);
+
+	//还没有关闭的连接
+	UFUNCTION(BlueprintPure, Category = "WebUtils|WebSocket", DisplayName = "获取所有连接")
+	TArray<UWebSocketConnection*> GetConnections() const { return ActiveConnections; }
+
+	//连接关闭时调用，不再持有连接对象
+	void OnConnectionClosed(UWebSocketConnection* Connection);
+
+private:
+	bool Tick(float DeltaTime);
+
+	UPROPERTY()
+	TArray<UWebSocketConnection*> ActiveConnections;
+	FWebUtilsTickerHandle TickHandle;
+};
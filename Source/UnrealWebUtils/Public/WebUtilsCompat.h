@@ -0,0 +1,16 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Runtime/Launch/Resources/Version.h"
+#include "Containers/Ticker.h"
+
+//UE5中FTicker被FTSTicker替代
+#if ENGINE_MAJOR_VERSION > 4
+typedef FTSTicker FWebUtilsTicker;
+typedef FTSTicker::FDelegateHandle FWebUtilsTickerHandle;
+#else
+typedef FTicker FWebUtilsTicker;
+typedef FDelegateHandle FWebUtilsTickerHandle;
+#endif
@@ -39,6 +39,8 @@ public class UnrealWebUtils : ModuleRules
 				"Slate",
 				"SlateCore",
 				"Http",
+				"WebSockets",
+				"Sockets",
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);